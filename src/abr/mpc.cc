@@ -5,7 +5,7 @@ using namespace std;
 
 MPC::MPC(const WebSocketClient & client,
          const string & abr_name, const YAML::Node & abr_config)
-  : ABRAlgo(client, abr_name)
+  : ABRAlgo(client, abr_name), ws_(thread_workspace())
 {
   if (abr_config["max_lookahead_horizon"]) {
     max_lookahead_horizon_ = min(
@@ -31,10 +31,12 @@ MPC::MPC(const WebSocketClient & client,
   }
 
   unit_buf_length_ = WebSocketClient::MAX_BUFFER_S / dis_buf_length_;
+}
 
-  for (size_t i = 0; i <= dis_buf_length_; i++) {
-    real_buffer_[i] = i * unit_buf_length_;
-  }
+MPC::Workspace & MPC::thread_workspace()
+{
+  static thread_local Workspace workspace;
+  return workspace;
 }
 
 void MPC::video_chunk_acked(Chunk && c)
@@ -60,7 +62,7 @@ VideoFormat MPC::select_video_format()
 
 void MPC::reinit()
 {
-  curr_round_++;
+  ws_.curr_round++;
 
   const auto & channel = client_.channel();
   const auto & vformats = channel->vformats();
@@ -84,20 +86,20 @@ void MPC::reinit()
 
   /* init curr_ssims */
   if (past_chunks_.size() > 0) {
-    curr_ssims_[0][0] = past_chunks_.back().ssim;
+    ws_.curr_ssims[0][0] = past_chunks_.back().ssim;
   } else {
-    curr_ssims_[0][0] = 0;
+    ws_.curr_ssims[0][0] = 0;
   }
 
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
     for (size_t j = 0; j < num_formats_; j++) {
       try {
-        curr_ssims_[i][j] = channel->vssim(vformats[j],
-                                           next_ts + vduration * (i - 1));
+        ws_.curr_ssims[i][j] = channel->vssim(vformats[j],
+                                              next_ts + vduration * (i - 1));
       } catch (const exception & e) {
         cerr << "Error occurs when getting the ssim of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_ssims_[i][j] = 0;
+        ws_.curr_ssims[i][j] = 0;
       }
     }
   }
@@ -108,7 +110,7 @@ void MPC::reinit()
   double max_err = 0;
 
   for (size_t i = 1; it != past_chunks_.end(); it++, i++) {
-    unit_sending_time_[i] = (double) it->trans_time / it->size / 1000;
+    ws_.unit_sending_time[i] = (double) it->trans_time / it->size / 1000;
     max_err = max(max_err, it->pred_err);
   }
 
@@ -119,7 +121,7 @@ void MPC::reinit()
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
     double tmp = 0;
     for (size_t j = 0; j < num_past_chunks; j++) {
-      tmp += unit_sending_time_[i + j];
+      tmp += ws_.unit_sending_time[i + j];
     }
 
     if (num_past_chunks != 0) {
@@ -129,22 +131,22 @@ void MPC::reinit()
         last_tp_pred_ = 1 / unit_st;
       }
 
-      unit_sending_time_[i + num_past_chunks] = unit_st * (1 + max_err);
+      ws_.unit_sending_time[i + num_past_chunks] = unit_st * (1 + max_err);
     } else {
       /* set the sending time to be a default hight value */
-      unit_sending_time_[i + num_past_chunks] = HIGH_SENDING_TIME;
+      ws_.unit_sending_time[i + num_past_chunks] = HIGH_SENDING_TIME;
     }
 
     const auto & data_map = channel->vdata(next_ts + vduration * (i - 1));
 
     for (size_t j = 0; j < num_formats_; j++) {
       try {
-        curr_sending_time_[i][j] = get<1>(data_map.at(vformats[j]))
-                                   * unit_sending_time_[i + num_past_chunks];
+        ws_.curr_sending_time[i][j] = get<1>(data_map.at(vformats[j]))
+                                      * ws_.unit_sending_time[i + num_past_chunks];
       } catch (const exception & e) {
         cerr << "Error occurs when getting the video size of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_sending_time_[i][j] = HIGH_SENDING_TIME;
+        ws_.curr_sending_time[i][j] = HIGH_SENDING_TIME;
       }
     }
   }
@@ -152,10 +154,10 @@ void MPC::reinit()
 
 size_t MPC::update_value(size_t i, size_t curr_buffer, size_t curr_format)
 {
-  flag_[i][curr_buffer][curr_format] = curr_round_;
+  ws_.flag[i][curr_buffer][curr_format] = ws_.curr_round;
 
   if (i == lookahead_horizon_) {
-    v_[i][curr_buffer][curr_format] = curr_ssims_[i][curr_format];
+    ws_.v[i][curr_buffer][curr_format] = ws_.curr_ssims[i][curr_format];
     return 0;
   }
 
@@ -168,7 +170,7 @@ size_t MPC::update_value(size_t i, size_t curr_buffer, size_t curr_format)
       best_next_format = next_format;
     }
   }
-  v_[i][curr_buffer][curr_format] = max_qvalue;
+  ws_.v[i][curr_buffer][curr_format] = max_qvalue;
 
   return best_next_format;
 }
@@ -176,23 +178,24 @@ size_t MPC::update_value(size_t i, size_t curr_buffer, size_t curr_format)
 double MPC::get_qvalue(size_t i, size_t curr_buffer, size_t curr_format,
                        size_t next_format)
 {
-  double real_rebuffer = curr_sending_time_[i + 1][next_format]
-                         - real_buffer_[curr_buffer];
+  /* the estimation of the discretized buffer length */
+  double real_rebuffer = ws_.curr_sending_time[i + 1][next_format]
+                         - curr_buffer * unit_buf_length_;
   size_t next_buffer = discretize_buffer(max(0.0, -real_rebuffer) + chunk_length_);
   next_buffer = min(next_buffer, dis_buf_length_);
-  return curr_ssims_[i][curr_format]
-         - ssim_diff_coeff_ * fabs(curr_ssims_[i][curr_format]
-                                   - curr_ssims_[i + 1][next_format])
+  return ws_.curr_ssims[i][curr_format]
+         - ssim_diff_coeff_ * fabs(ws_.curr_ssims[i][curr_format]
+                                   - ws_.curr_ssims[i + 1][next_format])
          - rebuffer_length_coeff_ * max(0.0, real_rebuffer)
          + get_value(i + 1, next_buffer, next_format);
 }
 
 double MPC::get_value(size_t i, size_t curr_buffer, size_t curr_format)
 {
-  if (flag_[i][curr_buffer][curr_format] != curr_round_) {
+  if (ws_.flag[i][curr_buffer][curr_format] != ws_.curr_round) {
     update_value(i, curr_buffer, curr_format);
   }
-  return v_[i][curr_buffer][curr_format];
+  return ws_.v[i][curr_buffer][curr_format];
 }
 
 size_t MPC::discretize_buffer(double buf)
@@ -50,24 +50,31 @@ private:
   /* for the current buffer length */
   size_t curr_buffer_ {};
 
-  /* for storing the value function */
-  uint64_t flag_[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
-  double v_[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
+  /* everything below is recomputed in every select_video_format(), so it is
+   * kept in a workspace shared by all the clients of a thread */
+  struct Workspace
+  {
+    /* for storing the value function */
+    uint64_t flag[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
+    double v[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
 
-  /* record the current round of DP */
-  uint64_t curr_round_ {};
+    /* record the current round of DP (of any client) */
+    uint64_t curr_round {};
 
-  /* map the discretized buffer length to the estimation */
-  double real_buffer_[MAX_DIS_BUF_LENGTH + 1] {};
+    /* unit sending time estimation */
+    double unit_sending_time[MAX_LOOKAHEAD_HORIZON + 1 + MAX_NUM_PAST_CHUNKS] {};
 
-  /* unit sending time estimation */
-  double unit_sending_time_[MAX_LOOKAHEAD_HORIZON + 1 + MAX_NUM_PAST_CHUNKS] {};
+    /* the ssim of the chunk given the timestamp and format */
+    double curr_ssims[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
 
-  /* the ssim of the chunk given the timestamp and format */
-  double curr_ssims_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+    /* the estimation of sending time given the timestamp and format */
+    double curr_sending_time[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+  };
+
+  /* the workspace of the thread that created this object */
+  Workspace & ws_;
 
-  /* the estimation of sending time given the timestamp and format */
-  double curr_sending_time_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+  static Workspace & thread_workspace();
 
   void reinit();
 
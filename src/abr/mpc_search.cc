@@ -5,7 +5,7 @@ using namespace std;
 
 MPCSearch::MPCSearch(const WebSocketClient & client,
                      const string & abr_name, const YAML::Node & abr_config)
-  : ABRAlgo(client, abr_name)
+  : ABRAlgo(client, abr_name), ws_(thread_workspace())
 {
   if (abr_config["max_lookahead_horizon"]) {
     max_lookahead_horizon_ = min(
@@ -29,12 +29,15 @@ MPCSearch::MPCSearch(const WebSocketClient & client,
 
   if (is_discrete_buf_) {
     unit_buf_length_ = WebSocketClient::MAX_BUFFER_S / dis_buf_length_;
-    for (size_t i = 0; i <= dis_buf_length_; i++) {
-      real_buffer_[i] = i * unit_buf_length_;
-    }
   }
 }
 
+MPCSearch::Workspace & MPCSearch::thread_workspace()
+{
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
 void MPCSearch::video_chunk_acked(Chunk && c)
 {
   past_chunks_.push_back(c);
@@ -86,20 +89,20 @@ void MPCSearch::reinit()
 
   /* init curr_ssims */
   if (past_chunks_.size() > 0) {
-    curr_ssims_[0][0] = past_chunks_.back().ssim;
+    ws_.curr_ssims[0][0] = past_chunks_.back().ssim;
   } else {
-    curr_ssims_[0][0] = 0;
+    ws_.curr_ssims[0][0] = 0;
   }
 
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
     for (size_t j = 0; j < num_formats_; j++) {
       try {
-        curr_ssims_[i][j] = channel->vssim(vformats[j],
-                                           next_ts + vduration * (i - 1));
+        ws_.curr_ssims[i][j] = channel->vssim(vformats[j],
+                                              next_ts + vduration * (i - 1));
       } catch (const exception & e) {
         cerr << "Error occurs when getting the ssim of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_ssims_[i][j] = 0;
+        ws_.curr_ssims[i][j] = 0;
       }
     }
   }
@@ -109,32 +112,32 @@ void MPCSearch::reinit()
 
   auto it = past_chunks_.begin();
   for (size_t i = 1; it != past_chunks_.end(); it++, i++) {
-    unit_sending_time_[i] = (double) it->trans_time / it->size / 1000;
+    ws_.unit_sending_time[i] = (double) it->trans_time / it->size / 1000;
   }
 
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
     double tmp = 0;
     for (size_t j = 0; j < num_past_chunks; j++) {
-      tmp += unit_sending_time_[i + j];
+      tmp += ws_.unit_sending_time[i + j];
     }
 
     if (num_past_chunks != 0) {
-      unit_sending_time_[i + num_past_chunks] = tmp / num_past_chunks;
+      ws_.unit_sending_time[i + num_past_chunks] = tmp / num_past_chunks;
     } else {
       /* set the sending time to be a default hight value */
-      unit_sending_time_[i + num_past_chunks] = HIGH_SENDING_TIME;
+      ws_.unit_sending_time[i + num_past_chunks] = HIGH_SENDING_TIME;
     }
 
     const auto & data_map = channel->vdata(next_ts + vduration * (i - 1));
 
     for (size_t j = 0; j < num_formats_; j++) {
       try {
-        curr_sending_time_[i][j] = get<1>(data_map.at(vformats[j]))
-                                   * unit_sending_time_[i + num_past_chunks];
+        ws_.curr_sending_time[i][j] = get<1>(data_map.at(vformats[j]))
+                                      * ws_.unit_sending_time[i + num_past_chunks];
       } catch (const exception & e) {
         cerr << "Error occurs when getting the video size of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_sending_time_[i][j] = HIGH_SENDING_TIME;
+        ws_.curr_sending_time[i][j] = HIGH_SENDING_TIME;
       }
     }
   }
@@ -143,15 +146,15 @@ void MPCSearch::reinit()
 double MPCSearch::get_qvalue(size_t i, double curr_buffer, size_t curr_format,
                              size_t next_format)
 {
-  double real_rebuffer = curr_sending_time_[i + 1][next_format] - curr_buffer;
+  double real_rebuffer = ws_.curr_sending_time[i + 1][next_format] - curr_buffer;
   double next_buffer = min(WebSocketClient::MAX_BUFFER_S,
                            max(0.0, -real_rebuffer) + chunk_length_);
   if (is_discrete_buf_) {
     next_buffer = discretize_buffer(next_buffer);
   }
-  return curr_ssims_[i][curr_format]
-         - ssim_diff_coeff_ * fabs(curr_ssims_[i][curr_format]
-                                   - curr_ssims_[i + 1][next_format])
+  return ws_.curr_ssims[i][curr_format]
+         - ssim_diff_coeff_ * fabs(ws_.curr_ssims[i][curr_format]
+                                   - ws_.curr_ssims[i + 1][next_format])
          - rebuffer_length_coeff_ * max(0.0, real_rebuffer)
          + get_value(i + 1, next_buffer, next_format);
 }
@@ -159,7 +162,7 @@ double MPCSearch::get_qvalue(size_t i, double curr_buffer, size_t curr_format,
 double MPCSearch::get_value(size_t i, double curr_buffer, size_t curr_format)
 {
   if (i == lookahead_horizon_) {
-    return curr_ssims_[i][curr_format];
+    return ws_.curr_ssims[i][curr_format];
   }
 
   double max_qvalue = 0;
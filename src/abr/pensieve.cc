@@ -1,68 +1,48 @@
 #include "pensieve.hh"
 #include "ws_client.hh"
-#include "pid.hh"
-#include "system_runner.hh"
-#include "serialization.hh"
-#include "ipc_socket.hh"
-#include "json.hpp"
+
+#include <map>
+#include <algorithm>
 
 using namespace std;
-using json = nlohmann::json;
 
-Pensieve::Pensieve(const WebSocketClient & client,
-                   const string & abr_name, const YAML::Node & abr_config)
-  : ABRAlgo(client, abr_name)
+/* load each model once per process */
+static shared_ptr<torch::jit::script::Module> load_actor(const string & path)
 {
-  string ipc_dir = "pensieve_ipc";
-  fs::create_directory(ipc_dir);
-  ipc_file_ = fs::path(ipc_dir) /
-              (to_string(pid()) + "_" + to_string(client.connection_id()));
-
-  IPCSocket sock;
-  sock.bind(ipc_file_);
-  sock.listen();
-
-  fs::path ipc_path = fs::current_path() / ipc_file_;
-  string pensieve_path;
-  string nn_path;
-
-  if (abr_config["pensieve_path"] && abr_config["nn_path"]) {
-    pensieve_path = abr_config["pensieve_path"].as<string>();
-    nn_path = abr_config["nn_path"].as<string>();
-  } else {
-    cerr << "Pensieve requires specifying paths in abr_config" << endl;
-    throw runtime_error("Pensieve config missing");
-  }
+  static map<string, shared_ptr<torch::jit::script::Module>> actors;
 
-  /* start child process */
-  vector<string> prog_args { pensieve_path, nn_path, ipc_path };
+  auto it = actors.find(path);
+  if (it != actors.end()) {
+    return it->second;
+  }
 
-  pensieve_proc_ = make_unique<ChildProcess>(pensieve_path,
-    [&pensieve_path, &prog_args]() {
-      return ezexec(pensieve_path, prog_args);
-    }
-  );
+  auto actor = torch::jit::load(path);
+  if (not actor) {
+    throw runtime_error("Model " + path + " does not exist");
+  }
 
-  connection_ =  make_unique<FileDescriptor>(sock.accept());
+  actors.emplace(path, actor);
+  return actor;
 }
 
-Pensieve::~Pensieve()
+Pensieve::Pensieve(const WebSocketClient & client,
+                   const string & abr_name, const YAML::Node & abr_config)
+  : ABRAlgo(client, abr_name)
 {
-  if (not fs::remove(ipc_file_)) {
-    cerr << "Warning: file " << ipc_file_ << " cannot be removed" << endl;
+  if (abr_config["nn_path"]) {
+    actor_ = load_actor(abr_config["nn_path"].as<string>());
+  } else {
+    throw runtime_error("Pensieve requires specifying nn_path in abr_config");
   }
 }
 
 void Pensieve::video_chunk_acked(Chunk && c)
 {
-  const unsigned int size = c.size; // bytes
-  const uint64_t trans_time = c.trans_time; // ms
-
   const auto & channel = client_.channel();
   const auto & vformats = channel->vformats();
   size_t vformats_cnt = vformats.size();
 
-  assert(vformats_cnt == 10); // pensieve requires exactly 10 bitrates
+  assert(vformats_cnt == A_DIM); // pensieve requires exactly 10 bitrates
 
   uint64_t next_vts = client_.next_vts().value();
   const auto & data_map = channel->vdata(next_vts);
@@ -77,20 +57,33 @@ void Pensieve::video_chunk_acked(Chunk && c)
   sort(next_chunk_sizes.begin(), next_chunk_sizes.end());
 
   // TODO: increase trans_time to account for time to send audio chunks?
-  json j;
-  j["delay"] = trans_time; // ms
-  j["playback_buf"] = client_.video_playback_buf(); // seconds
-  j["rebuf_time"] = client_.cum_rebuffer(); // seconds
-  j["last_chunk_size"] = (double)size; // bytes
-  j["next_chunk_sizes"] = next_chunk_sizes; // bytes
-  uint16_t json_len = j.dump().length();
-
-  connection_->write(put_field(json_len) + j.dump());
-
-  auto read_data = connection_->read_exactly(2); // read 2 byte length
-  auto rcvd_json_len = get_uint16(read_data.data());
-  auto read_json = connection_->read_exactly(rcvd_json_len);
-  next_br_index_ = json::parse(read_json).at("bit_rate");
+  const double delay = max<uint64_t>(c.trans_time, 1); // ms
+
+  /* shift the history left by one chunk, and fill in the latest */
+  for (auto & row : state_) {
+    rotate(begin(row), begin(row) + 1, end(row));
+  }
+
+  state_[0][S_LEN - 1] = next_br_index_ / double(A_DIM - 1);
+  state_[1][S_LEN - 1] = client_.video_playback_buf() / BUFFER_NORM_FACTOR;
+  state_[2][S_LEN - 1] = c.size / delay / M_IN_K; // KB/ms
+  state_[3][S_LEN - 1] = delay / M_IN_K / BUFFER_NORM_FACTOR;
+  for (size_t i = 0; i < A_DIM; i++) {
+    state_[4][i] = next_chunk_sizes[i] / M_IN_K / M_IN_K; // MB
+  }
+  state_[5][S_LEN - 1] = 1.0; // a live stream never ends
+
+  /* forward the state through the actor and pick the likeliest action */
+  torch::NoGradGuard no_grad;
+
+  vector<torch::jit::IValue> torch_inputs;
+  torch_inputs.push_back(torch::from_blob(state_, {1, S_INFO, S_LEN},
+                                          torch::kF32));
+
+  at::Tensor action_prob = actor_->forward(torch_inputs).toTensor();
+  assert((size_t) action_prob.numel() == A_DIM);
+
+  next_br_index_ = action_prob.argmax().item<int64_t>();
 }
 
 VideoFormat Pensieve::select_video_format()
@@ -2,24 +2,37 @@
 #define PENSIEVE_HH
 
 #include "abr_algo.hh"
-#include "child_process.hh"
-#include "filesystem.hh"
+#include "torch/script.h"
+
+#include <memory>
 
 class Pensieve : public ABRAlgo
 {
 public:
   Pensieve(const WebSocketClient & client,
            const std::string & abr_name, const YAML::Node & abr_config);
-  ~Pensieve();
 
   void video_chunk_acked(Chunk && c) override;
   VideoFormat select_video_format() override;
 
 private:
+  /* Pensieve requires exactly this many bitrates */
+  static constexpr size_t A_DIM = 10;
+
+  /* shape of the state fed to the actor network: S_INFO kinds of inputs,
+   * each over the past S_LEN chunks */
+  static constexpr size_t S_INFO = 6;
+  static constexpr size_t S_LEN = 10;
+
+  static constexpr double BUFFER_NORM_FACTOR = 10.0;  /* seconds */
+  static constexpr double M_IN_K = 1000.0;
+
+  /* the actor network (exported to TorchScript) is evaluated in process
+   * and shared by all the clients using the same model */
+  std::shared_ptr<torch::jit::script::Module> actor_ {};
+
+  float state_[S_INFO][S_LEN] {};
   size_t next_br_index_ {};
-  fs::path ipc_file_ {};
-  std::unique_ptr<FileDescriptor> connection_ {nullptr};
-  std::unique_ptr<ChildProcess> pensieve_proc_ {nullptr};
 };
 
 #endif /* PENSIEVE_HH */
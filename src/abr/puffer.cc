@@ -11,7 +11,7 @@ using json = nlohmann::json;
 
 Puffer::Puffer(const WebSocketClient & client,
                const string & abr_name, const YAML::Node & abr_config)
-  : ABRAlgo(client, abr_name)
+  : ABRAlgo(client, abr_name), ws_(thread_workspace())
 {
   if (abr_config["max_lookahead_horizon"]) {
     max_lookahead_horizon_ = min(
@@ -31,6 +31,12 @@ Puffer::Puffer(const WebSocketClient & client,
                         discretize_buffer(WebSocketClient::MAX_BUFFER_S));
 }
 
+Puffer::Workspace & Puffer::thread_workspace()
+{
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
 void Puffer::video_chunk_acked(Chunk && c)
 {
   past_chunks_.push_back(c);
@@ -48,7 +54,7 @@ VideoFormat Puffer::select_video_format()
 
 void Puffer::reinit()
 {
-  curr_round_++;
+  ws_.curr_round++;
 
   const auto & channel = client_.channel();
   const auto & vformats = channel->vformats();
@@ -72,9 +78,9 @@ void Puffer::reinit()
 
   /* init curr_ssims */
   if (past_chunks_.size() > 0) {
-    curr_ssims_[0][0] = past_chunks_.back().ssim;
+    ws_.curr_ssims[0][0] = past_chunks_.back().ssim;
   } else {
-    curr_ssims_[0][0] = 0;
+    ws_.curr_ssims[0][0] = 0;
   }
 
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
@@ -82,20 +88,20 @@ void Puffer::reinit()
 
     for (size_t j = 0; j < num_formats_; j++) {
       try {
-        curr_ssims_[i][j] = channel->vssim(vformats[j],
-                                           next_ts + vduration * (i - 1));
+        ws_.curr_ssims[i][j] = channel->vssim(vformats[j],
+                                              next_ts + vduration * (i - 1));
       } catch (const exception & e) {
         cerr << "Error occurs when getting the ssim of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_ssims_[i][j] = 0;
+        ws_.curr_ssims[i][j] = 0;
       }
 
       try {
-        curr_sizes_[i][j] = get<1>(data_map.at(vformats[j]));
+        ws_.curr_sizes[i][j] = get<1>(data_map.at(vformats[j]));
       } catch (const exception & e) {
         cerr << "Error occurs when getting the sizes of "
              << next_ts + vduration * (i - 1) << " " << vformats[j] << endl;
-        curr_sizes_[i][j] = -1;
+        ws_.curr_sizes[i][j] = -1;
       }
     }
   }
@@ -110,9 +116,9 @@ void Puffer::deal_all_ban(size_t i)
   size_t min_id = num_formats_;
 
   for (size_t j = 0; j < num_formats_; j++) {
-    double tmp = curr_sizes_[i][j];
+    double tmp = ws_.curr_sizes[i][j];
     if (tmp > 0 and (min_id == num_formats_ or min_v > tmp)) {
-      min_v = curr_sizes_[i][j];
+      min_v = ws_.curr_sizes[i][j];
       min_id = j;
     }
   }
@@ -121,27 +127,27 @@ void Puffer::deal_all_ban(size_t i)
     min_id = 0;
   }
 
-  is_ban_[i][min_id] = false;
+  ws_.is_ban[i][min_id] = false;
   for (size_t k = 0; k < dis_sending_time_; k++) {
-     sending_time_prob_[i][min_id][k] = 0;
+     ws_.sending_time_prob[i][min_id][k] = 0;
   }
 
-  sending_time_prob_[i][min_id][dis_sending_time_] = 1;
+  ws_.sending_time_prob[i][min_id][dis_sending_time_] = 1;
 }
 
 size_t Puffer::update_value(size_t i, size_t curr_buffer, size_t curr_format)
 {
-  flag_[i][curr_buffer][curr_format] = curr_round_;
+  ws_.flag[i][curr_buffer][curr_format] = ws_.curr_round;
 
   if (i == lookahead_horizon_) {
-    v_[i][curr_buffer][curr_format] = curr_ssims_[i][curr_format];
+    ws_.v[i][curr_buffer][curr_format] = ws_.curr_ssims[i][curr_format];
     return 0;
   }
 
   size_t best_next_format = num_formats_;
   double max_qvalue = 0;
   for (size_t next_format = 0; next_format < num_formats_; next_format++) {
-    if (is_ban_[i + 1][next_format] == true) {
+    if (ws_.is_ban[i + 1][next_format] == true) {
       continue;
     }
 
@@ -151,7 +157,7 @@ size_t Puffer::update_value(size_t i, size_t curr_buffer, size_t curr_format)
       best_next_format = next_format;
     }
   }
-  v_[i][curr_buffer][curr_format] = max_qvalue;
+  ws_.v[i][curr_buffer][curr_format] = max_qvalue;
 
   return best_next_format;
 }
@@ -159,13 +165,13 @@ size_t Puffer::update_value(size_t i, size_t curr_buffer, size_t curr_format)
 double Puffer::get_qvalue(size_t i, size_t curr_buffer, size_t curr_format,
                           size_t next_format)
 {
-  assert(is_ban_[i + 1][next_format] == false);
+  assert(ws_.is_ban[i + 1][next_format] == false);
 
-  double ans = curr_ssims_[i][curr_format] - ssim_diff_coeff_
-               * fabs(curr_ssims_[i][curr_format] - curr_ssims_[i + 1][next_format]);
+  double ans = ws_.curr_ssims[i][curr_format] - ssim_diff_coeff_
+               * fabs(ws_.curr_ssims[i][curr_format] - ws_.curr_ssims[i + 1][next_format]);
 
   for (size_t st = 0; st <= dis_sending_time_; st++) {
-    if (sending_time_prob_[i + 1][next_format][st] < st_prob_eps_) {
+    if (ws_.sending_time_prob[i + 1][next_format][st] < st_prob_eps_) {
       continue;
     }
 
@@ -179,7 +185,7 @@ double Puffer::get_qvalue(size_t i, size_t curr_buffer, size_t curr_format,
       real_rebuffer = rebuffer * unit_buf_length_ * 0.25;
     }
 
-    ans += sending_time_prob_[i+1][next_format][st]
+    ans += ws_.sending_time_prob[i+1][next_format][st]
            * (get_value(i + 1, next_buffer, next_format)
               - rebuffer_length_coeff_ * real_rebuffer);
   }
@@ -189,10 +195,10 @@ double Puffer::get_qvalue(size_t i, size_t curr_buffer, size_t curr_format,
 
 double Puffer::get_value(size_t i, size_t curr_buffer, size_t curr_format)
 {
-  if (flag_[i][curr_buffer][curr_format] != curr_round_) {
+  if (ws_.flag[i][curr_buffer][curr_format] != ws_.curr_round) {
     update_value(i, curr_buffer, curr_format);
   }
-  return v_[i][curr_buffer][curr_format];
+  return ws_.v[i][curr_buffer][curr_format];
 }
 
 size_t Puffer::discretize_buffer(double buf)
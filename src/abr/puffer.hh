@@ -45,23 +45,33 @@ protected:
   /* for the current buffer length */
   size_t curr_buffer_ {};
 
-  /* for storing the value function */
-  uint64_t flag_[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
-  double v_[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
+  /* everything below is recomputed in every select_video_format(), so it is
+   * kept in a workspace shared by all the clients of a thread */
+  struct Workspace
+  {
+    /* for storing the value function */
+    uint64_t flag[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
+    double v[MAX_LOOKAHEAD_HORIZON + 1][MAX_DIS_BUF_LENGTH + 1][MAX_NUM_FORMATS] {};
 
-  /* record the current round of DP */
-  uint64_t curr_round_ {};
+    /* record the current round of DP (of any client) */
+    uint64_t curr_round {};
 
-  /* the ssim and size of the chunk given the timestamp and format */
-  double curr_ssims_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
-  int curr_sizes_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+    /* the ssim and size of the chunk given the timestamp and format */
+    double curr_ssims[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+    int curr_sizes[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
 
-  /* the estimation of sending time given the timestamp and format */
-  double sending_time_prob_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS]
-                           [MAX_DIS_SENDING_TIME + 1] {};
+    /* the estimation of sending time given the timestamp and format */
+    double sending_time_prob[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS]
+                            [MAX_DIS_SENDING_TIME + 1] {};
 
-  /* denote whether a chunk is abandoned */
-  bool is_ban_[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+    /* denote whether a chunk is abandoned */
+    bool is_ban[MAX_LOOKAHEAD_HORIZON + 1][MAX_NUM_FORMATS] {};
+  };
+
+  /* the workspace of the thread that created this object */
+  Workspace & ws_;
+
+  static Workspace & thread_workspace();
 
   void reinit();
   virtual void reinit_sending_time() {};
@@ -14,8 +14,8 @@ PufferRaw::PufferRaw(const WebSocketClient & client,
 
 void PufferRaw::reinit_sending_time()
 {
-  static double unit_st[MAX_LOOKAHEAD_HORIZON + 1 + MAX_NUM_PAST_CHUNKS];
-  static double st_prob[MAX_DIS_SENDING_TIME + 1];
+  static thread_local double unit_st[MAX_LOOKAHEAD_HORIZON + 1 + MAX_NUM_PAST_CHUNKS];
+  static thread_local double st_prob[MAX_DIS_SENDING_TIME + 1];
 
   size_t num_past_chunks = past_chunks_.size();
   auto it = past_chunks_.begin();
@@ -41,19 +41,19 @@ void PufferRaw::reinit_sending_time()
     bool is_all_ban = true;
 
     for (size_t j = 0; j < num_formats_; j++) {
-      if (curr_sizes_[i][j] > 0) {
-        st = curr_sizes_[i][j] * unit_st[i + num_past_chunks];
+      if (ws_.curr_sizes[i][j] > 0) {
+        st = ws_.curr_sizes[i][j] * unit_st[i + num_past_chunks];
       } else {
-        is_ban_[i][j] = true;
+        ws_.is_ban[i][j] = true;
         continue;
       }
 
       size_t dis_st = min(discretize_buffer(st), dis_sending_time_);
       if (dis_st == dis_sending_time_) {
-        is_ban_[i][j] = true;
+        ws_.is_ban[i][j] = true;
         continue;
       } else {
-        is_ban_[i][j] = false;
+        ws_.is_ban[i][j] = false;
         is_all_ban = false;
       }
 
@@ -79,7 +79,7 @@ void PufferRaw::reinit_sending_time()
       }
 
       for (size_t k = 0; k <= dis_sending_time_; k++) {
-        sending_time_prob_[i][j][k] = st_prob[k] / tmp;
+        ws_.sending_time_prob[i][j][k] = st_prob[k] / tmp;
       }
     }
 
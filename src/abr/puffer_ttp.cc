@@ -90,10 +90,10 @@ void PufferTTP::reinit_sending_time()
 
   for (size_t i = 1; i <= lookahead_horizon_; i++) {
     /* prepare the inputs for each ahead timestamp and format */
-    static double inputs[MAX_NUM_FORMATS * TTP_INPUT_DIM];
+    static thread_local double inputs[MAX_NUM_FORMATS * TTP_INPUT_DIM];
 
     for (size_t j = 0; j < num_formats_; j++) {
-      raw_input[TTP_INPUT_DIM - 1] = (double) curr_sizes_[i][j] / PKT_BYTES;
+      raw_input[TTP_INPUT_DIM - 1] = (double) ws_.curr_sizes[i][j] / PKT_BYTES;
       vector<double> norm_input {raw_input};
 
       normalize_in_place(i - 1, norm_input);
@@ -117,8 +117,8 @@ void PufferTTP::reinit_sending_time()
     bool is_all_ban = true;
 
     for (size_t j = 0; j < num_formats_; j++) {
-      if (curr_sizes_[i][j] < 0) {
-        is_ban_[i][j] = true;
+      if (ws_.curr_sizes[i][j] < 0) {
+        ws_.is_ban[i][j] = true;
         continue;
       }
 
@@ -128,19 +128,21 @@ void PufferTTP::reinit_sending_time()
         double tmp = output[j][k].item<double>();
 
         if (tmp < st_prob_eps_) {
+          /* the workspace holds the probabilities of another round */
+          ws_.sending_time_prob[i][j][k] = 0;
           continue;
         }
 
-        sending_time_prob_[i][j][k] = tmp;
+        ws_.sending_time_prob[i][j][k] = tmp;
         good_prob += tmp;
       }
 
-      sending_time_prob_[i][j][dis_sending_time_] = 1 - good_prob;
+      ws_.sending_time_prob[i][j][dis_sending_time_] = 1 - good_prob;
 
       if (good_prob < ban_prob_) {
-        is_ban_[i][j] = true;
+        ws_.is_ban[i][j] = true;
       } else {
-        is_ban_[i][j] = false;
+        ws_.is_ban[i][j] = false;
         is_all_ban = false;
       }
     }
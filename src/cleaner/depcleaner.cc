@@ -1,9 +1,9 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <tuple>
 
 #include "filesystem.hh"
+#include "retention.hh"
 
 using namespace std;
 
@@ -33,8 +33,8 @@ int main(int argc, char * argv[])
 
   /* parse arguments */
   string input_file = argv[1];
-  vector<tuple<string, string>> clean_files;
-  vector<tuple<string, string>> depend_files;
+  vector<DependencyRetention::DirExt> clean_files;
+  vector<DependencyRetention::DirExt> depend_files;
 
   int clean_pos = 0, depend_pos = 0;
   for (int i = 2; i < argc; i++) {
@@ -68,22 +68,24 @@ int main(int argc, char * argv[])
   }
 
   /* check if all dependent files exist */
+  DependencyRetention dependencies(clean_files, depend_files);
+  vector<string> to_clean;
+
   string input_filestem = fs::path(input_file).stem();
-  for (const auto & depend_file : depend_files) {
-    const auto & [dep_dir, dep_ext] = depend_file;
+  for (size_t i = 0; i < depend_files.size(); i++) {
+    const auto & [dep_dir, dep_ext] = depend_files[i];
 
-    string dep_filepath = fs::path(dep_dir) / (input_filestem + dep_ext);
-    if (not fs::exists(dep_filepath)) {
+    string dep_filename = input_filestem + dep_ext;
+    if (not fs::exists(fs::path(dep_dir) / dep_filename)) {
       return EXIT_SUCCESS;
     }
+
+    to_clean = dependencies.add(i, dep_filename);
   }
 
   /* all of the downstream files exist so we can remove the upstream files */
   error_code ec;
-  for (const auto & clean_file : clean_files) {
-    const auto & [clean_dir, clean_ext] = clean_file;
-
-    string clean_filepath = fs::path(clean_dir) / (input_filestem + clean_ext);
+  for (const auto & clean_filepath : to_clean) {
     /* remove the file to clean and suppress exceptions */
     fs::remove(clean_filepath, ec);
   }
@@ -0,0 +1,168 @@
+#include "retention.hh"
+
+#include <stdexcept>
+
+#include "filesystem.hh"
+
+using namespace std;
+
+/* timestamp that 'stem' (e.g., of 180180.m4s) consists of */
+static optional<int64_t> parse_stem(const string & stem)
+{
+  try {
+    size_t pos;
+    const int64_t timestamp = stoll(stem, &pos);
+    if (pos == stem.size()) {
+      return timestamp;
+    }
+  } catch (const exception &) {}
+
+  return nullopt;
+}
+
+WindowRetention::WindowRetention(const string & ext, const int64_t time_window)
+  : ext_(ext), time_window_(time_window)
+{
+  if (time_window_ <= 0) {
+    throw runtime_error("Time window cannot be negative or less than 0");
+  }
+}
+
+optional<int64_t> WindowRetention::parse_timestamp(const string & filename) const
+{
+  const fs::path path = filename;
+  if (path.extension() != ext_) {
+    return nullopt;
+  }
+
+  return parse_stem(path.stem());
+}
+
+bool WindowRetention::insert(const string & filename)
+{
+  const auto timestamp = parse_timestamp(filename);
+  if (not timestamp) {
+    return false;
+  }
+
+  files_.emplace(*timestamp, filename);
+  return true;
+}
+
+vector<string> WindowRetention::add(const string & filename)
+{
+  if (not insert(filename)) {
+    return {};
+  }
+
+  return evict_before(*parse_timestamp(filename));
+}
+
+vector<string> WindowRetention::evict()
+{
+  if (files_.empty()) {
+    return {};
+  }
+
+  return evict_before(files_.rbegin()->first);
+}
+
+vector<string> WindowRetention::evict_before(const int64_t timestamp)
+{
+  vector<string> evicted;
+
+  auto it = files_.begin();
+  for (; it != files_.end() and timestamp - it->first > time_window_; it++) {
+    evicted.emplace_back(it->second);
+  }
+  files_.erase(files_.begin(), it);
+
+  return evicted;
+}
+
+DependencyRetention::DependencyRetention(const vector<DirExt> & clean,
+                                         const vector<DirExt> & depend,
+                                         const optional<int64_t> & time_window)
+  : clean_(clean), depend_(depend), time_window_(time_window)
+{
+  if (depend_.empty()) {
+    throw runtime_error("DependencyRetention: no dependent files");
+  }
+
+  if (time_window_ and *time_window_ <= 0) {
+    throw runtime_error("Time window cannot be negative or less than 0");
+  }
+}
+
+void DependencyRetention::clean(const string & stem, vector<string> & to_clean)
+{
+  for (const auto & [clean_dir, clean_ext] : clean_) {
+    to_clean.emplace_back(fs::path(clean_dir) / (stem + clean_ext));
+  }
+}
+
+vector<string> DependencyRetention::add(const size_t index,
+                                        const string & filename)
+{
+  vector<string> to_clean;
+
+  const fs::path path = filename;
+  if (index >= depend_.size() or path.extension() != depend_[index].second) {
+    return to_clean;
+  }
+
+  const string stem = path.stem();
+
+  optional<int64_t> timestamp;
+  if (time_window_) {
+    timestamp = parse_stem(stem);
+
+    /* not timestamped, or already given up on */
+    if (not timestamp or (newest_complete_
+        and *newest_complete_ - *timestamp > *time_window_)) {
+      return to_clean;
+    }
+  }
+
+  auto it = pending_.find(stem);
+  if (it == pending_.end()) {
+    it = pending_.emplace(stem, vector<bool>(depend_.size(), false)).first;
+
+    if (timestamp) {
+      timeline_.emplace(*timestamp, stem);
+    }
+  }
+
+  auto & appeared = it->second;
+  appeared[index] = true;
+
+  for (const bool a : appeared) {
+    if (not a) {
+      return to_clean;
+    }
+  }
+
+  /* all of the dependent files exist so the files can be cleaned */
+  pending_.erase(it);
+  clean(stem, to_clean);
+
+  if (not timestamp) {
+    return to_clean;
+  }
+
+  timeline_.erase({*timestamp, stem});
+  if (not newest_complete_ or *timestamp > *newest_complete_) {
+    newest_complete_ = timestamp;
+  }
+
+  /* give up on the stems too old to ever be complete */
+  auto oldest = timeline_.begin();
+  for (; oldest != timeline_.end()
+         and *newest_complete_ - oldest->first > *time_window_; oldest++) {
+    pending_.erase(oldest->second);
+    clean(oldest->second, to_clean);
+  }
+  timeline_.erase(timeline_.begin(), oldest);
+
+  return to_clean;
+}
@@ -0,0 +1,91 @@
+#ifndef RETENTION_HH
+#define RETENTION_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <optional>
+#include <utility>
+
+/* files named after their timestamps (e.g., 180180.m4s) in a directory,
+ * ordered by timestamp; a new file evicts those older than itself by more
+ * than the time window, without rescanning the directory */
+class WindowRetention
+{
+public:
+  WindowRetention(const std::string & ext, const int64_t time_window);
+
+  /* index 'filename' without evicting anything; false if it is not a
+   * timestamped file with the extension */
+  bool insert(const std::string & filename);
+
+  /* index 'filename' and return the indexed files that are more than the
+   * time window older than it, which are no longer indexed */
+  std::vector<std::string> add(const std::string & filename);
+
+  /* the same, relative to the newest indexed file */
+  std::vector<std::string> evict();
+
+  size_t size() const { return files_.size(); }
+
+private:
+  std::string ext_;
+  int64_t time_window_;
+
+  std::map<int64_t, std::string> files_ {};  /* timestamp -> filename */
+
+  /* timestamp in 'filename', if it has the extension */
+  std::optional<int64_t> parse_timestamp(const std::string & filename) const;
+
+  /* stop indexing and return the files older than 'timestamp' minus the
+   * time window; only the evicted files are visited */
+  std::vector<std::string> evict_before(const int64_t timestamp);
+};
+
+/* files to clean (e.g., in working/) once every file depending on them
+ * (e.g., in ready/) has appeared, matched by stem; with a time window, only
+ * timestamped stems are tracked, and a stem more than the time window older
+ * than the newest complete one is given up on (its files are cleaned too,
+ * since files appear in timestamp order and it will never be complete) */
+class DependencyRetention
+{
+public:
+  /* (directory, extension) of the files to clean and of their dependents */
+  using DirExt = std::pair<std::string, std::string>;
+
+  DependencyRetention(const std::vector<DirExt> & clean,
+                      const std::vector<DirExt> & depend,
+                      const std::optional<int64_t> & time_window = {});
+
+  /* 'filename' appeared in the 'index'-th directory of dependents; return
+   * the paths of the files to clean if all their dependents have appeared,
+   * and of those given up on */
+  std::vector<std::string> add(const size_t index,
+                               const std::string & filename);
+
+  const std::vector<DirExt> & depend() const { return depend_; }
+
+  /* stems waiting for some of their dependents */
+  size_t size() const { return pending_.size(); }
+
+private:
+  std::vector<DirExt> clean_;
+  std::vector<DirExt> depend_;
+  std::optional<int64_t> time_window_;
+
+  /* stem -> which dependents have appeared */
+  std::unordered_map<std::string, std::vector<bool>> pending_ {};
+
+  /* with a time window: the pending stems by timestamp, and the timestamp
+   * of the newest complete stem */
+  std::set<std::pair<int64_t, std::string>> timeline_ {};
+  std::optional<int64_t> newest_complete_ {};
+
+  /* append the paths of the files to clean for 'stem' */
+  void clean(const std::string & stem, std::vector<std::string> & to_clean);
+};
+
+#endif /* RETENTION_HH */
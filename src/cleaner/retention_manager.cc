@@ -0,0 +1,204 @@
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <optional>
+
+#include "filesystem.hh"
+#include "exception.hh"
+#include "poller.hh"
+#include "inotify.hh"
+#include "retention.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [--window <dir> <ext> <time_window>]...\n"
+  "       [--clean <clean_dir> <clean_ext>... "
+  "--depend <dep_dir> <dep_ext>...\n"
+  "        [--expire <time_window>]]...\n\n"
+  "Watch the directories and remove files as windowcleaner and depcleaner\n"
+  "do, in a single process and without rescanning the directories.\n\n"
+  "--window <dir> <ext> <time_window>\n"
+  "    whenever a file with a timestamped name and <ext> is moved into\n"
+  "    <dir>, remove those less than its timestamp - <time_window>\n"
+  "--clean <clean_dir> <clean_ext>... --depend <dep_dir> <dep_ext>...\n"
+  "    remove a file from every <clean_dir> once a file with the same\n"
+  "    stem has been moved into every <dep_dir>\n"
+  "--expire <time_window>\n"
+  "    only for timestamped stems, and give up on (and remove the files of)\n"
+  "    those less than the newest stem removed - <time_window>"
+  << endl;
+}
+
+/* callbacks for the files moved into a directory, which inotify can watch
+ * only once */
+using FileCallback = function<void(const string & filename)>;
+
+/* remove 'paths' (in one pass) and suppress exceptions */
+void remove_files(const vector<string> & paths)
+{
+  for (const auto & path : paths) {
+    if (unlink(path.c_str()) != 0 and errno != ENOENT) {
+      cerr << "Warning: " << unix_error("unlink (" + path + ")").what()
+           << endl;
+    }
+  }
+}
+
+vector<string> in_dir(const string & dir, const vector<string> & filenames)
+{
+  vector<string> paths;
+  for (const auto & filename : filenames) {
+    paths.emplace_back(fs::path(dir) / filename);
+  }
+  return paths;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  /* parse arguments */
+  struct WindowArg {
+    string dir;
+    string ext;
+    int64_t time_window;
+  };
+
+  using DirExt = DependencyRetention::DirExt;
+
+  struct DependencyArg {
+    vector<DirExt> clean {};
+    vector<DirExt> depend {};
+    optional<int64_t> time_window {};
+  };
+
+  vector<WindowArg> window_args;
+  vector<DependencyArg> dependency_args;
+
+  enum class Mode { None, Clean, Depend } mode = Mode::None;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+
+    if (arg == "--window" and i + 3 < argc) {
+      window_args.push_back({argv[i + 1], argv[i + 2], stoll(argv[i + 3])});
+      mode = Mode::None;
+      i += 3;
+    } else if (arg == "--clean") {
+      dependency_args.emplace_back();
+      mode = Mode::Clean;
+    } else if (arg == "--depend" and mode == Mode::Clean) {
+      mode = Mode::Depend;
+    } else if (arg == "--expire" and mode == Mode::Depend and i + 1 < argc) {
+      dependency_args.back().time_window = stoll(argv[i + 1]);
+      mode = Mode::None;
+      i++;
+    } else if (mode != Mode::None and i + 1 < argc) {
+      auto & dir_exts = (mode == Mode::Clean) ? dependency_args.back().clean
+                                              : dependency_args.back().depend;
+      dir_exts.emplace_back(argv[i], argv[i + 1]);
+      i++;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (window_args.empty() and dependency_args.empty()) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (const auto & [clean, depend, time_window] : dependency_args) {
+    if (depend.empty()) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* the retention of each directory, which stays where it is */
+  deque<WindowRetention> windows;
+  deque<DependencyRetention> dependencies;
+  map<string, vector<FileCallback>> callbacks;
+
+  for (const auto & [dir, ext, time_window] : window_args) {
+    WindowRetention & window = windows.emplace_back(ext, time_window);
+
+    callbacks[dir].emplace_back(
+      [&window, dir = dir](const string & filename) {
+        remove_files(in_dir(dir, window.add(filename)));
+      }
+    );
+  }
+
+  for (const auto & [clean, depend, time_window] : dependency_args) {
+    DependencyRetention & deps = dependencies.emplace_back(clean, depend,
+                                                           time_window);
+
+    for (size_t i = 0; i < depend.size(); i++) {
+      callbacks[depend[i].first].emplace_back(
+        [&deps, i](const string & filename) {
+          remove_files(deps.add(i, filename));
+        }
+      );
+    }
+  }
+
+  Poller poller;
+  Inotify inotify(poller);
+
+  for (const auto & [dir, dir_callbacks] : callbacks) {
+    inotify.add_watch(dir, IN_MOVED_TO,
+      [&dir_callbacks = dir_callbacks]
+      (const inotify_event & event, const string &) {
+        /* only interested in regular files moved into the directory */
+        if (not (event.mask & IN_MOVED_TO) or (event.mask & IN_ISDIR)) {
+          return;
+        }
+
+        for (const auto & callback : dir_callbacks) {
+          callback(event.name);
+        }
+      }
+    );
+  }
+
+  /* start with the files already in the directories, which are watched by
+   * now so that none is missed */
+  for (size_t i = 0; i < windows.size(); i++) {
+    const string & dir = window_args[i].dir;
+
+    for (const auto & entry : fs::directory_iterator(dir)) {
+      windows[i].insert(entry.path().filename());
+    }
+    remove_files(in_dir(dir, windows[i].evict()));
+  }
+
+  for (size_t i = 0; i < dependencies.size(); i++) {
+    const auto & depend = dependency_args[i].depend;
+
+    for (size_t j = 0; j < depend.size(); j++) {
+      for (const auto & entry : fs::directory_iterator(depend[j].first)) {
+        remove_files(dependencies[i].add(j, entry.path().filename()));
+      }
+    }
+  }
+
+  for (;;) {
+    auto ret = poller.poll(-1);
+    if (ret.result != Poller::Result::Type::Success) {
+      return ret.exit_status;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
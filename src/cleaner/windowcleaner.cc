@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "filesystem.hh"
+#include "retention.hh"
 
 using namespace std;
 
@@ -37,26 +38,21 @@ int main(int argc, char * argv[])
     return EXIT_FAILURE;
   }
 
-  /* Obtain the timestamp of the input file from the path */
-  int64_t input_file_timestamp = stoll(fs::path(input_file).stem());
+  const fs::path input_path = input_file;
+  const auto & input_dir = input_path.parent_path();
 
-  const auto & input_dir = fs::path(input_file).parent_path();
-
-  error_code ec;
+  /* index the other files, then evict relative to the input file */
+  WindowRetention window(clean_ext, time_window);
   for (const auto & entry : fs::directory_iterator(input_dir)) {
-    const auto & file = entry.path();
-    /* File is of the type to clean */
-    if (file.extension() != clean_ext) {
-      continue;
+    if (entry.path().filename() != input_path.filename()) {
+      window.insert(entry.path().filename());
     }
+  }
 
-    int64_t file_timestamp = stoll(file.stem());
-
-    /* Check if file timestamp is outside of the window of the input file */
-    if (input_file_timestamp - file_timestamp > time_window) {
-      /* remove the file and suppress exceptions */
-      fs::remove(file, ec);
-    }
+  error_code ec;
+  for (const auto & filename : window.add(input_path.filename())) {
+    /* remove the file and suppress exceptions */
+    fs::remove(input_dir / filename, ec);
   }
 
   return EXIT_SUCCESS;
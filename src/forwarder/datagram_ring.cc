@@ -0,0 +1,155 @@
+#include "datagram_ring.hh"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "exception.hh"
+
+using namespace std;
+
+DatagramRing::DatagramRing(const size_t capacity)
+  : num_slots_(capacity / SLOT_SIZE), buffer_(), lengths_(),
+    msgs_(RECV_BATCH), recv_iovs_(RECV_BATCH), send_iovs_(SEND_BATCH)
+{
+  /* room for a full batch besides a partially written datagram */
+  if (num_slots_ < RECV_BATCH * 2) {
+    throw runtime_error("DatagramRing: capacity is too small");
+  }
+
+  buffer_.resize(num_slots_ * SLOT_SIZE);
+  lengths_.resize(num_slots_);
+}
+
+size_t DatagramRing::receive(FileDescriptor & socket)
+{
+  size_t received = 0;
+
+  for (size_t round = 0; round < MAX_RECV_BATCHES; round++) {
+    if (count_ == num_slots_) {
+      drop_oldest(RECV_BATCH);
+    }
+
+    /* receive straight into the free slots following the newest datagram */
+    const size_t batch = min(RECV_BATCH, num_slots_ - count_);
+    for (size_t i = 0; i < batch; i++) {
+      recv_iovs_[i] = {slot(slot_index(count_ + i)), SLOT_SIZE};
+
+      memset(&msgs_[i], 0, sizeof(mmsghdr));
+      msgs_[i].msg_hdr.msg_iov = &recv_iovs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int n = recvmmsg(socket.fd_num(), msgs_.data(), batch,
+                           MSG_DONTWAIT, nullptr);
+    stats_.recv_calls++;
+    socket.register_read();
+
+    if (n < 0) {
+      if (errno == EAGAIN or errno == EWOULDBLOCK) {
+        break;
+      }
+      throw unix_error("recvmmsg");
+    }
+
+    for (int i = 0; i < n; i++) {
+      const size_t index = slot_index(count_);
+
+      if (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        stats_.truncated_datagrams++;
+        lengths_[index] = 0;  /* keep the slot; writes nothing */
+      } else {
+        lengths_[index] = msgs_[i].msg_len;
+        queued_bytes_ += msgs_[i].msg_len;
+
+        stats_.received_datagrams++;
+        stats_.received_bytes += msgs_[i].msg_len;
+      }
+
+      count_++;
+    }
+
+    received += n;
+    stats_.max_queued_bytes = max(stats_.max_queued_bytes, queued_bytes_);
+
+    /* the socket has been drained */
+    if (static_cast<size_t>(n) < batch) {
+      break;
+    }
+  }
+
+  return received;
+}
+
+size_t DatagramRing::send(FileDescriptor & socket)
+{
+  if (count_ == 0) {
+    return 0;
+  }
+
+  /* gather the queued datagrams, which might wrap around the ring */
+  const size_t num_iovs = min(count_, SEND_BATCH);
+  for (size_t i = 0; i < num_iovs; i++) {
+    const size_t index = slot_index(i);
+    const size_t offset = (i == 0) ? head_offset_ : 0;
+
+    send_iovs_[i] = {slot(index) + offset, lengths_[index] - offset};
+  }
+
+  const ssize_t n = writev(socket.fd_num(), send_iovs_.data(), num_iovs);
+  stats_.send_calls++;
+  socket.register_write();
+
+  if (n < 0) {
+    if (errno == EAGAIN or errno == EWOULDBLOCK) {
+      return 0;
+    }
+    throw unix_error("writev");
+  }
+
+  /* release the slots written completely */
+  size_t written = n;
+  while (count_ > 0) {
+    const size_t remaining = lengths_[head_] - head_offset_;
+
+    if (written < remaining) {
+      head_offset_ += written;
+      break;
+    }
+
+    written -= remaining;
+    head_ = slot_index(1);
+    head_offset_ = 0;
+    count_--;
+  }
+
+  queued_bytes_ -= n;
+  stats_.sent_bytes += n;
+
+  return n;
+}
+
+void DatagramRing::drop_oldest(const size_t n)
+{
+  /* a datagram partially written must be completed to keep the stream
+   * aligned, so it is moved over the datagrams dropped after it */
+  const size_t first = (head_offset_ > 0) ? 1 : 0;
+  const size_t to_drop = min(n, count_ - first);
+
+  for (size_t i = first; i < first + to_drop; i++) {
+    const size_t length = lengths_[slot_index(i)];
+
+    stats_.dropped_datagrams++;
+    stats_.dropped_bytes += length;
+    queued_bytes_ -= length;
+  }
+
+  if (first == 1 and to_drop > 0) {
+    const size_t new_head = slot_index(to_drop);
+    memcpy(slot(new_head), slot(head_), lengths_[head_]);
+    lengths_[new_head] = lengths_[head_];
+  }
+
+  head_ = slot_index(to_drop);
+  count_ -= to_drop;
+}
@@ -0,0 +1,80 @@
+#ifndef DATAGRAM_RING_HH
+#define DATAGRAM_RING_HH
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <vector>
+
+#include "file_descriptor.hh"
+
+/* a preallocated ring of datagram slots, filled in batches with recvmmsg()
+ * and drained to a stream socket with writev() over many slots at once;
+ * datagrams are never split or reordered, and once the ring is full the
+ * oldest datagrams (not yet partially written) are dropped for new ones */
+class DatagramRing
+{
+public:
+  /* larger datagrams are dropped (MPEG-TS over UDP is 7 * 188 = 1316 bytes) */
+  static constexpr size_t SLOT_SIZE = 2048;
+
+  /* datagrams received per recvmmsg(), and recvmmsg() calls per receive() */
+  static constexpr size_t RECV_BATCH = 64;
+  static constexpr size_t MAX_RECV_BATCHES = 16;
+
+  /* slots written per writev() at most */
+  static constexpr size_t SEND_BATCH = 1024;  /* IOV_MAX on Linux */
+
+  struct Stats
+  {
+    uint64_t received_datagrams {0};
+    uint64_t received_bytes {0};
+    uint64_t sent_bytes {0};
+    uint64_t dropped_datagrams {0};  /* the ring was full */
+    uint64_t dropped_bytes {0};
+    uint64_t truncated_datagrams {0};  /* larger than SLOT_SIZE */
+    uint64_t recv_calls {0};
+    uint64_t send_calls {0};
+    size_t max_queued_bytes {0};
+  };
+
+  /* 'capacity' is the memory of the ring, in bytes */
+  DatagramRing(const size_t capacity);
+
+  /* receive the datagrams pending on a non-blocking 'socket'; return the
+   * number of datagrams received */
+  size_t receive(FileDescriptor & socket);
+
+  /* write as much as a non-blocking 'socket' takes; return the bytes written */
+  size_t send(FileDescriptor & socket);
+
+  bool empty() const { return count_ == 0; }
+  size_t queued_bytes() const { return queued_bytes_; }
+  size_t num_slots() const { return num_slots_; }
+
+  const Stats & stats() const { return stats_; }
+
+private:
+  size_t num_slots_;
+  std::vector<char> buffer_;  /* num_slots_ * SLOT_SIZE */
+  std::vector<size_t> lengths_;  /* datagram length in each slot */
+
+  size_t head_ {0};  /* oldest slot */
+  size_t count_ {0};  /* occupied slots */
+  size_t head_offset_ {0};  /* bytes of the oldest datagram already written */
+  size_t queued_bytes_ {0};
+
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> recv_iovs_;
+  std::vector<iovec> send_iovs_;
+
+  Stats stats_ {};
+
+  char * slot(const size_t index) { return &buffer_[index * SLOT_SIZE]; }
+  size_t slot_index(const size_t i) const { return (head_ + i) % num_slots_; }
+
+  /* drop the 'n' oldest datagrams, keeping the one partially written */
+  void drop_oldest(const size_t n);
+};
+
+#endif /* DATAGRAM_RING_HH */
@@ -0,0 +1,301 @@
+#include "destination.hh"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <iostream>
+#include <algorithm>
+
+#include "exception.hh"
+#include "serialization.hh"
+#include "timestamp.hh"
+#include "file_message.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* bytes per sendfile() at most */
+static const size_t SENDFILE_SIZE = 1024 * 1024;
+
+Destination::Destination(Poller & poller, const Address & address,
+                         const size_t max_backlog)
+  : poller_(poller), address_(address), max_backlog_(max_backlog)
+{
+  if (max_backlog_ == 0) {
+    throw runtime_error("Destination: max_backlog must be positive");
+  }
+
+  poller_.add_action(Poller::Action(timer_, Direction::In,
+    [this]() {
+      if (timer_.expirations() > 0) {
+        if (state_ == State::Connecting) {
+          disconnect("timed out connecting");
+        } else if (state_ == State::Disconnected) {
+          connect();
+        }
+      }
+      return ResultType::Continue;
+    }
+  ));
+
+  connect();
+}
+
+void Destination::send_file(const string & src_path, const string & dst_path)
+{
+  if (backlog() >= max_backlog_) {
+    /* drop the oldest file that is neither being sent nor in flight, as
+     * the media server will have moved past it long ago */
+    const size_t oldest = file_ ? 1 : 0;
+    if (queue_.size() > oldest) {
+      cerr << "Backlog to " << address_.str() << " is full; dropping "
+           << queue_[oldest].src_path << endl;
+      queue_.erase(queue_.begin() + oldest);
+    } else {
+      cerr << "Backlog to " << address_.str() << " is full; dropping "
+           << src_path << endl;
+      stats_.dropped_files++;
+      return;
+    }
+
+    stats_.dropped_files++;
+  }
+
+  queue_.push_back({src_path, dst_path, timestamp_ms()});
+}
+
+uint64_t Destination::pending_ms() const
+{
+  /* files in flight were queued before the others */
+  if (not in_flight_.empty()) {
+    return timestamp_ms() - in_flight_.front().queued_ms;
+  }
+
+  if (not queue_.empty()) {
+    return timestamp_ms() - queue_.front().queued_ms;
+  }
+
+  return 0;
+}
+
+void Destination::connect()
+{
+  /* the actions of the previous socket have been removed from the poller */
+  socket_ = make_unique<TCPSocket>();
+  socket_->set_blocking(false);
+
+  /* do not block the other destinations while connecting */
+  try {
+    socket_->connect(address_);
+  } catch (const unix_error & e) {
+    if (e.code().value() != EINPROGRESS) {
+      cerr << "Failed to connect to " << address_.str() << ": "
+           << e.what() << endl;
+      timer_.start(RECONNECT_INTERVAL_MS);
+      return;
+    }
+  }
+
+  state_ = State::Connecting;
+  timer_.start(CONNECT_TIMEOUT_MS);
+
+  next_file_id_ = 0;
+  next_ack_id_ = 0;
+  ack_buffer_.clear();
+
+  poller_.add_action(Poller::Action(*socket_, Direction::Out,
+    [this]() {
+      if (state_ == State::Connecting) {
+        try {
+          socket_->verify_no_errors();
+        } catch (const exception & e) {
+          socket_->register_write();  /* the connection attempt has ended */
+          disconnect(e.what());
+          return ResultType::Continue;
+        }
+
+        socket_->register_write();
+        state_ = State::Connected;
+        timer_.start(0);  /* disarm */
+
+        cerr << "Connected to " << address_.str() << "; " << backlog()
+             << " files to send" << endl;
+        return ResultType::Continue;
+      }
+
+      send_some();
+      return ResultType::Continue;
+    },
+    /* wait for the connection, then for files to send while few enough
+     * files are waiting for their acks */
+    [this]() {
+      if (state_ == State::Connecting) {
+        return true;
+      }
+
+      return state_ == State::Connected and not queue_.empty()
+             and (file_ or in_flight_.size() < MAX_IN_FLIGHT);
+    },
+    [this]() {
+      disconnect("connection error");
+    }
+  ));
+
+  poller_.add_action(Poller::Action(*socket_, Direction::In,
+    [this]() {
+      try {
+        const string data = socket_->read();
+        if (data.empty()) {
+          disconnect("connection closed by receiver");
+        } else {
+          receive_acks(data);
+        }
+      } catch (const exception & e) {
+        socket_->register_read();  /* the failed read served the socket */
+        disconnect(e.what());
+      }
+      return ResultType::Continue;
+    },
+    [this]() {
+      return state_ == State::Connected;
+    }
+  ));
+}
+
+void Destination::disconnect(const string & reason)
+{
+  if (state_ == State::Disconnected) {
+    return;
+  }
+
+  /* the socket is destroyed on reconnecting, after the poller has removed
+   * its actions */
+  state_ = State::Disconnected;
+  poller_.remove_fd(socket_->fd_num());
+
+  /* resend every file not acked, in order, from the beginning */
+  const size_t resent = in_flight_.size() + (file_ ? 1 : 0);
+  stats_.resent_files += resent;
+
+  queue_.insert(queue_.begin(), in_flight_.begin(), in_flight_.end());
+  in_flight_.clear();
+
+  file_.reset();
+  header_.clear();
+  header_offset_ = 0;
+  file_offset_ = 0;
+
+  cerr << "Disconnected from " << address_.str() << " (" << reason
+       << "); " << resent << " files to resend and " << backlog()
+       << " in total after reconnecting" << endl;
+
+  timer_.start(RECONNECT_INTERVAL_MS);
+}
+
+bool Destination::open_next_file()
+{
+  const File & next = queue_.front();
+
+  try {
+    file_.emplace(CheckSystemCall("open (" + next.src_path + ")",
+                                  open(next.src_path.c_str(), O_RDONLY)));
+  } catch (const exception & e) {
+    /* e.g., removed by the cleaner while queued */
+    cerr << "Skipping a file: " << e.what() << endl;
+    queue_.pop_front();
+    stats_.skipped_files++;
+    return false;
+  }
+
+  file_size_ = file_->filesize();
+  file_offset_ = 0;
+
+  header_ = FileMsg(next_file_id_, next.dst_path, file_size_).to_string();
+  header_offset_ = 0;
+
+  return true;
+}
+
+void Destination::send_some()
+{
+  while (not file_) {
+    if (queue_.empty()) {
+      /* every queued file has vanished; nothing to write this time */
+      socket_->register_write();
+      return;
+    }
+
+    open_next_file();
+  }
+
+  try {
+    if (header_offset_ < header_.size()) {
+      const string_view header = header_;
+      const auto it = socket_->write(header.substr(header_offset_), false);
+      header_offset_ = it - header.begin();
+
+      if (header_offset_ < header_.size()) {
+        return;
+      }
+    }
+
+    if (file_offset_ < file_size_) {
+      off_t offset = file_offset_;
+      const ssize_t n = sendfile(socket_->fd_num(), file_->fd_num(), &offset,
+                                 min<uint64_t>(SENDFILE_SIZE,
+                                               file_size_ - file_offset_));
+      socket_->register_write();
+
+      if (n < 0) {
+        if (errno == EAGAIN) {
+          return;
+        }
+        throw unix_error("sendfile");
+      }
+
+      if (n == 0) {
+        throw runtime_error("sendfile: " + queue_.front().src_path
+                            + " was truncated");
+      }
+
+      file_offset_ = offset;
+    }
+  } catch (const exception & e) {
+    socket_->register_write();  /* the failed write served the socket */
+    disconnect(e.what());
+    return;
+  }
+
+  if (file_offset_ == file_size_) {
+    /* wait for the ack */
+    file_.reset();
+    in_flight_.emplace_back(move(queue_.front()));
+    queue_.pop_front();
+    next_file_id_++;
+  }
+}
+
+void Destination::receive_acks(const string & data)
+{
+  ack_buffer_.append(data);
+
+  size_t pos = 0;
+  for (; pos + FileMsg::FILE_ACK_SIZE <= ack_buffer_.size();
+       pos += FileMsg::FILE_ACK_SIZE) {
+    const uint64_t file_id = get_uint64(ack_buffer_.data() + pos);
+
+    /* files are acked in the order they were sent */
+    if (in_flight_.empty() or file_id != next_ack_id_) {
+      disconnect("unexpected ack of file " + to_string(file_id));
+      return;
+    }
+
+    const uint64_t lag_ms = timestamp_ms() - in_flight_.front().queued_ms;
+    stats_.max_lag_ms = max(stats_.max_lag_ms, lag_ms);
+    stats_.acked_files++;
+
+    in_flight_.pop_front();
+    next_ack_id_++;
+  }
+
+  ack_buffer_.erase(0, pos);
+}
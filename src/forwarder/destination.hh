@@ -0,0 +1,115 @@
+#ifndef DESTINATION_HH
+#define DESTINATION_HH
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <memory>
+#include <optional>
+
+#include "address.hh"
+#include "socket.hh"
+#include "poller.hh"
+#include "timerfd.hh"
+#include "file_descriptor.hh"
+
+/* a file_receiver to which files are sent one after another over a single
+ * persistent connection: a FileMsg header followed by the file data, which
+ * is copied from the page cache with sendfile(); the receiver acks each file
+ * once it is durably in place, and after a failure, the connection is
+ * reestablished and every file not acked yet is sent again */
+class Destination
+{
+public:
+  struct Stats
+  {
+    uint64_t acked_files {0};
+    uint64_t resent_files {0};  /* sent again after a connection failure */
+    uint64_t dropped_files {0};  /* the backlog was full */
+    uint64_t skipped_files {0};  /* removed before they could be sent */
+
+    /* from queuing to ack, since the last reset */
+    uint64_t max_lag_ms {0};
+  };
+
+  /* keep at most 'max_backlog' files queued or waiting for their acks */
+  Destination(Poller & poller, const Address & address,
+              const size_t max_backlog);
+
+  /* queue the file at 'src_path' to be sent to 'dst_path' */
+  void send_file(const std::string & src_path, const std::string & dst_path);
+
+  /* files not acked yet */
+  size_t backlog() const { return queue_.size() + in_flight_.size(); }
+
+  /* how long the oldest file not acked yet has waited (the replication lag),
+   * or 0 if all files have been acked */
+  uint64_t pending_ms() const;
+
+  bool connected() const { return state_ == State::Connected; }
+  const Address & address() const { return address_; }
+
+  const Stats & stats() const { return stats_; }
+  void reset_max_lag() { stats_.max_lag_ms = 0; }
+
+private:
+  /* how long to wait before reconnecting, and for a connection to be made */
+  static constexpr int RECONNECT_INTERVAL_MS = 1000;
+  static constexpr int CONNECT_TIMEOUT_MS = 5000;
+
+  /* files sent but not acked yet at most */
+  static constexpr size_t MAX_IN_FLIGHT = 64;
+
+  enum class State { Disconnected, Connecting, Connected };
+
+  struct File
+  {
+    std::string src_path;
+    std::string dst_path;
+    uint64_t queued_ms;
+  };
+
+  Poller & poller_;
+  Address address_;
+  size_t max_backlog_;
+
+  std::unique_ptr<TCPSocket> socket_ {};
+  State state_ {State::Disconnected};
+  Timerfd timer_ {};  /* to reconnect, or to give up connecting */
+
+  /* sent completely and waiting for their acks, in order */
+  std::deque<File> in_flight_ {};
+
+  /* front: the file being sent, if 'file_' is open */
+  std::deque<File> queue_ {};
+
+  std::optional<FileDescriptor> file_ {};
+  std::string header_ {};
+  size_t header_offset_ {0};
+  uint64_t file_offset_ {0};
+  uint64_t file_size_ {0};
+
+  /* IDs of the files sent over the current connection */
+  uint64_t next_file_id_ {0};
+  uint64_t next_ack_id_ {0};
+  std::string ack_buffer_ {};
+
+  Stats stats_ {};
+
+  /* start connecting and add the socket to the poller */
+  void connect();
+
+  /* drop the connection and try again after RECONNECT_INTERVAL_MS */
+  void disconnect(const std::string & reason);
+
+  /* open the file at the front of the queue; false if it has vanished */
+  bool open_next_file();
+
+  /* write what the socket takes of the header and the file data */
+  void send_some();
+
+  /* handle the acks received */
+  void receive_acks(const std::string & data);
+};
+
+#endif /* DESTINATION_HH */
@@ -6,28 +6,50 @@
 
 using namespace std;
 
-FileMsg::FileMsg(const uint16_t _dst_path_len, const string & _dst_path)
-  : dst_path_len(_dst_path_len), dst_path(_dst_path)
-{}
+FileMsg::FileMsg(const uint64_t _file_id, const string & _dst_path,
+                 const uint64_t _file_size)
+  : dst_path_len(_dst_path.size()), dst_path(_dst_path), file_id(_file_id),
+    file_size(_file_size)
+{
+  if (_dst_path.size() > UINT16_MAX) {
+    throw runtime_error("FileMsg: dst_path is too long");
+  }
+}
 
 FileMsg::FileMsg(const string & str)
 {
+  if (missing_bytes(str) > 0) {
+    throw runtime_error("FileMsg is incomplete");
+  }
+
   const char * data = str.data();
 
+  dst_path_len = get_uint16(data);
+  dst_path = str.substr(sizeof(dst_path_len), dst_path_len);
+  data += sizeof(dst_path_len) + dst_path_len;
+  file_id = get_uint64(data);
+  file_size = get_uint64(data + sizeof(file_id));
+}
+
+size_t FileMsg::missing_bytes(const string & str)
+{
   if (str.size() < sizeof(dst_path_len)) {
-    throw runtime_error("FileMsg is too small to contain dst_path_len");
+    return sizeof(dst_path_len) - str.size();
   }
 
-  dst_path_len = get_uint16(data);
-  dst_path = str.substr(sizeof(dst_path_len), dst_path_len);
+  const size_t total = sizeof(dst_path_len) + get_uint16(str.data())
+                       + sizeof(file_id) + sizeof(file_size);
+  return str.size() < total ? total - str.size() : 0;
 }
 
 string FileMsg::to_string() const
 {
-  return put_field(dst_path_len) + dst_path;
+  return put_field(dst_path_len) + dst_path + put_field(file_id)
+         + put_field(file_size);
 }
 
 unsigned int FileMsg::size() const
 {
-  return sizeof(dst_path_len) + dst_path.size();
+  return sizeof(dst_path_len) + dst_path.size() + sizeof(file_id)
+         + sizeof(file_size);
 }
@@ -2,18 +2,32 @@
 #define FILE_MESSAGE_HH
 
 #include <string>
+#include <cstdint>
 
+/* header of a file sent over a persistent connection; the file data
+ * (file_size bytes) follows right after it, then the next header; once the
+ * file is in place, file_receiver sends file_id back as an ack (FILE_ACK_SIZE
+ * bytes); file IDs count up from 0 on each connection */
 class FileMsg
 {
 public:
+  static constexpr size_t FILE_ACK_SIZE = sizeof(uint64_t);
+
   uint16_t dst_path_len {};
   std::string dst_path {};
+  uint64_t file_id {};
+  uint64_t file_size {};
 
-  FileMsg(const uint16_t dst_path_len, const std::string & dst_path);
+  FileMsg(const uint64_t file_id, const std::string & dst_path,
+          const uint64_t file_size);
 
   /* parse a file message from network */
   FileMsg(const std::string & str);
 
+  /* bytes missing from the file message at the beginning of 'str', or 0 if
+   * it is complete; counts up to dst_path_len only until that has arrived */
+  static size_t missing_bytes(const std::string & str);
+
   /* make network representation of file message */
   std::string to_string() const;
 
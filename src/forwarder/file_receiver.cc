@@ -1,8 +1,10 @@
 #include <fcntl.h>
+#include <csignal>
 
 #include <iostream>
 #include <stdexcept>
 #include <map>
+#include <optional>
 
 #include "strict_conversions.hh"
 #include "socket.hh"
@@ -10,6 +12,7 @@
 #include "exception.hh"
 #include "poller.hh"
 #include "filesystem.hh"
+#include "serialization.hh"
 #include "file_message.hh"
 
 using namespace std;
@@ -27,43 +30,101 @@ void print_usage(const string & program_name)
   << endl;
 }
 
+/* a file_sender connection, which carries files one after another and
+ * receives an ack for each */
 class Client
 {
 public:
-  Client(TCPSocket && _socket) : socket(move(_socket)), buffer() {}
+  Client(TCPSocket && _socket) : socket(move(_socket)) {}
 
-  void write_to_file() const
+  /* write the received data to the files it belongs to, as it arrives */
+  void receive(string_view data)
   {
-    FileMsg metadata(buffer);
-    fs::path dst_path = metadata.dst_path;
-    fs::path tmp_path = tmp_dir_path / (dst_path.filename().string() + "."
-                                        + to_string(global_file_id++));
+    while (not data.empty()) {
+      if (not fd_) {
+        /* accumulate the header of the next file */
+        const size_t n = min(FileMsg::missing_bytes(header_), data.size());
+        header_.append(data.substr(0, n));
+        data.remove_prefix(n);
+
+        if (FileMsg::missing_bytes(header_) == 0) {
+          begin_file(FileMsg(header_));
+          header_.clear();
+        }
+        continue;
+      }
+
+      const size_t n = min<uint64_t>(data.size(), remaining_bytes_);
+      fd_->write(data.substr(0, n));
+      data.remove_prefix(n);
+      remaining_bytes_ -= n;
+
+      if (remaining_bytes_ == 0) {
+        end_file();
+      }
+    }
+  }
+
+  /* the connection was closed in the middle of a file */
+  void discard_file()
+  {
+    if (fd_) {
+      fd_.reset();
+      fs::remove(tmp_path_);
+      cerr << "Discarded incomplete " << tmp_path_ << endl;
+    }
+  }
+
+  TCPSocket socket;
+
+private:
+  string header_ {};
+
+  /* the file being received */
+  optional<FileDescriptor> fd_ {};
+  fs::path tmp_path_ {};
+  fs::path dst_path_ {};
+  uint64_t file_id_ {0};
+  uint64_t remaining_bytes_ {0};
+
+  void begin_file(const FileMsg & metadata)
+  {
+    dst_path_ = metadata.dst_path;
+    tmp_path_ = tmp_dir_path / (dst_path_.filename().string() + "."
+                                + to_string(global_file_id++));
 
     /* create parent directories if they don't exist yet */
-    if (dst_path.has_parent_path()) {
-      fs::create_directories(dst_path.parent_path());
+    if (dst_path_.has_parent_path()) {
+      fs::create_directories(dst_path_.parent_path());
     }
-    if (tmp_path.has_parent_path()) {
-      fs::create_directories(tmp_path.parent_path());
+    if (tmp_path_.has_parent_path()) {
+      fs::create_directories(tmp_path_.parent_path());
     }
 
-    FileDescriptor fd(CheckSystemCall("open (" + tmp_path.string() + ")",
-        open(tmp_path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+    fd_.emplace(CheckSystemCall("open (" + tmp_path_.string() + ")",
+        open(tmp_path_.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+    file_id_ = metadata.file_id;
+    remaining_bytes_ = metadata.file_size;
 
-    /* avoid writing empty data */
-    if (buffer.size() > metadata.size()) {
-      fd.write(buffer.substr(metadata.size()));
+    /* an empty file is complete already */
+    if (remaining_bytes_ == 0) {
+      end_file();
     }
+  }
 
-    fd.close();
+  /* ack the file once it is durably in place */
+  void end_file()
+  {
+    CheckSystemCall("fsync", fsync(fd_->fd_num()));
+    fd_->close();
+    fd_.reset();
 
-    fs::rename(tmp_path, dst_path);
+    fs::rename(tmp_path_, dst_path_);
 
-    cerr << "Received " << tmp_path << " and moved to " << dst_path << endl;
-  }
+    cerr << "Received " << tmp_path_ << " and moved to " << dst_path_ << endl;
 
-  TCPSocket socket;
-  string buffer;
+    socket.write(put_field(file_id_));
+  }
 };
 
 int main(int argc, char * argv[])
@@ -82,6 +143,11 @@ int main(int argc, char * argv[])
     tmp_dir_path = argv[2];
   }
 
+  /* a failed ack to a sender that is gone must not kill the receiver */
+  if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+    throw runtime_error("signal: failed to ignore SIGPIPE");
+  }
+
   TCPSocket listening_socket;
   listening_socket.set_reuseaddr();
   listening_socket.set_reuseport();
@@ -109,16 +175,22 @@ int main(int argc, char * argv[])
 
       poller.add_action(Poller::Action(client.socket, Direction::In,
         [client_id, &client, &clients]()->ResultType {
-          const string & data = client.socket.read();
-          client.buffer.append(data);
-
-          if (data.empty()) {  // EOF
-            client.write_to_file();
-            clients.erase(client_id);
-            return ResultType::CancelAll;
+          try {
+            const string data = client.socket.read();
+
+            if (not data.empty()) {
+              client.receive(data);
+              return ResultType::Continue;
+            }
+          } catch (const exception & e) {
+            /* the sender resends the files it has no acks for */
+            print_exception("file_receiver", e);
           }
 
-          return ResultType::Continue;
+          /* EOF or error */
+          client.discard_file();
+          clients.erase(client_id);
+          return ResultType::CancelAll;
         }
       ));
 
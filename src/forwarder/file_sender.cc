@@ -1,64 +1,196 @@
-#include <fcntl.h>
+#include <getopt.h>
+#include <sys/inotify.h>
+#include <csignal>
 
 #include <iostream>
+#include <vector>
+#include <memory>
 
 #include "strict_conversions.hh"
-#include "socket.hh"
-#include "file_descriptor.hh"
 #include "exception.hh"
 #include "filesystem.hh"
-#include "file_message.hh"
+#include "poller.hh"
+#include "timerfd.hh"
+#include "inotify.hh"
+#include "destination.hh"
 
 using namespace std;
+using namespace PollerShortNames;
+
+/* print the replication stats this often */
+static const int STATS_INTERVAL_MS = 60000;
 
 void print_usage(const string & program_name)
 {
   cerr <<
-  "Usage: " << program_name << " SRC-PATH HOST PORT DST-DIR\n\n"
-  "Transfer the file at SRC-PATH to DST-DIR on HOST:PORT"
+  "Usage: " << program_name << " [options] MEDIA-DIR SRC-DIR...\n\n"
+  "Replicate every file moved into each SRC-DIR (and those already in it),\n"
+  "a directory in MEDIA-DIR, to the same relative path in the media\n"
+  "directory of each destination, over a persistent connection to the\n"
+  "file_receiver of each destination; files are sent again until they are\n"
+  "acked by the receiver.\n\n"
+  "Options:\n"
+  "--destination, -d HOST:PORT:DST-MEDIA-DIR\n"
+  "                       a destination (at least one)\n"
+  "--max-backlog, -b N    files queued or waiting for acks per destination\n"
+  "                       at most; the oldest are dropped (default: 1000)"
   << endl;
 }
 
+struct DestinationArg
+{
+  Address address;
+  fs::path media_dir;
+};
+
+DestinationArg parse_destination(const string & arg)
+{
+  const size_t first_colon = arg.find(':');
+  const size_t second_colon = arg.find(':', first_colon + 1);
+
+  if (first_colon == string::npos or second_colon == string::npos) {
+    throw runtime_error("invalid destination: " + arg);
+  }
+
+  const string host = arg.substr(0, first_colon);
+  const uint16_t port = narrow_cast<uint16_t>(strict_atoui(
+      arg.substr(first_colon + 1, second_colon - first_colon - 1)));
+
+  return {{host, port}, arg.substr(second_colon + 1)};
+}
+
+void print_stats(const vector<unique_ptr<Destination>> & destinations)
+{
+  for (const auto & destination : destinations) {
+    const auto & stats = destination->stats();
+
+    cerr << "Replication to " << destination->address().str() << ": "
+         << (destination->connected() ? "connected" : "disconnected")
+         << ", " << stats.acked_files << " files acked, "
+         << destination->backlog() << " pending for "
+         << destination->pending_ms() << " ms, max lag "
+         << stats.max_lag_ms << " ms; " << stats.resent_files
+         << " resent, " << stats.dropped_files << " dropped, "
+         << stats.skipped_files << " skipped" << endl;
+
+    destination->reset_max_lag();
+  }
+}
+
 int main(int argc, char * argv[])
 {
   if (argc < 1) {
     abort();
   }
 
-  if (argc != 5) {
+  vector<DestinationArg> destination_args;
+  size_t max_backlog = 1000;
+
+  const option cmd_line_opts[] = {
+    {"destination", required_argument, nullptr, 'd'},
+    {"max-backlog", required_argument, nullptr, 'b'},
+    { nullptr,      0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "d:b:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'd':
+      destination_args.emplace_back(parse_destination(optarg));
+      break;
+    case 'b':
+      max_backlog = strict_atoui(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind + 2 > argc or destination_args.empty() or max_backlog == 0) {
     print_usage(argv[0]);
     return EXIT_FAILURE;
   }
 
-  string src_path = argv[1];
-  string dst_ip = argv[2];
-  uint16_t dst_port = narrow_cast<uint16_t>(stoi(argv[3]));
-  string dst_dir = argv[4];
+  const string media_dir = argv[optind];
 
-  TCPSocket socket;
-  socket.connect({dst_ip, dst_port});
-  cerr << "Connected to " << socket.peer_address().str() << endl;
+  /* a failed write to a receiver must not kill the sender */
+  if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+    throw runtime_error("signal: failed to ignore SIGPIPE");
+  }
 
-  /* send dst_path first */
-  string dst_path = fs::path(dst_dir) / fs::path(src_path).filename();
-  FileMsg metadata(dst_path.size(), dst_path);
-  socket.write(metadata.to_string());
+  Poller poller;
+  Inotify inotify(poller);
 
-  FileDescriptor fd(CheckSystemCall("open (" + src_path + ")",
-                    open(src_path.c_str(), O_RDONLY)));
-  /* send the file at src_path */
-  for (;;) {
-    const string data = fd.read();
-    if (data.empty()) {  // EOF
-      break;
+  /* the destinations are sent files concurrently */
+  vector<unique_ptr<Destination>> destinations;
+  for (const auto & arg : destination_args) {
+    destinations.emplace_back(
+        make_unique<Destination>(poller, arg.address, max_backlog));
+  }
+
+  for (int i = optind + 1; i < argc; i++) {
+    const string src_dir = argv[i];
+
+    if (src_dir.compare(0, media_dir.size(), media_dir) != 0) {
+      throw runtime_error(src_dir + " is not in " + media_dir);
     }
 
-    socket.write(data);
+    /* where src_dir is in each destination's media directory */
+    const string remaining = src_dir.substr(media_dir.size());
+    vector<fs::path> dst_dirs;
+    for (const auto & arg : destination_args) {
+      dst_dirs.emplace_back(arg.media_dir / remaining);
+    }
+
+    const auto send_file =
+      [&destinations, src_dir, dst_dirs](const string & filename) {
+        for (size_t j = 0; j < destinations.size(); j++) {
+          destinations[j]->send_file(fs::path(src_dir) / filename,
+                                     dst_dirs[j] / filename);
+        }
+      };
+
+    /* send any file moved into src_dir, e.g., init.mp4 and .m4s */
+    inotify.add_watch(src_dir, IN_MOVED_TO,
+      [send_file](const inotify_event & event, const string &) {
+        if (not (event.mask & IN_MOVED_TO) or (event.mask & IN_ISDIR)) {
+          return;
+        }
+
+        send_file(event.name);
+      }
+    );
+
+    /* files that were already there */
+    for (const auto & entry : fs::directory_iterator(src_dir)) {
+      if (fs::is_regular_file(entry.path())) {
+        send_file(entry.path().filename());
+      }
+    }
   }
 
-  fd.close();
+  Timerfd stats_timer;
+  poller.add_action(Poller::Action(stats_timer, Direction::In,
+    [&stats_timer, &destinations]() {
+      if (stats_timer.expirations() > 0) {
+        print_stats(destinations);
+      }
+      return ResultType::Continue;
+    }
+  ));
+  stats_timer.start(STATS_INTERVAL_MS, STATS_INTERVAL_MS);
 
-  cerr << "Delivered file " << src_path << endl;
+  for (;;) {
+    auto ret = poller.poll(-1);
+    if (ret.result != Poller::Result::Type::Success) {
+      return ret.exit_status;
+    }
+  }
 
   return EXIT_SUCCESS;
 }
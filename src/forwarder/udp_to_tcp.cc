@@ -1,16 +1,36 @@
 #include <iostream>
 #include <string>
 #include <cstdint>
-#include <deque>
 
 #include "strict_conversions.hh"
 #include "socket.hh"
 #include "poller.hh"
+#include "timerfd.hh"
+#include "datagram_ring.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
-static const int MAX_BUFFER_BYTES = 32 * 1000 * 1000;  /* 32 MB */
+/* memory to buffer datagrams while the TCP client falls behind; the oldest
+ * datagrams are dropped once it is full */
+static const size_t MAX_BUFFER_BYTES = 32 * 1024 * 1024;  /* 32 MB */
+
+/* print the counters this often */
+static const int STATS_INTERVAL_MS = 60000;
+
+void print_stats(const DatagramRing & ring)
+{
+  const auto & stats = ring.stats();
+
+  cerr << "Received " << stats.received_datagrams << " datagrams ("
+       << stats.received_bytes << " bytes) in " << stats.recv_calls
+       << " recvmmsg calls, sent " << stats.sent_bytes << " bytes in "
+       << stats.send_calls << " writev calls, dropped "
+       << stats.dropped_datagrams << " datagrams (" << stats.dropped_bytes
+       << " bytes) and " << stats.truncated_datagrams
+       << " truncated; queued " << ring.queued_bytes() << " bytes (max "
+       << stats.max_queued_bytes << ")" << endl;
+}
 
 void print_usage(const string & program_name)
 {
@@ -55,71 +75,48 @@ int main(int argc, char * argv[])
        << client.peer_address().str() << endl;
 
   /* start forwarding */
-  deque<string> buffer;
-  uint64_t buffer_size = 0;
-  size_t buffer_offset = 0;
+  DatagramRing ring(MAX_BUFFER_BYTES);
+  bool warned_drop = false;
 
   Poller poller;
 
-  /* read datagrams from UDP socket into the buffer */
+  /* read datagrams from UDP socket into the ring, in batches */
   poller.add_action(Poller::Action(udp_socket, Direction::In,
-    [&udp_socket, &buffer, &buffer_size]() {
-      string data = udp_socket.read();
+    [&udp_socket, &ring, &warned_drop]() {
+      ring.receive(udp_socket);
 
-      if (data.empty()) {
-        cerr << "Received empty data from UDP socket" << endl;
-        return ResultType::Exit;
-      }
-
-      buffer_size += data.size();
-      if (buffer_size >= MAX_BUFFER_BYTES) {
-        cerr << "Buffer size grows too big: " << buffer_size << endl;
-        return ResultType::Exit;
+      /* the counters are printed periodically */
+      if (not warned_drop and ring.stats().dropped_datagrams > 0) {
+        cerr << "Warning: buffer is full; dropping the oldest datagrams" << endl;
+        warned_drop = true;
       }
 
-      buffer.emplace_back(move(data));
-
       return ResultType::Continue;
     }
   ));
 
-  /* write datagrams to TCP client socket from the buffer */
+  /* write many datagrams at once to TCP client socket from the ring */
   poller.add_action(Poller::Action(client, Direction::Out,
-    [&client, &buffer, &buffer_size, &buffer_offset]() {
-      while (not buffer.empty()) {
-        const string & data = buffer.front();
-        /* convert to string_view to avoid copy */
-        string_view data_view = data;
-
-        /* set write_all to false because socket might be unable to write all */
-        const auto view_it = client.write(
-            data_view.substr(buffer_offset), false);
-
-        if (view_it != data_view.cend()) {
-          /* update buffer_size */
-          auto new_offset = view_it - data_view.cbegin();
-          buffer_size -= new_offset - buffer_offset;
-
-          /* save the offset of the remaining string */
-          buffer_offset = new_offset;
-          break;
-        } else {
-          /* update buffer_size */
-          buffer_size -= data.size() - buffer_offset;
-
-          /* move onto the next item in the deque */
-          buffer_offset = 0;
-          buffer.pop_front();
-        }
-      }
-
+    [&client, &ring]() {
+      ring.send(client);
       return ResultType::Continue;
     },
-    /* interested only when buffer is not empty */
-    [&buffer]() {
-      return not buffer.empty();
+    /* interested only when the ring is not empty */
+    [&ring]() {
+      return not ring.empty();
+    }
+  ));
+
+  Timerfd stats_timer;
+  poller.add_action(Poller::Action(stats_timer, Direction::In,
+    [&stats_timer, &ring]() {
+      if (stats_timer.expirations() > 0) {
+        print_stats(ring);
+      }
+      return ResultType::Continue;
     }
   ));
+  stats_timer.start(STATS_INTERVAL_MS, STATS_INTERVAL_MS);
 
   /* check if TCP client socket has closed */
   poller.add_action(Poller::Action(client, Direction::In,
@@ -140,6 +137,7 @@ int main(int argc, char * argv[])
   for (;;) {
     auto ret = poller.poll(-1);
     if (ret.result != Poller::Result::Type::Success) {
+      print_stats(ring);
       return ret.exit_status;
     }
   }
@@ -0,0 +1,275 @@
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "strict_conversions.hh"
+#include "socket.hh"
+#include "poller.hh"
+#include "exception.hh"
+#include "datagram_ring.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace PollerShortNames;
+
+static const size_t RING_BYTES = 32 * 1024 * 1024;  /* as in udp_to_tcp */
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options]\n\n"
+  "Send datagrams over loopback UDP as fast as possible (or at a given\n"
+  "rate), forward them to a loopback TCP connection as udp_to_tcp does,\n"
+  "and report the throughput and the system calls per datagram of the\n"
+  "batched ring buffer and of one read and one write per datagram.\n\n"
+  "Options:\n"
+  "--datagrams, -n   number of datagrams to send (default: 1000000)\n"
+  "--size, -s        datagram size in bytes (default: 1316)\n"
+  "--rate, -r        sending rate in Mbps (default: 0, unlimited)"
+  << endl;
+}
+
+struct Measurement
+{
+  uint64_t forwarded_datagrams {0};
+  uint64_t tcp_bytes {0};
+  uint64_t syscalls {0};
+  double elapsed_s {0};
+};
+
+/* send 'num_datagrams' to 'address' in batches with sendmmsg() */
+void send_datagrams(const Address & address, const unsigned int num_datagrams,
+                    const size_t size, const double rate_mbps,
+                    atomic<bool> & done)
+{
+  static constexpr size_t BATCH = 64;
+
+  UDPSocket socket;
+  socket.connect(address);
+
+  vector<char> payload(size, 'x');
+  vector<iovec> iovs(BATCH, {payload.data(), size});
+  vector<mmsghdr> msgs(BATCH);
+  for (size_t i = 0; i < BATCH; i++) {
+    msgs[i] = {};
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  const auto start = steady_clock::now();
+
+  for (unsigned int sent = 0; sent < num_datagrams;) {
+    const unsigned int batch = min<unsigned int>(BATCH, num_datagrams - sent);
+    const int n = CheckSystemCall("sendmmsg",
+        sendmmsg(socket.fd_num(), msgs.data(), batch, 0));
+    sent += n;
+
+    if (rate_mbps > 0) {
+      const auto due = start + duration<double>(sent * size * 8 / rate_mbps / 1e6);
+      this_thread::sleep_until(due);
+    }
+  }
+
+  done = true;
+}
+
+/* count the bytes received on a connection to 'address' until it closes */
+void receive_stream(const Address & address, uint64_t & bytes)
+{
+  TCPSocket socket;
+  socket.connect(address);
+
+  for (;;) {
+    const string data = socket.read();
+    if (data.empty()) {
+      break;
+    }
+    bytes += data.size();
+  }
+}
+
+/* forward with the ring buffer, as udp_to_tcp does */
+void forward_batched(UDPSocket & udp_socket, TCPSocket & client,
+                     const atomic<bool> & sender_done, Measurement & result)
+{
+  DatagramRing ring(RING_BYTES);
+  Poller poller;
+
+  poller.add_action(Poller::Action(udp_socket, Direction::In,
+    [&udp_socket, &ring]() {
+      ring.receive(udp_socket);
+      return ResultType::Continue;
+    }
+  ));
+
+  poller.add_action(Poller::Action(client, Direction::Out,
+    [&client, &ring]() {
+      ring.send(client);
+      return ResultType::Continue;
+    },
+    [&ring]() { return not ring.empty(); }
+  ));
+
+  while (poller.poll(100).result != Poller::Result::Type::Timeout
+         or not sender_done or not ring.empty()) {}
+
+  const auto & stats = ring.stats();
+  result.forwarded_datagrams = stats.received_datagrams - stats.dropped_datagrams;
+  result.syscalls = stats.recv_calls + stats.send_calls;
+}
+
+/* forward one datagram per read and per write (udp_to_tcp before the ring) */
+void forward_legacy(UDPSocket & udp_socket, TCPSocket & client,
+                    const atomic<bool> & sender_done, Measurement & result)
+{
+  deque<string> buffer;
+  size_t buffer_offset = 0;
+  Poller poller;
+
+  poller.add_action(Poller::Action(udp_socket, Direction::In,
+    [&udp_socket, &buffer, &result]() {
+      buffer.emplace_back(udp_socket.read());
+      result.forwarded_datagrams++;
+      result.syscalls++;
+      return ResultType::Continue;
+    }
+  ));
+
+  poller.add_action(Poller::Action(client, Direction::Out,
+    [&client, &buffer, &buffer_offset, &result]() {
+      while (not buffer.empty()) {
+        const string_view data = buffer.front();
+        const auto it = client.write(data.substr(buffer_offset), false);
+        result.syscalls++;
+
+        if (it != data.cend()) {
+          buffer_offset = it - data.cbegin();
+          break;
+        }
+
+        buffer_offset = 0;
+        buffer.pop_front();
+      }
+      return ResultType::Continue;
+    },
+    [&buffer]() { return not buffer.empty(); }
+  ));
+
+  while (poller.poll(100).result != Poller::Result::Type::Timeout
+         or not sender_done or not buffer.empty()) {}
+}
+
+Measurement benchmark(const bool batched, const unsigned int num_datagrams,
+                 const size_t size, const double rate_mbps)
+{
+  TCPSocket listening_socket;
+  listening_socket.bind(Address("127.0.0.1", 0));
+  listening_socket.listen();
+
+  Measurement result;
+  thread receiver(receive_stream, listening_socket.local_address(),
+                  ref(result.tcp_bytes));
+
+  {
+    TCPSocket client = listening_socket.accept();
+    client.set_blocking(false);
+
+    UDPSocket udp_socket;
+    udp_socket.bind(Address("127.0.0.1", 0));
+    udp_socket.set_blocking(false);
+
+    atomic<bool> sender_done {false};
+    const auto start = steady_clock::now();
+    thread sender(send_datagrams, udp_socket.local_address(), num_datagrams,
+                  size, rate_mbps, ref(sender_done));
+
+    if (batched) {
+      forward_batched(udp_socket, client, sender_done, result);
+    } else {
+      forward_legacy(udp_socket, client, sender_done, result);
+    }
+
+    /* the forwarders only stop after 100 ms without any datagram */
+    result.elapsed_s = duration<double>(steady_clock::now() - start).count()
+                       - 0.1;
+    sender.join();
+  } /* closing the connection lets the receiver finish */
+
+  receiver.join();
+
+  return result;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  unsigned int num_datagrams = 1000000;
+  size_t size = 1316;
+  double rate_mbps = 0;
+
+  const option cmd_line_opts[] = {
+    {"datagrams", required_argument, nullptr, 'n'},
+    {"size",      required_argument, nullptr, 's'},
+    {"rate",      required_argument, nullptr, 'r'},
+    { nullptr,    0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:s:r:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'n':
+      num_datagrams = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    case 's':
+      size = strict_atoui(optarg);
+      break;
+    case 'r':
+      rate_mbps = stod(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc or num_datagrams == 0 or size == 0 or
+      size > DatagramRing::SLOT_SIZE) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    cout << fixed << setprecision(2);
+
+    for (const bool batched : {false, true}) {
+      const Measurement r = benchmark(batched, num_datagrams, size, rate_mbps);
+      const uint64_t forwarded = r.tcp_bytes / size;
+
+      cout << (batched ? "recvmmsg/writev ring: " : "read/write per datagram: ")
+           << forwarded << "/" << num_datagrams << " datagrams forwarded, "
+           << r.tcp_bytes * 8 / r.elapsed_s / 1e6 << " Mbps, "
+           << static_cast<double>(r.syscalls) / max<uint64_t>(forwarded, 1)
+           << " syscalls per datagram" << endl;
+    }
+  } catch (const exception & e) {
+    print_exception(argv[0], e);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include <getopt.h>
+#include <malloc.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "ws_client.hh"
+#include "abr_algo.hh"
+#include "strict_conversions.hh"
+#include "exception.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options]\n\n"
+  "Create idle clients (connected but not yet streaming) with each ABR\n"
+  "algorithm, as ws_media_server does on every new connection, and report\n"
+  "the heap memory taken per client.\n\n"
+  "Options:\n"
+  "--connections, -n  number of clients per ABR algorithm (default: 10000)\n"
+  "--abr, -a          comma-separated ABR algorithms\n"
+  "                   (default: linear_bba,mpc,robust_mpc,mpc_search,puffer_raw)"
+  << endl;
+}
+
+/* bytes allocated on the heap and still in use */
+static size_t heap_in_use()
+{
+  const struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+/* return the heap bytes taken by each of 'num_clients' idle clients */
+double benchmark(const string & abr_name, const unsigned int num_clients)
+{
+  const YAML::Node abr_config;
+
+  const size_t heap_before = heap_in_use();
+
+  map<uint64_t, WebSocketClient> clients;
+  for (unsigned int i = 0; i < num_clients; i++) {
+    clients.emplace(piecewise_construct, forward_as_tuple(i),
+                    forward_as_tuple(i, abr_name, abr_config));
+  }
+
+  const size_t heap_after = heap_in_use();
+
+  return static_cast<double>(heap_after - heap_before) / num_clients;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  unsigned int num_clients = 10000;
+  string abr_list = "linear_bba,mpc,robust_mpc,mpc_search,puffer_raw";
+
+  const option cmd_line_opts[] = {
+    {"connections", required_argument, nullptr, 'n'},
+    {"abr",         required_argument, nullptr, 'a'},
+    { nullptr,      0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:a:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'n':
+      num_clients = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    case 'a':
+      abr_list = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc or num_clients == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  vector<string> abr_names;
+  istringstream abr_stream(abr_list);
+  for (string abr_name; getline(abr_stream, abr_name, ',');) {
+    abr_names.emplace_back(abr_name);
+  }
+
+  try {
+    cout << "sizeof(WebSocketClient): " << sizeof(WebSocketClient)
+         << " bytes" << endl;
+    cout << fixed << setprecision(0);
+
+    for (const auto & abr_name : abr_names) {
+      /* the first client of a thread also brings up the thread's shared ABR
+       * workspace, which is not on the heap and is not counted */
+      const double bytes = benchmark(abr_name, num_clients);
+
+      cout << setw(12) << left << abr_name << right
+           << setw(10) << bytes << " bytes per idle client ("
+           << setw(8) << bytes * num_clients / 1024 / 1024 << " MB for "
+           << num_clients << " clients)" << endl;
+    }
+  } catch (const exception & e) {
+    print_exception(argv[0], e);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include <getopt.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "session_auth.hh"
+#include "poller.hh"
+#include "timerfd.hh"
+#include "strict_conversions.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace PollerShortNames;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] <connection string>\n\n"
+  "Authenticate a burst of simulated clients against the database (or a\n"
+  "stand-in for it) and report how long the event loop was ever blocked.\n"
+  "Session keys starting with \"valid\" are expected to be valid.\n\n"
+  "Options:\n"
+  "--requests, -n     number of authentications (default: 10000)\n"
+  "--keys, -k         number of distinct session keys (default: 1000)\n"
+  "--burst, -b        authentications started every millisecond (default: 10)\n"
+  "--ttl, -t          cache TTL in ms (default: 60000)\n"
+  "--max-stall, -s    fail if the event loop stalled for longer, in ms"
+  << endl;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  unsigned int num_requests = 10000;
+  unsigned int num_keys = 1000;
+  unsigned int burst = 10;
+  uint64_t ttl_ms = 60000;
+  unsigned int max_stall_ms = 0;
+
+  const option cmd_line_opts[] = {
+    {"requests",  required_argument, nullptr, 'n'},
+    {"keys",      required_argument, nullptr, 'k'},
+    {"burst",     required_argument, nullptr, 'b'},
+    {"ttl",       required_argument, nullptr, 't'},
+    {"max-stall", required_argument, nullptr, 's'},
+    { nullptr,    0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:k:b:t:s:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'n':
+      num_requests = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    case 'k':
+      num_keys = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    case 'b':
+      burst = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    case 't':
+      ttl_ms = strict_atoui(optarg);
+      break;
+    case 's':
+      max_stall_ms = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 1 or num_requests == 0 or num_keys == 0
+      or burst == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Poller poller;
+  SessionAuth auth(poller, argv[optind], ttl_ms);
+
+  unsigned int started = 0, completed = 0, wrong = 0;
+  vector<double> latencies_ms;
+  latencies_ms.reserve(num_requests);
+
+  /* start 'burst' authentications every millisecond, and measure how late
+   * the timer fires to catch anything blocking the event loop */
+  Timerfd timer;
+  auto last_tick = steady_clock::now();
+  double max_stall_ms_seen = 0;
+
+  poller.add_action(Poller::Action(timer, Direction::In,
+    [&]() {
+      timer.expirations();
+
+      const auto now = steady_clock::now();
+      max_stall_ms_seen = max(max_stall_ms_seen,
+          duration<double, milli>(now - last_tick).count());
+      last_tick = now;
+
+      for (unsigned int i = 0; i < burst and started < num_requests; i++) {
+        const unsigned int key_id = started++ % num_keys;
+        const bool valid = key_id % 2 == 0;
+        const string session_key = (valid ? "valid-" : "invalid-")
+                                   + to_string(key_id);
+
+        auth.authenticate(session_key,
+          [&, valid, begin = steady_clock::now()](const bool authenticated) {
+            latencies_ms.emplace_back(duration<double, milli>(
+                steady_clock::now() - begin).count());
+
+            if (authenticated != valid) {
+              wrong++;
+            }
+            completed++;
+          }
+        );
+      }
+
+      if (completed == num_requests) {
+        return ResultType::Exit;
+      }
+
+      return ResultType::Continue;
+    }
+  ));
+
+  const auto begin = steady_clock::now();
+  timer.start(1, 1);
+
+  for (;;) {
+    const auto ret = poller.poll(-1);
+    if (ret.result == Poller::Result::Type::Exit) {
+      break;
+    }
+  }
+
+  const double elapsed_ms = duration<double, milli>(
+      steady_clock::now() - begin).count();
+
+  sort(latencies_ms.begin(), latencies_ms.end());
+  const auto percentile = [&latencies_ms](const double p) {
+    return latencies_ms.at(static_cast<size_t>(p * (latencies_ms.size() - 1)));
+  };
+
+  cout << fixed << setprecision(1)
+       << "requests: " << completed << " in " << elapsed_ms << " ms\n"
+       << "cache hits: " << auth.cache_hits()
+       << ", misses: " << auth.cache_misses()
+       << ", queries: " << auth.queries() << "\n"
+       << "latency (ms): median " << percentile(0.5)
+       << ", p99 " << percentile(0.99)
+       << ", max " << latencies_ms.back() << "\n"
+       << "max event loop stall: " << max_stall_ms_seen << " ms" << endl;
+
+  if (wrong > 0) {
+    cerr << wrong << " authentications returned a wrong result" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if (max_stall_ms > 0 and max_stall_ms_seen > max_stall_ms) {
+    cerr << "event loop stalled for longer than " << max_stall_ms << " ms"
+         << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -19,8 +19,14 @@ static const unsigned int DEFAULT_PRESENT_DELAY_CHUNK = 15;  // chunks
 static const unsigned int PRESENT_CLEAN_DIFF = 150;  // chunks
 static const unsigned int MAX_UNCHANGED_LIVE_EDGE_MS = 10000;  // ms
 
+/* reclaim the evicted chunks early if reclaim_obsolete() is not called */
+static const size_t MAX_OBSOLETE_MAPPINGS = 1024;
+
 Channel::Channel(const string & name, const fs::path & media_dir,
-                 const YAML::Node & config, Inotify & inotify)
+                 const YAML::Node & config, Inotify & inotify,
+                 const shared_ptr<MmapReclaimer> & reclaimer,
+                 const shared_ptr<ChunkCache> & cache)
+  : reclaimer_(reclaimer), cache_(cache)
 {
   live_ = config["live"].as<bool>();
   name_ = name;
@@ -89,6 +95,40 @@ Channel::Channel(const string & name, const fs::path & media_dir,
   }
 }
 
+Channel::~Channel()
+{
+  /* a retired channel may hold thousands of chunks */
+  for (const auto & [vf, data_size] : vinit_) {
+    obsolete_.emplace_back(get<0>(data_size));
+  }
+  for (const auto & [af, data_size] : ainit_) {
+    obsolete_.emplace_back(get<0>(data_size));
+  }
+  for (const auto & [ts, data] : vdata_) {
+    for (const auto & [vf, data_size] : data) {
+      obsolete_.emplace_back(get<0>(data_size));
+      if (cache_) {
+        cache_->erase(vpath(vf, ts));
+      }
+    }
+  }
+  for (const auto & [ts, data] : adata_) {
+    for (const auto & [af, data_size] : data) {
+      obsolete_.emplace_back(get<0>(data_size));
+      if (cache_) {
+        cache_->erase(apath(af, ts));
+      }
+    }
+  }
+
+  vinit_.clear();
+  ainit_.clear();
+  vdata_.clear();
+  adata_.clear();
+
+  reclaim_obsolete();
+}
+
 optional<uint64_t> Channel::init_vts() const
 {
   if (live_) {
@@ -198,7 +238,14 @@ mmap_t Channel::vinit(const VideoFormat & format) const
 
 mmap_t Channel::vdata(const VideoFormat & format, const uint64_t ts) const
 {
-  return vdata_.at(ts).at(format);
+  const mmap_t & data = vdata_.at(ts).at(format);
+
+  /* live chunks have been cached (if they fit) as they were moved in */
+  if (cache_ and not live_) {
+    return cached(vpath(format, ts), data);
+  }
+
+  return data;
 }
 
 const map<VideoFormat, mmap_t> & Channel::vdata(const uint64_t ts) const
@@ -223,7 +270,14 @@ mmap_t Channel::ainit(const AudioFormat & format) const
 
 mmap_t Channel::adata(const AudioFormat & format, const uint64_t ts) const
 {
-  return adata_.at(ts).at(format);
+  const mmap_t & data = adata_.at(ts).at(format);
+
+  /* live chunks have been cached (if they fit) as they were moved in */
+  if (cache_ and not live_) {
+    return cached(apath(format, ts), data);
+  }
+
+  return data;
 }
 
 const map<AudioFormat, mmap_t> & Channel::adata(const uint64_t ts) const
@@ -246,6 +300,43 @@ mmap_t mmap_file(const string & filepath)
   }
 }
 
+fs::path Channel::vpath(const VideoFormat & format, const uint64_t ts) const
+{
+  return input_path_ / "ready" / format.to_string() / (to_string(ts) + ".m4s");
+}
+
+fs::path Channel::apath(const AudioFormat & format, const uint64_t ts) const
+{
+  return input_path_ / "ready" / format.to_string() / (to_string(ts) + ".chk");
+}
+
+mmap_t Channel::load_chunk(const fs::path & filepath)
+{
+  /* copy live chunks before the first client asks for them */
+  if (cache_ and live_) {
+    try {
+      const auto data = cache_->load(filepath, true /* pinned */);
+      if (data) {
+        return *data;
+      }
+    } catch (const exception & e) {
+      print_exception("load_chunk", e);
+    }
+  }
+
+  return mmap_file(filepath);
+}
+
+mmap_t Channel::cached(const fs::path & filepath, const mmap_t & data) const
+{
+  auto copy = cache_->get(filepath);
+  if (not copy) {
+    copy = cache_->copy(filepath, data, false /* evicted if least used */);
+  }
+
+  return copy ? *copy : data;
+}
+
 void Channel::munmap_video(const uint64_t ts)
 {
   uint64_t clean_window_ts = (clean_window_chunk_.value() - 1) * vduration_;
@@ -258,6 +349,14 @@ void Channel::munmap_video(const uint64_t ts)
     if (ts <= obsolete) {
       cleaned_ts = ts;
       vssim_.erase(ts);
+
+      /* unmapped later, in a batch */
+      for (const auto & [vf, data_size] : it->second) {
+        obsolete_.emplace_back(get<0>(data_size));
+        if (cache_) {
+          cache_->erase(vpath(vf, ts));
+        }
+      }
       it = vdata_.erase(it);
     } else {
       break;
@@ -269,6 +368,10 @@ void Channel::munmap_video(const uint64_t ts)
   if (not vclean_frontier_ or *vclean_frontier_ < *cleaned_ts) {
     vclean_frontier_ = *cleaned_ts;
   }
+
+  if (obsolete_.size() >= MAX_OBSOLETE_MAPPINGS) {
+    reclaim_obsolete();
+  }
 }
 
 void Channel::munmap_audio(const uint64_t ts)
@@ -282,6 +385,14 @@ void Channel::munmap_audio(const uint64_t ts)
     uint64_t ts = it->first;
     if (ts <= obsolete) {
       cleaned_ts = ts;
+
+      /* unmapped later, in a batch */
+      for (const auto & [af, data_size] : it->second) {
+        obsolete_.emplace_back(get<0>(data_size));
+        if (cache_) {
+          cache_->erase(apath(af, ts));
+        }
+      }
       it = adata_.erase(it);
     } else {
       break;
@@ -293,6 +404,10 @@ void Channel::munmap_audio(const uint64_t ts)
   if (not aclean_frontier_ or *aclean_frontier_ < *cleaned_ts) {
     aclean_frontier_ = *cleaned_ts;
   }
+
+  if (obsolete_.size() >= MAX_OBSOLETE_MAPPINGS) {
+    reclaim_obsolete();
+  }
 }
 
 optional<uint64_t> Channel::live_edge() const
@@ -341,6 +456,34 @@ std::optional<uint64_t> Channel::aclean_frontier() const
   return aclean_frontier_;
 }
 
+void Channel::unwatch(Inotify & inotify)
+{
+  for (const int wd : watches_) {
+    try {
+      inotify.rm_watch(wd);
+    } catch (const exception & e) {
+      /* the kernel drops the watch by itself if the directory is removed */
+      cerr << "Channel " << name_ << ": " << e.what() << endl;
+    }
+  }
+
+  watches_.clear();
+}
+
+void Channel::reclaim_obsolete()
+{
+  if (obsolete_.empty()) {
+    return;
+  }
+
+  /* clients still sending a chunk keep it mapped until they are done */
+  if (reclaimer_) {
+    reclaimer_->retire(move(obsolete_));
+  }
+
+  obsolete_.clear();
+}
+
 void Channel::update_vready_frontier(const uint64_t vts)
 {
   if (not vready(vts)) return;
@@ -381,13 +524,13 @@ void Channel::update_aready_frontier(const uint64_t ats)
 
 void Channel::do_mmap_video(const fs::path & filepath, const VideoFormat & vf)
 {
-  const mmap_t & data_size = mmap_file(filepath);
   string filestem = filepath.stem();
 
   if (filestem == "init") {
-    vinit_.emplace(vf, data_size);
+    vinit_.emplace(vf, mmap_file(filepath));
   } else {
     if (filepath.extension() == ".m4s") {
+      const mmap_t & data_size = load_chunk(filepath);
       uint64_t ts = stoull(filestem);
       vdata_[ts][vf] = data_size;
 
@@ -408,7 +551,7 @@ void Channel::mmap_video_files(Inotify & inotify)
 
     /* watch new files only on live */
     if (live_) {
-      inotify.add_watch(video_dir, IN_MOVED_TO,
+      watches_.emplace_back(inotify.add_watch(video_dir, IN_MOVED_TO,
         [this, &vf, video_dir](const inotify_event & event,
                                const string & path) {
           /* only interested in regular files that are moved into the dir */
@@ -422,7 +565,7 @@ void Channel::mmap_video_files(Inotify & inotify)
           fs::path filepath = fs::path(path) / event.name;
           do_mmap_video(filepath, vf);
         }
-      );
+      ));
     }
 
     /* process existing files */
@@ -434,13 +577,13 @@ void Channel::mmap_video_files(Inotify & inotify)
 
 void Channel::do_mmap_audio(const fs::path & filepath, const AudioFormat & af)
 {
-  const mmap_t & data_size = mmap_file(filepath);
   string filestem = filepath.stem();
 
   if (filestem == "init") {
-    ainit_.emplace(af, data_size);
+    ainit_.emplace(af, mmap_file(filepath));
   } else {
     if (filepath.extension() == ".chk") {
+      const mmap_t & data_size = load_chunk(filepath);
       uint64_t ts = stoull(filestem);
       adata_[ts][af] = data_size;
 
@@ -461,7 +604,7 @@ void Channel::mmap_audio_files(Inotify & inotify)
 
     /* watch new files only on live */
     if (live_) {
-      inotify.add_watch(audio_dir, IN_MOVED_TO,
+      watches_.emplace_back(inotify.add_watch(audio_dir, IN_MOVED_TO,
         [this, &af, audio_dir](const inotify_event & event,
                                const string & path) {
           /* only interested in regular files that are moved into the dir */
@@ -475,7 +618,7 @@ void Channel::mmap_audio_files(Inotify & inotify)
           fs::path filepath = fs::path(path) / event.name;
           do_mmap_audio(filepath, af);
         }
-      );
+      ));
     }
 
     /* process existing files */
@@ -508,7 +651,7 @@ void Channel::load_ssim_files(Inotify & inotify)
 
     /* watch new files only on live */
     if (live_) {
-      inotify.add_watch(ssim_dir, IN_MOVED_TO,
+      watches_.emplace_back(inotify.add_watch(ssim_dir, IN_MOVED_TO,
         [this, &vf, ssim_dir](const inotify_event & event,
                               const string & path) {
           /* only interested in regular files that are moved into the dir */
@@ -522,7 +665,7 @@ void Channel::load_ssim_files(Inotify & inotify)
           fs::path filepath = fs::path(path) / event.name;
           do_read_ssim(filepath, vf);
         }
-      );
+      ));
     }
 
     /* process existing files */
@@ -12,14 +12,25 @@
 #include "mmap.hh"
 #include "media_formats.hh"
 #include "yaml.hh"
-
-using mmap_t = std::tuple<std::shared_ptr<char>, size_t>;
+#include "chunk_cache.hh"
 
 class Channel
 {
 public:
+  /* evicted chunks are unmapped on 'reclaimer' if given, or else inline;
+   * chunks are served from 'cache' if given (and if they fit), or else
+   * mapped from their files */
   Channel(const std::string & name, const fs::path & media_dir,
-          const YAML::Node & config, Inotify & inotify);
+          const YAML::Node & config, Inotify & inotify,
+          const std::shared_ptr<MmapReclaimer> & reclaimer = nullptr,
+          const std::shared_ptr<ChunkCache> & cache = nullptr);
+
+  /* hands every mapping over to the reclaimer */
+  ~Channel();
+
+  /* forbid copying or assigning */
+  Channel(const Channel & other) = delete;
+  const Channel & operator=(const Channel & other) = delete;
 
   bool live() const { return live_; }
   std::string name() const { return name_; }
@@ -71,6 +82,13 @@ public:
   std::optional<uint64_t> vclean_frontier() const;
   std::optional<uint64_t> aclean_frontier() const;
 
+  /* stop watching for new media files, before the channel is retired */
+  void unwatch(Inotify & inotify);
+
+  /* call this function periodically (e.g., every second); unmap the chunks
+   * evicted since the last call in a batch */
+  void reclaim_obsolete();
+
 private:
   bool live_ {false};
   std::string name_ {};
@@ -109,6 +127,17 @@ private:
   std::optional<uint64_t> init_vts_ {};
   bool repeat_ {};
 
+  /* inotify watch descriptors of the media directories */
+  std::vector<int> watches_ {};
+
+  /* mappings of the chunks evicted since the last reclaim_obsolete() */
+  std::shared_ptr<MmapReclaimer> reclaimer_ {};
+  std::vector<std::shared_ptr<void>> obsolete_ {};
+
+  /* copies of the live chunks as they are moved in, or of the pre-recorded
+   * chunks most recently served */
+  std::shared_ptr<ChunkCache> cache_ {};
+
   bool vready(const uint64_t ts) const;
   bool aready(const uint64_t ts) const;
 
@@ -118,6 +147,15 @@ private:
   bool is_valid_vts(const uint64_t ts) const { return ts % vduration_ == 0; }
   bool is_valid_ats(const uint64_t ts) const { return ts % aduration_ == 0; }
 
+  fs::path vpath(const VideoFormat & format, const uint64_t ts) const;
+  fs::path apath(const AudioFormat & format, const uint64_t ts) const;
+
+  /* a new media chunk, copied into the cache if live */
+  mmap_t load_chunk(const fs::path & filepath);
+
+  /* the cached copy of a pre-recorded chunk mapped as 'data' */
+  mmap_t cached(const fs::path & filepath, const mmap_t & data) const;
+
   void do_mmap_video(const fs::path & filepath, const VideoFormat & vf);
   void munmap_video(const uint64_t ts);
   void mmap_video_files(Inotify & inotify);
@@ -0,0 +1,287 @@
+#include "chunk_cache.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const size_t PAGE_SIZE = 4096;
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/* chunks in a slab start on a cache line */
+static const size_t SLAB_ALIGNMENT = 64;
+
+ChunkCache::ChunkCache(const uint64_t budget_bytes, const bool huge_pages,
+                       const shared_ptr<MmapReclaimer> & reclaimer)
+  : budget_bytes_(budget_bytes), huge_pages_(huge_pages), reclaimer_(reclaimer)
+{
+  if (budget_bytes_ == 0) {
+    throw runtime_error("ChunkCache: budget must be positive");
+  }
+}
+
+optional<mmap_t> ChunkCache::get(const string & filepath)
+{
+  auto it = entries_.find(filepath);
+  if (it == entries_.end()) {
+    stats_.misses++;
+    return nullopt;
+  }
+
+  stats_.hits++;
+
+  Entry & entry = it->second;
+  if (not entry.pinned) {
+    lru_.splice(lru_.begin(), lru_, entry.lru_it);
+  }
+
+  return entry.data;
+}
+
+optional<mmap_t> ChunkCache::load(const string & filepath, const bool pinned)
+{
+  FileDescriptor fd(CheckSystemCall("open (" + filepath + ")",
+                    open(filepath.c_str(), O_RDONLY)));
+  const size_t size = fd.filesize();
+
+  return insert(filepath, size, pinned,
+    [&fd, &filepath, size](char * dst) {
+      for (size_t offset = 0; offset < size;) {
+        const ssize_t n = CheckSystemCall("pread (" + filepath + ")",
+            pread(fd.fd_num(), dst + offset, size - offset, offset));
+        if (n == 0) {
+          throw runtime_error(filepath + " was truncated");
+        }
+        offset += n;
+      }
+    }
+  );
+}
+
+optional<mmap_t> ChunkCache::copy(const string & filepath, const mmap_t & data,
+                                  const bool pinned)
+{
+  const auto & [src, size] = data;
+  if (not src) {
+    return nullopt;
+  }
+
+  return insert(filepath, size, pinned,
+    [&src = src, size = size](char * dst) {
+      memcpy(dst, src.get(), size);
+    }
+  );
+}
+
+void ChunkCache::erase(const string & filepath)
+{
+  auto it = entries_.find(filepath);
+  if (it != entries_.end()) {
+    remove(it);
+  }
+}
+
+ChunkCache::Stats ChunkCache::reset_stats()
+{
+  Stats stats = stats_;
+  stats_ = {};
+  return stats;
+}
+
+size_t ChunkCache::allocation_length(const size_t size) const
+{
+  const size_t unit = huge_pages_ ? HUGE_PAGE_SIZE : PAGE_SIZE;
+  return (size + unit - 1) / unit * unit;
+}
+
+bool ChunkCache::in_slab(const size_t size) const
+{
+  /* a huge page of its own would be mostly wasted */
+  return huge_pages_ and size < HUGE_PAGE_SIZE;
+}
+
+char * ChunkCache::slab_space(const size_t size, const bool pinned)
+{
+  shared_ptr<Slab> & slab = open_slabs_[pinned];
+
+  if (slab) {
+    const size_t offset = (slab->used + SLAB_ALIGNMENT - 1)
+                          / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+    if (offset + size <= HUGE_PAGE_SIZE) {
+      slab->used = offset + size;
+      return slab->data.get() + offset;
+    }
+
+    close_slab(slab);
+  }
+
+  if (not make_room(HUGE_PAGE_SIZE)) {
+    return nullptr;
+  }
+
+  slab = make_shared<Slab>(Slab {
+      static_pointer_cast<char>(allocate(HUGE_PAGE_SIZE)), size, 0});
+  cached_bytes_ += HUGE_PAGE_SIZE;
+
+  return slab->data.get();
+}
+
+void ChunkCache::close_slab(shared_ptr<Slab> & slab)
+{
+  /* served read-only from now on (huge pages are protected as a whole) */
+  CheckSystemCall("mprotect", mprotect(slab->data.get(), HUGE_PAGE_SIZE,
+                                       PROT_READ));
+
+  if (slab->live == 0) {
+    release_slab(*slab);
+  }
+
+  slab.reset();
+}
+
+void ChunkCache::release_slab(Slab & slab)
+{
+  cached_bytes_ -= HUGE_PAGE_SIZE;
+  retire(move(slab.data));
+}
+
+void ChunkCache::retire(shared_ptr<char> && data)
+{
+  if (reclaimer_) {
+    vector<shared_ptr<void>> mappings;
+    mappings.emplace_back(move(data));
+    reclaimer_->retire(move(mappings));
+  }
+}
+
+bool ChunkCache::make_room(const size_t length)
+{
+  if (length > budget_bytes_) {
+    return false;
+  }
+
+  while (cached_bytes_ + length > budget_bytes_) {
+    if (lru_.empty()) {
+      /* the rest is pinned */
+      return false;
+    }
+
+    remove(entries_.find(lru_.back()));
+    stats_.evicted++;
+  }
+
+  return true;
+}
+
+void ChunkCache::remove(unordered_map<string, Entry>::iterator it)
+{
+  Entry & entry = it->second;
+
+  if (not entry.pinned) {
+    lru_.erase(entry.lru_it);
+  }
+
+  if (entry.slab) {
+    if (--entry.slab->live == 0) {
+      /* an empty slab is not filled any further */
+      if (entry.slab == open_slabs_[entry.pinned]) {
+        open_slabs_[entry.pinned].reset();
+      }
+      release_slab(*entry.slab);
+    }
+  } else {
+    cached_bytes_ -= entry.length;
+  }
+
+  retire(move(std::get<0>(entry.data)));
+  entries_.erase(it);
+}
+
+shared_ptr<void> ChunkCache::allocate(const size_t length)
+{
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  if (not huge_pages_) {
+    return mmap_shared(nullptr, length, PROT_READ | PROT_WRITE,
+                       flags | MAP_POPULATE, -1, 0);
+  }
+
+  /* huge pages reserved in /proc/sys/vm/nr_hugepages */
+  if (not hugetlb_failed_) {
+    try {
+      return mmap_shared(nullptr, length, PROT_READ | PROT_WRITE,
+                         flags | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    } catch (const exception &) {
+      hugetlb_failed_ = true;
+      cerr << "ChunkCache: no huge pages reserved; using transparent "
+              "huge pages instead" << endl;
+    }
+  }
+
+  /* transparent huge pages, faulted in as the chunk is written */
+  auto data = mmap_shared(nullptr, length, PROT_READ | PROT_WRITE, flags,
+                          -1, 0);
+  madvise(data.get(), length, MADV_HUGEPAGE);  /* best effort */
+  return data;
+}
+
+template<typename Fill>
+optional<mmap_t> ChunkCache::insert(const string & filepath, const size_t size,
+                                    const bool pinned, Fill && fill)
+{
+  if (size == 0) {
+    return nullopt;
+  }
+
+  /* replace a stale copy, e.g., of a file moved in again */
+  erase(filepath);
+
+  Entry entry {{nullptr, size}, 0, nullptr, pinned, lru_.end()};
+  shared_ptr<char> data;
+
+  if (in_slab(size)) {
+    char * dst = slab_space(size, pinned);
+    if (dst == nullptr) {
+      stats_.rejected++;
+      return nullopt;
+    }
+
+    entry.slab = open_slabs_[pinned];
+    fill(dst);
+    entry.slab->live++;
+
+    /* shares the reference count of the slab */
+    data = shared_ptr<char>(entry.slab->data, dst);
+  } else {
+    entry.length = allocation_length(size);
+    if (not make_room(entry.length)) {
+      stats_.rejected++;
+      return nullopt;
+    }
+
+    data = static_pointer_cast<char>(allocate(entry.length));
+    fill(data.get());
+
+    /* served read-only from now on */
+    CheckSystemCall("mprotect", mprotect(data.get(), entry.length,
+                                         PROT_READ));
+  }
+
+  std::get<0>(entry.data) = data;
+  if (not pinned) {
+    lru_.push_front(filepath);
+    entry.lru_it = lru_.begin();
+  }
+
+  cached_bytes_ += entry.length;
+  entries_.emplace(filepath, move(entry));
+
+  return mmap_t {data, size};
+}
@@ -0,0 +1,127 @@
+#ifndef CHUNK_CACHE_HH
+#define CHUNK_CACHE_HH
+
+#include <cstdint>
+#include <string>
+#include <optional>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <tuple>
+
+#include "mmap.hh"
+
+using mmap_t = std::tuple<std::shared_ptr<char>, size_t>;
+
+/* copies of media chunks in anonymous memory, faulted in (and thus placed on
+ * the NUMA node of the server under the default first-touch policy) when
+ * they are loaded instead of when they are first sent, and optionally backed
+ * by huge pages, in which case chunks smaller than a huge page are packed
+ * into shared 2 MB slabs; the memory held is capped by a budget:
+ *   pinned chunks (live) stay cached until they are erased, and are not
+ *     loaded once the budget is used up
+ *   other chunks (pre-recorded) are evicted least recently used first */
+class ChunkCache
+{
+public:
+  /* evicted chunks are unmapped on 'reclaimer' if given, or else inline */
+  ChunkCache(const uint64_t budget_bytes, const bool huge_pages,
+             const std::shared_ptr<MmapReclaimer> & reclaimer = nullptr);
+
+  /* return the cached copy of 'filepath' and mark it as recently used */
+  std::optional<mmap_t> get(const std::string & filepath);
+
+  /* read 'filepath' into the cache; nullopt if it does not fit */
+  std::optional<mmap_t> load(const std::string & filepath, const bool pinned);
+
+  /* copy 'data' (e.g., mapped from 'filepath') into the cache */
+  std::optional<mmap_t> copy(const std::string & filepath, const mmap_t & data,
+                             const bool pinned);
+
+  /* stop caching 'filepath'; clients still sending it keep their copy */
+  void erase(const std::string & filepath);
+
+  uint64_t budget_bytes() const { return budget_bytes_; }
+  uint64_t cached_bytes() const { return cached_bytes_; }
+  size_t size() const { return entries_.size(); }
+
+  struct Stats {
+    uint64_t hits {0};
+    uint64_t misses {0};
+    uint64_t evicted {0};  /* to make room for others */
+    uint64_t rejected {0};  /* did not fit */
+  };
+
+  /* return the stats since the last call and reset them */
+  Stats reset_stats();
+
+private:
+  /* a huge page holding several chunks, whose pointers to it share its
+   * reference count: it is unmapped once no chunk in it is referenced */
+  struct Slab {
+    std::shared_ptr<char> data;
+    size_t used {0};  /* bytes handed out from the start */
+    size_t live {0};  /* chunks in it that are still cached */
+  };
+
+  struct Entry {
+    mmap_t data;
+    size_t length;  /* of its own allocation; 0 if in a slab */
+    std::shared_ptr<Slab> slab;  /* if in a slab */
+    bool pinned;
+    std::list<std::string>::iterator lru_it;  /* if not pinned */
+  };
+
+  uint64_t budget_bytes_;
+  bool huge_pages_;
+  std::shared_ptr<MmapReclaimer> reclaimer_;
+
+  /* fall back to transparent huge pages once no huge page is reserved */
+  bool hugetlb_failed_ {false};
+
+  /* the slabs being filled, for unpinned and pinned chunks, which are kept
+   * apart since pinned chunks do not expire in LRU order */
+  std::shared_ptr<Slab> open_slabs_[2] {};
+
+  uint64_t cached_bytes_ {0};
+  std::unordered_map<std::string, Entry> entries_ {};
+  std::list<std::string> lru_ {};  /* unpinned chunks, most recent first */
+
+  Stats stats_ {};
+
+  /* size of the allocation for a chunk of 'size' bytes, not in a slab */
+  size_t allocation_length(const size_t size) const;
+
+  /* whether a chunk of 'size' bytes is packed into a slab */
+  bool in_slab(const size_t size) const;
+
+  /* where to put a chunk of 'size' bytes in the open slab; opens a new slab
+   * if needed, and returns nullptr if it does not fit in the budget */
+  char * slab_space(const size_t size, const bool pinned);
+
+  /* stop filling an open slab, and release it if it holds no chunk */
+  void close_slab(std::shared_ptr<Slab> & slab);
+
+  /* give the memory of a slab without cached chunks back to the budget */
+  void release_slab(Slab & slab);
+
+  /* unmap 'data' on the reclaimer if any */
+  void retire(std::shared_ptr<char> && data);
+
+  /* evict unpinned chunks until 'length' more bytes fit in the budget */
+  bool make_room(const size_t length);
+
+  /* stop caching the entry at 'it' */
+  void remove(std::unordered_map<std::string, Entry>::iterator it);
+
+  /* anonymous memory of 'length' bytes, faulted in as far as possible */
+  std::shared_ptr<void> allocate(const size_t length);
+
+  /* allocate populated memory for 'size' bytes, fill it with 'fill' and
+   * cache it for 'filepath' */
+  template<typename Fill>
+  std::optional<mmap_t> insert(const std::string & filepath, const size_t size,
+                               const bool pinned, Fill && fill);
+};
+
+#endif /* CHUNK_CACHE_HH */
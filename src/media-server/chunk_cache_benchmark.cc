@@ -0,0 +1,282 @@
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#include "chunk_cache.hh"
+#include "file_descriptor.hh"
+#include "filesystem.hh"
+#include "strict_conversions.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* a chunk is sent in records of this size (as in TLS) */
+static const size_t RECORD_SIZE = 16 * 1024;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options]\n\n"
+  "Write chunks as the media pipeline does, load them as a Channel does when\n"
+  "they are moved in (mapped from their files, or copied into a ChunkCache),\n"
+  "and send each of them once as to the first client; report the latency of\n"
+  "the first record and of the whole chunk, and the page faults taken.\n\n"
+  "Options:\n"
+  "--dir, -d DIR     where to write the chunks (default: a new one in /tmp)\n"
+  "--chunks, -n N    number of chunks (default: 200)\n"
+  "--size, -s BYTES  size of each chunk (default: 1048576)\n"
+  "--huge-pages, -H  back the cache with huge pages\n"
+  "--cold, -c        evict the chunks from the page cache before loading"
+  << endl;
+}
+
+struct Faults {
+  uint64_t minor {0};
+  uint64_t major {0};
+};
+
+static Faults page_faults()
+{
+  rusage usage;
+  CheckSystemCall("getrusage", getrusage(RUSAGE_SELF, &usage));
+  return {static_cast<uint64_t>(usage.ru_minflt),
+          static_cast<uint64_t>(usage.ru_majflt)};
+}
+
+static double elapsed_us(const steady_clock::time_point & start)
+{
+  return duration<double, micro>(steady_clock::now() - start).count();
+}
+
+struct Measurement {
+  vector<double> load_us {};
+  vector<double> first_record_us {};
+  vector<double> send_us {};
+  Faults load_faults {};
+  Faults send_faults {};
+};
+
+static double mean(const vector<double> & samples)
+{
+  double sum = 0;
+  for (const double sample : samples) {
+    sum += sample;
+  }
+  return samples.empty() ? 0 : sum / samples.size();
+}
+
+static double quantile(vector<double> samples, const double q)
+{
+  if (samples.empty()) {
+    return 0;
+  }
+
+  sort(samples.begin(), samples.end());
+  return samples[min(samples.size() - 1,
+                     static_cast<size_t>(q * samples.size()))];
+}
+
+static void write_chunks(const vector<string> & paths, const size_t size)
+{
+  string data(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<char>(i * 131 + 7);
+  }
+
+  for (const auto & path : paths) {
+    FileDescriptor fd(CheckSystemCall("open (" + path + ")",
+        open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+    fd.write(data);
+    CheckSystemCall("fsync", fsync(fd.fd_num()));
+  }
+}
+
+static void evict_from_page_cache(const vector<string> & paths)
+{
+  for (const auto & path : paths) {
+    FileDescriptor fd(CheckSystemCall("open (" + path + ")",
+                      open(path.c_str(), O_RDONLY)));
+    posix_fadvise(fd.fd_num(), 0, 0, POSIX_FADV_DONTNEED);
+  }
+}
+
+static mmap_t map_chunk(const string & path)
+{
+  FileDescriptor fd(CheckSystemCall("open (" + path + ")",
+                    open(path.c_str(), O_RDONLY)));
+  const size_t size = fd.filesize();
+  shared_ptr<void> data = mmap_shared(nullptr, size, PROT_READ, MAP_PRIVATE,
+                                      fd.fd_num(), 0);
+  return {static_pointer_cast<char>(data), size};
+}
+
+/* load every chunk with 'load', then send each once */
+template<typename Load>
+Measurement benchmark(const vector<string> & paths, const bool cold,
+                      Load && load)
+{
+  Measurement m;
+
+  if (cold) {
+    evict_from_page_cache(paths);
+  }
+
+  vector<mmap_t> chunks;
+  Faults before = page_faults();
+  for (const auto & path : paths) {
+    const auto start = steady_clock::now();
+    chunks.emplace_back(load(path));
+    m.load_us.emplace_back(elapsed_us(start));
+  }
+  Faults after = page_faults();
+  m.load_faults = {after.minor - before.minor, after.major - before.major};
+
+  /* what would be written to the socket */
+  vector<char> record(RECORD_SIZE);
+
+  before = page_faults();
+  for (const auto & [data, size] : chunks) {
+    const auto start = steady_clock::now();
+
+    for (size_t offset = 0; offset < size; offset += RECORD_SIZE) {
+      memcpy(record.data(), data.get() + offset,
+             min(RECORD_SIZE, size - offset));
+
+      if (offset == 0) {
+        m.first_record_us.emplace_back(elapsed_us(start));
+      }
+    }
+
+    m.send_us.emplace_back(elapsed_us(start));
+  }
+  after = page_faults();
+  m.send_faults = {after.minor - before.minor, after.major - before.major};
+
+  return m;
+}
+
+static void print_measurement(const string & name, const Measurement & m,
+                              const size_t num_chunks)
+{
+  cout << fixed << setprecision(1)
+       << setw(6) << name
+       << setw(12) << mean(m.load_us)
+       << setw(12) << mean(m.first_record_us)
+       << setw(12) << quantile(m.first_record_us, 0.99)
+       << setw(12) << mean(m.send_us)
+       << setw(12) << quantile(m.send_us, 0.99)
+       << setw(12) << static_cast<double>(m.load_faults.minor
+                                          + m.load_faults.major) / num_chunks
+       << setw(12) << static_cast<double>(m.send_faults.minor) / num_chunks
+       << setw(12) << static_cast<double>(m.send_faults.major) / num_chunks
+       << endl;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  string dir;
+  size_t num_chunks = 200;
+  size_t chunk_size = 1024 * 1024;
+  bool huge_pages = false;
+  bool cold = false;
+
+  const option cmd_line_opts[] = {
+    {"dir",        required_argument, nullptr, 'd'},
+    {"chunks",     required_argument, nullptr, 'n'},
+    {"size",       required_argument, nullptr, 's'},
+    {"huge-pages", no_argument,       nullptr, 'H'},
+    {"cold",       no_argument,       nullptr, 'c'},
+    { nullptr,     0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "d:n:s:Hc", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'n':
+      num_chunks = strict_atoui(optarg);
+      break;
+    case 's':
+      chunk_size = strict_atoui(optarg);
+      break;
+    case 'H':
+      huge_pages = true;
+      break;
+    case 'c':
+      cold = true;
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc or num_chunks == 0 or chunk_size == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const bool remove_dir = dir.empty();
+  if (remove_dir) {
+    char dir_template[] = "/tmp/chunk_cache_benchmark.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+      throw unix_error("mkdtemp");
+    }
+    dir = dir_template;
+  }
+
+  vector<string> paths;
+  for (size_t i = 0; i < num_chunks; i++) {
+    paths.emplace_back(fs::path(dir) / (to_string(i * 180180) + ".m4s"));
+  }
+  write_chunks(paths, chunk_size);
+
+  cout << num_chunks << " chunks of " << chunk_size << " bytes"
+       << (cold ? ", evicted from the page cache" : ", in the page cache")
+       << "; per chunk:" << endl;
+  cout << setw(6) << "" << setw(12) << "load us" << setw(12) << "1st rec us"
+       << setw(12) << "p99" << setw(12) << "send us" << setw(12) << "p99"
+       << setw(12) << "load flt" << setw(12) << "send minflt"
+       << setw(12) << "send majflt" << endl;
+
+  /* as Channel does without a cache */
+  print_measurement("mmap", benchmark(paths, cold, map_chunk), num_chunks);
+
+  /* as Channel does with a cache large enough for every chunk */
+  ChunkCache cache(2 * num_chunks * (chunk_size + 2 * 1024 * 1024),
+                   huge_pages);
+  print_measurement("cache", benchmark(paths, cold,
+    [&cache](const string & path) {
+      const auto data = cache.load(path, true);
+      if (not data) {
+        throw runtime_error("chunk does not fit in the cache");
+      }
+      return *data;
+    }
+  ), num_chunks);
+
+  if (remove_dir) {
+    fs::remove_all(dir);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -25,6 +25,11 @@ ClientInitMsg::ClientInitMsg(const json & msg)
   if (it != msg.end()) {
     next_ats = it->get<uint64_t>();
   }
+
+  it = msg.find("resumeToken");
+  if (it != msg.end()) {
+    resume_token = it->get<string>();
+  }
 }
 
 ClientInfoMsg::ClientInfoMsg(const json & msg)
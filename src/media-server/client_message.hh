@@ -44,6 +44,9 @@ public:
   /* next timestamps to expect; used to resume connection only */
   std::optional<uint64_t> next_vts {};
   std::optional<uint64_t> next_ats {};
+
+  /* resume token of the previous connection (from its server-init) */
+  std::optional<std::string> resume_token {};
 };
 
 class ClientInfoMsg : public ClientMsg
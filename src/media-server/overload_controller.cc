@@ -0,0 +1,160 @@
+#include "overload_controller.hh"
+
+#include <sys/resource.h>
+#include <chrono>
+#include <algorithm>
+
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+static uint64_t monotonic_us()
+{
+  return chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* user and system CPU time used by this process */
+static uint64_t process_cpu_us()
+{
+  rusage usage;
+  CheckSystemCall("getrusage", getrusage(RUSAGE_SELF, &usage));
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull
+         + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+OverloadController::OverloadController(Poller & poller,
+                                       const YAML::Node & config,
+                                       QueuedBytesCallback && queued_bytes)
+  : queued_bytes_callback_(move(queued_bytes))
+{
+  if (config["max_loop_lag_ms"]) {
+    max_loop_lag_ms_ = config["max_loop_lag_ms"].as<double>();
+  }
+
+  if (config["max_queued_mb"]) {
+    max_queued_bytes_ = config["max_queued_mb"].as<uint64_t>() * 1024 * 1024;
+  }
+
+  if (config["max_cpu_usage"]) {
+    max_cpu_usage_ = config["max_cpu_usage"].as<double>();
+  }
+
+  if (max_loop_lag_ms_ <= 0 or max_queued_bytes_ == 0 or max_cpu_usage_ <= 0) {
+    throw runtime_error("OverloadController: thresholds must be positive");
+  }
+
+  poller.add_action(Poller::Action(timer_, Direction::In,
+    [this]() {
+      handle_tick();
+      return ResultType::Continue;
+    }
+  ), "overload");
+
+  last_tick_us_ = last_sample_us_ = monotonic_us();
+  last_cpu_us_ = process_cpu_us();
+  timer_.start(TICK_MS, TICK_MS);
+}
+
+void OverloadController::set_level_callback(LevelCallback && callback)
+{
+  level_callback_ = move(callback);
+}
+
+uint64_t OverloadController::reset_rejected_inits()
+{
+  const uint64_t ret = rejected_inits_;
+  rejected_inits_ = 0;
+  return ret;
+}
+
+string OverloadController::level_str(const Level level)
+{
+  switch (level) {
+  case Level::Normal: return "normal";
+  case Level::Degraded: return "degraded";
+  case Level::Shedding: return "shedding";
+  default: throw runtime_error("invalid overload level");
+  }
+}
+
+void OverloadController::handle_tick()
+{
+  const uint64_t expirations = timer_.expirations();
+  if (expirations == 0) {
+    return;
+  }
+
+  /* a tick that fires late has waited for the event loop to come around */
+  const uint64_t now = monotonic_us();
+  const double elapsed_ms = (now - last_tick_us_) / 1000.0;
+  last_tick_us_ = now;
+
+  max_tick_lag_ms_ = max(max_tick_lag_ms_, elapsed_ms - TICK_MS);
+
+  ticks_ += expirations;
+  if (ticks_ >= TICKS_PER_SAMPLE) {
+    ticks_ = 0;
+    sample();
+  }
+}
+
+void OverloadController::sample()
+{
+  const uint64_t now = monotonic_us();
+  const uint64_t cpu_us = process_cpu_us();
+
+  loop_lag_ms_ = max_tick_lag_ms_;
+  max_tick_lag_ms_ = 0;
+
+  if (now > last_sample_us_) {
+    cpu_usage_ = static_cast<double>(cpu_us - last_cpu_us_)
+                 / (now - last_sample_us_);
+  }
+  last_cpu_us_ = cpu_us;
+  last_sample_us_ = now;
+
+  queued_bytes_ = queued_bytes_callback_();
+
+  load_ = max({loop_lag_ms_ / max_loop_lag_ms_,
+               cpu_usage_ / max_cpu_usage_,
+               static_cast<double>(queued_bytes_) / max_queued_bytes_});
+
+  Level target = Level::Normal;
+  if (load_ >= SHED_LOAD) {
+    target = Level::Shedding;
+  } else if (load_ >= DEGRADE_LOAD) {
+    target = Level::Degraded;
+  }
+
+  /* step up right away */
+  if (target > level_) {
+    recovery_samples_ = 0;
+    set_level(target);
+    return;
+  }
+
+  /* step down one level at a time once the load has stayed well below */
+  const double entry_load = shedding() ? SHED_LOAD : DEGRADE_LOAD;
+  if (target == level_ or load_ >= entry_load * RECOVERY_FACTOR) {
+    recovery_samples_ = 0;
+    return;
+  }
+
+  if (++recovery_samples_ >= RECOVERY_SAMPLES) {
+    recovery_samples_ = 0;
+    set_level(shedding() ? Level::Degraded : Level::Normal);
+  }
+}
+
+void OverloadController::set_level(const Level level)
+{
+  const Level old_level = level_;
+  level_ = level;
+
+  if (level_callback_) {
+    level_callback_(old_level, level_);
+  }
+}
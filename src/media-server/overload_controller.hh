@@ -0,0 +1,102 @@
+#ifndef OVERLOAD_CONTROLLER_HH
+#define OVERLOAD_CONTROLLER_HH
+
+#include <cstdint>
+#include <string>
+#include <functional>
+
+#include "poller.hh"
+#include "timerfd.hh"
+#include "yaml.hh"
+
+/* watches how overloaded the server is, by how late the event loop runs a
+ * timer, how many bytes are queued for clients and how much CPU is used, and
+ * moves between load levels with hysteresis:
+ *   Normal   -> everything is served as configured
+ *   Degraded -> expensive ABR algorithms are replaced with linear_bba
+ *   Shedding -> degraded, and new client-inits are rejected as Unavailable */
+class OverloadController
+{
+public:
+  enum class Level { Normal, Degraded, Shedding };
+
+  using QueuedBytesCallback = std::function<uint64_t()>;
+  using LevelCallback = std::function<void(const Level old_level,
+                                           const Level new_level)>;
+
+  /* 'config' is the optional "overload" section of the YAML configuration */
+  OverloadController(Poller & poller, const YAML::Node & config,
+                     QueuedBytesCallback && queued_bytes);
+
+  /* called whenever the level changes */
+  void set_level_callback(LevelCallback && callback);
+
+  Level level() const { return level_; }
+  bool degraded() const { return level_ != Level::Normal; }
+  bool shedding() const { return level_ == Level::Shedding; }
+
+  /* a client-init has been rejected */
+  void count_rejected_init() { rejected_inits_++; }
+
+  /* measurements over the last sampling period */
+  double loop_lag_ms() const { return loop_lag_ms_; }
+  double cpu_usage() const { return cpu_usage_; }
+  uint64_t queued_bytes() const { return queued_bytes_; }
+
+  /* the highest of the measurements relative to their thresholds */
+  double load() const { return load_; }
+
+  /* return the number of rejected client-inits and reset it */
+  uint64_t reset_rejected_inits();
+
+  static std::string level_str(const Level level);
+
+private:
+  /* the event loop is expected to run the timer this often */
+  static constexpr unsigned int TICK_MS = 100;
+  static constexpr unsigned int TICKS_PER_SAMPLE = 10;
+
+  /* degrade once the load is this close to the thresholds */
+  static constexpr double DEGRADE_LOAD = 0.75;
+  static constexpr double SHED_LOAD = 1.0;
+
+  /* step down a level only after the load has stayed below the level's
+   * entry point by this factor, for this many consecutive samples */
+  static constexpr double RECOVERY_FACTOR = 0.8;
+  static constexpr unsigned int RECOVERY_SAMPLES = 5;
+
+  /* thresholds */
+  double max_loop_lag_ms_ {100};
+  uint64_t max_queued_bytes_ {1024 * 1024 * 1024};  /* 1 GB */
+  double max_cpu_usage_ {0.9};  /* fraction of a core */
+
+  QueuedBytesCallback queued_bytes_callback_;
+  LevelCallback level_callback_ {};
+
+  Timerfd timer_ {};
+  uint64_t last_tick_us_ {0};
+  unsigned int ticks_ {0};
+
+  /* worst lag of the ticks in the current sampling period */
+  double max_tick_lag_ms_ {0};
+
+  /* CPU time used by the process and wall-clock time at the last sample */
+  uint64_t last_cpu_us_ {0};
+  uint64_t last_sample_us_ {0};
+
+  Level level_ {Level::Normal};
+  unsigned int recovery_samples_ {0};
+
+  double loop_lag_ms_ {0};
+  double cpu_usage_ {0};
+  uint64_t queued_bytes_ {0};
+  double load_ {0};
+
+  uint64_t rejected_inits_ {0};
+
+  void handle_tick();
+  void sample();
+  void set_level(const Level level);
+};
+
+#endif /* OVERLOAD_CONTROLLER_HH */
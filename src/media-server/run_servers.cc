@@ -114,13 +114,7 @@ int main(int argc, char * argv[])
   auto log_reporter = src_path / "monitoring/log_reporter";
   vector<string> log_stems {
     "server_info", "active_streams", "client_buffer", "client_sysinfo",
-    "video_sent", "video_acked"};
-
-  /* Remove ipc directory prior to starting Media Server */
-  string ipc_dir = "pensieve_ipc";
-  if (fs::exists(ipc_dir)) {
-    fs::remove_all(ipc_dir);
-  }
+    "video_sent", "video_acked", "event_loop", "event_loop_callbacks"};
 
   /* run media servers in each experimental group */
   const auto & expt_json = src_path / "scripts" / "expt_json.py";
@@ -27,7 +27,8 @@ ServerInitMsg::ServerInitMsg(const unsigned int init_id,
                              const unsigned int aduration,
                              const uint64_t init_vts,
                              const uint64_t init_ats,
-                             const bool can_resume)
+                             const bool can_resume,
+                             const string & resume_token)
 {
   msg_ = {
     {"type", "server-init"},
@@ -42,6 +43,11 @@ ServerInitMsg::ServerInitMsg(const unsigned int init_id,
     {"initAudioTimestamp", init_ats},
     {"canResume", can_resume}
   };
+
+  /* to resume the session on a later connection, possibly to another server */
+  if (not resume_token.empty()) {
+    msg_["resumeToken"] = resume_token;
+  }
 }
 
 ServerVideoMsg::ServerVideoMsg(const unsigned int init_id,
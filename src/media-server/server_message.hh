@@ -36,7 +36,8 @@ public:
                 const unsigned int aduration,
                 const uint64_t init_vts,
                 const uint64_t init_ats,
-                const bool can_resume);
+                const bool can_resume,
+                const std::string & resume_token = "");
 };
 
 class ServerVideoMsg : public ServerMsg
@@ -0,0 +1,424 @@
+#include "session_auth.hh"
+
+#include <sys/epoll.h>
+#include <iostream>
+#include <set>
+#include <algorithm>
+#include <iterator>
+
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* a single query checks a batch of session keys (as a text array); expiry
+ * dates are returned so that valid keys are not cached past them */
+static const char AUTH_QUERY[] =
+  "SELECT session_key, (EXTRACT(EPOCH FROM expire_date) * 1000)::bigint "
+  "FROM django_session WHERE session_key = ANY($1::varchar[]) "
+  "AND expire_date > now();";
+
+void SessionAuth::PGconnDeleter::operator()(PGconn * conn) const
+{
+  PQfinish(conn);
+}
+
+SessionAuth::SessionAuth(Poller & poller, const string & conn_str,
+                         const uint64_t cache_ttl_ms,
+                         const size_t cache_capacity)
+  : conn_str_(conn_str), cache_ttl_ms_(cache_ttl_ms),
+    cache_capacity_(cache_capacity),
+    epoll_fd_(CheckSystemCall("epoll_create1", epoll_create1(EPOLL_CLOEXEC)))
+{
+  poller.add_action(Poller::Action(epoll_fd_, Direction::In,
+    [this]() {
+      handle_events();
+      return ResultType::Continue;
+    }
+  ), "session_auth");
+
+  poller.add_action(Poller::Action(timer_, Direction::In,
+    [this]() {
+      handle_timer();
+      return ResultType::Continue;
+    }
+  ), "session_auth_timer");
+  timer_.start(TIMER_INTERVAL_MS, TIMER_INTERVAL_MS);
+
+  /* fail early on an invalid connection string */
+  connect();
+  if (state_ == State::Disconnected) {
+    throw runtime_error("SessionAuth: failed to connect to the database");
+  }
+}
+
+void SessionAuth::authenticate(const string & session_key,
+                               Callback && callback)
+{
+  if (lookup_cache(session_key)) {
+    cache_hits_++;
+    callback(true);
+    return;
+  }
+
+  cache_misses_++;
+
+  /* concurrent requests for the same key share a lookup */
+  const uint64_t now = timestamp_ms();
+  waiting_[session_key].push_back({move(callback), now + REQUEST_TIMEOUT_MS});
+
+  if (state_ == State::Disconnected) {
+    /* otherwise the timer reconnects */
+    if (now - last_connect_ms_ >= RECONNECT_INTERVAL_MS) {
+      connect();
+    }
+    return;
+  }
+
+  send_batch();
+}
+
+bool SessionAuth::lookup_cache(const string & session_key)
+{
+  auto it = cache_.find(session_key);
+  if (it == cache_.end()) {
+    return false;
+  }
+
+  if (it->second.first <= timestamp_ms()) {
+    lru_.erase(it->second.second);
+    cache_.erase(it);
+    return false;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second.second);
+  return true;
+}
+
+void SessionAuth::insert_cache(const string & session_key,
+                               const uint64_t expiry_ms)
+{
+  if (cache_capacity_ == 0) {
+    return;
+  }
+
+  auto it = cache_.find(session_key);
+  if (it != cache_.end()) {
+    it->second.first = expiry_ms;
+    lru_.splice(lru_.begin(), lru_, it->second.second);
+    return;
+  }
+
+  if (cache_.size() >= cache_capacity_) {
+    cache_.erase(lru_.back());
+    lru_.pop_back();
+  }
+
+  lru_.push_front(session_key);
+  cache_.emplace(session_key, make_pair(expiry_ms, lru_.begin()));
+}
+
+void SessionAuth::connect()
+{
+  last_connect_ms_ = timestamp_ms();
+  busy_since_ms_ = last_connect_ms_;
+
+  conn_.reset(PQconnectStart(conn_str_.c_str()));
+  if (not conn_) {
+    disconnect("out of memory");
+    return;
+  }
+
+  if (PQstatus(conn_.get()) == CONNECTION_BAD) {
+    disconnect(PQerrorMessage(conn_.get()));
+    return;
+  }
+
+  /* as if PQconnectPoll returned PGRES_POLLING_WRITING */
+  state_ = State::Connecting;
+  watch_socket(true);
+}
+
+void SessionAuth::disconnect(const string & reason)
+{
+  cerr << "SessionAuth: database connection failed: " << reason << endl;
+
+  if (watched_fd_ >= 0) {
+    /* might fail if libpq has already closed the socket */
+    epoll_ctl(epoll_fd_.fd_num(), EPOLL_CTL_DEL, watched_fd_, nullptr);
+    watched_fd_ = -1;
+  }
+
+  conn_.reset();
+  state_ = State::Disconnected;
+
+  /* query the keys again once reconnected */
+  for (auto & [session_key, requests] : in_flight_) {
+    auto & waiting = waiting_[session_key];
+    move(requests.begin(), requests.end(), back_inserter(waiting));
+  }
+  in_flight_.clear();
+}
+
+void SessionAuth::handle_timer()
+{
+  if (timer_.expirations() == 0) {
+    return;
+  }
+
+  const uint64_t now = timestamp_ms();
+
+  if (state_ != State::Disconnected and state_ != State::Idle
+      and now - busy_since_ms_ > QUERY_TIMEOUT_MS) {
+    disconnect("timed out");
+  }
+
+  if (state_ == State::Disconnected and not waiting_.empty()
+      and now - last_connect_ms_ >= RECONNECT_INTERVAL_MS) {
+    connect();
+  }
+
+  vector<Callback> overdue;
+  take_overdue(waiting_, now, overdue);
+  take_overdue(in_flight_, now, overdue);
+
+  /* callbacks might add new requests */
+  for (auto & callback : overdue) {
+    callback(false);
+  }
+}
+
+void SessionAuth::take_overdue(map<string, vector<Request>> & requests,
+                               const uint64_t now, vector<Callback> & overdue)
+{
+  for (auto it = requests.begin(); it != requests.end();) {
+    auto & key_requests = it->second;
+
+    for (auto & request : key_requests) {
+      if (request.deadline_ms <= now) {
+        overdue.emplace_back(move(request.callback));
+      }
+    }
+
+    key_requests.erase(remove_if(key_requests.begin(), key_requests.end(),
+        [now](const Request & request) {
+          return request.deadline_ms <= now;
+        }), key_requests.end());
+
+    if (key_requests.empty()) {
+      it = requests.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+void SessionAuth::handle_events()
+{
+  /* the events of the only fd in the epoll instance are not needed */
+  epoll_event events[1];
+  CheckSystemCall("epoll_wait", epoll_wait(epoll_fd_.fd_num(), events, 1, 0));
+  epoll_fd_.register_read();
+
+  try {
+    if (state_ == State::Connecting) {
+      continue_connect();
+    } else if (state_ != State::Disconnected) {
+      continue_query();
+    }
+  } catch (const exception & e) {
+    disconnect(e.what());
+  }
+}
+
+void SessionAuth::continue_connect()
+{
+  switch (PQconnectPoll(conn_.get())) {
+  case PGRES_POLLING_READING:
+    watch_socket(false);
+    break;
+  case PGRES_POLLING_WRITING:
+    watch_socket(true);
+    break;
+  case PGRES_POLLING_OK:
+    if (PQsetnonblocking(conn_.get(), 1) != 0 or
+        not PQsendPrepare(conn_.get(), "auth", AUTH_QUERY, 1, nullptr)) {
+      disconnect(PQerrorMessage(conn_.get()));
+      return;
+    }
+
+    cerr << "Connected to database: " << PQhost(conn_.get()) << endl;
+    state_ = State::Preparing;
+    flush();
+    break;
+  default:
+    disconnect(PQerrorMessage(conn_.get()));
+    break;
+  }
+}
+
+void SessionAuth::continue_query()
+{
+  if (not PQconsumeInput(conn_.get())) {
+    disconnect(PQerrorMessage(conn_.get()));
+    return;
+  }
+
+  if (want_write_) {
+    flush();
+    return;
+  }
+
+  /* nothing is expected from the server when idle */
+  if (state_ == State::Idle) {
+    return;
+  }
+
+  while (not PQisBusy(conn_.get())) {
+    unique_ptr<PGresult, decltype(&PQclear)> result {
+      PQgetResult(conn_.get()), PQclear};
+
+    if (not result) {
+      /* the command is complete */
+      state_ = State::Idle;
+      send_batch();
+      return;
+    }
+
+    const ExecStatusType status = PQresultStatus(result.get());
+
+    if (state_ == State::Preparing) {
+      if (status != PGRES_COMMAND_OK) {
+        const string error = PQresultErrorMessage(result.get());
+        result.reset();
+        disconnect("failed to prepare statement: " + error);
+        return;
+      }
+    } else if (status == PGRES_TUPLES_OK) {
+      finish_batch(result.get());
+    } else {
+      /* the keys are queried again on a new connection */
+      const string error = PQresultErrorMessage(result.get());
+      result.reset();
+      disconnect("query failed: " + error);
+      return;
+    }
+  }
+}
+
+void SessionAuth::send_batch()
+{
+  if (state_ != State::Idle or waiting_.empty()) {
+    return;
+  }
+
+  /* build a text array of up to MAX_BATCH_SIZE keys */
+  string keys = "{";
+
+  while (not waiting_.empty() and in_flight_.size() < MAX_BATCH_SIZE) {
+    auto node = waiting_.extract(waiting_.begin());
+
+    if (keys.size() > 1) {
+      keys += ',';
+    }
+
+    keys += '"';
+    for (const char c : node.key()) {
+      if (c == '"' or c == '\\') {
+        keys += '\\';
+      }
+      keys += c;
+    }
+    keys += '"';
+
+    in_flight_.insert(move(node));
+  }
+
+  keys += '}';
+
+  const char * const values[] = {keys.c_str()};
+  if (not PQsendQueryPrepared(conn_.get(), "auth", 1, values,
+                              nullptr, nullptr, 0)) {
+    disconnect(PQerrorMessage(conn_.get()));
+    return;
+  }
+
+  queries_++;
+  state_ = State::Querying;
+  busy_since_ms_ = timestamp_ms();
+  flush();
+}
+
+void SessionAuth::flush()
+{
+  const int ret = PQflush(conn_.get());
+  if (ret < 0) {
+    disconnect(PQerrorMessage(conn_.get()));
+    return;
+  }
+
+  /* keep writing until everything is sent (ret == 1), then wait to read */
+  watch_socket(ret == 1);
+}
+
+void SessionAuth::watch_socket(const bool want_write)
+{
+  const int fd = PQsocket(conn_.get());
+  if (fd < 0) {
+    throw runtime_error("SessionAuth: invalid libpq socket");
+  }
+
+  if (watched_fd_ >= 0 and watched_fd_ != fd) {
+    /* might fail if libpq has already closed the old socket */
+    epoll_ctl(epoll_fd_.fd_num(), EPOLL_CTL_DEL, watched_fd_, nullptr);
+  }
+
+  epoll_event event {};
+  event.events = want_write ? EPOLLOUT : EPOLLIN;
+
+  /* while flushing a query, keep reading so the server never blocks on us */
+  if (want_write and state_ != State::Connecting) {
+    event.events |= EPOLLIN;
+  }
+  event.data.fd = fd;
+
+  /* libpq might have replaced the socket with a new one of the same number */
+  if (epoll_ctl(epoll_fd_.fd_num(), EPOLL_CTL_MOD, fd, &event) < 0) {
+    if (errno != ENOENT) {
+      throw unix_error("epoll_ctl");
+    }
+
+    CheckSystemCall("epoll_ctl",
+                    epoll_ctl(epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd, &event));
+  }
+
+  watched_fd_ = fd;
+  want_write_ = want_write;
+}
+
+void SessionAuth::finish_batch(const PGresult * result)
+{
+  const uint64_t now = timestamp_ms();
+  set<string> valid_keys;
+
+  for (int i = 0; i < PQntuples(result); i++) {
+    const string session_key = PQgetvalue(result, i, 0);
+    const uint64_t expire_ms = stoull(PQgetvalue(result, i, 1));
+
+    insert_cache(session_key, min(now + cache_ttl_ms_, expire_ms));
+    valid_keys.emplace(session_key);
+  }
+
+  /* callbacks might add new requests */
+  auto requests = move(in_flight_);
+  in_flight_.clear();
+
+  for (auto & [session_key, key_requests] : requests) {
+    const bool authenticated = valid_keys.count(session_key) > 0;
+
+    for (auto & request : key_requests) {
+      request.callback(authenticated);
+    }
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef SESSION_AUTH_HH
+#define SESSION_AUTH_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <libpq-fe.h>
+
+#include "poller.hh"
+#include "file_descriptor.hh"
+#include "timerfd.hh"
+
+/* checks the session keys of clients against django_session without ever
+ * blocking the event loop: keys are looked up in a cache of recently
+ * authenticated sessions first, and the misses are sent to the database in
+ * batches over a non-blocking libpq connection driven by the poller; while
+ * the database is unreachable, requests wait (across reconnections) until
+ * it answers or their deadline passes */
+class SessionAuth
+{
+public:
+  using Callback = std::function<void(const bool authenticated)>;
+
+  SessionAuth(Poller & poller, const std::string & conn_str,
+              const uint64_t cache_ttl_ms = 60000,
+              const size_t cache_capacity = 100000);
+
+  /* call 'callback' with the result, either right away on a cache hit or
+   * once the database replied (false if it did not within
+   * REQUEST_TIMEOUT_MS); the callback might call authenticate() */
+  void authenticate(const std::string & session_key, Callback && callback);
+
+  /* statistics */
+  uint64_t cache_hits() const { return cache_hits_; }
+  uint64_t cache_misses() const { return cache_misses_; }
+  uint64_t queries() const { return queries_; }
+  size_t pending() const { return waiting_.size() + in_flight_.size(); }
+  size_t cache_size() const { return cache_.size(); }
+
+private:
+  /* keys at most in a query */
+  static constexpr size_t MAX_BATCH_SIZE = 1000;
+
+  /* wait at least this long before reconnecting to the database */
+  static constexpr uint64_t RECONNECT_INTERVAL_MS = 1000;
+
+  /* fail a request that has not been answered for this long */
+  static constexpr uint64_t REQUEST_TIMEOUT_MS = 10000;
+
+  /* reconnect if connecting or a query takes longer than this, e.g., to a
+   * database that stopped answering without closing the connection */
+  static constexpr uint64_t QUERY_TIMEOUT_MS = 5000;
+
+  /* how often the timeouts are checked */
+  static constexpr int TIMER_INTERVAL_MS = 100;
+
+  enum class State { Disconnected, Connecting, Preparing, Idle, Querying };
+
+  struct PGconnDeleter { void operator()(PGconn * conn) const; };
+
+  std::string conn_str_;
+  uint64_t cache_ttl_ms_;
+  size_t cache_capacity_;
+
+  std::unique_ptr<PGconn, PGconnDeleter> conn_ {};
+  State state_ {State::Disconnected};
+  uint64_t last_connect_ms_ {0};
+
+  /* when connecting or the query in flight started */
+  uint64_t busy_since_ms_ {0};
+
+  Timerfd timer_ {};
+
+  /* libpq's socket might change while connecting, so it is watched through
+   * an epoll instance, which is the only fd the poller knows about */
+  FileDescriptor epoll_fd_;
+  int watched_fd_ {-1};
+  bool want_write_ {false};
+
+  struct Request {
+    Callback callback {};
+    uint64_t deadline_ms {0};
+  };
+
+  /* requests for the keys waiting to be sent, and for those being queried */
+  std::map<std::string, std::vector<Request>> waiting_ {};
+  std::map<std::string, std::vector<Request>> in_flight_ {};
+
+  /* valid session keys: key -> (expiry in ms since epoch, position in LRU) */
+  std::list<std::string> lru_ {};  /* most recently used at the front */
+  std::unordered_map<std::string,
+      std::pair<uint64_t, std::list<std::string>::iterator>> cache_ {};
+
+  uint64_t cache_hits_ {0};
+  uint64_t cache_misses_ {0};
+  uint64_t queries_ {0};
+
+  /* return true if 'session_key' is cached and has not expired */
+  bool lookup_cache(const std::string & session_key);
+  void insert_cache(const std::string & session_key, const uint64_t expiry_ms);
+
+  void connect();
+
+  /* close the connection; the requests being queried wait to be sent again
+   * once reconnected */
+  void disconnect(const std::string & reason);
+
+  /* reconnect, time out a stuck connection, and fail the overdue requests */
+  void handle_timer();
+
+  /* advance the state machine once the libpq socket is ready */
+  void handle_events();
+  void continue_connect();
+  void continue_query();
+
+  /* send the waiting keys in a query if the connection is idle */
+  void send_batch();
+
+  /* (re)register libpq's socket with epoll_fd_ for reading or writing */
+  void watch_socket(const bool want_write);
+
+  /* flush the outgoing query and wait for whatever comes next */
+  void flush();
+
+  void finish_batch(const PGresult * result);
+
+  /* move the requests past their deadline out of 'requests' */
+  static void take_overdue(
+      std::map<std::string, std::vector<Request>> & requests,
+      const uint64_t now, std::vector<Callback> & overdue);
+};
+
+#endif /* SESSION_AUTH_HH */
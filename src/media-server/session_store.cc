@@ -0,0 +1,165 @@
+#include "session_store.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+
+#include "file_descriptor.hh"
+#include "exception.hh"
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static json chunk_to_json(const ABRAlgo::Chunk & c)
+{
+  return {
+    {"format", c.format.to_string()},
+    {"ssim", c.ssim},
+    {"size", c.size},
+    {"transTime", c.trans_time},
+    {"cwnd", c.cwnd},
+    {"inFlight", c.in_flight},
+    {"minRtt", c.min_rtt},
+    {"rtt", c.rtt},
+    {"deliveryRate", c.delivery_rate}
+  };
+}
+
+static ABRAlgo::Chunk chunk_from_json(const json & j)
+{
+  return {
+    VideoFormat(j.at("format").get<string>()),
+    j.at("ssim").get<double>(),
+    j.at("size").get<unsigned int>(),
+    j.at("transTime").get<uint64_t>(),
+    j.at("cwnd").get<uint32_t>(),
+    j.at("inFlight").get<uint32_t>(),
+    j.at("minRtt").get<uint32_t>(),
+    j.at("rtt").get<uint32_t>(),
+    j.at("deliveryRate").get<uint64_t>()
+  };
+}
+
+SessionStore::SessionStore(const fs::path & dir, const uint64_t ttl_ms)
+  : dir_(dir), ttl_ms_(ttl_ms)
+{
+  if (ttl_ms_ == 0) {
+    throw runtime_error("SessionStore: TTL must be positive");
+  }
+
+  fs::create_directories(dir_);
+}
+
+string SessionStore::new_token()
+{
+  string token;
+
+  for (size_t i = 0; i < TOKEN_BYTES; i += sizeof(unsigned int)) {
+    const unsigned int r = random_();
+    for (size_t j = 0; j < sizeof(unsigned int) * 2; j++) {
+      token += HEX_DIGITS[(r >> (j * 4)) & 0xF];
+    }
+  }
+
+  return token;
+}
+
+fs::path SessionStore::session_path(const string & token) const
+{
+  /* the token comes from the client and becomes a file name */
+  if (token.size() != TOKEN_BYTES * 2 or
+      token.find_first_not_of(HEX_DIGITS) != string::npos) {
+    throw runtime_error("SessionStore: malformed resume token");
+  }
+
+  return dir_ / token;
+}
+
+void SessionStore::save(const string & token, const SessionState & state)
+{
+  json chunks = json::array();
+  for (const auto & c : state.acked_chunks) {
+    chunks.push_back(chunk_to_json(c));
+  }
+
+  const json session = {
+    {"username", state.username},
+    {"channel", state.channel},
+    {"ackedChunks", chunks}
+  };
+
+  /* write to a temporary file and rename it, so that other processes never
+   * read a partial session */
+  const fs::path path = session_path(token);
+  const fs::path tmp_path = path.string() + ".tmp";
+
+  {
+    FileDescriptor fd(CheckSystemCall("open (" + tmp_path.string() + ")",
+        open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600)));
+    fd.write(session.dump());
+  }
+
+  fs::rename(tmp_path, path);
+}
+
+optional<SessionState> SessionStore::claim(const string & token)
+{
+  const fs::path path = session_path(token);
+
+  /* whoever manages to move the session away first owns it */
+  const fs::path claimed_path = path.string() + ".claimed."
+                                + to_string(getpid());
+  error_code ec;
+  fs::rename(path, claimed_path, ec);
+  if (ec) {
+    return nullopt;  /* unknown, expired and cleaned, or claimed already */
+  }
+
+  string data;
+  fs::file_time_type mtime;
+  {
+    FileDescriptor fd(CheckSystemCall("open (" + claimed_path.string() + ")",
+        open(claimed_path.c_str(), O_RDONLY)));
+    while (not fd.eof()) {
+      data += fd.read();
+    }
+    mtime = fs::last_write_time(claimed_path);
+  }
+  fs::remove(claimed_path);
+
+  const auto age = chrono::duration_cast<chrono::milliseconds>(
+      fs::file_time_type::clock::now() - mtime).count();
+  if (age < 0 or static_cast<uint64_t>(age) > ttl_ms_) {
+    return nullopt;
+  }
+
+  const json session = json::parse(data);
+
+  SessionState state;
+  state.username = session.at("username").get<string>();
+  state.channel = session.at("channel").get<string>();
+  for (const auto & c : session.at("ackedChunks")) {
+    state.acked_chunks.emplace_back(chunk_from_json(c));
+  }
+
+  return state;
+}
+
+void SessionStore::expire()
+{
+  const auto now = fs::file_time_type::clock::now();
+  const auto ttl = chrono::milliseconds(ttl_ms_);
+
+  for (const auto & entry : fs::directory_iterator(dir_)) {
+    error_code ec;
+    const auto mtime = fs::last_write_time(entry.path(), ec);
+
+    /* another process might have claimed or expired it in the meantime */
+    if (not ec and now - mtime > ttl) {
+      fs::remove(entry.path(), ec);
+    }
+  }
+}
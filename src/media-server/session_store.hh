@@ -0,0 +1,58 @@
+#ifndef SESSION_STORE_HH
+#define SESSION_STORE_HH
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <optional>
+#include <random>
+
+#include "abr_algo.hh"
+#include "filesystem.hh"
+
+/* what a client needs to pick up where it left off on a new connection */
+struct SessionState
+{
+  std::string username {};
+  std::string channel {};
+
+  /* the most recently acked video chunks, replayed into the ABR algorithm
+   * so that it starts with warm throughput estimates */
+  std::deque<ABRAlgo::Chunk> acked_chunks {};
+};
+
+/* sessions of disconnected clients, keyed by a random resume token handed
+ * to the client in server-init; each session is a small file in a directory
+ * that the server processes on a host share (e.g., on /dev/shm), so that a
+ * client may resume on any of them, e.g., while a server is drained */
+class SessionStore
+{
+public:
+  SessionStore(const fs::path & dir, const uint64_t ttl_ms);
+
+  /* a new unguessable token */
+  std::string new_token();
+
+  /* store (or replace) the session of 'token' */
+  void save(const std::string & token, const SessionState & state);
+
+  /* take the session of 'token' out of the store, unless it has expired;
+   * a session can be claimed only once */
+  std::optional<SessionState> claim(const std::string & token);
+
+  /* remove the expired sessions */
+  void expire();
+
+private:
+  static constexpr size_t TOKEN_BYTES = 16;
+
+  fs::path dir_;
+  uint64_t ttl_ms_;
+
+  std::random_device random_ {};
+
+  /* path to the session of 'token'; throws on a malformed token */
+  fs::path session_path(const std::string & token) const;
+};
+
+#endif /* SESSION_STORE_HH */
@@ -15,9 +15,12 @@ static constexpr double UPPER_RESERVOIR = 0.9;
 
 WebSocketClient::WebSocketClient(const uint64_t connection_id,
                                  const string & abr_name,
-                                 const YAML::Node & abr_config)
+                                 const YAML::Node & abr_config,
+                                 const bool abr_degraded)
   : connection_id_(connection_id), abr_name_(abr_name),
-    abr_config_(abr_config), channel_(), last_msg_recv_ts_(timestamp_ms())
+    abr_config_(abr_config),
+    abr_degraded_(abr_degraded and abr_name != "linear_bba"),
+    channel_(), last_msg_recv_ts_(timestamp_ms())
 {
   init_abr_algo();
 }
@@ -102,10 +105,17 @@ void WebSocketClient::video_chunk_acked(const VideoFormat & format,
   try {
     const auto & ti = tcp_info_.value();
 
-    abr_algo_->video_chunk_acked({
+    ABRAlgo::Chunk c {
       format, ssim, chunk_size, transmission_time,
       ti.cwnd, ti.in_flight, ti.min_rtt, ti.rtt, ti.delivery_rate
-    });
+    };
+
+    acked_chunks_.push_back(c);
+    if (acked_chunks_.size() > MAX_ACKED_CHUNKS) {
+      acked_chunks_.pop_front();
+    }
+
+    abr_algo_->video_chunk_acked(move(c));
   } catch (const exception & e) {
     print_exception("video_chunk_acked", e);
     throw runtime_error("Error: video_chunk_acked failed with " + abr_name_);
@@ -189,9 +199,31 @@ AudioFormat WebSocketClient::select_audio_format()
   return aformats[ret_idx];
 }
 
+void WebSocketClient::set_abr_degraded(const bool degraded)
+{
+  if (degraded == abr_degraded_ or abr_name_ == "linear_bba") {
+    return;
+  }
+
+  abr_degraded_ = degraded;
+  init_abr_algo();
+}
+
+void WebSocketClient::warm_start(const deque<ABRAlgo::Chunk> & acked_chunks)
+{
+  acked_chunks_ = acked_chunks;
+  while (acked_chunks_.size() > MAX_ACKED_CHUNKS) {
+    acked_chunks_.pop_front();
+  }
+
+  init_abr_algo();
+}
+
 void WebSocketClient::init_abr_algo()
 {
-  if (abr_name_ == "linear_bba") {
+  if (abr_degraded_) {
+    abr_algo_ = make_unique<LinearBBA>(*this, "linear_bba", YAML::Node());
+  } else if (abr_name_ == "linear_bba") {
     abr_algo_ = make_unique<LinearBBA>(*this, abr_name_, abr_config_);
   } else if (abr_name_ == "mpc") {
     abr_algo_ = make_unique<MPC>(*this, abr_name_, abr_config_);
@@ -208,4 +240,19 @@ void WebSocketClient::init_abr_algo()
   } else {
     throw runtime_error("undefined ABR algorithm");
   }
+
+  /* bring the new algorithm up to date with the chunks acked so far (some
+   * algorithms look at the channel when a chunk is acked) */
+  if (not is_channel_initialized()) {
+    return;
+  }
+
+  try {
+    for (ABRAlgo::Chunk c : acked_chunks_) {
+      abr_algo_->video_chunk_acked(move(c));
+    }
+  } catch (const exception & e) {
+    /* not fatal: the algorithm merely starts cold */
+    print_exception("init_abr_algo", e);
+  }
 }
@@ -5,6 +5,7 @@
 #include <optional>
 #include <string>
 #include <memory>
+#include <deque>
 
 #include "address.hh"
 #include "channel.hh"
@@ -12,15 +13,16 @@
 #include "media_formats.hh"
 #include "yaml.hh"
 #include "socket.hh"
-
-class ABRAlgo;
+#include "tcp_info_sampler.hh"
+#include "abr_algo.hh"
 
 class WebSocketClient
 {
 public:
   WebSocketClient(const uint64_t connection_id,
                   const std::string & abr_name,
-                  const YAML::Node & abr_config);
+                  const YAML::Node & abr_config,
+                  const bool abr_degraded = false);
 
   /* forbid copying or move assigning WebSocketClient */
   WebSocketClient(const WebSocketClient & other) = delete;
@@ -48,6 +50,7 @@ public:
   bool is_authenticated() const { return authenticated_; }
   std::string session_key() const { return session_key_; }
   std::string username() const { return username_; }
+  std::string resume_token() const { return resume_token_; }
 
   std::string signature() const {
     return std::to_string(connection_id_) + "," + username_;
@@ -83,11 +86,15 @@ public:
   std::optional<uint64_t> last_video_send_ts() const { return last_video_send_ts_; }
   std::optional<TCPInfo> tcp_info() const { return tcp_info_; }
 
+  /* tcp_info sampled periodically over the connection */
+  const TCPInfoRing & tcp_info_samples() const { return tcp_info_samples_; }
+
   /* mutators */
   void set_init_id(const unsigned int init_id) { init_id_ = init_id; }
   void set_authenticated(const bool authenticated) { authenticated_ = authenticated; }
   void set_session_key(const std::string & session_key) { session_key_ = session_key; }
   void set_username(const std::string & username) { username_ = username; }
+  void set_resume_token(const std::string & token) { resume_token_ = token; }
 
   void set_browser(const std::string & browser) { browser_ = browser; }
   void set_os(const std::string & os) { os_ = os; }
@@ -114,6 +121,7 @@ public:
 
   void set_last_video_send_ts(const std::optional<uint64_t> send_ts) { last_video_send_ts_ = send_ts; }
   void set_tcp_info(const std::optional<TCPInfo> tcp_info) { tcp_info_ = tcp_info; }
+  void add_tcp_info_sample(const TCPInfoSample & sample) { tcp_info_samples_.push(sample); }
 
   /* ABR related */
   void video_chunk_acked(const VideoFormat & format,
@@ -123,8 +131,23 @@ public:
   VideoFormat select_video_format();
   AudioFormat select_audio_format();
 
+  /* fall back to linear_bba under overload, and back to the configured ABR
+   * algorithm afterwards (which picks up the recently acked chunks) */
+  void set_abr_degraded(const bool degraded);
+  bool is_abr_degraded() const { return abr_degraded_; }
+
+  /* the most recently acked video chunks, which are replayed into the ABR
+   * algorithm whenever it is (re)instantiated */
+  const std::deque<ABRAlgo::Chunk> & acked_chunks() const { return acked_chunks_; }
+
+  /* resume the ABR state of a previous connection of this client */
+  void warm_start(const std::deque<ABRAlgo::Chunk> & acked_chunks);
+
   static constexpr double MAX_BUFFER_S = 15.0;  /* seconds */
 
+  /* enough history for any ABR algorithm (Pensieve looks at the most) */
+  static constexpr size_t MAX_ACKED_CHUNKS = 10;
+
 private:
   uint64_t connection_id_;
 
@@ -132,6 +155,8 @@ private:
   std::string abr_name_;
   YAML::Node abr_config_;
   std::unique_ptr<ABRAlgo> abr_algo_ {nullptr};
+  bool abr_degraded_ {false};
+  std::deque<ABRAlgo::Chunk> acked_chunks_ {};
 
   /* WebSocketClient has no interest in managing the ownership of channel */
   std::weak_ptr<Channel> channel_;
@@ -146,6 +171,9 @@ private:
   std::string session_key_ {};
   std::string username_ {};
 
+  /* identifies the session in the SessionStore once disconnected */
+  std::string resume_token_ {};
+
   /* fields set in client-init */
   std::string browser_ {};
   std::string os_ {};
@@ -179,6 +207,7 @@ private:
   std::optional<uint64_t> last_video_send_ts_ {};
   /* TCP info before sending a video chunk */
   std::optional<TCPInfo> tcp_info_ {};
+  TCPInfoRing tcp_info_samples_ {};
 
   /* (re)instantiate abr_algo_ */
   void init_abr_algo();
@@ -11,7 +11,6 @@
 #include <memory>
 #include <random>
 #include <algorithm>
-#include <pqxx/pqxx>
 
 #include "util.hh"
 #include "strict_conversions.hh"
@@ -26,6 +25,11 @@
 #include "media_formats.hh"
 #include "yaml.hh"
 #include "abr_algo.hh"
+#include "session_auth.hh"
+#include "overload_controller.hh"
+#include "session_store.hh"
+#include "signalfd.hh"
+#include "telemetry_log.hh"
 
 using namespace std;
 using namespace PollerShortNames;
@@ -38,12 +42,34 @@ using WebSocketServer = WebSocketSecureServer;
 
 /* global variables */
 YAML::Node config;
+static string config_path;  /* reloaded on SIGHUP or once modified */
 static map<string, shared_ptr<Channel>> channels;  /* key: channel name */
+
+/* unmaps the chunks evicted by the channels off the event loop */
+static shared_ptr<MmapReclaimer> mmap_reclaimer;
+
+/* copies of the chunks in (huge-page-backed) memory (null: disabled) */
+static shared_ptr<ChunkCache> chunk_cache;
 static map<uint64_t, WebSocketClient> clients;  /* key: connection ID */
 
 static const size_t MAX_WS_FRAME_B = 100 * 1024;  /* 10 KB */
 static const unsigned int MAX_IDLE_MS = 60000; /* clean idle connections */
 
+/* start sending a chunk only once the previous ones have been generated and
+ * less than this is queued for the client */
+static const size_t MAX_QUEUED_B = 1024 * 1024;  /* 1 MB */
+
+/* pace each video chunk at this multiple of the delivery rate (0: off) */
+static double pacing_gain = 0;
+
+/* sample tcp_info of all connections this often (0: once per video chunk) */
+static unsigned int tcp_info_interval_ms = 100;
+
+/* sessions of disconnected clients, shared with the other servers on the
+ * host so that clients resume with warm ABR state (null: disabled) */
+static unique_ptr<SessionStore> session_store;
+static const unsigned int SESSION_EXPIRY_INTERVAL_S = 60;
+
 /* for logging */
 static bool enable_logging = false;
 static fs::path log_dir;  /* base directory for logging */
@@ -53,6 +79,47 @@ static map<string, FileDescriptor> log_fds;  /* map log name to fd */
 static const unsigned int MAX_LOG_FILESIZE = 100 * 1024 * 1024;  /* 100 MB */
 static uint64_t last_minute = 0;  /* in ms; multiple of 60000 */
 
+/* write video_sent, video_acked and client_buffer as binary telemetry logs
+ * (<stem>.<server ID>.tlog) instead of text */
+static bool binary_logging = false;
+static map<string, unique_ptr<TelemetryLogWriter>> telemetry_logs;
+
+/* columns of the logs that can be binary, in the order of the text logs */
+using Col = TelemetryColumn;
+
+static const TelemetrySchema video_sent_schema {"video_sent", 1, {
+  {"time", Col::Type::Int}, {"channel", Col::Type::String},
+  {"expt_id", Col::Type::String}, {"user", Col::Type::String},
+  {"init_id", Col::Type::Int}, {"video_ts", Col::Type::Int},
+  {"format", Col::Type::String}, {"size", Col::Type::Int},
+  {"ssim_index", Col::Type::Float, 6}, {"cwnd", Col::Type::Int},
+  {"in_flight", Col::Type::Int}, {"min_rtt", Col::Type::Int},
+  {"rtt", Col::Type::Int}, {"delivery_rate", Col::Type::Int},
+  {"buffer", Col::Type::Float, 3}, {"cum_rebuffer", Col::Type::Float, 3},
+  {"tcp_samples", Col::Type::Int}, {"mean_delivery_rate", Col::Type::Int},
+  {"mean_rtt", Col::Type::Int}, {"max_rtt", Col::Type::Int},
+  {"acked_rate", Col::Type::Int}
+}};
+
+static const TelemetrySchema video_acked_schema {"video_acked", 1, {
+  {"time", Col::Type::Int}, {"channel", Col::Type::String},
+  {"expt_id", Col::Type::String}, {"user", Col::Type::String},
+  {"init_id", Col::Type::Int}, {"video_ts", Col::Type::Int},
+  {"ssim_index", Col::Type::Float, 6}, {"buffer", Col::Type::Float, 3},
+  {"cum_rebuffer", Col::Type::Float, 3}
+}};
+
+static const TelemetrySchema client_buffer_schema {"client_buffer", 1, {
+  {"time", Col::Type::Int}, {"channel", Col::Type::String},
+  {"event", Col::Type::String}, {"expt_id", Col::Type::String},
+  {"user", Col::Type::String}, {"init_id", Col::Type::Int},
+  {"buffer", Col::Type::Float, 3}, {"cum_rebuf", Col::Type::Float, 3}
+}};
+
+/* video_sent rows waiting for the chunk to be acked, to be completed with
+ * the timeline of tcp_info while it was sent; key: connection ID */
+static map<uint64_t, vector<TelemetryValue>> pending_video_sent;
+
 void print_usage(const string & program_name)
 {
   cerr <<
@@ -107,6 +174,105 @@ void append_to_log(const string & log_stem, const string & log_line)
   }
 }
 
+/* open the binary log at 'log_path', moving an existing log with another
+ * schema (e.g., written before an upgrade) out of the way */
+unique_ptr<TelemetryLogWriter> open_telemetry_log(
+    const string & log_path, const TelemetrySchema & schema)
+{
+  try {
+    return make_unique<TelemetryLogWriter>(log_path, schema);
+  } catch (const exception & e) {
+    print_exception("open_telemetry_log", e);
+  }
+
+  fs::rename(log_path, log_path + ".old");
+  cerr << "Renamed " << log_path << " to " << log_path + ".old" << endl;
+
+  return make_unique<TelemetryLogWriter>(log_path, schema);
+}
+
+/* append a row to the log named after the schema, in binary if
+ * binary_logging is true */
+void append_to_log(const TelemetrySchema & schema,
+                   const vector<TelemetryValue> & row)
+{
+  if (not binary_logging) {
+    string log_line;
+    for (size_t i = 0; i < row.size(); i++) {
+      if (i > 0) {
+        log_line += ",";
+      }
+      append_as_text(log_line, schema.columns.at(i), row[i]);
+    }
+
+    append_to_log(schema.name, log_line);
+    return;
+  }
+
+  string log_path = log_dir / (schema.name + "." + server_id + ".tlog");
+
+  /* find or create a writer for the log */
+  auto log_it = telemetry_logs.find(schema.name);
+  if (log_it == telemetry_logs.end()) {
+    log_it = telemetry_logs.emplace(schema.name,
+        open_telemetry_log(log_path, schema)).first;
+  }
+
+  /* rows are buffered and written a block at a time */
+  auto & writer = log_it->second;
+  writer->append(row);
+
+  /* rotate log if filesize is too large */
+  if (writer->size() > MAX_LOG_FILESIZE) {
+    writer->flush();
+    fs::rename(log_path, log_path + ".old");
+    cerr << "Renamed " << log_path << " to " << log_path + ".old" << endl;
+
+    writer = open_telemetry_log(log_path, schema);
+  }
+}
+
+/* write the rows buffered for the binary logs */
+void flush_telemetry_logs()
+{
+  for (auto & [log_stem, writer] : telemetry_logs) {
+    writer->flush();
+  }
+}
+
+/* return the latest tcp_info sample if it is recent enough, rather than
+ * asking the kernel again */
+TCPInfo latest_tcp_info(WebSocketServer & server, WebSocketClient & client)
+{
+  const auto & samples = client.tcp_info_samples();
+
+  if (tcp_info_interval_ms > 0 and not samples.empty() and
+      timestamp_ms() - samples.back().timestamp_ms <= 2 * tcp_info_interval_ms) {
+    return samples.back().info;
+  }
+
+  return server.get_tcp_info(client.connection_id());
+}
+
+/* write the pending video_sent line of the connection, if any, along with
+ * the summary of tcp_info while the chunk was sent */
+void log_video_sent(const uint64_t connection_id,
+                    const TCPInfoTimeline & timeline)
+{
+  auto it = pending_video_sent.find(connection_id);
+  if (it == pending_video_sent.end()) {
+    return;
+  }
+
+  vector<TelemetryValue> row = move(it->second);
+  pending_video_sent.erase(it);
+
+  row.insert(row.end(), {timeline.samples, timeline.mean_delivery_rate,
+                         timeline.mean_rtt, timeline.max_rtt,
+                         timeline.acked_rate});
+  append_to_log(video_sent_schema, row);
+}
+
 void serve_video_to_client(WebSocketServer & server,
                            WebSocketClient & client)
 {
@@ -114,9 +280,15 @@ void serve_video_to_client(WebSocketServer & server,
   uint64_t next_vts = client.next_vts().value();
 
   /* save TCP info before client.select_video_format() */
-  TCPInfo tcpi = server.get_tcp_info(client.connection_id());
+  TCPInfo tcpi = latest_tcp_info(server, client);
   client.set_tcp_info(tcpi);
 
+  /* avoid sending the chunk in a line-rate burst */
+  if (pacing_gain > 0 and tcpi.delivery_rate > 0) {
+    server.set_pacing_rate(client.connection_id(), static_cast<uint64_t>(
+        pacing_gain * tcpi.delivery_rate));
+  }
+
   /* select a video format using ABR algorithm */
   const VideoFormat & next_vformat = client.select_video_format();
   double ssim = channel->vssim(next_vts).at(next_vformat);
@@ -132,21 +304,25 @@ void serve_video_to_client(WebSocketServer & server,
   const auto data_mmap = channel->vdata(next_vformat, next_vts);
   VideoSegment next_vsegment {next_vformat, data_mmap, init_mmap};
 
-  /* divide the next segment into WebSocket frames and send */
-  while (not next_vsegment.done()) {
-    ServerVideoMsg video_msg(client.init_id(),
-                             channel->name(),
-                             next_vformat.to_string(),
-                             next_vts,
-                             next_vsegment.offset(),
-                             next_vsegment.length(),
-                             ssim);
-    string frame_payload = video_msg.to_string();
-    next_vsegment.read(frame_payload, MAX_WS_FRAME_B - frame_payload.size());
+  /* divide the next segment into WebSocket frames, generated one at a time
+   * as the socket drains */
+  server.queue_frames(client.connection_id(),
+    [segment = move(next_vsegment), init_id = client.init_id(),
+     channel_name = channel->name(), format = next_vformat.to_string(),
+     next_vts, ssim]() mutable -> optional<WSFrame>
+    {
+      if (segment.done()) {
+        return nullopt;
+      }
 
-    WSFrame frame {true, WSFrame::OpCode::Binary, move(frame_payload)};
-    server.queue_frame(client.connection_id(), frame);
-  }
+      ServerVideoMsg video_msg(init_id, channel_name, format, next_vts,
+                               segment.offset(), segment.length(), ssim);
+      string frame_payload = video_msg.to_string();
+      segment.read(frame_payload, MAX_WS_FRAME_B - frame_payload.size());
+
+      return WSFrame {true, WSFrame::OpCode::Binary, move(frame_payload)};
+    }
+  );
 
   /* finish sending */
   client.set_next_vts(next_vts + channel->vduration());
@@ -157,16 +333,15 @@ void serve_video_to_client(WebSocketServer & server,
        << ", video " << next_vts << " " << next_vformat << " " << ssim << endl;
 
   if (enable_logging) {
-    string log_line = to_string(timestamp_ms()) + "," + channel->name() + ","
-      + expt_id + "," + client.username() + "," + to_string(client.init_id())
-      + "," + to_string(next_vts) + "," + next_vformat.to_string() + ","
-      + to_string(get<1>(data_mmap)) + "," + to_string(ssim)
-      + "," + to_string(tcpi.cwnd) + "," + to_string(tcpi.in_flight) + ","
-      + to_string(tcpi.min_rtt) + "," + to_string(tcpi.rtt) + ","
-      + to_string(tcpi.delivery_rate) + ","
-      + double_to_string(client.video_playback_buf(), 3) + ","
-      + double_to_string(client.cum_rebuffer(), 3);
-    append_to_log("video_sent", log_line);
+    vector<TelemetryValue> row {timestamp_ms(), channel->name(), expt_id,
+      client.username(), client.init_id(), next_vts,
+      next_vformat.to_string(), get<1>(data_mmap), ssim, tcpi.cwnd,
+      tcpi.in_flight, tcpi.min_rtt, tcpi.rtt, tcpi.delivery_rate,
+      client.video_playback_buf(), client.cum_rebuffer()};
+
+    /* the previous chunk was never acked (e.g., the client re-inited) */
+    log_video_sent(client.connection_id(), {});
+    pending_video_sent.emplace(client.connection_id(), move(row));
   }
 }
 
@@ -190,20 +365,25 @@ void serve_audio_to_client(WebSocketServer & server,
   const auto data_mmap = channel->adata(next_aformat, next_ats);
   AudioSegment next_asegment {next_aformat, data_mmap, init_mmap};
 
-  /* divide the next segment into WebSocket frames and send */
-  while (not next_asegment.done()) {
-    ServerAudioMsg audio_msg(client.init_id(),
-                             channel->name(),
-                             next_aformat.to_string(),
-                             next_ats,
-                             next_asegment.offset(),
-                             next_asegment.length());
-    string frame_payload = audio_msg.to_string();
-    next_asegment.read(frame_payload, MAX_WS_FRAME_B - frame_payload.size());
+  /* divide the next segment into WebSocket frames, generated one at a time
+   * as the socket drains */
+  server.queue_frames(client.connection_id(),
+    [segment = move(next_asegment), init_id = client.init_id(),
+     channel_name = channel->name(), format = next_aformat.to_string(),
+     next_ats]() mutable -> optional<WSFrame>
+    {
+      if (segment.done()) {
+        return nullopt;
+      }
 
-    WSFrame frame {true, WSFrame::OpCode::Binary, move(frame_payload)};
-    server.queue_frame(client.connection_id(), frame);
-  }
+      ServerAudioMsg audio_msg(init_id, channel_name, format, next_ats,
+                               segment.offset(), segment.length());
+      string frame_payload = audio_msg.to_string();
+      segment.read(frame_payload, MAX_WS_FRAME_B - frame_payload.size());
+
+      return WSFrame {true, WSFrame::OpCode::Binary, move(frame_payload)};
+    }
+  );
 
   /* finish sending */
   client.set_next_ats(next_ats + channel->aduration());
@@ -228,7 +408,7 @@ void send_server_init(WebSocketServer & server, WebSocketClient & client,
                      channel->timescale(),
                      channel->vduration(), channel->aduration(),
                      *client.next_vts(), *client.next_ats(),
-                     can_resume);
+                     can_resume, client.resume_token());
   WSFrame frame {true, WSFrame::OpCode::Binary, init.to_string()};
 
   /* drop previously queued frames before sending server-init */
@@ -295,6 +475,12 @@ void serve_client(WebSocketServer & server, WebSocketClient & client)
     }
   }
 
+  /* wait for the data queued for the client to drain below MAX_QUEUED_B;
+   * serve_client() is called again then */
+  if (not server.ready_to_send(client.connection_id())) {
+    return;
+  }
+
   if (client.audio_playback_buf() <= WebSocketClient::MAX_BUFFER_S and
       *client.audio_in_flight() == 0 and channel->aready_to_serve(next_ats)
       and next_ats <= next_vts) {
@@ -334,17 +520,68 @@ void log_active_streams(const uint64_t this_minute)
   }
 }
 
-void log_server_info(const uint64_t this_minute)
+void log_server_info(const uint64_t this_minute, WebSocketServer & server,
+                     OverloadController & overload)
 {
   /* the tag "server_id" is used to avoid data point overwriting;
    * the field "server_id" is used to count distinct values, i.e., the number
    * of running servers, as a workaround until InfluxDB supports DISTINCT
    * function to operate on tags */
   string log_line = to_string(this_minute) + "," + server_id + "," + server_id;
+
+  /* memory of the send buffers: in total, and per connection at most */
+  log_line += "," + to_string(clients.size()) + ","
+    + to_string(server.total_buffer_bytes()) + ","
+    + to_string(server.reset_peak_buffer_bytes());
+
+  /* overload level (0: normal, 1: degraded, 2: shedding) and its inputs */
+  log_line += "," + to_string(static_cast<int>(overload.level())) + ","
+    + double_to_string(overload.loop_lag_ms(), 1) + ","
+    + double_to_string(overload.cpu_usage(), 3) + ","
+    + to_string(overload.reset_rejected_inits());
   append_to_log("server_info", log_line);
 }
 
-void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server)
+#ifdef POLLER_PROFILING
+void log_event_loop(const uint64_t this_minute, Poller & poller)
+{
+  const auto & profile = poller.profile();
+
+  /* loop iterations and the time blocked in poll() */
+  const auto & poll_time = profile.poll_time_us;
+  string log_line = to_string(this_minute) + "," + server_id + ","
+    + to_string(profile.iterations) + "," + to_string(poll_time.sum()) + ","
+    + to_string(poll_time.quantile(0.5)) + ","
+    + to_string(poll_time.quantile(0.99)) + ","
+    + to_string(poll_time.max());
+  append_to_log("event_loop", log_line);
+
+  /* per category of callbacks: how long they ran, and how long they waited
+   * behind the others after their fds became ready (in microseconds) */
+  for (const auto & [category, callback_profile] : profile.callbacks) {
+    const auto & run_time = callback_profile.run_time_us;
+    const auto & wait_time = callback_profile.wait_time_us;
+    if (wait_time.count() == 0) {
+      continue;
+    }
+
+    log_line = to_string(this_minute) + "," + server_id + "," + category + ","
+      + to_string(wait_time.count()) + "," + to_string(run_time.sum()) + ","
+      + to_string(run_time.quantile(0.5)) + ","
+      + to_string(run_time.quantile(0.99)) + ","
+      + to_string(run_time.max()) + ","
+      + to_string(wait_time.quantile(0.5)) + ","
+      + to_string(wait_time.quantile(0.99)) + ","
+      + to_string(wait_time.max());
+    append_to_log("event_loop_callbacks", log_line);
+  }
+
+  poller.reset_profile();
+}
+#endif
+
+void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server,
+                      OverloadController & overload)
 {
   bool enforce_moving_live_edge = false;
   if (config["enforce_moving_live_edge"]) {
@@ -352,7 +589,8 @@ void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server)
   }
 
   server.poller().add_action(Poller::Action(slow_timer, Direction::In,
-    [&slow_timer, &server, enforce_moving_live_edge]()->Result {
+    [&slow_timer, &server, &overload, enforce_moving_live_edge,
+     slow_timer_ticks = 0u]() mutable -> Result {
       /* must read the timerfd, and check if timer has fired */
       if (slow_timer.expirations() == 0) {
         return ResultType::Continue;
@@ -365,6 +603,11 @@ void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server)
         }
       }
 
+      /* unmap the chunks evicted in the last second in a batch */
+      for (const auto & channel_it : channels) {
+        channel_it.second->reclaim_obsolete();
+      }
+
       set<uint64_t> connections_to_clean;
 
       for (auto & [connection_id, client] : clients) {
@@ -378,10 +621,22 @@ void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server)
         }
       }
 
-      /* connections can be safely cleaned now */
+      /* connections can be safely cleaned now; the close callback saves
+       * the session of each client (whose connection most likely died
+       * silently) before erasing it */
       for (const uint64_t connection_id : connections_to_clean) {
-        clients.erase(connection_id);
         server.clean_idle_connection(connection_id);
+        clients.erase(connection_id);
+      }
+
+      /* remove the sessions that nobody resumed in time */
+      if (session_store and
+          ++slow_timer_ticks % SESSION_EXPIRY_INTERVAL_S == 0) {
+        try {
+          session_store->expire();
+        } catch (const exception & e) {
+          print_exception("session_store", e);
+        }
       }
 
       if (enable_logging) {
@@ -393,16 +648,70 @@ void start_slow_timer(Timerfd & slow_timer, WebSocketServer & server)
           last_minute = this_minute;
 
           /* server info: server heartbeats, etc. */
-          log_server_info(this_minute);
+          log_server_info(this_minute, server, overload);
 
           /* write active_streams count to file */
           log_active_streams(this_minute);
+
+          /* write the rows buffered for the binary logs in the last minute */
+          flush_telemetry_logs();
+
+#ifdef POLLER_PROFILING
+          /* where the event loop spent the last minute */
+          log_event_loop(this_minute, server.poller());
+#endif
         }
       }
 
       return ResultType::Continue;
     }
-  ));
+  ), "slow_timer");
+}
+
+/* save the session of a client that is about to be disconnected */
+void save_session(const WebSocketClient & client)
+{
+  if (not session_store or client.resume_token().empty() or
+      not client.is_channel_initialized()) {
+    return;
+  }
+
+  try {
+    session_store->save(client.resume_token(),
+                        {client.username(), client.channel()->name(),
+                         client.acked_chunks()});
+  } catch (const exception & e) {
+    /* not fatal: the client would merely start cold */
+    cerr << client.signature() << ": failed to save session: "
+         << e.what() << endl;
+  }
+}
+
+/* take over the session of the previous connection named in 'msg' */
+optional<SessionState> claim_session(const WebSocketClient & client,
+                                     const ClientInitMsg & msg)
+{
+  if (not session_store or not msg.resume_token) {
+    return nullopt;
+  }
+
+  optional<SessionState> session;
+  try {
+    session = session_store->claim(*msg.resume_token);
+  } catch (const exception & e) {
+    cerr << client.signature() << ": failed to resume session: "
+         << e.what() << endl;
+    return nullopt;
+  }
+
+  /* the token must not let a user take over someone else's session */
+  if (session and session->username != client.username()) {
+    cerr << client.signature() << ": ignored the session of "
+         << session->username << endl;
+    return nullopt;
+  }
+
+  return session;
 }
 
 bool resume_connection(WebSocketServer & server,
@@ -433,11 +742,22 @@ bool resume_connection(WebSocketServer & server,
 }
 
 void handle_client_init(WebSocketServer & server, WebSocketClient & client,
-                        const ClientInitMsg & msg)
+                        const ClientInitMsg & msg,
+                        OverloadController & overload)
 {
   /* always set client's init_id when a client-init is received */
   client.set_init_id(msg.init_id);
 
+  /* shed load by turning away clients that are not streaming yet, so that
+   * those already watching keep playing */
+  if (overload.shedding() and not client.is_channel_initialized()) {
+    send_server_error(server, client, ServerErrorMsg::Type::Unavailable);
+    overload.count_rejected_init();
+    cerr << client.signature() << ": rejected client-init under overload"
+         << endl;
+    return;
+  }
+
   /* invalid channel request */
   auto it = channels.find(msg.channel);
   if (it == channels.end()) {
@@ -459,24 +779,35 @@ void handle_client_init(WebSocketServer & server, WebSocketClient & client,
 
   /* record client-init */
   if (enable_logging) {
-    string log_line = to_string(timestamp_ms()) + "," + msg.channel + ",init,"
-      + expt_id + "," + client.username() + ","
-      + to_string(msg.init_id) + ",0,0" /* buffer cum_rebuf */;
-    append_to_log("client_buffer", log_line);
+    append_to_log(client_buffer_schema, {timestamp_ms(), msg.channel, "init",
+      expt_id, client.username(), msg.init_id, 0.0 /* buffer */,
+      0.0 /* cum_rebuf */});
   }
 
-  /* check if the streaming can be resumed */
-  if (resume_connection(server, client, msg, channel)) {
-    return;
+  /* a client reconnecting (to this or another server) continues with the
+   * ABR state of its previous connection */
+  const auto session = claim_session(client, msg);
+
+  if (session_store and client.resume_token().empty()) {
+    client.set_resume_token(session_store->new_token());
   }
 
-  uint64_t init_vts = channel->init_vts().value();
-  uint64_t init_ats = channel->init_ats().value();
+  /* check if the streaming can be resumed */
+  if (not resume_connection(server, client, msg, channel)) {
+    uint64_t init_vts = channel->init_vts().value();
+    uint64_t init_ats = channel->init_ats().value();
 
-  client.init_channel(channel, init_vts, init_ats);
-  send_server_init(server, client, false /* initialize rather than resume */);
+    client.init_channel(channel, init_vts, init_ats);
+    send_server_init(server, client, false /* initialize rather than resume */);
 
-  cerr << client.signature() << ": connection initialized" << endl;
+    cerr << client.signature() << ": connection initialized" << endl;
+  }
+
+  if (session) {
+    client.warm_start(session->acked_chunks);
+    cerr << client.signature() << ": resumed ABR state with "
+         << session->acked_chunks.size() << " acked chunks" << endl;
+  }
 }
 
 void handle_client_info(WebSocketClient & client, const ClientInfoMsg & msg)
@@ -520,12 +851,9 @@ void handle_client_info(WebSocketClient & client, const ClientInfoMsg & msg)
     const auto channel_name = client.channel()->name();
 
     /* record client-info */
-    string log_line = to_string(timestamp_ms()) + "," + channel_name + ","
-      + msg.event_str + "," + expt_id + ","
-      + client.username() + "," + to_string(msg.init_id) + ","
-      + double_to_string(msg.video_buffer, 3) + ","
-      + double_to_string(msg.cum_rebuffer, 3);
-    append_to_log("client_buffer", log_line);
+    append_to_log(client_buffer_schema, {timestamp_ms(), channel_name,
+      msg.event_str, expt_id, client.username(), msg.init_id,
+      msg.video_buffer, msg.cum_rebuffer});
   }
 }
 
@@ -566,6 +894,12 @@ void handle_client_video_ack(WebSocketClient & client,
     /* notify the ABR algorithm that a video chunk is acked */
     client.video_chunk_acked(msg.video_format, msg.ssim,
                              media_chunk_size, trans_time);
+
+    if (enable_logging) {
+      log_video_sent(client.connection_id(),
+                     client.tcp_info_samples().timeline(
+                         *client.last_video_send_ts(), timestamp_ms()));
+    }
     client.set_last_video_send_ts(nullopt);
     client.set_tcp_info(nullopt);
   } else {
@@ -576,12 +910,9 @@ void handle_client_video_ack(WebSocketClient & client,
 
   /* record client's received video */
   if (enable_logging) {
-    string log_line = to_string(timestamp_ms()) + "," + msg.channel + ","
-      + expt_id + "," + client.username() + "," + to_string(msg.init_id) + ","
-      + to_string(msg.timestamp) + "," + to_string(msg.ssim) + ","
-      + double_to_string(msg.video_buffer, 3) + ","
-      + double_to_string(msg.cum_rebuffer, 3);
-    append_to_log("video_acked", log_line);
+    append_to_log(video_acked_schema, {timestamp_ms(), msg.channel, expt_id,
+      client.username(), msg.init_id, msg.timestamp, msg.ssim,
+      msg.video_buffer, msg.cum_rebuffer});
   }
 }
 
@@ -611,17 +942,23 @@ void handle_client_audio_ack(WebSocketClient & client,
   client.set_client_next_ats(msg.timestamp + client.channel()->aduration());
 }
 
+/* create the channels in the configuration that do not exist yet */
 void create_channels(Inotify & inotify)
 {
   fs::path media_dir = config["media_dir"].as<string>();
 
   set<string> channel_set = load_channels(config);
   for (const auto & channel_name : channel_set) {
+    if (channels.count(channel_name)) {
+      continue;
+    }
+
     /* exceptions might be thrown from the lambda callbacks in the channel */
     try {
       auto channel = make_shared<Channel>(
           channel_name, media_dir,
-          config["channel_configs"][channel_name], inotify);
+          config["channel_configs"][channel_name], inotify,
+          mmap_reclaimer, chunk_cache);
       channels.emplace(channel_name, move(channel));
     } catch (const exception & e) {
       cerr << "Error: exceptions in channel " << channel_name << ": "
@@ -630,20 +967,59 @@ void create_channels(Inotify & inotify)
   }
 }
 
-bool auth_client(const string & session_key, pqxx::nontransaction & db_work)
+/* send 'error_type' to the clients of a channel and destroy it */
+void retire_channel(WebSocketServer & server, Inotify & inotify,
+                    const string & channel_name,
+                    const ServerErrorMsg::Type error_type)
 {
-  try {
-    pqxx::result r = db_work.prepared("auth")(session_key).exec();
+  auto channel_it = channels.find(channel_name);
+  if (channel_it == channels.end()) {
+    return;
+  }
 
-    if (r.size() == 1 and r[0].size() == 1) {
-      /* returned record is valid containing only true or false */
-      return r[0][0].as<bool>();
+  for (auto & client_it : clients) {
+    WebSocketClient & client = client_it.second;
+
+    if (client.channel() == channel_it->second) {
+      send_server_error(server, client, error_type);
     }
-  } catch (const exception & e) {
-    print_exception("auth_client", e);
   }
 
-  return false;
+  /* clients only hold weak pointers to the channel */
+  channel_it->second->unwatch(inotify);
+  channels.erase(channel_it);
+}
+
+/* set up the client once its session key is valid */
+void authenticate_client(WebSocketServer & server, WebSocketClient & client,
+                         const ClientInitMsg & msg)
+{
+  client.set_authenticated(true);
+
+  /* set client's username and IP */
+  client.set_session_key(msg.session_key);
+  client.set_username(msg.username);
+  client.set_address(server.peer_addr(client.connection_id()));
+
+  /* set client's system info (OS, browser and screen size) */
+  client.set_os(msg.os);
+  client.set_browser(msg.browser);
+  client.set_screen_size(msg.screen_width, msg.screen_height);
+
+  /* record system information */
+  if (enable_logging) {
+    string log_line = to_string(timestamp_ms()) + "," + expt_id
+      + "," + server_id + "," + client.username() + ","
+      + to_string(msg.init_id) + "," + client.address().ip() + ","
+      + msg.os + "," + msg.browser + ","
+      + to_string(msg.screen_width) + ","
+      + to_string(msg.screen_height);
+    append_to_log("client_sysinfo", log_line);
+  }
+
+  cerr << client.connection_id() << ": authentication succeeded" << endl;
+  cerr << client.signature() << ": " << client.browser() << " on "
+       << client.os() << ", " << client.address().str() << endl;
 }
 
 void validate_id(const string & id)
@@ -661,12 +1037,18 @@ void validate_id(const string & id)
   }
 }
 
-int run_websocket_server(pqxx::nontransaction & db_work)
+/* congestion control and ABR algorithm of this server */
+struct ExperimentSettings
 {
   /* default congestion control and ABR algorithm */
-  string cc_name = "cubic";
-  string abr_name = "linear_bba";
-  YAML::Node abr_config;
+  string cc_name {"cubic"};
+  string abr_name {"linear_bba"};
+  YAML::Node abr_config {};
+};
+
+ExperimentSettings experiment_settings(const YAML::Node & config)
+{
+  ExperimentSettings expt;
 
   /* read congestion control and ABR from experimental settings */
   if (not server_id.empty()) {
@@ -686,16 +1068,92 @@ int run_websocket_server(pqxx::nontransaction & db_work)
       throw runtime_error("Invalid server ID " + server_id);
     }
 
-    cc_name = fingerprint["cc"].as<string>();
-    abr_name = fingerprint["abr"].as<string>();
+    expt.cc_name = fingerprint["cc"].as<string>();
+    expt.abr_name = fingerprint["abr"].as<string>();
     if (fingerprint["abr_config"]) {
-      abr_config = fingerprint["abr_config"];
+      expt.abr_config = fingerprint["abr_config"];
+    }
+  }
+
+  return expt;
+}
+
+/* re-read the configuration file, and apply what can be changed without
+ * disconnecting anyone: channels are created or retired (their clients are
+ * told to reinitialize, or that the channel is gone), and a new ABR
+ * algorithm applies to the connections opened from now on */
+void reload_config(WebSocketServer & server, Inotify & inotify,
+                   ExperimentSettings & expt)
+{
+  YAML::Node new_config;
+  ExperimentSettings new_expt;
+  bool media_dir_changed;
+  set<string> new_channels;
+
+  /* whatever is missing or invalid in the new file rejects the reload */
+  try {
+    new_config = YAML::LoadFile(config_path);
+    new_channels = load_channels(new_config);
+    new_expt = experiment_settings(new_config);
+    media_dir_changed = new_config["media_dir"].as<string>()
+                        != config["media_dir"].as<string>();
+  } catch (const exception & e) {
+    cerr << "Error: kept the current configuration as " << config_path
+         << " is invalid: " << e.what() << endl;
+    return;
+  }
+
+  vector<string> removed, changed;
+  for (const auto & channel_it : channels) {
+    const string & name = channel_it.first;
+
+    if (not new_channels.count(name)) {
+      removed.emplace_back(name);
+    } else if (media_dir_changed or
+               YAML::Dump(config["channel_configs"][name]) !=
+               YAML::Dump(new_config["channel_configs"][name])) {
+      changed.emplace_back(name);
     }
   }
 
+  for (const auto & name : removed) {
+    retire_channel(server, inotify, name, ServerErrorMsg::Type::Unavailable);
+    cerr << "Reload: removed channel " << name << endl;
+  }
+
+  /* the clients of a changed channel reinitialize it right away */
+  for (const auto & name : changed) {
+    retire_channel(server, inotify, name, ServerErrorMsg::Type::Reinit);
+    cerr << "Reload: reconfigured channel " << name << endl;
+  }
+
+  config = new_config;
+  create_channels(inotify);
+
+  if (new_expt.cc_name != expt.cc_name) {
+    cerr << "Reload: warning: congestion control " << new_expt.cc_name
+         << " requires a restart" << endl;
+  }
+  new_expt.cc_name = expt.cc_name;
+
+  if (new_expt.abr_name != expt.abr_name or
+      YAML::Dump(new_expt.abr_config) != YAML::Dump(expt.abr_config)) {
+    cerr << "Reload: new connections use ABR algorithm "
+         << new_expt.abr_name << endl;
+  }
+  expt = new_expt;
+
+  cerr << "Reloaded " << config_path << ": " << channels.size()
+       << " channels" << endl;
+}
+
+int run_websocket_server(const string & db_conn_str)
+{
+  ExperimentSettings expt = experiment_settings(config);
+
   const string ip = "0.0.0.0";
   const uint16_t port = config["ws_port"].as<uint16_t>();
-  WebSocketServer server {{ip, port}, cc_name};
+  WebSocketServer server {{ip, port}, expt.cc_name};
 
   const bool portal_debug = config["portal_settings"]["debug"].as<bool>();
   /* workaround using compiler macros (CXXFLAGS='-DNONSECURE') to create a
@@ -716,13 +1174,133 @@ int run_websocket_server(pqxx::nontransaction & db_work)
   }
   #endif
 
+  /* admission control and pacing of the data sent to each client */
+  server.set_max_queued_bytes(MAX_QUEUED_B);
+  if (config["pacing_gain"]) {
+    pacing_gain = config["pacing_gain"].as<double>();
+  }
+
+  /* sample tcp_info of all connections at once on a timer, for the ABR
+   * algorithms and the per-chunk timelines in video_sent */
+  if (config["tcp_info_interval_ms"]) {
+    tcp_info_interval_ms = config["tcp_info_interval_ms"].as<unsigned int>();
+  }
+
+  if (tcp_info_interval_ms > 0) {
+    server.sample_tcp_info(tcp_info_interval_ms,
+      [](const uint64_t connection_id, const TCPInfoSample & sample)
+      {
+        auto client_it = clients.find(connection_id);
+        if (client_it != clients.end()) {
+          client_it->second.add_tcp_info_sample(sample);
+        }
+      }
+    );
+  }
+
   /* create Channels and mmap existing and newly created media files */
+  mmap_reclaimer = make_shared<MmapReclaimer>();
+
+  /* copy the chunks into memory local to the server before they are sent,
+   * within a budget shared by the channels */
+  if (config["chunk_cache"]) {
+    const YAML::Node & cache_config = config["chunk_cache"];
+
+    const uint64_t budget_mb = cache_config["budget_mb"].as<uint64_t>();
+    bool huge_pages = false;
+    if (cache_config["huge_pages"]) {
+      huge_pages = cache_config["huge_pages"].as<bool>();
+    }
+
+    chunk_cache = make_shared<ChunkCache>(budget_mb * 1024 * 1024,
+                                          huge_pages, mmap_reclaimer);
+  }
+
   Inotify inotify(server.poller());
   create_channels(inotify);
 
+  /* check session keys in client-init against the database, with a cache of
+   * recently authenticated sessions (a session deleted from the database,
+   * e.g., by logging out, stays valid for the cache TTL at most) */
+  SessionAuth session_auth(server.poller(), db_conn_str);
+
+  /* degrade quality and then turn away new clients rather than letting a
+   * flash crowd stall every stream on the server */
+  OverloadController overload(server.poller(), config["overload"],
+    [&server]() { return server.total_buffer_bytes(); }
+  );
+
+  overload.set_level_callback(
+    [&overload](const OverloadController::Level old_level,
+                const OverloadController::Level new_level)
+    {
+      cerr << "Overload level changed from "
+           << OverloadController::level_str(old_level) << " to "
+           << OverloadController::level_str(new_level) << " (event loop lag "
+           << overload.loop_lag_ms() << " ms, CPU " << overload.cpu_usage()
+           << ", queued " << overload.queued_bytes() << " bytes)" << endl;
+
+      /* existing clients switch ABR algorithms too */
+      for (auto & client_it : clients) {
+        client_it.second.set_abr_degraded(overload.degraded());
+      }
+    }
+  );
+
+  /* hand each client a resume token, with which it continues on a new
+   * connection (to any server on the host) with the ABR state of the old */
+  if (config["session_store"]) {
+    const YAML::Node & store_config = config["session_store"];
+
+    uint64_t ttl_s = 300;
+    if (store_config["ttl_s"]) {
+      ttl_s = store_config["ttl_s"].as<uint64_t>();
+    }
+
+    session_store = make_unique<SessionStore>(
+        store_config["dir"].as<string>(), ttl_s * 1000);
+  }
+
+  /* SIGHUP: reload the configuration; SIGTERM: the server is drained (e.g.,
+   * for a deploy), so save the session of every client before exiting */
+  const SignalMask signals {SIGHUP, SIGTERM, SIGINT};
+  signals.set_as_mask();
+  SignalFD signal_fd(signals);
+
+  server.poller().add_action(Poller::Action(signal_fd.fd(), Direction::In,
+    [&signal_fd, &server, &inotify, &expt]()->Result {
+      const auto sig = signal_fd.read_signal();
+
+      if (sig.ssi_signo == SIGHUP) {
+        reload_config(server, inotify, expt);
+        return ResultType::Continue;
+      }
+
+      cerr << "Received signal " << sig.ssi_signo << "; exiting" << endl;
+      for (const auto & client_it : clients) {
+        save_session(client_it.second);
+      }
+
+      return {ResultType::Exit, EXIT_SUCCESS};
+    }
+  ), "signals");
+
+  /* reload the configuration once it is modified too (editors and deploy
+   * scripts usually replace the file, so watch its directory) */
+  const fs::path config_file = fs::absolute(config_path);
+  inotify.add_watch(config_file.parent_path(), IN_CLOSE_WRITE | IN_MOVED_TO,
+    [config_file, &server, &inotify, &expt](const inotify_event & event,
+                                            const string &) {
+      if (event.len != 0 and config_file.filename() == event.name) {
+        reload_config(server, inotify, expt);
+      }
+    }
+  );
+
   /* set server callbacks */
   server.set_message_callback(
-    [&server, &db_work](const uint64_t connection_id, const WSMessage & ws_msg)
+    [&server, &session_auth, &overload](const uint64_t connection_id,
+                                        const WSMessage & ws_msg)
     {
       try {
         WebSocketClient & client = clients.at(connection_id);
@@ -732,44 +1310,45 @@ int run_websocket_server(pqxx::nontransaction & db_work)
         if (msg_parser.msg_type() == ClientMsgParser::Type::Init) {
           ClientInitMsg msg = msg_parser.parse_client_init();
 
-          /* authenticate user */
+          /* authenticate user without blocking the other clients; the
+           * client might be gone by the time the result comes back */
           if (not client.is_authenticated()) {
-            if (auth_client(msg.session_key, db_work)) {
-              client.set_authenticated(true);
-
-              /* set client's username and IP */
-              client.set_session_key(msg.session_key);
-              client.set_username(msg.username);
-              client.set_address(server.peer_addr(connection_id));
-
-              /* set client's system info (OS, browser and screen size) */
-              client.set_os(msg.os);
-              client.set_browser(msg.browser);
-              client.set_screen_size(msg.screen_width, msg.screen_height);
-
-              /* record system information */
-              if (enable_logging) {
-                string log_line = to_string(timestamp_ms()) + "," + expt_id
-                  + "," + server_id + "," + client.username() + ","
-                  + to_string(msg.init_id) + "," + client.address().ip() + ","
-                  + msg.os + "," + msg.browser + ","
-                  + to_string(msg.screen_width) + ","
-                  + to_string(msg.screen_height);
-                append_to_log("client_sysinfo", log_line);
+            session_auth.authenticate(msg.session_key,
+              [&server, &overload, connection_id, msg]
+              (const bool authenticated)
+              {
+                try {
+                  auto client_it = clients.find(connection_id);
+                  if (client_it == clients.end()) {
+                    return;
+                  }
+                  WebSocketClient & client = client_it->second;
+
+                  if (not authenticated) {
+                    cerr << connection_id << ": authentication failed" << endl;
+                    server.close_connection(connection_id);
+                    return;
+                  }
+
+                  if (not client.is_authenticated()) {
+                    authenticate_client(server, client, msg);
+                  }
+
+                  handle_client_init(server, client, msg, overload);
+                  serve_client(server, client);
+                } catch (const exception & e) {
+                  cerr << client_signature(connection_id)
+                       << ": warning in authentication callback: "
+                       << e.what() << endl;
+                  server.close_connection(connection_id);
+                }
               }
-
-              cerr << connection_id << ": authentication succeeded" << endl;
-              cerr << client.signature() << ": " << client.browser() << " on "
-                   << client.os() << ", " << client.address().str() << endl;
-            } else {
-              cerr << connection_id << ": authentication failed" << endl;
-              server.close_connection(connection_id);
-              return;
-            }
+            );
+            return;
           }
 
           /* handle client-init and initialize client's channel */
-          handle_client_init(server, client, msg);
+          handle_client_init(server, client, msg, overload);
         } else {
           /* parse a message other than client-init only if user is authed */
           if (not client.is_authenticated()) {
@@ -804,8 +1383,25 @@ int run_websocket_server(pqxx::nontransaction & db_work)
     }
   );
 
+  server.set_drain_callback(
+    [&server](const uint64_t connection_id)
+    {
+      try {
+        auto client_it = clients.find(connection_id);
+        if (client_it != clients.end()) {
+          serve_client(server, client_it->second);
+        }
+      } catch (const exception & e) {
+        cerr << client_signature(connection_id)
+             << ": warning in drain callback: " << e.what() << endl;
+        server.close_connection(connection_id);
+      }
+    }
+  );
+
   server.set_open_callback(
-    [&server, &abr_name, &abr_config](const uint64_t connection_id)
+    [&server, &expt, &overload]
+    (const uint64_t connection_id)
     {
       try {
         cerr << connection_id << ": connection opened" << endl;
@@ -814,7 +1410,8 @@ int run_websocket_server(pqxx::nontransaction & db_work)
         clients.emplace(
             piecewise_construct,
             forward_as_tuple(connection_id),
-            forward_as_tuple(connection_id, abr_name, abr_config));
+            forward_as_tuple(connection_id, expt.abr_name, expt.abr_config,
+                             overload.degraded()));
       } catch (const exception & e) {
         cerr << client_signature(connection_id)
              << ": warning in open callback: " << e.what() << endl;
@@ -827,7 +1424,14 @@ int run_websocket_server(pqxx::nontransaction & db_work)
     [](const uint64_t connection_id)
     {
       try {
-        clients.erase(connection_id);
+        const auto client_it = clients.find(connection_id);
+        if (client_it != clients.end()) {
+          save_session(client_it->second);
+          clients.erase(client_it);
+        }
+        if (enable_logging) {
+          log_video_sent(connection_id, {});
+        }
         cerr << connection_id << ": connection closed" << endl;
       } catch (const exception & e) {
         cerr << client_signature(connection_id)
@@ -838,7 +1442,7 @@ int run_websocket_server(pqxx::nontransaction & db_work)
 
   /* start a slow timer to perform some tasks */
   Timerfd slow_timer;
-  start_slow_timer(slow_timer, server);
+  start_slow_timer(slow_timer, server, overload);
 
   slow_timer.start(1000, 1000);  /* slow timer fires every second */
 
@@ -857,8 +1461,12 @@ int main(int argc, char * argv[])
   }
 
   /* load YAML settings */
-  config = YAML::LoadFile(argv[1]);
+  config_path = argv[1];
+  config = YAML::LoadFile(config_path);
   enable_logging = config["enable_logging"].as<bool>();
+  if (config["binary_logging"]) {
+    binary_logging = config["binary_logging"].as<bool>();
+  }
 
   if (argc == 2 and enable_logging) {
     cerr << "Must provide server ID and expt ID if enable_logging is true" << endl;
@@ -878,18 +1486,9 @@ int main(int argc, char * argv[])
     throw runtime_error("signal: failed to ignore SIGPIPE");
   }
 
-  /* connect to the database for user authentication */
+  /* database for user authentication */
   string db_conn_str = postgres_connection_string(config["postgres_connection"]);
-  pqxx::connection db_conn(db_conn_str);
-  cerr << "Connected to database: " << db_conn.hostname() << endl;
-
-  /* prepare a statement to check if the session_key in client-init is valid */
-  db_conn.prepare("auth", "SELECT EXISTS(SELECT 1 FROM django_session WHERE "
-    "session_key = $1 AND expire_date > now());");
-
-  /* reuse the same nontransaction as the server only reads the database */
-  pqxx::nontransaction db_work(db_conn);
 
   /* run a WebSocketServer instance */
-  return run_websocket_server(db_work);
+  return run_websocket_server(db_conn_str);
 }
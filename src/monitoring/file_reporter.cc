@@ -1,13 +1,20 @@
+#include <getopt.h>
+#include <fcntl.h>
 #include <iostream>
 #include <string>
-#include <fstream>
 #include <map>
+#include <set>
+#include <vector>
+#include <thread>
+#include <algorithm>
 #include <ctime>
 
 #include "util.hh"
 #include "yaml.hh"
 #include "media_formats.hh"
 #include "exception.hh"
+#include "file_descriptor.hh"
+#include "strict_conversions.hh"
 #include "timerfd.hh"
 #include "poller.hh"
 #include "inotify.hh"
@@ -20,48 +27,150 @@ using namespace std;
 using namespace PollerShortNames;
 
 static const int TIMER_PERIOD_MS = 60000;  /* 1 minute */
+
+/* recount the backlogs from scratch this often (in timer periods), in case
+ * the counts have drifted, e.g., across the startup scan */
+static const unsigned int BACKLOG_RESYNC_PERIODS = 60;
+
+static const uint32_t BACKLOG_MASK =
+  IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM;
+
 static fs::path media_dir;
 
 void print_usage(const string & program_name)
 {
-  cerr << "Usage: " << program_name << " <YAML configuration>" << endl;
+  cerr <<
+  "Usage: " << program_name << " [options] <YAML configuration>\n\n"
+  "Options:\n"
+  "--threads, -t N  report the channels on N threads (default: the number\n"
+  "                 of CPUs, or of channels if fewer)"
+  << endl;
 }
 
-void report_decoder_info(const string & channel_name,
-                         Inotify & inotify,
-                         InfluxDBClient & influxdb_client)
+struct InfluxDBArgs
 {
-  fs::path channel_path = media_dir / channel_name;
-  string video_raw = channel_path / "working/video-raw";
+  Address address;
+  string database;
+  string user;
+  string password;
+};
+
+struct ChannelArgs
+{
+  string name;
+  vector<string> vformats;
+};
+
+/* regular files in working/ of a channel (and in working/video-canonical),
+ * counted as they are created, moved and deleted instead of rescanning
+ * working/ every minute */
+struct Backlog
+{
+  fs::path working_dir {};
+  fs::path canonical_dir {};
+  int64_t working_cnt {0};
+  int64_t canonical_cnt {0};
+};
+
+static bool is_in(const fs::path & path, const fs::path & dir)
+{
+  const auto & [dir_end, path_it] = mismatch(dir.begin(), dir.end(),
+                                             path.begin(), path.end());
+  return dir_end == dir.end();
+}
+
+/* count the regular files in 'dir' (recursively) */
+static void scan_backlog(Backlog & backlog, const fs::path & dir)
+{
+  for (const auto & entry : fs::recursive_directory_iterator(dir)) {
+    if (fs::is_regular_file(entry)) {
+      backlog.working_cnt++;
+      if (is_in(entry.path(), backlog.canonical_dir)) {
+        backlog.canonical_cnt++;
+      }
+    }
+  }
+}
+
+static void resync_backlog(Backlog & backlog)
+{
+  backlog.working_cnt = 0;
+  backlog.canonical_cnt = 0;
+  scan_backlog(backlog, backlog.working_dir);
+}
+
+/* keep 'backlog' up to date with the files in 'dir' and in its
+ * subdirectories; the watch of 'dir' also calls 'callback' if given, as
+ * inotify watches a directory only once */
+void watch_backlog(Backlog & backlog, const string & dir, Inotify & inotify,
+                   const map<string, Inotify::callback_t> & callbacks)
+{
+  const bool in_canonical = is_in(dir, backlog.canonical_dir);
+
+  auto callback_it = callbacks.find(dir);
+  const Inotify::callback_t callback =
+    callback_it == callbacks.end() ? nullptr : callback_it->second;
+
+  inotify.add_watch(dir, BACKLOG_MASK,
+    [&backlog, &inotify, in_canonical, callback]
+    (const inotify_event & event, const string & path) {
+      if (event.mask & IN_ISDIR) {
+        /* new directories are watched too, with whatever is in them */
+        if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+          const string subdir = fs::path(path) / event.name;
+          watch_backlog(backlog, subdir, inotify, {});
+          scan_backlog(backlog, subdir);
+        }
+      } else {
+        const int delta = (event.mask & (IN_CREATE | IN_MOVED_TO)) ? 1 : -1;
+        backlog.working_cnt += delta;
+        if (in_canonical) {
+          backlog.canonical_cnt += delta;
+        }
+      }
+
+      if (callback) {
+        callback(event, path);
+      }
+    }
+  );
+
+  for (const auto & entry : fs::directory_iterator(dir)) {
+    if (fs::is_directory(entry)) {
+      watch_backlog(backlog, entry.path(), inotify, callbacks);
+    }
+  }
+}
 
-  inotify.add_watch(video_raw, IN_MOVED_TO,
-    [channel_name, video_raw, &influxdb_client]
+Inotify::callback_t report_decoder_info(const string & channel_name,
+                                        InfluxDBClient & influxdb_client)
+{
+  return [channel_name, &influxdb_client]
     (const inotify_event & event, const string & path) {
       /* only interested in regular files that are moved into the dir */
       if (not (event.mask & IN_MOVED_TO) or (event.mask & IN_ISDIR)) {
         return;
       }
 
-      assert(video_raw == path);
       assert(event.len != 0);
 
       fs::path filepath = fs::path(path) / event.name;
       if (filepath.extension() == ".info") {
-        ifstream decoder_info_stream(filepath);
-        string line;
-        getline(decoder_info_stream, line);
-        vector<string> sp = split(line, " ");
+        FileDescriptor info_fd(CheckSystemCall("open (" + filepath.string()
+          + ")", open(filepath.c_str(), O_RDONLY)));
+        const string contents = info_fd.read();
+        vector<string> sp = split(contents.substr(0, contents.find('\n')),
+                                  " ");
 
         string log_line = "decoder_info,channel=" + channel_name
           + " timestamp=" + sp[1] + "i,due=" + sp[2] + "i,filler_fields="
           + sp[3] + "i " + sp[0];
-        influxdb_client.post(log_line);
+        influxdb_client.add_point(log_line);
 
         /* remove .y4m.info files after posting to InfluxDB */
         fs::remove(filepath);
       }
-    }
-  );
+    };
 }
 
 void report_ssim(const string & channel_name,
@@ -87,14 +196,16 @@ void report_ssim(const string & channel_name,
       if (filepath.extension() == ".ssim") {
         string ts = filepath.stem();
 
-        ifstream ssim_file(filepath);
-        string line;
-        getline(ssim_file, line);
+        /* a single line, read at once */
+        FileDescriptor ssim_fd(CheckSystemCall("open (" + filepath.string()
+          + ")", open(filepath.c_str(), O_RDONLY)));
+        const string contents = ssim_fd.read();
+        const string line = contents.substr(0, contents.find('\n'));
 
         string log_line = "ssim,channel=" + channel_name + ",format="
           + vformat + " timestamp=" + ts + "i,ssim_index=" + line
           + " " + to_string(timestamp_ms());
-        influxdb_client.post(log_line);
+        influxdb_client.add_point(log_line);
       }
     }
   );
@@ -127,48 +238,37 @@ void report_video_size(const string & channel_name,
         string log_line = "video_size,channel=" + channel_name + ",format="
           + vformat + " timestamp=" + ts + "i,size=" + to_string(filesize)
           + "i " + to_string(timestamp_ms());
-        influxdb_client.post(log_line);
+        influxdb_client.add_point(log_line);
       }
     }
   );
 }
 
-void report_backlog(const set<string> & channel_set,
+void report_backlog(map<string, Backlog> & backlogs,
                     Poller & poller,
                     Timerfd & timer,
                     InfluxDBClient & influxdb_client)
 {
   poller.add_action(Poller::Action(timer, Direction::In,
-    [&channel_set, &timer, &influxdb_client]() {
+    [&backlogs, &timer, &influxdb_client, periods = 0u]() mutable {
       /* must read the timerfd, and check if timer has fired */
       if (timer.expirations() == 0) {
         return ResultType::Continue;
       }
 
-      for (const auto & channel_name : channel_set) {
-        fs::path channel_path = media_dir / channel_name;
-        string working_dir = channel_path / "working";
-        string canonical_dir = channel_path / "working/video-canonical";
-
-        unsigned int working_cnt = 0;
-        for (const auto & entry : fs::recursive_directory_iterator(working_dir)) {
-          if (fs::is_regular_file(entry)) {
-            working_cnt++;
-          }
-        }
+      const bool resync = ++periods % BACKLOG_RESYNC_PERIODS == 0;
 
-        unsigned int canonical_cnt = 0;
-        for (const auto & entry : fs::recursive_directory_iterator(canonical_dir)) {
-          if (fs::is_regular_file(entry)) {
-            canonical_cnt++;
-          }
+      for (auto & [channel_name, backlog] : backlogs) {
+        if (resync) {
+          resync_backlog(backlog);
         }
 
         string log_line = "backlog,channel=" + channel_name
-          + " working_cnt=" + to_string(working_cnt)
-          + "i,canonical_cnt=" + to_string(canonical_cnt)
+          + " working_cnt=" + to_string(max<int64_t>(backlog.working_cnt, 0))
+          + "i,canonical_cnt="
+          + to_string(max<int64_t>(backlog.canonical_cnt, 0))
           + "i " + to_string(timestamp_ms());
-        influxdb_client.post(log_line);
+        influxdb_client.add_point(log_line);
       }
 
       return ResultType::Continue;
@@ -176,18 +276,106 @@ void report_backlog(const set<string> & channel_set,
   ));
 }
 
+/* report the files of 'channels' on this thread, with a poller and a
+ * connection to InfluxDB of its own */
+void run_reporter(const vector<ChannelArgs> & channels,
+                  const InfluxDBArgs & influx)
+{
+  Poller poller;
+  Inotify inotify(poller);
+
+  InfluxDBClient influxdb_client(poller, influx.address, influx.database,
+                                 influx.user, influx.password);
+
+  /* channel name -> backlog; never moved once watched */
+  map<string, Backlog> backlogs;
+
+  for (const auto & channel : channels) {
+    fs::path channel_path = media_dir / channel.name;
+
+    Backlog & backlog = backlogs[channel.name];
+    backlog.working_dir = channel_path / "working";
+    backlog.canonical_dir = channel_path / "working/video-canonical";
+
+    /* report .y4m.info files, which are in working/ as well */
+    const map<string, Inotify::callback_t> callbacks {
+      {channel_path / "working/video-raw",
+       report_decoder_info(channel.name, influxdb_client)}
+    };
+
+    /* watch working/ before counting what is in it, so that no file is
+     * missed */
+    watch_backlog(backlog, backlog.working_dir, inotify, callbacks);
+    resync_backlog(backlog);
+
+    for (const auto & vformat : channel.vformats) {
+      /* report SSIM indices */
+      report_ssim(channel.name, vformat, inotify, influxdb_client);
+
+      /* report video sizes */
+      report_video_size(channel.name, vformat, inotify, influxdb_client);
+    }
+  }
+
+  /* the backlogs have been lost track of */
+  inotify.set_overflow_callback(
+    [&backlogs]() {
+      cerr << "Warning: inotify queue overflowed; recounting backlogs"
+           << endl;
+      for (auto & backlog_it : backlogs) {
+        resync_backlog(backlog_it.second);
+      }
+    }
+  );
+
+  /* create a periodic timer that fires every minute to report backlog sizes */
+  Timerfd timer;
+  report_backlog(backlogs, poller, timer, influxdb_client);
+  timer.start(TIMER_PERIOD_MS, TIMER_PERIOD_MS);
+
+  for (;;) {
+    auto ret = poller.poll(-1);
+    if (ret.result != Poller::Result::Type::Success) {
+      exit(ret.exit_status);
+    }
+  }
+}
+
 int main(int argc, char * argv[])
 {
   if (argc < 1) {
     abort();
   }
 
-  if (argc != 2) {
+  unsigned int num_threads = 0;
+
+  const option cmd_line_opts[] = {
+    {"threads", required_argument, nullptr, 't'},
+    { nullptr,  0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "t:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 't':
+      num_threads = strict_atoui(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 1) {
     print_usage(argv[0]);
     return EXIT_FAILURE;
   }
 
-  YAML::Node config = YAML::LoadFile(argv[1]);
+  YAML::Node config = YAML::LoadFile(argv[optind]);
   if (not config["enable_logging"].as<bool>()) {
     cerr << "Error: logging is not enabled yet" << endl;
     return EXIT_FAILURE;
@@ -196,46 +384,42 @@ int main(int argc, char * argv[])
   media_dir = config["media_dir"].as<string>();
   set<string> channel_set = load_channels(config);
 
-  Poller poller;
-  Inotify inotify(poller);
-
+  /* read everything from the configuration before the threads start */
   const auto & influx = config["influxdb_connection"];
-  InfluxDBClient influxdb_client(
-      poller,
-      {influx["host"].as<string>(), influx["port"].as<uint16_t>()},
-      influx["dbname"].as<string>(),
-      influx["user"].as<string>(),
-      safe_getenv(influx["password"].as<string>()));
+  const InfluxDBArgs influx_args {
+    {influx["host"].as<string>(), influx["port"].as<uint16_t>()},
+    influx["dbname"].as<string>(),
+    influx["user"].as<string>(),
+    safe_getenv(influx["password"].as<string>())
+  };
+
+  if (num_threads == 0) {
+    num_threads = max(thread::hardware_concurrency(), 1u);
+  }
+  num_threads = min<size_t>(num_threads, max<size_t>(channel_set.size(), 1));
 
+  /* shard the channels across the threads */
+  vector<vector<ChannelArgs>> shards(num_threads);
+  size_t i = 0;
   for (const auto & channel_name : channel_set) {
     const auto & channel_config = config["channel_configs"][channel_name];
 
-    /* report .y4m.info files */
-    report_decoder_info(channel_name, inotify, influxdb_client);
-
-    vector<VideoFormat> vformats = channel_video_formats(channel_config);
-
-    for (const auto & vformat : vformats) {
-      /* report SSIM indices */
-      report_ssim(channel_name, vformat.to_string(),
-                  inotify, influxdb_client);
-
-      /* report video sizes */
-      report_video_size(channel_name, vformat.to_string(),
-                        inotify, influxdb_client);
+    ChannelArgs channel {channel_name, {}};
+    for (const auto & vformat : channel_video_formats(channel_config)) {
+      channel.vformats.emplace_back(vformat.to_string());
     }
+
+    shards[i++ % num_threads].emplace_back(move(channel));
   }
 
-  /* create a periodic timer that fires every minute to report backlog sizes */
-  Timerfd timer;
-  report_backlog(channel_set, poller, timer, influxdb_client);
-  timer.start(TIMER_PERIOD_MS, TIMER_PERIOD_MS);
+  vector<thread> reporters;
+  for (const auto & shard : shards) {
+    reporters.emplace_back(run_reporter, cref(shard), cref(influx_args));
+  }
 
-  for (;;) {
-    auto ret = poller.poll(-1);
-    if (ret.result != Poller::Result::Type::Success) {
-      return ret.exit_status;
-    }
+  /* the reporters run until the process exits */
+  for (auto & reporter : reporters) {
+    reporter.join();
   }
 
   return EXIT_SUCCESS;
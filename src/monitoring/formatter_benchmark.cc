@@ -0,0 +1,296 @@
+#include <getopt.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "formatter.hh"
+#include "tokenize.hh"
+#include "strict_conversions.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* count the allocations made while formatting */
+static size_t num_allocations = 0;
+
+void * operator new(size_t size)
+{
+  num_allocations++;
+  if (void * ptr = malloc(size)) {
+    return ptr;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void * ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+/* the Formatter as it was before being compiled into instructions: a list
+ * of polymorphic fields and a string built with += */
+class LegacyFormatter
+{
+public:
+  LegacyFormatter(const string & format_string)
+  {
+    size_t pos = 0;
+    unsigned int auto_index = 0;
+
+    while (pos < format_string.size()) {
+      size_t lpos = format_string.find("{", pos);
+      if (lpos == string::npos) {
+        fields_.emplace_back(make_unique<Literal>(format_string.substr(pos)));
+        break;
+      }
+
+      if (lpos > pos) {
+        fields_.emplace_back(make_unique<Literal>(
+                             format_string.substr(pos, lpos - pos)));
+      }
+
+      size_t rpos = format_string.find("}", lpos + 1);
+      if (rpos == string::npos) {
+        throw runtime_error("no matching }");
+      }
+      pos = rpos + 1;
+
+      if (rpos - lpos == 1) {
+        fields_.emplace_back(make_unique<Replacement>(auto_index++));
+      } else {
+        fields_.emplace_back(make_unique<Replacement>(
+            stoi(format_string.substr(lpos + 1, rpos - lpos - 1))));
+      }
+    }
+  }
+
+  string format(const vector<string> & values)
+  {
+    string ret;
+
+    for (const auto & field : fields_) {
+      if (field->type == Type::literal) {
+        ret += static_cast<Literal*>(field.get())->text;
+      } else if (field->type == Type::replacement) {
+        unsigned int index = static_cast<Replacement*>(field.get())->index;
+
+        if (index >= values.size()) {
+          throw runtime_error("index out of range");
+        }
+
+        ret += values.at(index);
+      } else {
+        throw runtime_error("invalid field type");
+      }
+    }
+
+    return ret;
+  }
+
+private:
+  enum class Type {literal, replacement};
+
+  struct Field {
+    Type type;
+
+    Field(const Type type_) : type(type_) {}
+    virtual ~Field() {}
+  };
+
+  struct Literal : Field {
+    string text;
+
+    Literal(const string & text_) : Field(Type::literal), text(text_) {}
+  };
+
+  struct Replacement : Field {
+    unsigned int index;
+
+    Replacement(const unsigned int index_)
+      : Field(Type::replacement), index(index_) {}
+  };
+
+  vector<unique_ptr<Field>> fields_ {};
+};
+
+/* log_reporter posts (and clears) its payload at about this size */
+static const size_t MAX_POST_BYTES = 1024 * 1024;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] <log format>...\n\n"
+  "Format log lines with each log format (e.g., monitoring/*.conf) as\n"
+  "log_reporter does, with the former Formatter (split into strings, then\n"
+  "format) and with the compiled one (split into views, then format_to\n"
+  "into the payload); report the time and allocations per line.\n\n"
+  "Options:\n"
+  "--lines, -n N    number of lines formatted per run (default: 1000000)"
+  << endl;
+}
+
+/* log lines with plausible values: a timestamp, then numbers and names of
+ * varied lengths */
+static vector<string> make_lines(const size_t num_values)
+{
+  static const vector<string> samples = {
+    "puffer", "0.987654", "12", "cbs", "1048576", "-3.5", "tcp_info",
+    "45678", "0", "4k", "chrome", "2.71828182", "linux", "1280x720-20"
+  };
+
+  vector<string> lines;
+  for (size_t i = 0; i < 1000; i++) {
+    string line = to_string(1571234567890 + i * 37);
+    for (size_t j = 1; j < num_values; j++) {
+      line += ',' + samples[(i * 7 + j * 3) % samples.size()];
+    }
+    lines.emplace_back(move(line));
+  }
+
+  return lines;
+}
+
+struct Result {
+  double ns_per_line {0};
+  double allocations_per_line {0};
+  size_t bytes {0};
+};
+
+template<typename FormatLine>
+Result run(const vector<string> & lines, const size_t num_lines,
+           FormatLine && format_line)
+{
+  string payload;
+  payload.reserve(2 * MAX_POST_BYTES);
+
+  Result result;
+
+  const size_t allocations = num_allocations;
+  const auto start = steady_clock::now();
+
+  for (size_t i = 0; i < num_lines; i++) {
+    format_line(lines[i % lines.size()], payload);
+    payload.push_back('\n');
+
+    if (payload.size() >= MAX_POST_BYTES) {
+      result.bytes += payload.size();
+      payload.clear();
+    }
+  }
+
+  const auto elapsed = steady_clock::now() - start;
+  result.bytes += payload.size();
+
+  result.ns_per_line = duration<double, nano>(elapsed).count() / num_lines;
+  result.allocations_per_line =
+      static_cast<double>(num_allocations - allocations) / num_lines;
+
+  return result;
+}
+
+static void print_result(const string & name, const Result & result)
+{
+  cout << fixed << setprecision(1)
+       << setw(12) << name
+       << setw(12) << result.ns_per_line
+       << setw(12) << result.allocations_per_line
+       << setw(14) << result.bytes << endl;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  size_t num_lines = 1000000;
+
+  const option cmd_line_opts[] = {
+    {"lines", required_argument, nullptr, 'n'},
+    { nullptr, 0,                nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'n':
+      num_lines = strict_atoui(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind == argc or num_lines == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    ifstream format_ifstream(argv[i]);
+    string format_string;
+    getline(format_ifstream, format_string);
+
+    Formatter formatter;
+    formatter.parse(format_string);
+    LegacyFormatter legacy(format_string);
+
+    const vector<string> lines = make_lines(formatter.num_values());
+
+    for (const auto & line : lines) {
+      vector<string_view> values;
+      split_view(line, ',', values);
+
+      string formatted;
+      formatter.format_to(formatted, values);
+      if (formatted != legacy.format(split(line, ","))) {
+        throw runtime_error("formatters disagree on: " + line);
+      }
+    }
+
+    cout << argv[i] << " (" << formatter.num_values() << " values); "
+         << "per line:" << endl;
+    cout << setw(12) << "" << setw(12) << "ns" << setw(12) << "allocs"
+         << setw(14) << "total bytes" << endl;
+
+    const Result before = run(lines, num_lines,
+      [&legacy](const string & line, string & payload) {
+        payload += legacy.format(split(line, ","));
+      }
+    );
+    print_result("legacy", before);
+
+    vector<string_view> values;
+    const Result after = run(lines, num_lines,
+      [&formatter, &values](const string & line, string & payload) {
+        split_view(line, ',', values);
+        formatter.format_to(payload, values);
+      }
+    );
+    print_result("compiled", after);
+
+    if (before.bytes != after.bytes) {
+      throw runtime_error("formatters disagree on the output");
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -57,6 +57,17 @@ InfluxDBClient::InfluxDBClient(Poller & poller,
       return not buffer_.empty();
     }
   ));
+
+  poller.add_action(Poller::Action(flush_timer_, Direction::In,
+    [this]()->Result {
+      if (flush_timer_.expirations() > 0) {
+        flush();
+      }
+
+      return ResultType::Continue;
+    }
+  ));
+  flush_timer_.start(FLUSH_INTERVAL_MS, FLUSH_INTERVAL_MS);
 }
 
 void InfluxDBClient::post(const string & payload)
@@ -72,3 +83,23 @@ void InfluxDBClient::post(const string & payload)
   request.read_in_body(payload);
   buffer_.emplace_back(request.str());
 }
+
+void InfluxDBClient::add_point(const string & line)
+{
+  batch_.append(line);
+  batch_.push_back('\n');
+
+  if (batch_.size() >= MAX_BATCH_BYTES) {
+    flush();
+  }
+}
+
+void InfluxDBClient::flush()
+{
+  if (batch_.empty()) {
+    return;
+  }
+
+  post(batch_);
+  batch_.clear();
+}
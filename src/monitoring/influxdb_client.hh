@@ -3,6 +3,7 @@
 
 #include "socket.hh"
 #include "poller.hh"
+#include "timerfd.hh"
 
 class InfluxDBClient
 {
@@ -15,7 +16,19 @@ public:
 
   void post(const std::string & payload);
 
+  /* post a point (a line of the line protocol) along with the others added
+   * within FLUSH_INTERVAL_MS, in a single request */
+  void add_point(const std::string & line);
+
+  /* post the points added so far */
+  void flush();
+
 private:
+  static constexpr unsigned int FLUSH_INTERVAL_MS = 1000;
+
+  /* flush before the next tick once this many bytes of points are added */
+  static constexpr size_t MAX_BATCH_BYTES = 1024 * 1024;
+
   Address influxdb_addr_ {};
   TCPSocket sock_ {};
 
@@ -23,4 +36,7 @@ private:
 
   std::deque<std::string> buffer_ {};
   size_t buffer_offset_ {0};
+
+  std::string batch_ {};
+  Timerfd flush_timer_ {};
 };
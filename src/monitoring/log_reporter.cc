@@ -1,9 +1,13 @@
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <fstream>
 
 #include "util.hh"
@@ -30,6 +34,94 @@ void print_usage(const string & program_name)
   << endl;
 }
 
+/* post at most about this many bytes of points per request */
+static const size_t MAX_POST_BYTES = 1024 * 1024;
+
+/* content read from the log that has not been posted yet */
+struct LogBuffer
+{
+  /* the incomplete line at the end of what has been read, in [0, end) */
+  vector<char> data = vector<char>(BUFFER_SIZE);
+  size_t end {0};
+
+  /* reused across lines, to avoid allocating */
+  vector<string_view> values {};
+  string payload {};
+};
+
+/* format the complete lines in 'log' into its payload, posting it whenever
+ * it grows beyond MAX_POST_BYTES, and keep the incomplete line */
+void parse_lines(LogBuffer & log, InfluxDBClient & influxdb_client)
+{
+  const string_view content(log.data.data(), log.end);
+
+  size_t start = 0;
+  size_t pos;
+  while ((pos = content.find('\n', start)) != string_view::npos) {
+    split_view(content.substr(start, pos - start), ',', log.values);
+
+    formatter.format_to(log.payload, log.values);
+    log.payload.push_back('\n');
+
+    if (log.payload.size() >= MAX_POST_BYTES) {
+      influxdb_client.post(log.payload);
+      log.payload.clear();
+    }
+
+    start = pos + 1;
+  }
+
+  /* move the incomplete line to the front, once per read */
+  memmove(log.data.data(), log.data.data() + start, log.end - start);
+  log.end -= start;
+}
+
+/* read everything appended to the log since the last call, then post the
+ * complete lines in it */
+void read_log(FileDescriptor & fd, LogBuffer & log,
+              InfluxDBClient & influxdb_client)
+{
+  for (;;) {
+    if (log.end == log.data.size()) {
+      /* a line longer than the buffer */
+      log.data.resize(log.data.size() * 2);
+    }
+
+    const ssize_t n = CheckSystemCall("read", ::read(fd.fd_num(),
+        log.data.data() + log.end, log.data.size() - log.end));
+    if (n == 0) {
+      break;
+    }
+
+    log.end += n;
+    parse_lines(log, influxdb_client);
+  }
+
+  if (not log.payload.empty()) {
+    influxdb_client.post(log.payload);
+    log.payload.clear();
+  }
+}
+
+/* whether 'log_path' no longer names the log open as 'fd', i.e., the log was
+ * rotated (renamed to .old) rather than just closed by its writer */
+bool log_rotated_away(const FileDescriptor & fd, const string & log_path)
+{
+  struct stat fd_stat, path_stat;
+  CheckSystemCall("fstat", fstat(fd.fd_num(), &fd_stat));
+
+  if (stat(log_path.c_str(), &path_stat) != 0) {
+    if (errno == ENOENT) {
+      /* the new log is not created yet */
+      return true;
+    }
+    throw unix_error("stat (" + log_path + ")");
+  }
+
+  return fd_stat.st_dev != path_stat.st_dev
+         or fd_stat.st_ino != path_stat.st_ino;
+}
+
 int tail_loop(const YAML::Node & config, const string & log_path)
 {
   Poller poller;
@@ -44,46 +136,33 @@ int tail_loop(const YAML::Node & config, const string & log_path)
       safe_getenv(influx["password"].as<string>()));
 
   bool log_rotated = false;  /* whether log rotation happened */
-  string buf;  /* used to assemble content read from the log into lines */
+  bool first_log = true;
+  LogBuffer log;
 
   for (;;) {
+    /* the writer might not have created the new log yet */
     FileDescriptor fd(CheckSystemCall("open (" + log_path + ")",
-                                      open(log_path.c_str(), O_RDONLY)));
-    fd.seek(0, SEEK_END);
+        open(log_path.c_str(), O_RDONLY | O_CREAT, 0644)));
+
+    /* skip what was logged before starting, but not the lines written to
+     * the new log since it was rotated */
+    if (first_log) {
+      fd.seek(0, SEEK_END);
+      first_log = false;
+    }
 
     int wd = inotify.add_watch(log_path, IN_MODIFY | IN_CLOSE_WRITE,
-      [&log_rotated, &buf, &fd, &influxdb_client]
+      [&log_rotated, &log, &fd, &influxdb_client, &log_path]
       (const inotify_event & event, const string &) {
         if (event.mask & IN_MODIFY) {
-          string new_content = fd.read();
-          if (new_content.empty()) {
-            /* return if nothing more to read */
-            return;
-          }
-          buf += new_content;
-
-          /* find new lines iteratively */
-          size_t pos = 0;
-          string payload;
-
-          while ((pos = buf.find("\n")) != string::npos) {
-            const string & line = buf.substr(0, pos);
-            vector<string> values = split(line, ",");
-
-            /* aggregate multiple points and separate by new lines */
-            if (not payload.empty()) {
-              payload += "\n";
-            }
-            payload += formatter.format(values);
-
-            buf = buf.substr(pos + 1);
-          }
-
-          /* post aggregated lines */
-          influxdb_client.post(payload);
+          read_log(fd, log, influxdb_client);
         } else if (event.mask & IN_CLOSE_WRITE) {
-          /* old log was closed; open and watch new log in next loop */
-          log_rotated = true;
+          read_log(fd, log, influxdb_client);
+
+          /* if the old log (now .old) was closed, open and watch the new
+           * log in next loop; otherwise (e.g., the writer restarted) keep
+           * reading the same log from where it was */
+          log_rotated = log_rotated_away(fd, log_path);
         }
       }
     );
@@ -97,6 +176,9 @@ int tail_loop(const YAML::Node & config, const string & log_path)
 
     inotify.rm_watch(wd);
     log_rotated = false;
+
+    /* a line cut off by rotation is never completed */
+    log.end = 0;
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,181 @@
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+
+#include "telemetry_log.hh"
+#include "formatter.hh"
+
+using namespace std;
+
+/* write to stdout once this many bytes are converted */
+static const size_t OUTPUT_BYTES = 1024 * 1024;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] <telemetry log>...\n\n"
+  "Convert binary telemetry logs (e.g., video_sent.1.tlog) written by the\n"
+  "media server to the lines of its text logs (CSV), or to the InfluxDB\n"
+  "line protocol that log_reporter would post for them.\n\n"
+  "Options:\n"
+  "--influx, -i <log format>  format each row with a log format (e.g.,\n"
+  "                           monitoring/video_sent.conf)\n"
+  "--header, -H               start the CSV with the names of the columns\n"
+  "--schema, -s               print the schema of each log instead"
+  << endl;
+}
+
+static void flush_output(string & out)
+{
+  cout.write(out.data(), out.size());
+  out.clear();
+}
+
+static void print_schema(const string & path, const TelemetrySchema & schema)
+{
+  static const char * const type_names[] = {"int", "float", "string"};
+
+  cout << path << ": " << schema.name << " version " << schema.version
+       << endl;
+  for (const auto & column : schema.columns) {
+    cout << "  " << column.name << " "
+         << type_names[static_cast<uint8_t>(column.type)];
+    if (column.type == TelemetryColumn::Type::Float) {
+      cout << " (" << static_cast<unsigned int>(column.precision)
+           << " decimals)";
+    }
+    cout << endl;
+  }
+}
+
+static void convert(TelemetryLogReader & reader,
+                    const optional<Formatter> & formatter, string & out)
+{
+  const size_t num_columns = reader.schema().columns.size();
+
+  /* the text of each value of a row, for the formatter */
+  string fields;
+  vector<size_t> ends(num_columns);
+  vector<string_view> values(num_columns);
+
+  while (reader.next_block()) {
+    for (size_t row = 0; row < reader.num_rows(); row++) {
+      if (not formatter) {
+        for (size_t i = 0; i < num_columns; i++) {
+          if (i > 0) {
+            out.push_back(',');
+          }
+          reader.append_as_text(out, row, i);
+        }
+      } else {
+        fields.clear();
+        for (size_t i = 0; i < num_columns; i++) {
+          reader.append_as_text(fields, row, i);
+          ends[i] = fields.size();
+        }
+
+        for (size_t i = 0, start = 0; i < num_columns; start = ends[i++]) {
+          values[i] = string_view(fields).substr(start, ends[i] - start);
+        }
+
+        formatter->format_to(out, values);
+      }
+
+      out.push_back('\n');
+    }
+
+    if (out.size() >= OUTPUT_BYTES) {
+      flush_output(out);
+    }
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  optional<Formatter> formatter;
+  bool header = false;
+  bool schema_only = false;
+
+  const option cmd_line_opts[] = {
+    {"influx", required_argument, nullptr, 'i'},
+    {"header", no_argument,       nullptr, 'H'},
+    {"schema", no_argument,       nullptr, 's'},
+    { nullptr, 0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "i:Hs", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'i': {
+      /* read a line specifying log format, as log_reporter does */
+      ifstream format_ifstream(optarg);
+      string format_string;
+      getline(format_ifstream, format_string);
+
+      formatter.emplace();
+      formatter->parse(format_string);
+      break;
+    }
+    case 'H':
+      header = true;
+      break;
+    case 's':
+      schema_only = true;
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind == argc or (header and formatter)) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ios::sync_with_stdio(false);
+
+  string out;
+  out.reserve(2 * OUTPUT_BYTES);
+
+  for (int i = optind; i < argc; i++) {
+    TelemetryLogReader reader(argv[i]);
+    const auto & schema = reader.schema();
+
+    if (schema_only) {
+      print_schema(argv[i], schema);
+      continue;
+    }
+
+    if (formatter and formatter->num_values() > schema.columns.size()) {
+      cerr << "Error: the log format refers to more than the "
+           << schema.columns.size() << " columns of " << argv[i] << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* once, as the logs are usually parts of the same one */
+    if (header and i == optind) {
+      for (size_t j = 0; j < schema.columns.size(); j++) {
+        out += (j > 0 ? "," : "") + schema.columns[j].name;
+      }
+      out.push_back('\n');
+    }
+
+    convert(reader, formatter, out);
+    flush_output(out);
+  }
+
+  return EXIT_SUCCESS;
+}
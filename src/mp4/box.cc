@@ -8,11 +8,13 @@ using namespace std;
 using namespace MP4;
 
 Box::Box(const uint64_t size, const string & type)
-  : size_(size), type_(type), raw_data_(), children_()
+  : size_(size), type_(type), raw_data_(), raw_data_owner_(), children_(),
+    lazy_children_()
 {}
 
 Box::Box(const string & type)
-  : size_(), type_(type), raw_data_(), children_()
+  : size_(), type_(type), raw_data_(), raw_data_owner_(), children_(),
+    lazy_children_()
 {}
 
 void Box::add_child(shared_ptr<Box> && child)
@@ -22,6 +24,8 @@ void Box::add_child(shared_ptr<Box> && child)
 
 void Box::remove_child(const string & type)
 {
+  create_lazy_children();
+
   for (auto it = children_.begin(); it != children_.end(); ) {
     if ((*it)->type() == type) {
       it = children_.erase(it);
@@ -34,6 +38,8 @@ void Box::remove_child(const string & type)
 
 void Box::insert_child(shared_ptr<Box> && child, const string & type)
 {
+  create_lazy_children();
+
   for (auto it = children_.begin(); it != children_.end(); ) {
     if ((*it)->type() == type) {
       children_.insert(++it, move(child));
@@ -46,6 +52,8 @@ void Box::insert_child(shared_ptr<Box> && child, const string & type)
 
 shared_ptr<Box> Box::find_child(const string & type)
 {
+  create_lazy_children();
+
   for (const auto & child : children_) {
     if (child->type() == type) {
       return child;
@@ -55,19 +63,47 @@ shared_ptr<Box> Box::find_child(const string & type)
   return nullptr;
 }
 
+unsigned int Box::children_size()
+{
+  create_lazy_children();
+
+  return children_.size();
+}
+
 list<shared_ptr<Box>>::const_iterator Box::children_begin()
 {
+  create_lazy_children();
+
   return children_.cbegin();
 }
 
 list<shared_ptr<Box>>::const_iterator Box::children_end()
 {
+  create_lazy_children();
+
   return children_.cend();
 }
 
+void Box::set_lazy_children(function<void(Box &)> && create_children)
+{
+  lazy_children_ = move(create_children);
+}
+
+void Box::create_lazy_children()
+{
+  if (lazy_children_) {
+    /* reset first so that the children can be added without recursing */
+    auto create_children = move(lazy_children_);
+    lazy_children_ = nullptr;
+
+    create_children(*this);
+  }
+}
+
 void Box::print_box(const unsigned int indent)
 {
   print_size_type(indent);
+  create_lazy_children();
 
   for (const auto & child : children_) {
     child->print_box(indent + 2);
@@ -76,7 +112,16 @@ void Box::print_box(const unsigned int indent)
 
 void Box::parse_data(MP4File & mp4, const uint64_t data_size)
 {
-  raw_data_ = mp4.read_exactly(narrow_cast<size_t>(data_size));
+  if (mp4.mapped()) {
+    /* no copy: view the mapping and keep it alive */
+    raw_data_ = mp4.read_view(narrow_cast<size_t>(data_size));
+    raw_data_owner_ = mp4.mapping();
+  } else {
+    auto raw_data = make_shared<const string>(
+        mp4.read_exactly(narrow_cast<size_t>(data_size)));
+    raw_data_ = *raw_data;
+    raw_data_owner_ = move(raw_data);
+  }
 }
 
 void Box::write_box(MP4File & mp4)
@@ -84,6 +129,7 @@ void Box::write_box(MP4File & mp4)
   uint64_t size_offset = mp4.curr_offset();
 
   write_size_type(mp4);
+  create_lazy_children();
 
   if (raw_data_.size()) {
     mp4.write(raw_data_);
@@ -5,6 +5,7 @@
 #include <string>
 #include <list>
 #include <memory>
+#include <functional>
 
 #include "mp4_file.hh"
 
@@ -20,7 +21,7 @@ public:
   /* accessors */
   uint64_t size() { return size_; }
   std::string type() { return type_; }
-  std::string raw_data() { return raw_data_; }
+  std::string_view raw_data() { return raw_data_; }
 
   /* parameter is a sink; use rvalue reference to save a "move" operation */
   void add_child(std::shared_ptr<Box> && child);
@@ -33,11 +34,14 @@ public:
 
   std::shared_ptr<Box> find_child(const std::string & type);
 
-  unsigned int children_size() { return children_.size(); }
+  unsigned int children_size();
 
   std::list<std::shared_ptr<Box>>::const_iterator children_begin();
   std::list<std::shared_ptr<Box>>::const_iterator children_end();
 
+  /* defer creating the children until they are first accessed */
+  void set_lazy_children(std::function<void(Box &)> && create_children);
+
   /* print the box and its children */
   virtual void print_box(const unsigned int indent = 0);
 
@@ -67,8 +71,14 @@ private:
   uint64_t size_;
   std::string type_;
 
-  std::string raw_data_;
+  /* raw data is a view into a mapped MP4 or into an owned copy */
+  std::string_view raw_data_;
+  std::shared_ptr<const void> raw_data_owner_;
+
   std::list<std::shared_ptr<Box>> children_;
+  std::function<void(Box &)> lazy_children_;
+
+  void create_lazy_children();
 };
 
 class FullBox : public Box
@@ -1,25 +1,220 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <endian.h>
+#include <sys/mman.h>
+#include <cstring>
 
 #include "exception.hh"
+#include "mmap.hh"
 #include "mp4_file.hh"
 
 using namespace std;
 using namespace MP4;
 
 MP4File::MP4File(const string & filename, int flags)
-  : FileDescriptor(CheckSystemCall("open (" + filename + ")",
-                                   open(filename.c_str(), flags)))
+  : fd_(in_place, CheckSystemCall("open (" + filename + ")",
+                                  open(filename.c_str(), flags))),
+    buffer_(), offset_(0), mapping_(), mapped_data_()
 {}
 
 MP4File::MP4File(const string & filename, int flags, mode_t mode)
-  : FileDescriptor(CheckSystemCall("open (" + filename + ")",
-                                   open(filename.c_str(), flags, mode)))
+  : fd_(in_place, CheckSystemCall("open (" + filename + ")",
+                                  open(filename.c_str(), flags, mode))),
+    buffer_(), offset_(0), mapping_(), mapped_data_()
 {}
 
+MP4File::MP4File()
+  : fd_(), buffer_(), offset_(0), mapping_(), mapped_data_()
+{}
+
+shared_ptr<MP4File> MP4File::map(const string & filename)
+{
+  auto mp4 = make_shared<MP4File>();
+
+  FileDescriptor fd(CheckSystemCall("open (" + filename + ")",
+                                    open(filename.c_str(), O_RDONLY)));
+  const size_t size = fd.filesize();
+
+  if (size == 0) {
+    /* mmap() rejects empty mappings */
+    mp4->mapping_ = make_shared<const string>();
+  } else {
+    auto mapping = mmap_shared(nullptr, size, PROT_READ, MAP_PRIVATE,
+                               fd.fd_num(), 0);
+    mp4->mapped_data_ = {static_cast<const char *>(mapping.get()), size};
+    mp4->mapping_ = move(mapping);
+  }
+
+  /* the mapping outlives the file descriptor */
+  fd.close();
+
+  return mp4;
+}
+
+string MP4File::read(const size_t limit)
+{
+  if (fd_) {
+    return fd_->read(limit);
+  }
+
+  const uint64_t size = data_size();
+  if (offset_ >= size) {
+    return {};
+  }
+
+  const size_t length = min<uint64_t>(limit, size - offset_);
+  string data = mapped() ? string(mapped_data_.substr(offset_, length))
+                         : buffer_.substr(offset_, length);
+  offset_ += length;
+  return data;
+}
+
+string MP4File::read_exactly(const size_t length)
+{
+  if (fd_) {
+    return fd_->read_exactly(length);
+  }
+
+  if (offset_ + length > data_size()) {
+    throw runtime_error("read_exactly: reached EOF before reaching target");
+  }
+
+  return read(length);
+}
+
+string_view MP4File::read_view(const size_t length)
+{
+  if (not mapped()) {
+    throw runtime_error("read_view() is only available for mapped MP4");
+  }
+
+  if (offset_ + length > mapped_data_.size()) {
+    throw runtime_error("read_view: reached EOF before reaching target");
+  }
+
+  const string_view data = mapped_data_.substr(offset_, length);
+  offset_ += length;
+  return data;
+}
+
+void MP4File::write(const string_view & data)
+{
+  if (fd_) {
+    fd_->write(data);
+    return;
+  }
+
+  if (mapped()) {
+    throw runtime_error("cannot write to a read-only mapped MP4");
+  }
+
+  if (offset_ == buffer_.size()) {
+    buffer_.append(data);
+  } else {
+    /* overwrite in place (and extend if needed) */
+    if (offset_ + data.size() > buffer_.size()) {
+      buffer_.resize(offset_ + data.size());
+    }
+    buffer_.replace(offset_, data.size(), data);
+  }
+
+  offset_ += data.size();
+}
+
+uint64_t MP4File::seek(const int64_t offset, const int whence)
+{
+  if (fd_) {
+    return fd_->seek(offset, whence);
+  }
+
+  int64_t new_offset;
+
+  switch (whence) {
+  case SEEK_SET:
+    new_offset = offset;
+    break;
+  case SEEK_CUR:
+    new_offset = offset_ + offset;
+    break;
+  case SEEK_END:
+    new_offset = data_size() + offset;
+    break;
+  default:
+    throw runtime_error("invalid whence");
+  }
+
+  if (new_offset < 0) {
+    throw runtime_error("seek before the start of MP4");
+  }
+
+  offset_ = new_offset;
+  return offset_;
+}
+
+uint64_t MP4File::curr_offset()
+{
+  return fd_ ? fd_->curr_offset() : offset_;
+}
+
+uint64_t MP4File::inc_offset(const int64_t offset)
+{
+  return seek(offset, SEEK_CUR);
+}
+
+uint64_t MP4File::filesize()
+{
+  return fd_ ? fd_->filesize() : data_size();
+}
+
+uint64_t MP4File::data_size() const
+{
+  return mapped() ? mapped_data_.size() : buffer_.size();
+}
+
+const string & MP4File::contents() const
+{
+  if (not in_memory()) {
+    throw runtime_error("contents() is only available for in-memory MP4");
+  }
+
+  return buffer_;
+}
+
+void MP4File::save_to_file(const string & filename, mode_t mode) const
+{
+  FileDescriptor fd(CheckSystemCall("open (" + filename + ")",
+      open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode)));
+
+  if (contents().size()) {
+    fd.write(contents());
+  }
+
+  fd.close();
+}
+
+template<typename T>
+T MP4File::read_mapped()
+{
+  T data;
+  memcpy(&data, read_view(sizeof(T)).data(), sizeof(T));
+
+  if constexpr (sizeof(T) == 2) {
+    return be16toh(data);
+  } else if constexpr (sizeof(T) == 4) {
+    return be32toh(data);
+  } else if constexpr (sizeof(T) == 8) {
+    return be64toh(data);
+  } else {
+    return data;
+  }
+}
+
 uint8_t MP4File::read_uint8()
 {
+  if (mapped()) {
+    return read_mapped<uint8_t>();
+  }
+
   string data = read(1);
   const uint8_t * size = reinterpret_cast<const uint8_t *>(data.c_str());
   return *size;
@@ -27,6 +222,10 @@ uint8_t MP4File::read_uint8()
 
 uint16_t MP4File::read_uint16()
 {
+  if (mapped()) {
+    return read_mapped<uint16_t>();
+  }
+
   string data = read(2);
   const uint16_t * size = reinterpret_cast<const uint16_t *>(data.c_str());
   return be16toh(*size);
@@ -34,6 +233,10 @@ uint16_t MP4File::read_uint16()
 
 uint32_t MP4File::read_uint32()
 {
+  if (mapped()) {
+    return read_mapped<uint32_t>();
+  }
+
   string data = read(4);
   const uint32_t * size = reinterpret_cast<const uint32_t *>(data.c_str());
   return be32toh(*size);
@@ -41,6 +244,10 @@ uint32_t MP4File::read_uint32()
 
 uint64_t MP4File::read_uint64()
 {
+  if (mapped()) {
+    return read_mapped<uint64_t>();
+  }
+
   string data = read(8);
   const uint64_t * size = reinterpret_cast<const uint64_t *>(data.c_str());
   return be64toh(*size);
@@ -48,6 +255,10 @@ uint64_t MP4File::read_uint64()
 
 int8_t MP4File::read_int8()
 {
+  if (mapped()) {
+    return read_mapped<int8_t>();
+  }
+
   string data = read(1);
   const int8_t * size = reinterpret_cast<const int8_t *>(data.c_str());
   return *size;
@@ -55,6 +266,10 @@ int8_t MP4File::read_int8()
 
 int16_t MP4File::read_int16()
 {
+  if (mapped()) {
+    return read_mapped<int16_t>();
+  }
+
   string data = read(2);
   const int16_t * size = reinterpret_cast<const int16_t *>(data.c_str());
   return be16toh(*size);
@@ -62,6 +277,10 @@ int16_t MP4File::read_int16()
 
 int32_t MP4File::read_int32()
 {
+  if (mapped()) {
+    return read_mapped<int32_t>();
+  }
+
   string data = read(4);
   const int32_t * size = reinterpret_cast<const int32_t *>(data.c_str());
   return be32toh(*size);
@@ -69,6 +288,10 @@ int32_t MP4File::read_int32()
 
 int64_t MP4File::read_int64()
 {
+  if (mapped()) {
+    return read_mapped<int64_t>();
+  }
+
   string data = read(8);
   const int64_t * size = reinterpret_cast<const int64_t *>(data.c_str());
   return be64toh(*size);
@@ -128,9 +351,11 @@ void MP4File::write_int64(const int64_t data)
 
 void MP4File::write_zeros(const size_t bytes)
 {
-  for (size_t i = 0; i < bytes; ++i) {
-    write(string(1, static_cast<char>(0)));
+  if (bytes == 0) {
+    return;
   }
+
+  write(string(bytes, static_cast<char>(0)));
 }
 
 void MP4File::write_string(const string & data, const size_t bytes)
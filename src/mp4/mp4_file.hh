@@ -5,17 +5,45 @@
 #include <cstdint>
 #include <string>
 #include <tuple>
+#include <optional>
+#include <memory>
 
 #include "file_descriptor.hh"
 
 namespace MP4 {
 
-class MP4File : public FileDescriptor
+/* an MP4 file on disk, a read-only MP4 mapped into memory,
+ * or an MP4 being assembled in memory */
+class MP4File
 {
 public:
   MP4File(const std::string & filename, int flags);
   MP4File(const std::string & filename, int flags, mode_t mode);
 
+  /* create an empty in-memory MP4; retrieve the result with contents() */
+  MP4File();
+
+  /* map the whole of 'filename' read-only: reads are served from the
+   * mapping without any system calls */
+  static std::shared_ptr<MP4File> map(const std::string & filename);
+
+  /* raw bytes */
+  std::string read(const size_t limit = BUFFER_SIZE);
+  std::string read_exactly(const size_t length);
+  void write(const std::string_view & data);
+
+  /* mapped MP4 only: return the next 'length' bytes as a view into the
+   * mapping, which stays valid as long as mapping() is held */
+  bool mapped() const { return mapping_ != nullptr; }
+  std::string_view read_view(const size_t length);
+  const std::shared_ptr<const void> & mapping() const { return mapping_; }
+
+  /* manipulate offset */
+  uint64_t seek(const int64_t offset, const int whence);
+  uint64_t curr_offset();
+  uint64_t inc_offset(const int64_t offset);
+  uint64_t filesize();
+
   /* read bytes from file and return meaningful data */
   uint8_t read_uint8();
   uint16_t read_uint16();
@@ -44,6 +72,31 @@ public:
   /* overwrite 'data' at 'offset' */
   void write_uint32_at(const uint32_t data, const uint64_t offset);
   void write_int32_at(const int32_t data, const uint64_t offset);
+
+  /* in-memory MP4 only */
+  bool in_memory() const { return not fd_.has_value() and not mapped(); }
+  const std::string & contents() const;
+
+  /* write the in-memory MP4 to 'filename' with a single write */
+  void save_to_file(const std::string & filename, mode_t mode = 0644) const;
+
+private:
+  std::optional<FileDescriptor> fd_;
+
+  /* contents and offset of an in-memory MP4 */
+  std::string buffer_;
+  uint64_t offset_;
+
+  /* keeps the mapping of a mapped MP4 alive; 'mapped_data_' views it */
+  std::shared_ptr<const void> mapping_;
+  std::string_view mapped_data_;
+
+  /* size of the in-memory or mapped contents */
+  uint64_t data_size() const;
+
+  /* read a big-endian integer of type T from the mapping */
+  template<typename T>
+  T read_mapped();
 };
 
 } /* namespace MP4 */
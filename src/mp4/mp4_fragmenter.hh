@@ -0,0 +1,41 @@
+#ifndef MP4_FRAGMENTER_HH
+#define MP4_FRAGMENTER_HH
+
+#include <cstdint>
+#include <string>
+
+#include "mp4_parser.hh"
+#include "mp4_file.hh"
+
+namespace MP4 {
+
+/* convert a (non-fragmented) MP4 segment into a DASH initialization segment
+ * and a media segment (styp, sidx, moof and mdat); both can be written to
+ * an in-memory MP4File so that no intermediate file is needed */
+class MP4Fragmenter
+{
+public:
+  MP4Fragmenter(const std::string & mp4_file);
+
+  /* 'global_timestamp' is the start of the segment in 90 kHz */
+  void create_media_segment(MP4File & output_mp4,
+                            const uint64_t global_timestamp);
+
+  /* modifies the parsed boxes, so it must be called last */
+  void create_init_segment(MP4File & output_mp4);
+
+private:
+  MP4Parser mp4_parser_;
+  bool init_segment_created_;
+};
+
+/* fragment 'input_mp4', whose filename is its timestamp in 90 kHz, into the
+ * media segment 'media_segment' and, if not empty, the init segment
+ * 'init_segment'; each segment is assembled in memory and written at once */
+void fragment_mp4(const std::string & input_mp4,
+                  const std::string & media_segment,
+                  const std::string & init_segment = "");
+
+} /* namespace MP4 */
+
+#endif /* MP4_FRAGMENTER_HH */
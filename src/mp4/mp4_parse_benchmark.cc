@@ -0,0 +1,114 @@
+#include <getopt.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+
+#include "mp4_parser.hh"
+#include "strict_conversions.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace MP4;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] <file.mp4>...\n\n"
+  "Compare the time to parse each MP4 through the file descriptor\n"
+  "(one read system call per field) and through a read-only mapping\n"
+  "(e.g., run it over the MP4s in the test vectors)\n\n"
+  "Options:\n"
+  "--iterations, -n    number of parses of each file per reader (default: 100)"
+  << endl;
+}
+
+/* parse 'mp4_file', look up the boxes mp4_info and mp4_fragment rely on,
+ * and serialize the parsed boxes into 'output' */
+void parse_once(const string & mp4_file, const bool use_mmap, MP4File & output)
+{
+  MP4Parser parser(mp4_file, use_mmap);
+  parser.parse();
+
+  for (const string type : {"mvhd", "mdhd", "avc1", "mp4a", "stsz", "mdat"}) {
+    parser.find_first_box_of(type);
+  }
+
+  parser.save_to_mp4(output);
+}
+
+/* return the average time in microseconds to parse 'mp4_file' */
+double benchmark(const string & mp4_file, const bool use_mmap,
+                 const unsigned int iterations, string & serialized)
+{
+  const auto begin = steady_clock::now();
+
+  for (unsigned int i = 0; i < iterations; i++) {
+    MP4File output;
+    parse_once(mp4_file, use_mmap, output);
+
+    if (i == 0) {
+      serialized = output.contents();
+    }
+  }
+
+  const auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin);
+  return static_cast<double>(elapsed.count()) / iterations;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 1) {
+    abort();
+  }
+
+  unsigned int iterations = 100;
+
+  const option cmd_line_opts[] = {
+    {"iterations", required_argument, nullptr, 'n'},
+    { nullptr,     0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'n':
+      iterations = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind >= argc or iterations == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  cout << fixed << setprecision(1);
+
+  for (int i = optind; i < argc; i++) {
+    const string mp4_file = argv[i];
+
+    string fd_output, mmap_output;
+    const double fd_us = benchmark(mp4_file, false, iterations, fd_output);
+    const double mmap_us = benchmark(mp4_file, true, iterations, mmap_output);
+
+    /* both readers must produce the same boxes */
+    if (fd_output != mmap_output) {
+      throw runtime_error(mp4_file + ": parsed boxes differ between readers");
+    }
+
+    cout << mp4_file << ": read " << fd_us << " us, mmap " << mmap_us
+         << " us (" << fd_us / mmap_us << "x)" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
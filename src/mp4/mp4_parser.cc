@@ -32,8 +32,9 @@ MP4Parser::MP4Parser()
   : mp4_(), root_box_(make_shared<Box>("root")), ignored_boxes_()
 {}
 
-MP4Parser::MP4Parser(const string & mp4_file)
-  : mp4_(make_shared<MP4File>(mp4_file, O_RDONLY)),
+MP4Parser::MP4Parser(const string & mp4_file, const bool use_mmap)
+  : mp4_(use_mmap ? MP4File::map(mp4_file)
+                  : make_shared<MP4File>(mp4_file, O_RDONLY)),
     root_box_(make_shared<Box>("root")), ignored_boxes_()
 {}
 
@@ -43,7 +44,10 @@ void MP4Parser::parse()
     throw runtime_error("MP4Parser did not open an MP4 file to parse");
   }
 
-  create_boxes(root_box_, 0, mp4_->filesize());
+  const uint64_t filesize = mp4_->filesize();
+  if (filesize > 0) {
+    create_boxes(mp4_, ignored_boxes_, *root_box_, 0, filesize);
+  }
 }
 
 void MP4Parser::ignore_box(const string & type)
@@ -96,13 +100,15 @@ void MP4Parser::save_to_mp4(MP4File & mp4)
   }
 }
 
-shared_ptr<Box> MP4Parser::box_factory(const uint64_t size,
+shared_ptr<Box> MP4Parser::box_factory(MP4File & mp4,
+                                       const set<string> & ignored_boxes,
+                                       const uint64_t size,
                                        const string & type,
                                        const uint64_t data_size)
 {
   shared_ptr<Box> box;
 
-  if (is_ignored(type)) {
+  if (ignored_boxes.count(type)) {
     /* skip parsing box but save raw data */
     box = make_shared<Box>(size, type);
   } else {
@@ -144,10 +150,10 @@ shared_ptr<Box> MP4Parser::box_factory(const uint64_t size,
       auto stsd_box = make_shared<StsdBox>(size, type);
 
       /* special case: a sample entry box of stsd can be ignored too */
-      if (is_ignored("avc1")) {
+      if (ignored_boxes.count("avc1")) {
         stsd_box->ignore_sample_entry("avc1");
       }
-      if (is_ignored("mp4a")) {
+      if (ignored_boxes.count("mp4a")) {
         stsd_box->ignore_sample_entry("mp4a");
       }
 
@@ -158,54 +164,72 @@ shared_ptr<Box> MP4Parser::box_factory(const uint64_t size,
     }
   }
 
-  uint64_t init_offset = mp4_->curr_offset();
+  uint64_t init_offset = mp4.curr_offset();
 
-  box->parse_data(*mp4_, data_size);
+  box->parse_data(mp4, data_size);
 
-  if (mp4_->curr_offset() != init_offset + data_size) {
+  if (mp4.curr_offset() != init_offset + data_size) {
     throw runtime_error("parse_data() should increment offset by data_size");
   }
 
   return box;
 }
 
-void MP4Parser::create_boxes(const shared_ptr<Box> & parent_box,
+void MP4Parser::create_boxes(const shared_ptr<MP4File> & mp4,
+                             const set<string> & ignored_boxes,
+                             Box & parent_box,
                              const uint64_t start_offset,
                              const uint64_t total_size)
 {
   while (true) {
-    uint64_t size = mp4_->read_uint32();
-    string type = mp4_->read(4);
+    uint64_t size = mp4->read_uint32();
+    string type = mp4->read(4);
     uint64_t data_size;
 
     if (size == 0) {
-      data_size = start_offset + total_size - mp4_->curr_offset();
+      data_size = start_offset + total_size - mp4->curr_offset();
       size = data_size + 8;
     } else if (size == 1) {
-      size = mp4_->read_uint64();
+      size = mp4->read_uint64();
       data_size = size - 16;
     } else {
       data_size = size - 8;
     }
 
     if (type == "uuid") {
-      mp4_->read(16); /* ignore extended_type */
+      mp4->inc_offset(16); /* ignore extended_type */
     }
 
-    if (mp4_container_boxes.find(type) != mp4_container_boxes.end()) {
+    if (mp4->mapped() and mp4_lazy_boxes.count(type)) {
+      /* skip the container for now and parse it when it is accessed */
+      auto box = make_shared<Box>(size, type);
+      const uint64_t data_offset = mp4->curr_offset();
+
+      box->set_lazy_children(
+        [mp4, ignored_boxes, data_offset, data_size](Box & lazy_box) {
+          const uint64_t prev_offset = mp4->curr_offset();
+          mp4->seek(data_offset, SEEK_SET);
+          create_boxes(mp4, ignored_boxes, lazy_box, data_offset, data_size);
+          mp4->seek(prev_offset, SEEK_SET);
+        });
+
+      mp4->inc_offset(data_size);
+      parent_box.add_child(move(box));
+    } else if (mp4_container_boxes.find(type) != mp4_container_boxes.end()) {
       /* parse a container box recursively */
       auto box = make_shared<Box>(size, type);
-      create_boxes(box, mp4_->curr_offset(), data_size);
+      create_boxes(mp4, ignored_boxes, *box, mp4->curr_offset(), data_size);
 
-      parent_box->add_child(move(box));
+      parent_box.add_child(move(box));
     } else {
       /* parse a regular box */
-      shared_ptr<Box> box = box_factory(size, type, data_size);
+      shared_ptr<Box> box = box_factory(*mp4, ignored_boxes,
+                                        size, type, data_size);
 
-      parent_box->add_child(move(box));
+      parent_box.add_child(move(box));
     }
 
-    if (mp4_->curr_offset() >= start_offset + total_size) {
+    if (mp4->curr_offset() >= start_offset + total_size) {
       break;
     }
   }
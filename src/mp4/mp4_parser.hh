@@ -16,11 +16,17 @@ const std::set<std::string> mp4_container_boxes{
   "mfra", "skip", "strk", "meta", "dinf", "ipro", "sinf", "fiin", "paen",
   "meco", "mere"};
 
+/* container boxes of a mapped MP4 whose children are parsed on first access */
+const std::set<std::string> mp4_lazy_boxes{"trak"};
+
 class MP4Parser
 {
 public:
   MP4Parser();
-  MP4Parser(const std::string & mp4_file);
+
+  /* parse boxes out of a read-only mapping of 'mp4_file' by default;
+   * 'use_mmap = false' reads through the file descriptor instead */
+  MP4Parser(const std::string & mp4_file, const bool use_mmap = true);
 
   /* parse MP4 into boxes */
   void parse();
@@ -53,15 +59,19 @@ private:
   std::set<std::string> ignored_boxes_;
 
   /* a factory method to create different boxes based on their type */
-  std::shared_ptr<Box> box_factory(const uint64_t size,
-                                   const std::string & type,
-                                   const uint64_t data_size);
+  static std::shared_ptr<Box> box_factory(
+      MP4File & mp4, const std::set<std::string> & ignored_boxes,
+      const uint64_t size, const std::string & type,
+      const uint64_t data_size);
 
   /* recursively create boxes between 'start_offset' and its following
-   * 'total_size' bytes; add created boxes as children of the 'parent_box' */
-  void create_boxes(const std::shared_ptr<Box> & parent_box,
-                    const uint64_t start_offset,
-                    const uint64_t total_size);
+   * 'total_size' bytes; add created boxes as children of the 'parent_box'.
+   * Static so that lazily parsed boxes do not depend on the parser. */
+  static void create_boxes(const std::shared_ptr<MP4File> & mp4,
+                           const std::set<std::string> & ignored_boxes,
+                           Box & parent_box,
+                           const uint64_t start_offset,
+                           const uint64_t total_size);
 
   std::shared_ptr<Box> do_find_first_box_of(const std::shared_ptr<Box> & box,
                                             const std::string & type);
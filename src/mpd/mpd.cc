@@ -18,21 +18,27 @@ using std::endl;
 using std::shared_ptr;
 
 XMLWriter::XMLWriter()
-  : tag_open_(false), newline_(true), os_(std::ostringstream()),
-    elt_stack_(std::stack<XMLNode>())
+  : XMLWriter(0)
 {
   os_ << (xml_header) << endl;
 }
 
+XMLWriter::XMLWriter(const unsigned int depth)
+  : tag_open_(false), newline_(true), depth_(depth),
+    os_(std::ostringstream()), elt_stack_(std::stack<XMLNode>())
+{}
+
 XMLWriter::~XMLWriter()
 {}
 
 void XMLWriter::open_elt(const string & tag)
 {
   close_tag();
-  if (elt_stack_.size() > 0) {
+  if (elt_stack_.size() > 0 or depth_ > 0) {
     os_ << endl;
     indent();
+  }
+  if (elt_stack_.size() > 0) {
     elt_stack_.top().hasContent = true;
   }
   os_ << "<" << tag;
@@ -104,6 +110,18 @@ void XMLWriter::content(const string & val)
   elt_stack_.top().hasContent = true;
 }
 
+void XMLWriter::raw(const string & xml)
+{
+  if (not elt_stack_.size()) {
+    throw std::runtime_error("XMLWriter: no element to insert into.");
+  }
+  close_tag();
+  os_ << xml;
+  elt_stack_.top().hasContent = true;
+  /* the fragment ends with a closed element */
+  newline_ = true;
+}
+
 inline void XMLWriter::close_tag()
 {
   if (tag_open_) {
@@ -114,7 +132,7 @@ inline void XMLWriter::close_tag()
 
 inline void XMLWriter::indent()
 {
-  for (unsigned int i = 0; i < elt_stack_.size(); i++) {
+  for (unsigned int i = 0; i < elt_stack_.size() + depth_; i++) {
     os_ << xml_indent;
   }
 }
@@ -201,23 +219,31 @@ void MPD::AdaptionSet::check_data(shared_ptr<Representation> repr)
   }
 }
 
+void MPD::AdaptionSet::set_timeline(std::vector<SegmentRun> timeline)
+{
+  timeline_ = move(timeline);
+  increment_version();
+}
+
 void MPD::AudioAdaptionSet::add_repr(shared_ptr<AudioRepresentation> repr)
 {
   AdaptionSet::check_data(repr);
   repr_set_.insert(repr);
+  increment_version();
 }
 
 void MPD::VideoAdaptionSet::add_repr(shared_ptr<VideoRepresentation> repr)
 {
   AdaptionSet::check_data(repr);
   repr_set_.insert(repr);
+  increment_version();
 }
 
 MPDWriter::MPDWriter(uint32_t min_buffer_time,
                      string base_url,
                      string time_url)
   : min_buffer_time_(min_buffer_time), publish_time_(std::time(nullptr)),
-    writer_(std::make_unique<XMLWriter>()), base_url_(base_url),
+    writer_(), base_url_(base_url),
     time_url_(time_url), video_adaption_set_(), audio_adaption_set_()
 {}
 
@@ -331,28 +357,69 @@ void MPDWriter::write_audio_repr(shared_ptr<MPD::AudioRepresentation> repr)
 
 void MPDWriter::write_video_adaption_set(shared_ptr<MPD::VideoAdaptionSet> set)
 {
-  writer_->open_elt("AdaptationSet");
-  write_adaption_set(set);
+  writer_->raw(adaption_set_xml(set));
+}
 
-  /* Write the segment */
-  for (const auto & repr : set->get_video_repr()) {
-    write_video_repr(repr);
-  }
+void MPDWriter::write_audio_adaption_set(shared_ptr<MPD::AudioAdaptionSet> set)
+{
+  writer_->raw(adaption_set_xml(set));
+}
 
-  writer_->close_elt();
+string MPDWriter::write_fragment(const unsigned int depth,
+                                 const std::function<void()> & write)
+{
+  auto document_writer = move(writer_);
+  writer_ = std::make_unique<XMLWriter>(depth);
+
+  write();
+
+  string xml = writer_->str();
+  writer_ = move(document_writer);
+  return xml;
 }
 
-void MPDWriter::write_audio_adaption_set(shared_ptr<MPD::AudioAdaptionSet> set)
+string MPDWriter::adaption_set_xml(shared_ptr<MPD::AdaptionSet> set)
 {
-  writer_->open_elt("AdaptationSet");
-  write_adaption_set(set);
+  auto & cached = adaption_set_xml_[set];
+  if (not cached.second.empty() and cached.first == set->version()) {
+    return cached.second;
+  }
+
+  /* MPD > Period > AdaptationSet */
+  cached.second = write_fragment(2, [this, &set]() {
+    writer_->open_elt("AdaptationSet");
+    write_adaption_set(set);
 
-  /* Write the segment */
-  for (const auto & repr : set->get_audio_repr()) {
-    write_audio_repr(repr);
+    /* Write the segment */
+    for (const auto & repr : set->get_repr()) {
+      writer_->raw(repr_xml(repr));
+    }
+
+    writer_->close_elt();
+  });
+  cached.first = set->version();
+
+  return cached.second;
+}
+
+string MPDWriter::repr_xml(shared_ptr<MPD::Representation> repr)
+{
+  auto it = repr_xml_.find(repr);
+  if (it != repr_xml_.end()) {
+    return it->second;
   }
 
-  writer_->close_elt();
+  /* MPD > Period > AdaptationSet > Representation */
+  string xml = write_fragment(3, [this, &repr]() {
+    if (repr->type == MPD::MimeType::Video) {
+      write_video_repr(std::static_pointer_cast<MPD::VideoRepresentation>(repr));
+    } else {
+      write_audio_repr(std::static_pointer_cast<MPD::AudioRepresentation>(repr));
+    }
+  });
+
+  repr_xml_.emplace(repr, xml);
+  return xml;
 }
 
 void MPDWriter::write_adaption_set(shared_ptr<MPD::AdaptionSet> set)
@@ -385,22 +452,35 @@ void MPDWriter::write_adaption_set(shared_ptr<MPD::AdaptionSet> set)
     writer_->attr("presentationTimeOffset", set->presentation_time_offset());
   }
 
-  writer_->attr("duration", set->duration());
-
-  /* remove timeline to make it cleaner */
-  /* write dummy segment timeline */
-  /* writer_->open_elt("SegmentTimeline");
-  writer_->open_elt("S");
-  writer_->attr("d", set->duration());
-  // use the largest number because each segment will be the same length
-  writer_->attr("r", 0xFFFFFFFF);
-  writer_->close_elt();
-  writer_->close_elt();
-  */
+  if (set->timeline().empty()) {
+    writer_->attr("duration", set->duration());
+  }
 
   /* allow bitstream switching */
   writer_->attr("bitstreamSwitching", "true");
 
+  /* the timeline of a live adaption set, if any */
+  if (not set->timeline().empty()) {
+    write_timeline(set->timeline());
+  }
+
+  writer_->close_elt();
+}
+
+void MPDWriter::write_timeline(const std::vector<MPD::SegmentRun> & timeline)
+{
+  writer_->open_elt("SegmentTimeline");
+
+  for (const auto & run : timeline) {
+    writer_->open_elt("S");
+    writer_->attr("t", std::to_string(run.time));
+    writer_->attr("d", run.duration);
+    if (run.repeat) {
+      writer_->attr("r", run.repeat);
+    }
+    writer_->close_elt();
+  }
+
   writer_->close_elt();
 }
 
@@ -443,6 +523,8 @@ void MPDWriter::add_audio_adaption_set(shared_ptr<MPD::AudioAdaptionSet> set)
 
 string MPDWriter::flush()
 {
+  writer_ = std::make_unique<XMLWriter>();
+
   writer_->open_elt("MPD");
   /* MPD scheme */
   writer_->attr("xmlns:xsi",
@@ -8,6 +8,9 @@
 #include <algorithm>
 #include <iterator>
 #include <chrono>
+#include <vector>
+#include <map>
+#include <functional>
 
 class XMLNode
 {
@@ -28,6 +31,7 @@ class XMLWriter
 private:
   bool tag_open_;
   bool newline_;
+  unsigned int depth_;
   std::ostringstream os_;
   std::stack<XMLNode> elt_stack_;
   inline void close_tag();
@@ -50,10 +54,19 @@ public:
   void content(const unsigned int val);
   void content(const std::string & val);
 
+  /* insert 'xml', written by a fragment writer of the matching depth,
+   * as a child of the current element */
+  void raw(const std::string & xml);
+
   std::string str();
   void output(std::ofstream &out);
 
+  /* a document writer, which starts with the XML declaration */
   XMLWriter();
+
+  /* a fragment writer, which indents its elements as if they were nested
+   * 'depth' elements deep in a document */
+  explicit XMLWriter(const unsigned int depth);
   ~XMLWriter();
 };
 
@@ -128,6 +141,25 @@ inline bool operator<(const Representation & a, const Representation & b)
   return a.id < b.id;
 }
 
+/* a run of 'repeat' + 1 consecutive segments of the same duration
+ * starting at 'time', i.e., an <S t d r> element of a SegmentTimeline */
+struct SegmentRun {
+  uint64_t time;
+  uint32_t duration;
+  uint32_t repeat;
+};
+
+inline bool operator==(const SegmentRun & a, const SegmentRun & b)
+{
+  return a.time == b.time and a.duration == b.duration
+         and a.repeat == b.repeat;
+}
+
+inline bool operator!=(const SegmentRun & a, const SegmentRun & b)
+{
+  return not (a == b);
+}
+
 class AdaptionSet
 {
 public:
@@ -145,6 +177,13 @@ public:
 
   virtual uint32_t size() { return get_repr().size(); }
 
+  /* an empty timeline is omitted, and "duration" describes the segments */
+  const std::vector<SegmentRun> & timeline() const { return timeline_; }
+  void set_timeline(std::vector<SegmentRun> timeline);
+
+  /* incremented whenever the set changes; lets MPDWriter cache its XML */
+  uint64_t version() const { return version_; }
+
 protected:
   void set_duration(uint32_t duration) { duration_ = duration; }
   void set_timescale(uint32_t timescale) { timescale_ = timescale; }
@@ -154,6 +193,8 @@ protected:
   void check_data(std::shared_ptr<Representation> repr);
   virtual ~AdaptionSet() {}
 
+  void increment_version() { version_++; }
+
 private:
   uint32_t id_;
   std::string init_uri_;
@@ -161,6 +202,8 @@ private:
   uint32_t duration_;
   uint32_t presentation_time_offset_ = 0;
   uint32_t timescale_ = 0;
+  std::vector<SegmentRun> timeline_ {};
+  uint64_t version_ = 0;
 };
 
 class AudioAdaptionSet : public AdaptionSet
@@ -214,6 +257,10 @@ public:
   MPDWriter(uint32_t min_buffer_time, std::string base_url,
             std::string time_url);
   ~MPDWriter();
+
+  /* serialize the MPD; can be called repeatedly as the adaption sets
+   * change, and only re-serializes the adaption sets whose version changed
+   * and the representations that were not serialized before */
   std::string flush();
   void add_video_adaption_set(std::shared_ptr<MPD::VideoAdaptionSet> set);
   void add_audio_adaption_set(std::shared_ptr<MPD::AudioAdaptionSet> set);
@@ -229,6 +276,22 @@ private:
 
   std::set<std::shared_ptr<MPD::VideoAdaptionSet>> video_adaption_set_;
   std::set<std::shared_ptr<MPD::AudioAdaptionSet>> audio_adaption_set_;
+
+  /* serialized <AdaptationSet> and the set version it was serialized at */
+  std::map<std::shared_ptr<MPD::AdaptionSet>,
+           std::pair<uint64_t, std::string>>
+  adaption_set_xml_ {};
+
+  /* serialized <Representation>; representations never change */
+  std::map<std::shared_ptr<MPD::Representation>, std::string> repr_xml_ {};
+
+  /* serialize what 'write' writes with writer_ as a fragment at 'depth' */
+  std::string write_fragment(const unsigned int depth,
+                             const std::function<void()> & write);
+  std::string adaption_set_xml(std::shared_ptr<MPD::AdaptionSet> set);
+  std::string repr_xml(std::shared_ptr<MPD::Representation> repr);
+  void write_timeline(const std::vector<MPD::SegmentRun> & timeline);
+
   std::string format_time(const time_t time);
   std::string format_time(const std::chrono::seconds & time);
   std::string format_time_now();
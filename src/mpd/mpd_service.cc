@@ -0,0 +1,505 @@
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <map>
+#include <optional>
+#include <charconv>
+#include <vector>
+#include <numeric>
+
+#include "mpd.hh"
+#include "representation.hh"
+#include "poller.hh"
+#include "inotify.hh"
+#include "file_descriptor.hh"
+#include "exception.hh"
+#include "strict_conversions.hh"
+#include "filesystem.hh"
+
+using namespace std;
+using namespace MPD;
+
+const char default_base_uri[] = "";
+const char default_audio_uri[] = "$RepresentationID$/$Time$.chk";
+const char default_video_uri[] = "$RepresentationID$/$Time$.m4s";
+const char default_video_init_uri[] = "$RepresentationID$/init.mp4";
+const char default_audio_init_uri[] = "$RepresentationID$/init.webm";
+const uint32_t default_buffer_time = 2;
+const string default_time_uri = "/time";
+const uint32_t default_num_audio_check = 3;
+
+const set<fs::path> media_extension {".m4s", ".chk"};
+
+void print_usage(const string & program_name)
+{
+  cerr
+  << "Usage: " << program_name << " [options] -o <path.mpd> <dir> <dir> ...\n\n"
+  "Keep the MPD of a live channel up to date: the media info of each\n"
+  "representation is read once, and the SegmentTimeline of each adaption\n"
+  "set follows the media segments moved into and removed from <dir>.\n\n"
+  "<dir>                        Path to video/audio folders in ready/.\n"
+  "-o --output <path.mpd>       Output mpd to <path.mpd> (replaced\n"
+  "                             atomically on every update).\n"
+  "-u --url <base_url>          Set the base url for all media segments.\n"
+  "-b --buffer-time <time>      Set the minimum buffer time in seconds.\n"
+  "-a --audio-init-name <name>  Set the audio initial segment name.\n"
+  "-v --video-init-name <name>  Set the video initial segment name.\n"
+  "-p --publish-time <time>     Set the publish time to <time> in unix\n"
+  "                             timestamp\n"
+  "-t --time-url                Set the iso time url.\n"
+  "-n --num-audio               Number of chunks to wait for in a folder\n"
+  "                             before computing its segment duration.\n"
+  << endl;
+}
+
+class MPDService
+{
+public:
+  MPDService(MPDWriter & writer,
+             const shared_ptr<VideoAdaptionSet> & v_set,
+             const shared_ptr<AudioAdaptionSet> & a_set,
+             const fs::path & video_init_name,
+             const fs::path & audio_init_name,
+             const uint32_t num_check,
+             const string & output)
+    : writer_(writer), v_set_(v_set), a_set_(a_set),
+      video_init_name_(video_init_name), audio_init_name_(audio_init_name),
+      num_check_(num_check), output_(output), dirs_(), timelines_(),
+      changed_(true)
+  {}
+
+  /* track the media segments in 'dir', now and as they come and go */
+  void watch(Inotify & inotify, const fs::path & dir);
+
+  /* write the MPD if anything changed since the last call */
+  void write_if_changed();
+
+private:
+  struct RepresentationDir
+  {
+    fs::path path;
+    fs::path extension {};  /* of the media segments */
+    set<uint64_t> segments {};
+
+    /* the adaption set the representation was added to, if added */
+    shared_ptr<AdaptionSet> adaption_set {};
+
+    RepresentationDir(const fs::path & path) : path(path) {}
+  };
+
+  MPDWriter & writer_;
+  shared_ptr<VideoAdaptionSet> v_set_;
+  shared_ptr<AudioAdaptionSet> a_set_;
+  fs::path video_init_name_;
+  fs::path audio_init_name_;
+  uint32_t num_check_;
+  string output_;
+
+  /* the segments of an adaption set and its timeline, which describes those
+   * present in all of its representations */
+  struct Timeline
+  {
+    size_t num_representations {0};
+
+    /* timestamp -> number of representations with the segment */
+    map<uint64_t, size_t> counts {};
+
+    vector<SegmentRun> runs {};
+  };
+
+  /* representation dirs must not move since inotify callbacks refer to them */
+  vector<unique_ptr<RepresentationDir>> dirs_;
+  map<shared_ptr<AdaptionSet>, Timeline> timelines_;
+  bool changed_;
+
+  void on_file_added(RepresentationDir & dir, const fs::path & filename);
+  void on_file_removed(RepresentationDir & dir, const fs::path & filename);
+
+  /* add the representation once its init segment and enough media segments
+   * are ready; it is parsed only once */
+  void try_add_representation(RepresentationDir & dir);
+
+  /* the segment 'ts' is now in every representation of the set: extend the
+   * end of the timeline, or rebuild it if the segment is not the newest */
+  void segment_completed(const shared_ptr<AdaptionSet> & adaption_set,
+                         Timeline & timeline, const uint64_t ts);
+
+  /* the segment 'ts' is no longer in every representation: trim the start
+   * of the timeline, or rebuild it if the segment is not the oldest */
+  void segment_uncompleted(const shared_ptr<AdaptionSet> & adaption_set,
+                           Timeline & timeline, const uint64_t ts);
+
+  /* recompute the timeline from the counts, on out-of-order events */
+  void rebuild_timeline(const shared_ptr<AdaptionSet> & adaption_set,
+                        Timeline & timeline);
+
+  /* only a changed timeline invalidates the cached XML of the set */
+  void publish_timeline(const shared_ptr<AdaptionSet> & adaption_set,
+                        const Timeline & timeline);
+};
+
+/* the timestamp in the name of a media segment, if any */
+optional<uint64_t> parse_timestamp(const fs::path & filename)
+{
+  const string stem = filename.stem().string();
+
+  uint64_t ts;
+  const auto [end, ec] = from_chars(stem.data(), stem.data() + stem.size(),
+                                    ts);
+  if (ec != errc() or end != stem.data() + stem.size()) {
+    return nullopt;
+  }
+
+  return ts;
+}
+
+void MPDService::watch(Inotify & inotify, const fs::path & path)
+{
+  dirs_.emplace_back(make_unique<RepresentationDir>(path));
+  RepresentationDir & dir = *dirs_.back();
+
+  inotify.add_watch(path, IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM,
+    [this, &dir](const inotify_event & event, const string &) {
+      /* only interested in regular files */
+      if ((event.mask & IN_ISDIR) or event.len == 0) {
+        return;
+      }
+
+      if (event.mask & IN_MOVED_TO) {
+        on_file_added(dir, event.name);
+      } else {
+        on_file_removed(dir, event.name);
+      }
+    }
+  );
+
+  /* process existing files */
+  for (const auto & file : fs::directory_iterator(path)) {
+    on_file_added(dir, file.path().filename());
+  }
+}
+
+void MPDService::on_file_added(RepresentationDir & dir,
+                               const fs::path & filename)
+{
+  if (not media_extension.count(filename.extension())) {
+    /* an init segment may complete the representation */
+    if (not dir.adaption_set) {
+      try_add_representation(dir);
+    }
+    return;
+  }
+
+  /* ignore stray files that are not named after their timestamps */
+  const auto ts = parse_timestamp(filename);
+  if (not ts) {
+    cerr << "Warning: ignored " << (dir.path / filename) << endl;
+    return;
+  }
+
+  if (dir.extension.empty()) {
+    dir.extension = filename.extension();
+  }
+
+  if (not dir.segments.emplace(*ts).second) {
+    return;
+  }
+
+  if (not dir.adaption_set) {
+    try_add_representation(dir);
+    return;
+  }
+
+  Timeline & timeline = timelines_.at(dir.adaption_set);
+  if (++timeline.counts[*ts] == timeline.num_representations) {
+    segment_completed(dir.adaption_set, timeline, *ts);
+  }
+}
+
+void MPDService::on_file_removed(RepresentationDir & dir,
+                                 const fs::path & filename)
+{
+  if (not media_extension.count(filename.extension())) {
+    return;
+  }
+
+  const auto ts = parse_timestamp(filename);
+  if (not ts or dir.segments.erase(*ts) == 0 or not dir.adaption_set) {
+    return;
+  }
+
+  Timeline & timeline = timelines_.at(dir.adaption_set);
+  auto it = timeline.counts.find(*ts);
+  const bool was_complete = (it->second == timeline.num_representations);
+
+  if (--it->second == 0) {
+    timeline.counts.erase(it);
+  }
+
+  if (was_complete) {
+    segment_uncompleted(dir.adaption_set, timeline, *ts);
+  }
+}
+
+void MPDService::try_add_representation(RepresentationDir & dir)
+{
+  if (dir.segments.size() < num_check_) {
+    return;
+  }
+
+  /* same assumption as mpd_writer: only WebM audio uses .chk */
+  const fs::path init = dir.path / (dir.extension == ".chk" ?
+                        audio_init_name_.filename() :
+                        video_init_name_.filename());
+  if (not fs::exists(init)) {
+    return;
+  }
+
+  /* the segment duration divides the timestamps of the earliest segments */
+  uint64_t expected_duration = 0;
+  auto it = dir.segments.begin();
+  for (uint32_t i = 0; i < num_check_; i++, it++) {
+    expected_duration = gcd(*it, expected_duration);
+  }
+
+  const fs::path segment = dir.path / (to_string(*dir.segments.begin())
+                                       + dir.extension.string());
+
+  dir.adaption_set = add_representation(
+      v_set_, a_set_, init, segment, narrow_cast<uint32_t>(expected_duration));
+  cerr << "Added representation " << dir.path.filename() << endl;
+
+  /* a late representation may lack segments of the others */
+  Timeline & timeline = timelines_[dir.adaption_set];
+  timeline.num_representations++;
+  for (const uint64_t ts : dir.segments) {
+    timeline.counts[ts]++;
+  }
+
+  rebuild_timeline(dir.adaption_set, timeline);
+  changed_ = true;
+}
+
+void MPDService::segment_completed(
+    const shared_ptr<AdaptionSet> & adaption_set, Timeline & timeline,
+    const uint64_t ts)
+{
+  const uint32_t duration = adaption_set->duration();
+
+  if (timeline.runs.empty()) {
+    timeline.runs.push_back({ts, duration, 0});
+  } else {
+    SegmentRun & last = timeline.runs.back();
+    const uint64_t end = last.time + (last.repeat + 1ull) * last.duration;
+
+    if (ts == end) {
+      last.repeat++;
+    } else if (ts > end) {
+      /* after a gap */
+      timeline.runs.push_back({ts, duration, 0});
+    } else {
+      rebuild_timeline(adaption_set, timeline);
+      return;
+    }
+  }
+
+  publish_timeline(adaption_set, timeline);
+}
+
+void MPDService::segment_uncompleted(
+    const shared_ptr<AdaptionSet> & adaption_set, Timeline & timeline,
+    const uint64_t ts)
+{
+  if (timeline.runs.empty() or timeline.runs.front().time != ts) {
+    rebuild_timeline(adaption_set, timeline);
+    return;
+  }
+
+  SegmentRun & first = timeline.runs.front();
+  if (first.repeat > 0) {
+    first.time += first.duration;
+    first.repeat--;
+  } else {
+    timeline.runs.erase(timeline.runs.begin());
+  }
+
+  publish_timeline(adaption_set, timeline);
+}
+
+void MPDService::rebuild_timeline(
+    const shared_ptr<AdaptionSet> & adaption_set, Timeline & timeline)
+{
+  const uint32_t duration = adaption_set->duration();
+  timeline.runs.clear();
+
+  for (const auto & [ts, count] : timeline.counts) {
+    if (count != timeline.num_representations) {
+      continue;
+    }
+
+    /* extend the last run if 'ts' follows it; start a new run otherwise */
+    if (not timeline.runs.empty()) {
+      SegmentRun & last = timeline.runs.back();
+      if (last.time + (last.repeat + 1ull) * last.duration == ts) {
+        last.repeat++;
+        continue;
+      }
+    }
+
+    timeline.runs.push_back({ts, duration, 0});
+  }
+
+  publish_timeline(adaption_set, timeline);
+}
+
+void MPDService::publish_timeline(
+    const shared_ptr<AdaptionSet> & adaption_set, const Timeline & timeline)
+{
+  if (timeline.runs != adaption_set->timeline()) {
+    adaption_set->set_timeline(timeline.runs);
+    changed_ = true;
+  }
+}
+
+void MPDService::write_if_changed()
+{
+  if (not changed_) {
+    return;
+  }
+  changed_ = false;
+
+  /* wait until there is something to describe */
+  if (v_set_->size() == 0 and a_set_->size() == 0) {
+    return;
+  }
+
+  const string out = writer_.flush();
+
+  /* replace the MPD atomically */
+  const string tmp_output = output_ + ".tmp";
+  FileDescriptor output_fd(CheckSystemCall("open (" + tmp_output + ")",
+      open(tmp_output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+  output_fd.write(out, true);
+  output_fd.close();
+
+  fs::rename(tmp_output, output_);
+}
+
+int main(int argc, char * argv[])
+{
+  uint32_t buffer_time = default_buffer_time;
+  string base_url = default_base_uri;
+  fs::path audio_init_name = default_audio_init_uri;
+  fs::path video_init_name = default_video_init_uri;
+  string time_url = default_time_uri;
+  uint32_t num_check = default_num_audio_check;
+
+  /* default time is when the program starts */
+  chrono::seconds publish_time = chrono::seconds(std::time(nullptr));
+  string output = "";
+
+  const char *optstring = "u:b:a:v:o:p:t:n:";
+  const struct option options[] = {
+    {"url",               required_argument, nullptr, 'u'},
+    {"buffer-time",       required_argument, nullptr, 'b'},
+    {"audio-init-name",   required_argument, nullptr, 'a'},
+    {"video-init-name",   required_argument, nullptr, 'v'},
+    {"output",            required_argument, nullptr, 'o'},
+    {"publish-time",      required_argument, nullptr, 'p'},
+    {"time-url",          required_argument, nullptr, 't'},
+    {"num-audio",         required_argument, nullptr, 'n'},
+    { nullptr,            0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, optstring, options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 'u':
+      base_url = optarg;
+      break;
+    case 'b':
+      buffer_time = stoi(optarg);
+      break;
+    case 'a':
+      audio_init_name = optarg;
+      break;
+    case 'v':
+      video_init_name = optarg;
+      break;
+    case 'p':
+      publish_time = chrono::seconds(stoi(optarg));
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'n': {
+      /* the segment duration is computed from at least one segment */
+      const int n = stoi(optarg);
+      if (n < 1) {
+        cerr << "Error: --num-audio must be at least 1" << endl;
+        return EXIT_FAILURE;
+      }
+      num_check = n;
+      break;
+    }
+    case 't':
+      time_url = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind >= argc or output.empty()) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  MPDWriter writer(buffer_time, base_url, time_url);
+  writer.set_publish_time(publish_time);
+
+  auto set_v = make_shared<VideoAdaptionSet>(1, video_init_name,
+                                             default_video_uri);
+  auto set_a = make_shared<AudioAdaptionSet>(2, audio_init_name,
+                                             default_audio_uri);
+  writer.add_video_adaption_set(set_v);
+  writer.add_audio_adaption_set(set_a);
+
+  MPDService service(writer, set_v, set_a, video_init_name, audio_init_name,
+                     num_check, output);
+
+  Poller poller;
+  Inotify inotify(poller);
+
+  for (int i = optind; i < argc; i++) {
+    const fs::path dir = argv[i];
+    if (not fs::is_directory(dir)) {
+      throw runtime_error(dir.string() + " is not a directory");
+    }
+
+    service.watch(inotify, dir);
+  }
+
+  service.write_if_changed();
+
+  /* write at most once per batch of inotify events */
+  for (;;) {
+    auto ret = poller.poll(-1);
+    if (ret.result != Poller::Result::Type::Success) {
+      return ret.exit_status;
+    }
+
+    service.write_if_changed();
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef MPD_REPRESENTATION_HH
+#define MPD_REPRESENTATION_HH
+
+#include <cstdint>
+#include <memory>
+
+#include "mpd.hh"
+#include "filesystem.hh"
+
+/* timescale of every representation in the MPD */
+const uint32_t global_timescale = 90000;
+
+bool is_webm(const fs::path & filename);
+
+/* read the media info of the representation in the folder of 'segment'
+ * from 'init' and 'segment', and add it to the video or audio adaption set;
+ * return the adaption set it was added to */
+std::shared_ptr<MPD::AdaptionSet> add_representation(
+    std::shared_ptr<MPD::VideoAdaptionSet> v_set,
+    std::shared_ptr<MPD::AudioAdaptionSet> a_set,
+    const fs::path & init, const fs::path & segment,
+    const uint32_t expected_duration);
+
+#endif /* MPD_REPRESENTATION_HH */
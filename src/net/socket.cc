@@ -232,12 +232,23 @@ string TCPSocket::get_congestion_control() const
     return optval;
 }
 
+void TCPSocket::set_pacing_rate( const uint64_t rate )
+{
+    /* honored by the fq qdisc, or by TCP itself since Linux 4.13 */
+    setsockopt( SOL_SOCKET, SO_MAX_PACING_RATE, rate );
+}
+
 TCPInfo TCPSocket::get_tcp_info() const
 {
   /* get tcp_info from the kernel */
   tcp_info x;
   getsockopt( IPPROTO_TCP, TCP_INFO, x );
 
+  return TCPInfo::from_kernel( x );
+}
+
+TCPInfo TCPInfo::from_kernel( const tcp_info & x )
+{
   /* construct a TCPInfo of our interest */
   TCPInfo ret;
   ret.cwnd = x.tcpi_snd_cwnd;
@@ -65,6 +65,8 @@ public:
     void set_timestamps( void );
 };
 
+struct tcp_info;
+
 /* tcp_info of our interest; keep the units used in the kernel */
 struct TCPInfo
 {
@@ -73,6 +75,8 @@ struct TCPInfo
   uint32_t min_rtt;   /* minimum RTT in microsecond */
   uint32_t rtt;       /* RTT in microsecond */
   uint64_t delivery_rate;  /* bytes per second */
+
+  static TCPInfo from_kernel( const tcp_info & x );
 };
 
 /* TCP socket */
@@ -103,6 +107,9 @@ public:
     /* get the current congestion control algorithm */
     std::string get_congestion_control() const;
 
+    /* cap the rate at which the kernel paces out the data (bytes/second) */
+    void set_pacing_rate( const uint64_t rate );
+
     TCPInfo get_tcp_info() const;
 };
 
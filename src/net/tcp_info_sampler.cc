@@ -0,0 +1,297 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "tcp_info_sampler.hh"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* a sock_diag dump is received in messages of up to this size */
+static const size_t NETLINK_BUFFER_SIZE = 64 * 1024;
+
+/* TCP_ESTABLISHED of <netinet/tcp.h>, which conflicts with <linux/tcp.h> */
+static const unsigned int TCP_STATE_ESTABLISHED = 1;
+
+static tcp_info copy_tcp_info(const void * data, const size_t len)
+{
+  /* older kernels fill in fewer fields */
+  tcp_info x;
+  memset(&x, 0, sizeof(x));
+  memcpy(&x, data, min(len, sizeof(x)));
+  return x;
+}
+
+static TCPInfoSample make_sample(const uint64_t now, const tcp_info & x)
+{
+  return {now, TCPInfo::from_kernel(x), x.tcpi_bytes_acked};
+}
+
+void TCPInfoRing::push(const TCPInfoSample & sample)
+{
+  if (size_ < CAPACITY) {
+    samples_[(head_ + size_) % CAPACITY] = sample;
+    size_++;
+  } else {
+    /* overwrite the oldest sample */
+    samples_[head_] = sample;
+    head_ = (head_ + 1) % CAPACITY;
+  }
+}
+
+const TCPInfoSample & TCPInfoRing::at(const size_t i) const
+{
+  if (i >= size_) {
+    throw out_of_range("TCPInfoRing: no such sample");
+  }
+
+  return samples_[(head_ + i) % CAPACITY];
+}
+
+TCPInfoTimeline TCPInfoRing::timeline(const uint64_t begin_ms,
+                                      const uint64_t end_ms) const
+{
+  TCPInfoTimeline ret;
+
+  uint64_t sum_delivery_rate = 0, sum_rtt = 0;
+
+  /* bytes acked are counted from the last sample before the period */
+  const TCPInfoSample * first = nullptr;
+  const TCPInfoSample * last = nullptr;
+
+  for (size_t i = 0; i < size_; i++) {
+    const TCPInfoSample & sample = at(i);
+
+    if (sample.timestamp_ms < begin_ms) {
+      first = &sample;
+      continue;
+    }
+
+    if (sample.timestamp_ms > end_ms) {
+      break;
+    }
+
+    if (not first) {
+      first = &sample;
+    }
+    last = &sample;
+
+    ret.samples++;
+    sum_delivery_rate += sample.info.delivery_rate;
+    sum_rtt += sample.info.rtt;
+    ret.max_rtt = max(ret.max_rtt, sample.info.rtt);
+  }
+
+  if (ret.samples == 0) {
+    return ret;
+  }
+
+  ret.mean_delivery_rate = sum_delivery_rate / ret.samples;
+  ret.mean_rtt = sum_rtt / ret.samples;
+
+  if (last->timestamp_ms > first->timestamp_ms) {
+    ret.acked_rate = (last->bytes_acked - first->bytes_acked) * 1000
+                     / (last->timestamp_ms - first->timestamp_ms);
+  }
+
+  return ret;
+}
+
+TCPInfoSampler::TCPInfoSampler(Poller & poller, const uint16_t local_port,
+                               const unsigned int interval_ms,
+                               SampleCallback && callback)
+  : local_port_(local_port), callback_(move(callback))
+{
+  if (interval_ms == 0) {
+    throw runtime_error("TCPInfoSampler: invalid sampling interval");
+  }
+
+  const int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                        NETLINK_SOCK_DIAG);
+  if (fd >= 0) {
+    netlink_.emplace(fd);
+  } else {
+    cerr << "TCPInfoSampler: netlink is unavailable ("
+         << strerror(errno) << "); sampling each socket instead" << endl;
+  }
+
+  poller.add_action(Poller::Action(timer_, Direction::In,
+    [this]() {
+      if (timer_.expirations() > 0) {
+        sample();
+      }
+      return ResultType::Continue;
+    }
+  ), "tcp_info");
+
+  timer_.start(interval_ms, interval_ms);
+}
+
+void TCPInfoSampler::add(const uint64_t id, const TCPSocket & socket)
+{
+  struct stat st;
+  CheckSystemCall("fstat", fstat(socket.fd_num(), &st));
+
+  remove(id);
+  sockets_.emplace(id, Entry {socket, st.st_ino});
+  ids_[st.st_ino] = id;
+}
+
+void TCPInfoSampler::remove(const uint64_t id)
+{
+  auto it = sockets_.find(id);
+  if (it == sockets_.end()) {
+    return;
+  }
+
+  ids_.erase(it->second.inode);
+  sockets_.erase(it);
+}
+
+void TCPInfoSampler::sample()
+{
+  if (sockets_.empty()) {
+    return;
+  }
+
+  const uint64_t now = timestamp_ms();
+
+  if (netlink_) {
+    try {
+      dump(now);
+      return;
+    } catch (const exception & e) {
+      print_exception("TCPInfoSampler", e);
+      cerr << "TCPInfoSampler: sampling each socket instead" << endl;
+      netlink_.reset();
+    }
+  }
+
+  sample_each(now);
+}
+
+void TCPInfoSampler::dump(const uint64_t now)
+{
+  /* match the sockets bound to local_port_ only */
+  const inet_diag_bc_op bytecode[] = {
+    {INET_DIAG_BC_S_GE, sizeof(inet_diag_bc_op) * 2,
+                        sizeof(inet_diag_bc_op) * 4 + 4},
+    {0, 0, local_port_},
+    {INET_DIAG_BC_S_LE, sizeof(inet_diag_bc_op) * 2,
+                        sizeof(inet_diag_bc_op) * 2 + 4},
+    {0, 0, local_port_},
+  };
+
+  struct {
+    nlmsghdr header;
+    inet_diag_req_v2 request;
+    rtattr bytecode_attr;
+    inet_diag_bc_op bytecode[4];
+  } msg;
+  memset(&msg, 0, sizeof(msg));
+
+  msg.header.nlmsg_len = sizeof(msg);
+  msg.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  msg.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  msg.header.nlmsg_seq = ++seq_;
+
+  msg.request.sdiag_family = AF_INET;
+  msg.request.sdiag_protocol = IPPROTO_TCP;
+  msg.request.idiag_states = 1 << TCP_STATE_ESTABLISHED;
+  msg.request.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+
+  msg.bytecode_attr.rta_type = INET_DIAG_REQ_BYTECODE;
+  msg.bytecode_attr.rta_len = sizeof(rtattr) + sizeof(bytecode);
+  memcpy(msg.bytecode, bytecode, sizeof(bytecode));
+
+  sockaddr_nl kernel;
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+
+  CheckSystemCall("sendto", sendto(netlink_->fd_num(), &msg, sizeof(msg), 0,
+      reinterpret_cast<const sockaddr *>(&kernel), sizeof(kernel)));
+
+  /* the dump arrives in multipart messages, terminated by NLMSG_DONE */
+  alignas(nlmsghdr) char buffer[NETLINK_BUFFER_SIZE];
+
+  for (;;) {
+    const ssize_t len = CheckSystemCall("recv",
+        recv(netlink_->fd_num(), buffer, sizeof(buffer), 0));
+
+    size_t offset = 0;
+    while (offset + sizeof(nlmsghdr) <= static_cast<size_t>(len)) {
+      const auto header = reinterpret_cast<const nlmsghdr *>(buffer + offset);
+      if (header->nlmsg_len < sizeof(nlmsghdr) or
+          offset + header->nlmsg_len > static_cast<size_t>(len)) {
+        throw runtime_error("TCPInfoSampler: truncated netlink message");
+      }
+      offset += NLMSG_ALIGN(header->nlmsg_len);
+
+      if (header->nlmsg_seq != seq_) {
+        continue;  /* left over from an earlier dump */
+      }
+
+      if (header->nlmsg_type == NLMSG_DONE) {
+        return;
+      }
+
+      if (header->nlmsg_type == NLMSG_ERROR) {
+        const auto error = static_cast<const nlmsgerr *>(NLMSG_DATA(header));
+        throw unix_error("sock_diag", -error->error);
+      }
+
+      const auto diag = static_cast<const inet_diag_msg *>(NLMSG_DATA(header));
+      const auto id_it = ids_.find(diag->idiag_inode);
+      if (id_it == ids_.end()) {
+        continue;  /* another process's socket on the same port */
+      }
+
+      /* look for the tcp_info among the attributes */
+      size_t attr_offset = NLMSG_LENGTH(sizeof(inet_diag_msg));
+      while (attr_offset + sizeof(rtattr) <= header->nlmsg_len) {
+        const auto attr = reinterpret_cast<const rtattr *>(
+            reinterpret_cast<const char *>(header) + attr_offset);
+        if (attr->rta_len < sizeof(rtattr) or
+            attr_offset + attr->rta_len > header->nlmsg_len) {
+          break;
+        }
+
+        if (attr->rta_type == INET_DIAG_INFO) {
+          callback_(id_it->second, make_sample(now,
+              copy_tcp_info(RTA_DATA(attr), RTA_PAYLOAD(attr))));
+          break;
+        }
+
+        attr_offset += RTA_ALIGN(attr->rta_len);
+      }
+    }
+  }
+}
+
+void TCPInfoSampler::sample_each(const uint64_t now)
+{
+  for (const auto & [id, entry] : sockets_) {
+    tcp_info x;
+    socklen_t len = sizeof(x);
+
+    if (getsockopt(entry.socket.fd_num(), IPPROTO_TCP, TCP_INFO,
+                   &x, &len) < 0) {
+      continue;  /* the connection is being closed */
+    }
+
+    callback_(id, make_sample(now, copy_tcp_info(&x, len)));
+  }
+}
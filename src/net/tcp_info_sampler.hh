@@ -0,0 +1,109 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef TCP_INFO_SAMPLER_HH
+#define TCP_INFO_SAMPLER_HH
+
+#include <cstdint>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+#include <sys/types.h>
+
+#include "socket.hh"
+#include "poller.hh"
+#include "timerfd.hh"
+#include "file_descriptor.hh"
+
+struct TCPInfoSample
+{
+  uint64_t timestamp_ms;  /* milliseconds since epoch */
+  TCPInfo info;
+  uint64_t bytes_acked;
+};
+
+/* summary of the samples taken over a period, e.g., while a chunk was sent */
+struct TCPInfoTimeline
+{
+  unsigned int samples {0};
+  uint64_t mean_delivery_rate {0};  /* bytes per second */
+  uint32_t mean_rtt {0};  /* microseconds */
+  uint32_t max_rtt {0};  /* microseconds */
+  uint64_t acked_rate {0};  /* bytes acked per second over the period */
+};
+
+/* the most recent samples of a connection */
+class TCPInfoRing
+{
+public:
+  static constexpr size_t CAPACITY = 64;
+
+  void push(const TCPInfoSample & sample);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  /* the i-th oldest sample */
+  const TCPInfoSample & at(const size_t i) const;
+  const TCPInfoSample & back() const { return at(size_ - 1); }
+
+  /* summarize the samples taken between begin_ms and end_ms */
+  TCPInfoTimeline timeline(const uint64_t begin_ms,
+                           const uint64_t end_ms) const;
+
+private:
+  std::array<TCPInfoSample, CAPACITY> samples_ {};
+  size_t head_ {0};  /* index of the oldest sample */
+  size_t size_ {0};
+};
+
+/* samples tcp_info of the registered TCP sockets on a timer, all at once
+ * with a sock_diag dump over netlink (one request per tick), or with one
+ * getsockopt() per socket if netlink is unavailable */
+class TCPInfoSampler
+{
+public:
+  /* must not add or remove sockets */
+  using SampleCallback = std::function<void(const uint64_t id,
+                                            const TCPInfoSample & sample)>;
+
+  /* only sockets bound to 'local_port' are dumped */
+  TCPInfoSampler(Poller & poller, const uint16_t local_port,
+                 const unsigned int interval_ms, SampleCallback && callback);
+
+  /* the socket must outlive its registration */
+  void add(const uint64_t id, const TCPSocket & socket);
+  void remove(const uint64_t id);
+
+  /* whether the samples are taken with a netlink dump */
+  bool batched() const { return netlink_.has_value(); }
+
+private:
+  uint16_t local_port_;
+  SampleCallback callback_;
+  Timerfd timer_ {};
+
+  std::optional<FileDescriptor> netlink_ {};
+  uint32_t seq_ {0};
+
+  struct Entry
+  {
+    const TCPSocket & socket;
+    ino_t inode;
+  };
+
+  /* registered sockets: id -> socket, and socket inode -> id */
+  std::map<uint64_t, Entry> sockets_ {};
+  std::unordered_map<ino_t, uint64_t> ids_ {};
+
+  void sample();
+
+  /* request and parse a dump of all the sockets on local_port_ */
+  void dump(const uint64_t now);
+
+  /* fallback: ask for the tcp_info of each socket */
+  void sample_each(const uint64_t now);
+};
+
+#endif /* TCP_INFO_SAMPLER_HH */
@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <crypto++/sha.h>
 #include <crypto++/hex.h>
 #include <crypto++/base64.h>
@@ -126,9 +127,26 @@ string WSServer<NBSecureSocket>::Connection::read()
   return socket.ezread();
 }
 
+template<class SocketType>
+void WSServer<SocketType>::Connection::fill_send_buffer()
+{
+  while (send_buffer.empty() and not frame_generators.empty()) {
+    auto frame = frame_generators.front()();
+
+    if (frame) {
+      send_buffer.emplace_back(frame->to_string());
+      peak_buffer_bytes = std::max(peak_buffer_bytes, buffer_bytes());
+    } else {
+      frame_generators.pop_front();
+    }
+  }
+}
+
 template<>
 void WSServer<TCPSocket>::Connection::write()
 {
+  fill_send_buffer();
+
   while (not send_buffer.empty()) {
     const string & buffer = send_buffer.front();
 
@@ -147,6 +165,9 @@ void WSServer<TCPSocket>::Connection::write()
       /* move onto the next item in the deque */
       send_buffer_offset = 0;
       send_buffer.pop_front();
+
+      /* the socket has taken everything so far; try the next frame */
+      fill_send_buffer();
     }
   }
 }
@@ -154,6 +175,9 @@ void WSServer<TCPSocket>::Connection::write()
 template<>
 void WSServer<NBSecureSocket>::Connection::write()
 {
+  /* called only once NBSecureSocket has written out its buffer */
+  fill_send_buffer();
+
   while (not send_buffer.empty()) {
     socket.ezwrite(move(send_buffer.front()));
     send_buffer.pop_front();
@@ -184,6 +208,10 @@ void WSServer<SocketType>::init_listener_socket()
                            forward_as_tuple(move(client), ssl_context_));
       Connection & conn = connections_.at(conn_id);
 
+      if (tcp_info_sampler_) {
+        tcp_info_sampler_->add(conn_id, conn.socket);
+      }
+
       /* add the actions for this connection */
       poller_.add_action(Poller::Action(conn.socket, Direction::In,
         [this, &conn, conn_id]()->ResultType
@@ -304,7 +332,7 @@ void WSServer<SocketType>::init_listener_socket()
           return (conn.state != Connection::State::Connecting) and
                  (conn.state != Connection::State::Closed);
         }
-      ));
+      ), "ws_read");
 
       poller_.add_action(Poller::Action(conn.socket, Direction::Out,
         [this, &conn, conn_id]()->ResultType
@@ -343,7 +371,7 @@ void WSServer<SocketType>::init_listener_socket()
                    conn.state == Connection::State::Closed) and
                   conn.interested_in_sending());
         }
-      ));
+      ), "ws_write");
 
       if (connections_.size() >= MAX_CONNECTION_NUM) {
         listener_socket_.close();
@@ -353,7 +381,7 @@ void WSServer<SocketType>::init_listener_socket()
 
       return ResultType::Continue;
     }
-  ));
+  ), "ws_accept");
 }
 
 template<class SocketType>
@@ -376,12 +404,61 @@ bool WSServer<SocketType>::queue_frame(const uint64_t connection_id,
     return false;
   }
 
+  /* keep the order with the frames yet to be generated */
+  if (not conn.frame_generators.empty()) {
+    conn.frame_generators.emplace_back(
+      [next = optional<WSFrame>(frame)]() mutable
+      {
+        optional<WSFrame> ret = move(next);
+        next.reset();
+        return ret;
+      }
+    );
+    return true;
+  }
+
   /* frame.to_string() inevitably copies frame.payload_ into the return string,
    * but the return string will be moved into conn.send_buffer without copy */
   conn.send_buffer.emplace_back(frame.to_string());
+
+  conn.peak_buffer_bytes = max(conn.peak_buffer_bytes, conn.buffer_bytes());
   return true;
 }
 
+template<class SocketType>
+bool WSServer<SocketType>::queue_frames(const uint64_t connection_id,
+                                        FrameGenerator && generator)
+{
+  Connection & conn = connections_.at(connection_id);
+
+  if (conn.state != Connection::State::Connected) {
+    cerr << connection_id << ": not connected; cannot queue frames" << endl;
+    return false;
+  }
+
+  conn.frame_generators.emplace_back(move(generator));
+  return true;
+}
+
+template<class SocketType>
+bool WSServer<SocketType>::drained(const Connection & conn) const
+{
+  return max_queued_bytes_ == 0 or
+         (conn.frame_generators.empty() and
+          conn.buffer_bytes() < max_queued_bytes_);
+}
+
+template<class SocketType>
+bool WSServer<SocketType>::ready_to_send(const uint64_t connection_id)
+{
+  if (drained(connections_.at(connection_id))) {
+    return true;
+  }
+
+  blocked_connections_.insert(connection_id);
+  return false;
+}
+
 template<class SocketType>
 void WSServer<SocketType>::wait_close_connection(const uint64_t connection_id)
 {
@@ -397,7 +474,8 @@ void WSServer<SocketType>::wait_close_connection(const uint64_t connection_id)
     return;
   }
 
-  /* try to close the connection gracefully */
+  /* stop generating frames, and close the connection gracefully */
+  conn.frame_generators.clear();
   WSFrame close_frame { true, WSFrame::OpCode::Close, "" };
   queue_frame(connection_id, close_frame);
   conn.state = Connection::State::Closing;
@@ -414,6 +492,7 @@ void WSServer<SocketType>::force_close_connection(const uint64_t connection_id)
 
   auto & conn = conn_it->second;
   conn.state = Connection::State::Closed;
+  conn.frame_generators.clear();
   closed_connections_.insert(connection_id);
   close_callback_(connection_id);
 }
@@ -451,6 +530,18 @@ TCPInfo WSServer<SocketType>::get_tcp_info(const uint64_t connection_id) const
   return conn.socket.get_tcp_info();
 }
 
+template<class SocketType>
+void WSServer<SocketType>::sample_tcp_info(
+    const unsigned int interval_ms, TCPInfoSampler::SampleCallback && callback)
+{
+  tcp_info_sampler_ = make_unique<TCPInfoSampler>(
+      poller_, listener_addr_.port(), interval_ms, move(callback));
+
+  for (const auto & [conn_id, conn] : connections_) {
+    tcp_info_sampler_->add(conn_id, conn.socket);
+  }
+}
+
 template<class SocketType>
 Address WSServer<SocketType>::peer_addr(const uint64_t connection_id) const
 {
@@ -462,13 +553,13 @@ Address WSServer<SocketType>::peer_addr(const uint64_t connection_id) const
 template<>
 bool WSServer<TCPSocket>::Connection::interested_in_sending() const
 {
-  return send_buffer.size() > 0;
+  return data_to_write();
 }
 
 template<>
 bool WSServer<NBSecureSocket>::Connection::interested_in_sending() const
 {
-  return send_buffer.size() > 0 or socket.something_to_write();
+  return data_to_write() or socket.something_to_write();
 }
 
 template<>
@@ -506,15 +597,47 @@ template<>
 void WSServer<TCPSocket>::Connection::clear_buffer()
 {
   send_buffer.clear();
+  frame_generators.clear();
 }
 
 template<>
 void WSServer<NBSecureSocket>::Connection::clear_buffer()
 {
   send_buffer.clear();
+  frame_generators.clear();
   socket.clear_buffer();
 }
 
+template<class SocketType>
+size_t WSServer<SocketType>::total_buffer_bytes() const
+{
+  size_t total_bytes = 0;
+  for (const auto & conn : connections_) {
+    total_bytes += conn.second.buffer_bytes();
+  }
+
+  return total_bytes;
+}
+
+template<class SocketType>
+unsigned int WSServer<SocketType>::reset_peak_buffer_bytes()
+{
+  unsigned int peak_bytes = 0;
+  for (auto & conn : connections_) {
+    peak_bytes = max(peak_bytes, conn.second.peak_buffer_bytes);
+    conn.second.peak_buffer_bytes = conn.second.buffer_bytes();
+  }
+
+  return peak_bytes;
+}
+
+template<class SocketType>
+void WSServer<SocketType>::set_pacing_rate(const uint64_t connection_id,
+                                           const uint64_t rate)
+{
+  connections_.at(connection_id).socket.set_pacing_rate(rate);
+}
+
 template<class SocketType>
 void WSServer<SocketType>::clear_buffer(const uint64_t conn_id)
 {
@@ -528,11 +651,33 @@ Poller::Result WSServer<SocketType>::loop_once()
 
   /* let's garbage collect the closed connections */
   for (const uint64_t conn_id : closed_connections_) {
+    if (tcp_info_sampler_) {
+      tcp_info_sampler_->remove(conn_id);
+    }
     connections_.erase(conn_id);
   }
 
   closed_connections_.clear();
 
+  /* notify the blocked connections that have drained below the cap */
+  for (auto it = blocked_connections_.begin();
+       it != blocked_connections_.end();) {
+    const uint64_t conn_id = *it;
+    const auto conn_it = connections_.find(conn_id);
+
+    if (conn_it == connections_.end() or
+        conn_it->second.state != Connection::State::Connected) {
+      it = blocked_connections_.erase(it);
+    } else if (drained(conn_it->second)) {
+      it = blocked_connections_.erase(it);
+      if (drain_callback_) {
+        drain_callback_(conn_id);
+      }
+    } else {
+      it++;
+    }
+  }
+
   if (not active_ and connections_.size() < MAX_CONNECTION_NUM) {
     init_listener_socket();
   }
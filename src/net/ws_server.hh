@@ -7,6 +7,8 @@
 #include <set>
 #include <functional>
 #include <deque>
+#include <optional>
+#include <memory>
 
 #include "socket.hh"
 #include "nb_secure_socket.hh"
@@ -14,6 +16,7 @@
 #include "address.hh"
 #include "http_request_parser.hh"
 #include "ws_message_parser.hh"
+#include "tcp_info_sampler.hh"
 
 /* this implementation is not thread-safe. */
 template<class SocketType>
@@ -23,6 +26,10 @@ public:
   using MessageCallback = std::function<void(const uint64_t, const WSMessage &)>;
   using OpenCallback = std::function<void(const uint64_t)>;
   using CloseCallback = std::function<void(const uint64_t)>;
+  using DrainCallback = std::function<void(const uint64_t)>;
+
+  /* return the next frame to send, or nothing once all have been sent */
+  using FrameGenerator = std::function<std::optional<WSFrame>()>;
 
 private:
   uint64_t last_connection_id_ {0};
@@ -47,6 +54,9 @@ private:
     std::deque<std::string> send_buffer {};
     size_t send_buffer_offset {0};
 
+    /* frames are pulled from the generators only as the socket drains */
+    std::deque<FrameGenerator> frame_generators {};
+
     Connection(TCPSocket && sock, SSLContext & ssl_context);
 
     std::string read();
@@ -54,7 +64,11 @@ private:
 
     /* the connection has data to write to TCPSocket directly,
      * or write to NBSecureSocket's internal send_buffer */
-    bool data_to_write() const { return send_buffer.size() > 0; }
+    bool data_to_write() const
+    { return send_buffer.size() > 0 or frame_generators.size() > 0; }
+
+    /* generate the next frame once the previous ones have been written */
+    void fill_send_buffer();
 
     /* tell the poller if the connection is interested in sending
      * i.e., it or its NBSecureSocket has pending data in the send_buffer */
@@ -62,6 +76,9 @@ private:
 
     unsigned int buffer_bytes() const;
     void clear_buffer();
+
+    /* the most bytes queued since the last report */
+    unsigned int peak_buffer_bytes {0};
   };
 
   SSLContext ssl_context_ {};
@@ -74,14 +91,25 @@ private:
   MessageCallback message_callback_ {};
   OpenCallback open_callback_ {};
   CloseCallback close_callback_ {};
+  DrainCallback drain_callback_ {};
+
+  /* cap on the bytes queued for each connection (0: no cap), and the
+   * connections waiting to get below the cap */
+  size_t max_queued_bytes_ {0};
+  std::set<uint64_t> blocked_connections_ {};
 
   std::set<uint64_t> closed_connections_ {};
 
   bool active_ {};
   std::string congestion_control_ {};
 
+  std::unique_ptr<TCPInfoSampler> tcp_info_sampler_ {};
+
   void init_listener_socket();
 
+  /* whether the connection is under the cap of queued bytes */
+  bool drained(const Connection & conn) const;
+
   /* gracefully close the connection */
   void wait_close_connection(const uint64_t connection_id);
 
@@ -102,14 +130,33 @@ public:
   void set_message_callback(MessageCallback func) { message_callback_ = func; }
   void set_open_callback(OpenCallback func) { open_callback_ = func; }
   void set_close_callback(CloseCallback func) { close_callback_ = func; }
+  void set_drain_callback(DrainCallback func) { drain_callback_ = func; }
+
+  void set_max_queued_bytes(const size_t bytes) { max_queued_bytes_ = bytes; }
+
+  /* admission control: return true if the bytes queued for the connection
+   * are under the cap and no frames are left to generate; otherwise, return
+   * false and call the drain callback once the socket has drained */
+  bool ready_to_send(const uint64_t connection_id);
 
   bool queue_frame(const uint64_t connection_id, const WSFrame & frame);
 
+  /* queue frames to be generated one at a time as the socket drains */
+  bool queue_frames(const uint64_t connection_id, FrameGenerator && generator);
+
   Address peer_addr(const uint64_t connection_id) const;
 
   unsigned int buffer_bytes(const uint64_t connection_id) const;
   void clear_buffer(const uint64_t connection_id);
 
+  /* memory used by the send buffers: bytes queued for all connections now,
+   * and the most bytes queued for any connection since the last call */
+  size_t total_buffer_bytes() const;
+  unsigned int reset_peak_buffer_bytes();
+
+  /* pace out the connection at no more than 'rate' bytes per second */
+  void set_pacing_rate(const uint64_t connection_id, const uint64_t rate);
+
   /* public method to gracefully close a connection */
   void close_connection(const uint64_t connection_id);
 
@@ -117,6 +164,11 @@ public:
   void clean_idle_connection(const uint64_t connection_id);
 
   TCPInfo get_tcp_info(const uint64_t connection_id) const;
+
+  /* sample the tcp_info of all connections every 'interval_ms' and pass
+   * each sample to 'callback' */
+  void sample_tcp_info(const unsigned int interval_ms,
+                       TCPInfoSampler::SampleCallback && callback);
 };
 
 using WebSocketTCPServer = WSServer<TCPSocket>;
@@ -19,7 +19,7 @@ Inotify::Inotify(Poller & poller)
       [this]() {
         return handle_events();
       }
-    )
+    ), "inotify"
   );
 }
 
@@ -61,10 +61,16 @@ void Inotify::rm_watch(const int wd)
   }
 }
 
+void Inotify::set_overflow_callback(const function<void()> & callback)
+{
+  overflow_callback_ = callback;
+}
+
 Result Inotify::handle_events()
 {
-  /* explicitly ensure the buffer is sufficient to read at least one event */
-  const int BUF_LEN = sizeof(inotify_event) + NAME_MAX + 1;
+  /* explicitly ensure the buffer is sufficient to read at least one event,
+   * and read up to a batch of events at once */
+  const int BUF_LEN = 64 * (sizeof(inotify_event) + NAME_MAX + 1);
 
   /* read events */
   string event_buf = inotify_fd_.read(BUF_LEN);
@@ -76,6 +82,10 @@ Result Inotify::handle_events()
   for (const char * ptr = buf; ptr < buf + event_buf.size(); ) {
     event = reinterpret_cast<const inotify_event *>(ptr);
 
+    if ((event->mask & IN_Q_OVERFLOW) and overflow_callback_) {
+      overflow_callback_();
+    }
+
     auto map_it = map_.find(event->wd);
     /* ignore events from an unwatched descriptor */
     if (map_it != map_.end()) {
@@ -36,6 +36,10 @@ public:
   /* remove a watch descriptor from the watch list */
   void rm_watch(const int wd);
 
+  /* called when the kernel has dropped events (IN_Q_OVERFLOW), after which
+   * anything kept up to date by the events must be rebuilt */
+  void set_overflow_callback(const std::function<void()> & callback);
+
 private:
   /* inotify instance */
   FileDescriptor inotify_fd_;
@@ -43,6 +47,8 @@ private:
   /* map a watch descriptor to its associated <path, mask, callback> */
   std::unordered_map<int, std::tuple<std::string, uint32_t, callback_t>> map_;
 
+  std::function<void()> overflow_callback_ {};
+
   /* handles notified events and tells the poller to continue polling */
   Poller::Action::Result handle_events();
 };
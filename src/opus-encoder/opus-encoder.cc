@@ -3,6 +3,8 @@
 #include <memory>
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <exception>
 #include <endian.h>
 
 #include <sndfile.hh>
@@ -13,6 +15,7 @@ extern "C" {
 }
 
 #include "media_formats.hh"
+#include "filesystem.hh"
 
 const unsigned int SAMPLE_RATE = 48000; /* Hz */
 const unsigned int NUM_CHANNELS = 2;
@@ -210,7 +213,7 @@ public:
     }
   }
 
-  wav_frame_t view( const size_t offset )
+  wav_frame_t view( const size_t offset ) const
   {
     if ( offset > samples_.size() ) {
       throw out_of_range( "offset > samples_.size()" );
@@ -241,7 +244,8 @@ class AVFormatWrapper
 
   static int av_check( const int retval )
   {
-    static array<char, 256> errbuf;
+    /* not static: several outputs may be written from different threads */
+    array<char, 256> errbuf;
 
     if ( retval < 0 ) {
       if ( av_strerror( retval, errbuf.data(), errbuf.size() ) < 0 ) {
@@ -361,9 +365,61 @@ public:
   AVFormatWrapper & operator=( const AVFormatWrapper & other ) = delete;
 };
 
+/* encode the whole file, outputting every frame except the first,
+   and with prediction disabled until frame #2 */
+void encode_file( const WavWrapper & wav_file, const int bit_rate,
+                  AVFormatWrapper & output )
+{
+  /* create Opus encoder */
+  OpusEncoderWrapper encoder { bit_rate };
+
+  /* allocate memory for 20 ms of compressed Opus output */
+  opus_frame_t opus_frame;
+
+  encoder.disable_prediction();
+
+  for ( unsigned int frame_no = 0; frame_no < NUM_FRAMES_IN_OUTPUT + EXTRA_FRAMES_PREPENDED; frame_no++ ) {
+    if ( frame_no == EXTRA_FRAMES_PREPENDED ) {
+      encoder.enable_prediction();
+    }
+
+    if ( frame_no == NUM_FRAMES_IN_OUTPUT + EXTRA_FRAMES_PREPENDED - 1 ) {
+      encoder.disable_prediction();
+    }
+
+    encoder.encode( wav_file.view( frame_no * NUM_CHANNELS * NUM_SAMPLES_IN_OPUS_FRAME ), opus_frame );
+
+    if ( frame_no >= EXTRA_FRAMES_PREPENDED ) {
+      output.write( opus_frame, (frame_no - EXTRA_FRAMES_PREPENDED) * NUM_SAMPLES_IN_OPUS_FRAME );
+    }
+  }
+}
+
+int parse_bit_rate( const string & str )
+{
+  const AudioFormat audio_format { str };
+
+  if ( audio_format.bitrate <= 0 or audio_format.bitrate > 256 ) {
+    throw runtime_error( "invalid bit rate: " + str );
+  }
+
+  return audio_format.bitrate * 1000; /* bits per second */
+}
+
+/* one output of a (possibly multi-bitrate) invocation */
+struct EncoderOutput
+{
+  int bit_rate;
+  string output_filename; /* the file being written */
+  string final_filename;  /* moved here when done (if not empty) */
+};
+
 void opus_encode( int argc, char *argv[] ) {
-  if ( argc != 5 ) {
-    throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " WAV_INPUT WEBM_OUTPUT -b BIT_RATE [e.g., \"64k\"]" );
+  if ( argc < 5 or (argc - 5) % 4 != 0 ) {
+    throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " WAV_INPUT WEBM_OUTPUT -b BIT_RATE [e.g., \"64k\"]\n"
+                         "       [--extra BIT_RATE DST_DIR TMP_DIR]...\n"
+                         "--extra also encodes WAV_INPUT at BIT_RATE in the same run; the output\n"
+                         "is written in TMP_DIR and moved into DST_DIR once it is complete" );
   }
 
   /* parse arguments */
@@ -375,44 +431,67 @@ void opus_encode( int argc, char *argv[] ) {
     throw runtime_error( "-b argument is mandatory" );
   }
 
-  const AudioFormat audio_format { argv[ 4 ] };
-
-  if ( audio_format.bitrate <= 0 or audio_format.bitrate > 256 ) {
-    throw runtime_error( "invalid bit rate: " + string( argv[ 4 ] ) );
-  }
-
-  const int bit_rate = audio_format.bitrate * 1000; /* bits per second */
+  vector<EncoderOutput> outputs { { parse_bit_rate( argv[ 4 ] ), output_filename, "" } };
 
-  /* open input WAV file */
-  WavWrapper wav_file { input_filename };
+  const string output_basename = fs::path( input_filename ).stem().string() + ".webm";
 
-  /* create Opus encoder */
-  OpusEncoderWrapper encoder { bit_rate };
+  for ( int i = 5; i < argc; i += 4 ) {
+    if ( string( argv[ i ] ) != "--extra" ) {
+      throw runtime_error( "unexpected argument: " + string( argv[ i ] ) );
+    }
 
-  /* allocate memory for 20 ms of compressed Opus output */
-  opus_frame_t opus_frame;
+    outputs.push_back( { parse_bit_rate( argv[ i + 1 ] ),
+                         fs::path( argv[ i + 3 ] ) / output_basename,
+                         fs::path( argv[ i + 2 ] ) / output_basename } );
+  }
 
-  /* create .webm output */
-  AVFormatWrapper output { output_filename, bit_rate };
+  /* open input WAV file (read once, shared by every bit rate) */
+  const WavWrapper wav_file { input_filename };
 
-  /* encode the whole file, outputting every frame except the first,
-     and with prediction disabled until frame #2 */
+  {
+    /* create .webm outputs on this thread (libavformat registration is not
+       guaranteed to be thread-safe) */
+    vector<unique_ptr<AVFormatWrapper>> writers;
+    for ( const auto & output : outputs ) {
+      writers.emplace_back( make_unique<AVFormatWrapper>( output.output_filename, output.bit_rate ) );
+    }
 
-  encoder.disable_prediction();
+    if ( outputs.size() == 1 ) {
+      encode_file( wav_file, outputs.front().bit_rate, *writers.front() );
+    } else {
+      /* one encoder per bit rate, each on its own thread */
+      vector<exception_ptr> errors( outputs.size() );
+      vector<thread> encoders;
+
+      for ( size_t i = 0; i < outputs.size(); i++ ) {
+        encoders.emplace_back(
+          [&wav_file, &outputs, &writers, &errors, i] () {
+            try {
+              encode_file( wav_file, outputs[ i ].bit_rate, *writers[ i ] );
+            } catch ( ... ) {
+              errors[ i ] = current_exception();
+            }
+          } );
+      }
 
-  for ( unsigned int frame_no = 0; frame_no < NUM_FRAMES_IN_OUTPUT + EXTRA_FRAMES_PREPENDED; frame_no++ ) {
-    if ( frame_no == EXTRA_FRAMES_PREPENDED ) {
-      encoder.enable_prediction();
-    }
+      for ( auto & encoder : encoders ) {
+        encoder.join();
+      }
 
-    if ( frame_no == NUM_FRAMES_IN_OUTPUT + EXTRA_FRAMES_PREPENDED - 1 ) {
-      encoder.disable_prediction();
+      for ( const auto & error : errors ) {
+        if ( error ) {
+          rethrow_exception( error );
+        }
+      }
     }
 
-    encoder.encode( wav_file.view( frame_no * NUM_CHANNELS * NUM_SAMPLES_IN_OPUS_FRAME ), opus_frame );
+    /* writers are destroyed here, which writes out the trailers */
+  }
 
-    if ( frame_no >= EXTRA_FRAMES_PREPENDED ) {
-      output.write( opus_frame, (frame_no - EXTRA_FRAMES_PREPENDED) * NUM_SAMPLES_IN_OPUS_FRAME );
+  /* move the completed extra outputs into their destination directories */
+  for ( const auto & output : outputs ) {
+    if ( not output.final_filename.empty() ) {
+      fs::rename( output.output_filename, output.final_filename );
     }
   }
 }
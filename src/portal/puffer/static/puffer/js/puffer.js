@@ -422,6 +422,10 @@ function WebSocketClient(session_key, username_in, settings_debug,
   /* exponential backoff to reconnect */
   var reconnect_backoff = BASE_RECONNECT_BACKOFF;
 
+  /* token from the last server-init to resume the session after reconnecting
+   * (possibly to another server) with the same ABR state */
+  var resume_token = null;
+
   var set_channel_ts = null;  /* timestamp (in ms) of setting a channel */
   var startup_delay_ms = null;
 
@@ -466,6 +470,10 @@ function WebSocketClient(session_key, username_in, settings_debug,
       msg.nextAts = av_source.getNextAudioTimestamp();
     }
 
+    if (resume_token) {
+      msg.resumeToken = resume_token;
+    }
+
     ws.send(format_client_msg('client-init', msg));
 
     if (debug) {
@@ -617,6 +625,10 @@ function WebSocketClient(session_key, username_in, settings_debug,
         channel_error = true;
       }
     } else if (metadata.type === 'server-init') {
+      if (metadata.resumeToken) {
+        resume_token = metadata.resumeToken;
+      }
+
       /* return if client is able to resume */
       if (av_source && av_source.isOpen() && metadata.canResume) {
         console.log('Resuming playback');
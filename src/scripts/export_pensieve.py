@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+
+# Export the actor network of a Pensieve checkpoint (TensorFlow + TFLearn)
+# to TorchScript, which ws_media_server evaluates in process as nn_path.
+# The state layout below must match src/abr/pensieve.hh.
+
+import argparse
+import numpy as np
+import torch
+import tensorflow as tf
+
+
+S_INFO = 6
+S_LEN = 10
+A_DIM = 10
+DIM_H = 128
+
+
+class Actor(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+
+        # a 1-D convolution over a single step is a linear layer
+        self.split_0 = torch.nn.Linear(1, DIM_H)
+        self.split_1 = torch.nn.Linear(1, DIM_H)
+        self.split_2 = torch.nn.Linear(S_LEN, DIM_H)
+        self.split_3 = torch.nn.Linear(S_LEN, DIM_H)
+        self.split_4 = torch.nn.Linear(A_DIM, DIM_H)
+        self.split_5 = torch.nn.Linear(1, DIM_H)
+        self.merge = torch.nn.Linear(6 * DIM_H, DIM_H)
+        self.out = torch.nn.Linear(DIM_H, A_DIM)
+
+    def forward(self, x):
+        relu = torch.nn.functional.relu
+
+        merge = torch.cat([
+            relu(self.split_0(x[:, 0, -1:])),
+            relu(self.split_1(x[:, 1, -1:])),
+            relu(self.split_2(x[:, 2, :])),
+            relu(self.split_3(x[:, 3, :])),
+            relu(self.split_4(x[:, 4, :A_DIM])),
+            relu(self.split_5(x[:, 5, -1:])),
+        ], 1)
+
+        return torch.softmax(self.out(relu(self.merge(merge))), 1)
+
+
+def load_layer(layer, reader, name, conv=False):
+    weight = reader.get_tensor('actor/{}/W'.format(name))
+    bias = reader.get_tensor('actor/{}/b'.format(name))
+
+    if conv:
+        # [filter size, in channels, filters] with 'same' padding: a single
+        # step only meets the tap right after the left padding
+        weight = weight[(weight.shape[0] - 1) // 2]
+
+    layer.weight.data = torch.from_numpy(np.transpose(weight).copy())
+    layer.bias.data = torch.from_numpy(bias.copy())
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('checkpoint', help='Pensieve checkpoint (nn_model.ckpt)')
+    parser.add_argument('output', help='path to save the TorchScript actor')
+    args = parser.parse_args()
+
+    reader = tf.train.load_checkpoint(args.checkpoint)
+
+    actor = Actor()
+    load_layer(actor.split_0, reader, 'FullyConnected')
+    load_layer(actor.split_1, reader, 'FullyConnected_1')
+    load_layer(actor.split_2, reader, 'Conv1D', conv=True)
+    load_layer(actor.split_3, reader, 'Conv1D_1', conv=True)
+    load_layer(actor.split_4, reader, 'Conv1D_2', conv=True)
+    load_layer(actor.split_5, reader, 'FullyConnected_2')
+    load_layer(actor.merge, reader, 'FullyConnected_3')
+    load_layer(actor.out, reader, 'FullyConnected_4')
+    actor.eval()
+
+    example = torch.rand(1, S_INFO, S_LEN)
+    traced_script_module = torch.jit.trace(actor, example)
+    traced_script_module.save(args.output)
+
+
+if __name__ == '__main__':
+    main()
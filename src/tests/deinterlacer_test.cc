@@ -0,0 +1,112 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "deinterlacer.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* exit status for a test that is skipped */
+static const int EXIT_SKIP = 77;
+
+static void check(const bool condition, const string & what)
+{
+  if (not condition) {
+    throw runtime_error("check failed: " + what);
+  }
+}
+
+/* compare the AVX2 and scalar row kernels on random frames of the given
+ * size: chroma planes are half as wide, so an odd chroma width and the
+ * pixels past the last 8-pixel block of every plane are covered too */
+static void compare(const unsigned int width, const unsigned int height,
+                    const bool top_field_first, const unsigned int num_threads,
+                    mt19937 & prng)
+{
+  Deinterlacer simd(width, height, top_field_first, num_threads);
+  Deinterlacer scalar(width, height, top_field_first, num_threads);
+  scalar.disable_simd();
+
+  const size_t frame_size = simd.frame_size();
+  uniform_int_distribution<int> pixel(0, 255);
+
+  vector<vector<uint8_t>> frames(3, vector<uint8_t>(frame_size));
+  for (auto & frame : frames) {
+    for (auto & value : frame) {
+      value = pixel(prng);
+    }
+  }
+
+  const string what = to_string(width) + "x" + to_string(height)
+                      + (top_field_first ? " tff" : " bff")
+                      + " with " + to_string(num_threads) + " threads";
+
+  /* inside a sequence, and at its start and end */
+  const uint8_t * const neighbors[3][2] = {
+    {frames[0].data(), frames[2].data()},
+    {nullptr, frames[2].data()},
+    {frames[0].data(), nullptr},
+  };
+
+  for (const auto & neighbor : neighbors) {
+    vector<uint8_t> simd_first(frame_size), simd_second(frame_size);
+    vector<uint8_t> scalar_first(frame_size), scalar_second(frame_size);
+
+    simd.process(neighbor[0], frames[1].data(), neighbor[1],
+                 simd_first.data(), simd_second.data());
+    scalar.process(neighbor[0], frames[1].data(), neighbor[1],
+                   scalar_first.data(), scalar_second.data());
+
+    /* the whole frames, including the first and last two rows of each
+     * plane, whose filter reads rows clamped to the picture */
+    check(simd_first == scalar_first, "first field of " + what);
+    check(simd_second == scalar_second, "second field of " + what);
+
+    /* each output keeps one field of the current frame */
+    const unsigned int kept = top_field_first ? 0 : 1;
+    for (unsigned int y = 0; y < height; y++) {
+      const size_t offset = y * width;
+      const auto & output = ((y & 1) == kept) ? scalar_first : scalar_second;
+      check(equal(output.begin() + offset, output.begin() + offset + width,
+                  frames[1].begin() + offset), "kept row of " + what);
+    }
+  }
+}
+
+int main()
+{
+  try {
+    if (not Deinterlacer(2, 4, true).simd_enabled()) {
+      cerr << "deinterlacer_test: AVX2 is not supported; skipping" << endl;
+      return EXIT_SKIP;
+    }
+
+    mt19937 prng(20191018);
+
+    /* luma widths from below one 8-pixel block to several with tails,
+     * and heights down to a single row of each field per chroma plane */
+    const unsigned int widths[] = {2, 6, 14, 16, 18, 30, 46, 64, 130};
+    const unsigned int heights[] = {4, 8, 12, 36};
+
+    for (const unsigned int width : widths) {
+      for (const unsigned int height : heights) {
+        for (const bool top_field_first : {true, false}) {
+          compare(width, height, top_field_first, 1, prng);
+        }
+      }
+    }
+
+    /* slices split across threads */
+    compare(94, 68, true, 3, prng);
+    compare(94, 68, false, 4, prng);
+  } catch (const exception & e) {
+    print_exception("deinterlacer_test", e);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
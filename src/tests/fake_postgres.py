@@ -0,0 +1,187 @@
+# A minimal stand-in for PostgreSQL that speaks just enough of the frontend/
+# backend protocol (version 3.0) for libpq to connect without authentication,
+# prepare statements and run them in the extended query protocol. Every
+# prepared statement is answered as the session authentication query: the
+# session keys in the text array passed as $1 that start with 'valid_prefix'
+# are returned along with an expiry date an hour from now. The next
+# 'stalled_queries' queries are never answered, as if the database hung
+# without closing the connection.
+
+import time
+import struct
+import socketserver
+import threading
+
+
+SSL_REQUEST_CODE = 80877103
+GSSENC_REQUEST_CODE = 80877104
+
+TEXT_OID = 25
+INT8_OID = 20
+
+
+def message(msg_type, payload=b''):
+    return msg_type + struct.pack('!i', len(payload) + 4) + payload
+
+
+def cstring(s):
+    return s.encode() + b'\0'
+
+
+def parse_text_array(literal):
+    # parse a one-dimensional array literal, e.g., {"a","b\"c"}
+    assert literal[0] == '{' and literal[-1] == '}'
+
+    elements = []
+    i = 1
+    while i < len(literal) - 1:
+        assert literal[i] == '"'
+        i += 1
+
+        element = ''
+        while literal[i] != '"':
+            if literal[i] == '\\':
+                i += 1
+            element += literal[i]
+            i += 1
+
+        elements.append(element)
+        i += 2  # skip the closing quote and the comma
+
+    return elements
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def recv_exactly(self, n):
+        data = b''
+        while len(data) < n:
+            chunk = self.request.recv(n - len(data))
+            if not chunk:
+                raise EOFError()
+            data += chunk
+        return data
+
+    def startup(self):
+        while True:
+            length, code = struct.unpack('!ii', self.recv_exactly(8))
+            self.recv_exactly(length - 8)
+
+            # refuse encryption; libpq then carries on in plaintext
+            if code in (SSL_REQUEST_CODE, GSSENC_REQUEST_CODE):
+                self.request.sendall(b'N')
+                continue
+
+            break
+
+        out = message(b'R', struct.pack('!i', 0))  # AuthenticationOk
+        for name, value in [('server_version', '11.0'),
+                            ('client_encoding', 'UTF8'),
+                            ('standard_conforming_strings', 'on'),
+                            ('integer_datetimes', 'on'),
+                            ('DateStyle', 'ISO, MDY')]:
+            out += message(b'S', cstring(name) + cstring(value))
+        out += message(b'K', struct.pack('!ii', 1, 1))
+        out += message(b'Z', b'I')
+        self.request.sendall(out)
+
+    def bind(self, payload):
+        # skip the portal and statement names
+        i = payload.index(b'\0') + 1
+        i = payload.index(b'\0', i) + 1
+
+        num_formats = struct.unpack_from('!h', payload, i)[0]
+        i += 2 + 2 * num_formats
+
+        num_params = struct.unpack_from('!h', payload, i)[0]
+        i += 2
+
+        params = []
+        for _ in range(num_params):
+            length = struct.unpack_from('!i', payload, i)[0]
+            i += 4
+            params.append(payload[i:i + length].decode())
+            i += length
+
+        return params
+
+    def handle(self):
+        server = self.server
+
+        try:
+            self.startup()
+
+            out = b''
+            keys = []
+
+            while True:
+                msg_type = self.recv_exactly(1)
+                length = struct.unpack('!i', self.recv_exactly(4))[0]
+                payload = self.recv_exactly(length - 4)
+
+                if msg_type == b'P':  # Parse
+                    out += message(b'1')
+                elif msg_type == b'B':  # Bind
+                    keys = parse_text_array(self.bind(payload)[0])
+                    out += message(b'2')
+                elif msg_type == b'D':  # Describe
+                    fields = b''
+                    for name, oid, size in [('session_key', TEXT_OID, -1),
+                                            ('int8', INT8_OID, 8)]:
+                        fields += cstring(name) + struct.pack(
+                            '!ihihih', 0, 0, oid, size, -1, 0)
+                    out += message(b'T', struct.pack('!h', 2) + fields)
+                elif msg_type == b'E':  # Execute
+                    expire_ms = str(int(time.time() * 1000) + 3600 * 1000)
+                    rows = 0
+                    for key in keys:
+                        if not key.startswith(server.valid_prefix):
+                            continue
+                        row = struct.pack('!h', 2)
+                        for value in [key.encode(), expire_ms.encode()]:
+                            row += struct.pack('!i', len(value)) + value
+                        out += message(b'D', row)
+                        rows += 1
+                    out += message(b'C', cstring('SELECT {}'.format(rows)))
+
+                    with server.lock:
+                        server.queries += 1
+                elif msg_type == b'S':  # Sync
+                    with server.lock:
+                        stall = server.stalled_queries > 0
+                        if stall:
+                            server.stalled_queries -= 1
+
+                    if stall:
+                        # hold the connection until the client gives up
+                        while self.request.recv(4096):
+                            pass
+                        return
+
+                    time.sleep(server.latency)
+                    out += message(b'Z', b'I')
+                    self.request.sendall(out)
+                    out = b''
+                elif msg_type == b'X':  # Terminate
+                    return
+                else:
+                    raise ValueError('unsupported message: ' + str(msg_type))
+        except EOFError:
+            return
+
+
+class FakePostgres(socketserver.ThreadingTCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, port, latency=0.0, valid_prefix='valid'):
+        super().__init__(('127.0.0.1', port), Handler)
+        self.latency = latency
+        self.valid_prefix = valid_prefix
+        self.queries = 0
+        self.stalled_queries = 0
+        self.lock = threading.Lock()
+
+    def start(self):
+        thread = threading.Thread(target=self.serve_forever)
+        thread.daemon = True
+        thread.start()
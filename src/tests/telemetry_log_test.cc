@@ -0,0 +1,198 @@
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "telemetry_log.hh"
+#include "temp_file.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const TelemetrySchema schema {
+  "video_acked", 1, {
+    {"time", TelemetryColumn::Type::Int, 0},
+    {"channel", TelemetryColumn::Type::String, 0},
+    {"video_ts", TelemetryColumn::Type::Int, 0},
+    {"ssim_index", TelemetryColumn::Type::Float, 6},
+    {"buffer", TelemetryColumn::Type::Float, 3},
+  }
+};
+
+/* every row of the log as CSV */
+static string read_csv(const string & path)
+{
+  TelemetryLogReader reader(path);
+
+  string csv;
+  while (reader.next_block()) {
+    for (size_t row = 0; row < reader.num_rows(); row++) {
+      for (size_t i = 0; i < reader.schema().columns.size(); i++) {
+        csv += (i > 0) ? "," : "";
+        reader.append_as_text(csv, row, i);
+      }
+      csv += "\n";
+    }
+  }
+
+  return csv;
+}
+
+static void check(const bool condition, const string & what)
+{
+  if (not condition) {
+    throw runtime_error("check failed: " + what);
+  }
+}
+
+/* whether reading every block of the log, or opening a writer to append to
+ * it, throws */
+static bool rejected(const string & path, const bool by_writer)
+{
+  try {
+    if (by_writer) {
+      TelemetryLogWriter writer(path, schema);
+    } else {
+      read_csv(path);
+    }
+  } catch (const runtime_error &) {
+    return true;
+  }
+
+  return false;
+}
+
+/* the log with 'length' bytes at 'offset' replaced by 'bytes' */
+static void overwrite(TempFile & log, const string & original,
+                      const size_t offset, const string & bytes)
+{
+  string modified = original;
+  modified.replace(offset, bytes.size(), bytes);
+
+  CheckSystemCall("ftruncate", ftruncate(log.fd().fd_num(), 0));
+  log.fd().seek(0, SEEK_SET);
+  log.fd().write(modified);
+}
+
+static void put_u32(string & out, const uint32_t value)
+{
+  for (unsigned int i = 0; i < 4; i++) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+static uint32_t fnv1a(const string & data)
+{
+  uint32_t hash = 2166136261u;
+  for (const char c : data) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+int main()
+{
+  try {
+    TempFile log("/tmp/telemetry_log_test");
+
+    /* rows as the text logs write them */
+    string expected;
+    {
+      /* three blocks of two rows, and one row flushed on destruction */
+      TelemetryLogWriter writer(log.name(), schema, 2);
+
+      for (int64_t i = 0; i < 7; i++) {
+        const string channel = (i % 3 == 0) ? "nbc" : "cbs";
+        const int64_t video_ts = (3 - i) * 180180;
+
+        writer.append({1571234567890 + i, channel, video_ts,
+                       0.5 + i / 7.0, i});
+
+        string line;
+        append_as_text(line, 1571234567890 + i);
+        line += "," + channel + ",";
+        append_as_text(line, video_ts);
+        line += "," + to_string(0.5 + i / 7.0) + "," + to_string(i) + ".000";
+        expected += line + "\n";
+      }
+
+      check(writer.buffered_rows() == 1, "rows buffered");
+    }
+
+    check(read_csv(log.name()) == expected, "rows read back");
+
+    /* a block cut short by a crash is ignored, then dropped on append */
+    const string complete = read_csv(log.name());
+    log.fd().seek(0, SEEK_END);
+    log.fd().write(string("BLCK\x05\x00\x00\x00", 8));
+    check(read_csv(log.name()) == complete, "truncated block ignored");
+
+    {
+      TelemetryLogWriter writer(log.name(), schema);
+      writer.append({int64_t(-1), "abc", int64_t(0), -2.25, 1.0});
+      expected += "-1,abc,0,-2.250000,1.000\n";
+    }
+
+    check(read_csv(log.name()) == expected, "rows appended");
+
+    /* the log is only appended to with the same schema */
+    TelemetrySchema other = schema;
+    other.version++;
+
+    bool thrown = false;
+    try {
+      TelemetryLogWriter writer(log.name(), other);
+    } catch (const runtime_error &) {
+      thrown = true;
+    }
+    check(thrown, "schema mismatch");
+
+    /* rows must match the schema */
+    thrown = false;
+    try {
+      TelemetryLogWriter writer(log.name(), schema);
+      writer.append({int64_t(0), int64_t(0), int64_t(0), 0.0, 0.0});
+    } catch (const runtime_error &) {
+      thrown = true;
+    }
+    check(thrown, "invalid row");
+
+    /* corrupted blocks are rejected when read, and when skipped to append */
+    log.fd().seek(0, SEEK_SET);
+    const string original = log.fd().read_exactly(log.fd().filesize());
+    const size_t block = original.find("BLCK");
+    check(block != string::npos, "block found");
+
+    /* in the payload, or in the number of rows it is decoded with */
+    overwrite(log, original, original.size() - 1,
+              string(1, original.back() ^ 1));
+    check(rejected(log.name(), false), "corrupted payload read");
+    check(rejected(log.name(), true), "corrupted payload appended to");
+
+    overwrite(log, original, block + 4, string("\xff\xff\xff\x7f", 4));
+    check(rejected(log.name(), false), "corrupted row count read");
+    check(rejected(log.name(), true), "corrupted row count appended to");
+
+    /* more rows than the payload can hold, even with a valid checksum */
+    const uint32_t num_rows = 1 << 30;
+    const uint32_t payload_size = 5 * 4;
+    string forged = "BLCK";
+    put_u32(forged, num_rows);
+    put_u32(forged, payload_size);
+    string fields, payload;
+    put_u32(fields, num_rows);
+    put_u32(fields, payload_size);
+    for (unsigned int i = 0; i < 5; i++) {
+      put_u32(payload, 0);
+    }
+    put_u32(forged, fnv1a(fields + payload));
+    overwrite(log, original.substr(0, block) + forged + payload, 0, "");
+    check(rejected(log.name(), false), "row count beyond the payload");
+  } catch (const exception & e) {
+    print_exception("telemetry_log_test", e);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+#include "deinterlacer.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEINTERLACER_X86 1
+#endif
+
+using namespace std;
+
+/* filter coefficients of bwdif (scaled by 2^13) */
+static const int coef_lf[2] = { 4309, 213 };
+static const int coef_hf[3] = { 5570, 3801, 1016 };
+static const int coef_sp[2] = { 5077, 981 };
+
+namespace {
+
+/* the lines around a missing line that the filter reads */
+struct LineRefs
+{
+  /* kept field of the current frame at rows -3, -1, +1, +3 */
+  const uint8_t * cur[4];
+
+  /* kept field of the previous and next frames at rows -1, +1 */
+  const uint8_t * prev[2];
+  const uint8_t * next[2];
+
+  /* missing field in its earlier and later temporal neighbors
+   * at rows -4, -2, 0, +2, +4 */
+  const uint8_t * prev2[5];
+  const uint8_t * next2[5];
+};
+
+void filter_line_c(uint8_t * dst, const LineRefs & r,
+                   const unsigned int begin, const unsigned int end)
+{
+  for (unsigned int x = begin; x < end; x++) {
+    const int c = r.cur[1][x];
+    const int e = r.cur[2][x];
+    const int d = (r.prev2[2][x] + r.next2[2][x]) >> 1;
+
+    const int temporal_diff0 = abs(r.prev2[2][x] - r.next2[2][x]);
+    const int temporal_diff1 = (abs(r.prev[0][x] - c) + abs(r.prev[1][x] - e)) >> 1;
+    const int temporal_diff2 = (abs(r.next[0][x] - c) + abs(r.next[1][x] - e)) >> 1;
+    int diff = max({temporal_diff0 >> 1, temporal_diff1, temporal_diff2});
+
+    if (diff == 0) {
+      dst[x] = d;
+      continue;
+    }
+
+    /* spatial check */
+    const int b = ((r.prev2[1][x] + r.next2[1][x]) >> 1) - c;
+    const int f = ((r.prev2[3][x] + r.next2[3][x]) >> 1) - e;
+    const int dc = d - c;
+    const int de = d - e;
+    const int hi = max({de, dc, min(b, f)});
+    const int lo = min({de, dc, max(b, f)});
+    diff = max({diff, lo, -hi});
+
+    int interpol;
+    if (abs(c - e) > temporal_diff0) {
+      interpol = (((coef_hf[0] * (r.prev2[2][x] + r.next2[2][x])
+                    - coef_hf[1] * (r.prev2[1][x] + r.next2[1][x]
+                                    + r.prev2[3][x] + r.next2[3][x])
+                    + coef_hf[2] * (r.prev2[0][x] + r.next2[0][x]
+                                    + r.prev2[4][x] + r.next2[4][x])) >> 2)
+                  + coef_lf[0] * (c + e)
+                  - coef_lf[1] * (r.cur[0][x] + r.cur[3][x])) >> 13;
+    } else {
+      interpol = (coef_sp[0] * (c + e)
+                  - coef_sp[1] * (r.cur[0][x] + r.cur[3][x])) >> 13;
+    }
+
+    interpol = clamp(interpol, d - diff, d + diff);
+    dst[x] = clamp(interpol, 0, 255);
+  }
+}
+
+#ifdef DEINTERLACER_X86
+
+/* load 8 pixels widened to 32-bit lanes */
+__attribute__((target("avx2")))
+inline __m256i load8(const uint8_t * p)
+{
+  return _mm256_cvtepu8_epi32(
+    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i add8(const uint8_t * p, const uint8_t * q)
+{
+  return _mm256_add_epi32(load8(p), load8(q));
+}
+
+/* processes 8 pixels per iteration with the same integer arithmetic as
+ * filter_line_c, so both produce identical output */
+__attribute__((target("avx2")))
+unsigned int filter_line_avx2(uint8_t * dst, const LineRefs & r,
+                              const unsigned int width)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i max_pixel = _mm256_set1_epi32(255);
+  const __m256i lf0 = _mm256_set1_epi32(coef_lf[0]);
+  const __m256i lf1 = _mm256_set1_epi32(coef_lf[1]);
+  const __m256i hf0 = _mm256_set1_epi32(coef_hf[0]);
+  const __m256i hf1 = _mm256_set1_epi32(coef_hf[1]);
+  const __m256i hf2 = _mm256_set1_epi32(coef_hf[2]);
+  const __m256i sp0 = _mm256_set1_epi32(coef_sp[0]);
+  const __m256i sp1 = _mm256_set1_epi32(coef_sp[1]);
+
+  unsigned int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256i c = load8(r.cur[1] + x);
+    const __m256i e = load8(r.cur[2] + x);
+    const __m256i p0 = load8(r.prev2[2] + x);
+    const __m256i n0 = load8(r.next2[2] + x);
+    const __m256i sum0 = _mm256_add_epi32(p0, n0);
+    const __m256i d = _mm256_srai_epi32(sum0, 1);
+
+    const __m256i td0 = _mm256_abs_epi32(_mm256_sub_epi32(p0, n0));
+    const __m256i td1 = _mm256_srai_epi32(_mm256_add_epi32(
+      _mm256_abs_epi32(_mm256_sub_epi32(load8(r.prev[0] + x), c)),
+      _mm256_abs_epi32(_mm256_sub_epi32(load8(r.prev[1] + x), e))), 1);
+    const __m256i td2 = _mm256_srai_epi32(_mm256_add_epi32(
+      _mm256_abs_epi32(_mm256_sub_epi32(load8(r.next[0] + x), c)),
+      _mm256_abs_epi32(_mm256_sub_epi32(load8(r.next[1] + x), e))), 1);
+    const __m256i temporal_diff = _mm256_max_epi32(
+      _mm256_max_epi32(_mm256_srai_epi32(td0, 1), td1), td2);
+
+    /* spatial check */
+    const __m256i sum_m2 = add8(r.prev2[1] + x, r.next2[1] + x);
+    const __m256i sum_p2 = add8(r.prev2[3] + x, r.next2[3] + x);
+    const __m256i b = _mm256_sub_epi32(_mm256_srai_epi32(sum_m2, 1), c);
+    const __m256i f = _mm256_sub_epi32(_mm256_srai_epi32(sum_p2, 1), e);
+    const __m256i dc = _mm256_sub_epi32(d, c);
+    const __m256i de = _mm256_sub_epi32(d, e);
+    const __m256i hi = _mm256_max_epi32(_mm256_max_epi32(de, dc),
+                                        _mm256_min_epi32(b, f));
+    const __m256i lo = _mm256_min_epi32(_mm256_min_epi32(de, dc),
+                                        _mm256_max_epi32(b, f));
+    const __m256i diff = _mm256_max_epi32(
+      _mm256_max_epi32(temporal_diff, lo), _mm256_sub_epi32(zero, hi));
+
+    /* both interpolations, selected per pixel */
+    const __m256i ce = _mm256_add_epi32(c, e);
+    const __m256i outer = add8(r.cur[0] + x, r.cur[3] + x);
+    const __m256i sp_interpol = _mm256_srai_epi32(_mm256_sub_epi32(
+      _mm256_mullo_epi32(sp0, ce), _mm256_mullo_epi32(sp1, outer)), 13);
+
+    const __m256i sum_m4 = add8(r.prev2[0] + x, r.next2[0] + x);
+    const __m256i sum_p4 = add8(r.prev2[4] + x, r.next2[4] + x);
+    const __m256i hf = _mm256_srai_epi32(_mm256_add_epi32(
+      _mm256_sub_epi32(_mm256_mullo_epi32(hf0, sum0),
+                       _mm256_mullo_epi32(hf1, _mm256_add_epi32(sum_m2, sum_p2))),
+      _mm256_mullo_epi32(hf2, _mm256_add_epi32(sum_m4, sum_p4))), 2);
+    const __m256i hf_interpol = _mm256_srai_epi32(_mm256_sub_epi32(
+      _mm256_add_epi32(hf, _mm256_mullo_epi32(lf0, ce)),
+      _mm256_mullo_epi32(lf1, outer)), 13);
+
+    const __m256i use_hf = _mm256_cmpgt_epi32(
+      _mm256_abs_epi32(_mm256_sub_epi32(c, e)), td0);
+    __m256i interpol = _mm256_blendv_epi8(sp_interpol, hf_interpol, use_hf);
+
+    interpol = _mm256_min_epi32(interpol, _mm256_add_epi32(d, diff));
+    interpol = _mm256_max_epi32(interpol, _mm256_sub_epi32(d, diff));
+    interpol = _mm256_min_epi32(_mm256_max_epi32(interpol, zero), max_pixel);
+
+    /* no motion at all: take the temporal average */
+    interpol = _mm256_blendv_epi8(interpol, d,
+                                  _mm256_cmpeq_epi32(temporal_diff, zero));
+
+    /* narrow 8 x 32-bit to 8 x 8-bit (each 128-bit lane keeps its 4 pixels) */
+    const __m256i packed16 = _mm256_packus_epi32(interpol, interpol);
+    const __m256i packed8 = _mm256_packus_epi16(packed16, packed16);
+    const int low = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed8));
+    const int high = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed8, 1));
+    memcpy(dst + x, &low, 4);
+    memcpy(dst + x + 4, &high, 4);
+  }
+
+  return x;
+}
+
+#endif /* DEINTERLACER_X86 */
+
+/* nearest row inside [0, height) with the same parity as `row` */
+inline unsigned int clamp_row(int row, const int height)
+{
+  while (row < 0) {
+    row += 2;
+  }
+
+  while (row >= height) {
+    row -= 2;
+  }
+
+  return row;
+}
+
+}
+
+Deinterlacer::Deinterlacer(const unsigned int width, const unsigned int height,
+                           const bool top_field_first,
+                           const unsigned int num_threads)
+  : width_(width), height_(height), top_field_first_(top_field_first),
+    num_threads_(max(num_threads, 1u)), frame_size_(), use_avx2_(false),
+    planes_()
+{
+  if (width_ == 0 or height_ == 0 or width_ % 2 != 0 or height_ % 4 != 0) {
+    throw runtime_error("Deinterlacer: width must be a multiple of 2 "
+                        "and height a multiple of 4");
+  }
+
+  const size_t luma_size = width_ * height_;
+  const size_t chroma_size = (width_ / 2) * (height_ / 2);
+
+  planes_[0] = { 0, width_, height_ };
+  planes_[1] = { luma_size, width_ / 2, height_ / 2 };
+  planes_[2] = { luma_size + chroma_size, width_ / 2, height_ / 2 };
+  frame_size_ = luma_size + 2 * chroma_size;
+
+#ifdef DEINTERLACER_X86
+  __builtin_cpu_init();
+  use_avx2_ = __builtin_cpu_supports("avx2");
+#endif
+}
+
+void Deinterlacer::filter_slice(const uint8_t * prev, const uint8_t * cur,
+                                const uint8_t * next, uint8_t * output,
+                                const unsigned int parity,
+                                const bool second_field,
+                                const unsigned int slice,
+                                const unsigned int num_slices) const
+{
+  /* temporal neighbors of the missing field: the first field of a frame
+   * sits between the previous and current frames' missing lines, the
+   * second field between the current and next frames' */
+  const uint8_t * earlier = second_field ? cur : prev;
+  const uint8_t * later = second_field ? next : cur;
+
+  for (const Plane & plane : planes_) {
+    const int h = plane.height;
+    const unsigned int w = plane.width;
+    const unsigned int row_begin = plane.height * slice / num_slices;
+    const unsigned int row_end = plane.height * (slice + 1) / num_slices;
+
+    auto row = [&plane, w, h](const uint8_t * frame, const int y) {
+      return frame + plane.offset + clamp_row(y, h) * w;
+    };
+
+    for (unsigned int y = row_begin; y < row_end; y++) {
+      uint8_t * dst = output + plane.offset + y * w;
+
+      if ((y & 1) == parity) {
+        /* line of the kept field */
+        memcpy(dst, cur + plane.offset + y * w, w);
+        continue;
+      }
+
+      const int iy = y;
+      const LineRefs refs {
+        { row(cur, iy - 3), row(cur, iy - 1), row(cur, iy + 1), row(cur, iy + 3) },
+        { row(prev, iy - 1), row(prev, iy + 1) },
+        { row(next, iy - 1), row(next, iy + 1) },
+        { row(earlier, iy - 4), row(earlier, iy - 2), row(earlier, iy),
+          row(earlier, iy + 2), row(earlier, iy + 4) },
+        { row(later, iy - 4), row(later, iy - 2), row(later, iy),
+          row(later, iy + 2), row(later, iy + 4) }
+      };
+
+      unsigned int x = 0;
+#ifdef DEINTERLACER_X86
+      if (use_avx2_) {
+        x = filter_line_avx2(dst, refs, w);
+      }
+#endif
+      filter_line_c(dst, refs, x, w);
+    }
+  }
+}
+
+void Deinterlacer::process(const uint8_t * prev, const uint8_t * cur,
+                           const uint8_t * next,
+                           uint8_t * first_field_output,
+                           uint8_t * second_field_output) const
+{
+  if (cur == nullptr) {
+    throw runtime_error("Deinterlacer: current frame must not be null");
+  }
+
+  /* repeat the current frame at the boundaries of a sequence */
+  prev = prev ? prev : cur;
+  next = next ? next : cur;
+
+  const unsigned int first_parity = top_field_first_ ? 0 : 1;
+
+  auto run_slice = [&](const unsigned int slice) {
+    filter_slice(prev, cur, next, first_field_output,
+                 first_parity, false, slice, num_threads_);
+    filter_slice(prev, cur, next, second_field_output,
+                 1 - first_parity, true, slice, num_threads_);
+  };
+
+  if (num_threads_ == 1) {
+    run_slice(0);
+    return;
+  }
+
+  vector<thread> workers;
+  for (unsigned int slice = 1; slice < num_threads_; slice++) {
+    workers.emplace_back(run_slice, slice);
+  }
+
+  run_slice(0);
+
+  for (auto & worker : workers) {
+    worker.join();
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef DEINTERLACER_HH
+#define DEINTERLACER_HH
+
+#include <cstdint>
+#include <cstddef>
+
+/* Field-rate deinterlacer for planar 8-bit YUV 4:2:0 frames, modeled on
+ * ffmpeg's "bwdif" filter in its default mode: every interlaced frame yields
+ * two progressive frames, one per field, in temporal order. The lines of the
+ * kept field are copied and the missing lines are interpolated from the
+ * neighboring fields with the w3fdif/yadif-style temporal-spatial filter.
+ * Unlike bwdif, which switches to a simpler filter near the top and bottom
+ * edges, every missing line uses the full filter, with the rows it reads
+ * beyond the picture replaced by the nearest row of the same field.
+ *
+ * Each frame is a contiguous Y, Cb, Cr picture as stored in a Y4M file.
+ * Rows are processed with AVX2 when the CPU supports it, and split into
+ * slices across `num_threads` threads. */
+class Deinterlacer
+{
+public:
+  Deinterlacer(const unsigned int width, const unsigned int height,
+               const bool top_field_first,
+               const unsigned int num_threads = 1);
+
+  /* deinterlace `cur`; `prev` and `next` are the adjacent frames and may be
+   * nullptr at the start or end of a sequence. Both output buffers must hold
+   * frame_size() bytes */
+  void process(const uint8_t * prev, const uint8_t * cur,
+               const uint8_t * next,
+               uint8_t * first_field_output,
+               uint8_t * second_field_output) const;
+
+  size_t frame_size() const { return frame_size_; }
+
+  /* whether the AVX2 row kernel is in use */
+  bool simd_enabled() const { return use_avx2_; }
+
+  /* use the scalar row kernel only (e.g., to compare both) */
+  void disable_simd() { use_avx2_ = false; }
+
+private:
+  unsigned int width_, height_;
+  bool top_field_first_;
+  unsigned int num_threads_;
+  size_t frame_size_;
+  bool use_avx2_;
+
+  struct Plane
+  {
+    size_t offset;
+    unsigned int width;
+    unsigned int height;
+  };
+
+  Plane planes_[3];
+
+  /* produce rows [row_begin, row_end) of every plane (scaled for chroma)
+   * for the output that keeps the field at `parity` (0 = top, 1 = bottom) */
+  void filter_slice(const uint8_t * prev, const uint8_t * cur,
+                    const uint8_t * next, uint8_t * output,
+                    const unsigned int parity, const bool second_field,
+                    const unsigned int slice, const unsigned int num_slices) const;
+};
+
+#endif /* DEINTERLACER_HH */
@@ -1,5 +1,9 @@
 #include "formatter.hh"
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
 using namespace std;
 
 void Formatter::parse(const string & format_string)
@@ -16,13 +20,12 @@ void Formatter::parse(const string & format_string)
   while (pos < format_string.size()) {
     size_t lpos = format_string.find("{", pos);
     if (lpos == string::npos) {
-      fields_.emplace_back(make_unique<Literal>(format_string.substr(pos)));
+      add_literal(format_string, pos, format_string.size() - pos);
       break;
     }
 
     if (lpos > pos) {
-      fields_.emplace_back(make_unique<Literal>(
-                           format_string.substr(pos, lpos - pos)));
+      add_literal(format_string, pos, lpos - pos);
     }
     pos = lpos + 1;
 
@@ -41,7 +44,7 @@ void Formatter::parse(const string & format_string)
                             "to manual field specification");
       }
 
-      fields_.emplace_back(make_unique<Replacement>(*auto_field_index_));
+      add_replacement(*auto_field_index_);
       auto_field_index_ = *auto_field_index_ + 1;
     } else {  // {INDEX}
       if (not auto_field_numbering_) {
@@ -56,37 +59,98 @@ void Formatter::parse(const string & format_string)
         throw runtime_error("invalid negative index");
       }
 
-      fields_.emplace_back(make_unique<Replacement>(index));
+      add_replacement(index);
     }
   }
 }
 
+void Formatter::add_literal(const string & format_string,
+                            const size_t pos, const size_t len)
+{
+  /* merge with a preceding literal */
+  if (not instructions_.empty()
+      and instructions_.back().type == Type::literal) {
+    instructions_.back().length += len;
+  } else {
+    instructions_.push_back({Type::literal,
+                             static_cast<uint32_t>(literals_.size()),
+                             static_cast<uint32_t>(len)});
+  }
+
+  literals_.append(format_string, pos, len);
+}
+
+void Formatter::add_replacement(const unsigned int index)
+{
+  instructions_.push_back({Type::replacement, index, 0});
+  min_values_ = max(min_values_, static_cast<size_t>(index) + 1);
+}
+
 string Formatter::format(const vector<string> & values)
 {
+  const vector<string_view> views(values.begin(), values.end());
+
   string ret;
+  format_to(ret, views);
+  return ret;
+}
 
-  for (const auto & field : fields_) {
-    if (field->type == Type::literal) {
-      ret += static_cast<Literal*>(field.get())->text;
-    } else if (field->type == Type::replacement) {
-      unsigned int index = static_cast<Replacement*>(field.get())->index;
+void Formatter::check_values(const vector<string_view> & values) const
+{
+  if (values.size() < min_values_) {
+    throw runtime_error("index out of range");
+  }
+}
 
-      if (index >= values.size()) {
-        throw runtime_error("index out of range");
-      }
+size_t Formatter::formatted_size(const vector<string_view> & values) const
+{
+  check_values(values);
+
+  /* the literals are all copied once */
+  size_t size = literals_.size();
+  for (const auto & ins : instructions_) {
+    if (ins.type == Type::replacement) {
+      size += values[ins.offset].size();
+    }
+  }
+
+  return size;
+}
 
-      ret += values.at(index);
+char * Formatter::format_to(char * dest,
+                            const vector<string_view> & values) const
+{
+  check_values(values);
+
+  for (const auto & ins : instructions_) {
+    if (ins.type == Type::literal) {
+      memcpy(dest, literals_.data() + ins.offset, ins.length);
+      dest += ins.length;
     } else {
-      throw runtime_error("invalid field type");
+      const string_view & value = values[ins.offset];
+      memcpy(dest, value.data(), value.size());
+      dest += value.size();
     }
   }
 
-  return ret;
+  return dest;
+}
+
+void Formatter::format_to(string & out,
+                          const vector<string_view> & values) const
+{
+  const size_t old_size = out.size();
+
+  /* resize once (growing the capacity geometrically), then fill in place */
+  out.resize(old_size + formatted_size(values));
+  format_to(out.data() + old_size, values);
 }
 
 void Formatter::reset()
 {
-  fields_.clear();
+  instructions_.clear();
+  literals_.clear();
+  min_values_ = 0;
 
   auto_field_numbering_.reset();
   auto_field_index_.reset();
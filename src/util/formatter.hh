@@ -1,49 +1,66 @@
 #ifndef FORMATTER_HH
 #define FORMATTER_HH
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
-#include <memory>
 
 /* A Formatter similar to the one in Python 3. Currently supported formats:
  * '{}': simple positional formatting
- * '{INDEX}': explicit positional formatting with integer index */
+ * '{INDEX}': explicit positional formatting with integer index
+ *
+ * The format string is compiled into a flat array of instructions, each
+ * copying either a span of the literal text or a value, so that formatting
+ * is a sizing pass and a copying pass without allocating. */
 class Formatter
 {
 public:
   void parse(const std::string & format_string);
   std::string format(const std::vector<std::string> & values);
 
-  enum class Type {literal, replacement};
+  /* number of values the format string refers to */
+  size_t num_values() const { return min_values_; }
 
-  struct Field {
-    Type type;
+  /* exact length of the formatted string */
+  size_t formatted_size(const std::vector<std::string_view> & values) const;
 
-    Field(const Type type_) : type(type_) {}
-    virtual ~Field() {}
-  };
+  /* write the formatted string, which must fit in formatted_size() bytes,
+   * to 'dest' and return the end of what was written */
+  char * format_to(char * dest,
+                   const std::vector<std::string_view> & values) const;
 
-  struct Literal : Field {
-    std::string text;
+  /* append the formatted string to 'out', without copying 'values' */
+  void format_to(std::string & out,
+                 const std::vector<std::string_view> & values) const;
 
-    Literal(const std::string & text_)
-      : Field(Type::literal), text(text_) {}
-  };
+  enum class Type : uint8_t {literal, replacement};
 
-  struct Replacement : Field {
-    unsigned int index;
-
-    Replacement(const unsigned int index_)
-      : Field(Type::replacement), index(index_) {}
+  struct Instruction {
+    Type type;
+    uint32_t offset;  /* literal: offset in literals_; replacement: index */
+    uint32_t length;  /* literal only */
   };
 
 private:
-  std::vector<std::unique_ptr<Field>> fields_ {};
+  std::vector<Instruction> instructions_ {};
+
+  /* the text of every literal, concatenated */
+  std::string literals_ {};
+
+  /* values must have at least this many elements */
+  size_t min_values_ {0};
 
   std::optional<bool> auto_field_numbering_ {};
   std::optional<unsigned int> auto_field_index_ {};
 
+  void add_literal(const std::string & format_string,
+                   const size_t pos, const size_t len);
+  void add_replacement(const unsigned int index);
+
+  void check_values(const std::vector<std::string_view> & values) const;
+
   void reset();
 };
 
@@ -0,0 +1,70 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "latency_histogram.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+size_t LatencyHistogram::bucket_index( const uint64_t value )
+{
+  if ( value < SUB_BUCKETS ) {
+    return value;
+  }
+
+  /* keep the SUB_BUCKET_BITS + 1 most significant bits */
+  const unsigned int msb = 63 - __builtin_clzll( value );
+  const unsigned int shift = msb - SUB_BUCKET_BITS;
+
+  return SUB_BUCKETS * ( shift + 1 ) + ( ( value >> shift ) - SUB_BUCKETS );
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound( const size_t index )
+{
+  if ( index < SUB_BUCKETS ) {
+    return index;
+  }
+
+  const unsigned int shift = index / SUB_BUCKETS - 1;
+  const uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+
+  return ( ( mantissa + 1 ) << shift ) - 1;
+}
+
+void LatencyHistogram::record( const uint64_t value_us )
+{
+  const uint64_t value = min( value_us, ( uint64_t( 1 ) << MAX_BITS ) - 1 );
+
+  buckets_[ bucket_index( value ) ]++;
+  count_++;
+  sum_ += value;
+  max_ = std::max( max_, value );
+}
+
+uint64_t LatencyHistogram::quantile( const double quantile ) const
+{
+  if ( count_ == 0 ) {
+    return 0;
+  }
+
+  /* the rank of the value sought, counting from 1 */
+  const uint64_t rank = std::max( uint64_t( 1 ), static_cast<uint64_t>(
+      ceil( min( std::max( quantile, 0.0 ), 1.0 ) * count_ ) ) );
+
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < NUM_BUCKETS; i++ ) {
+    seen += buckets_[ i ];
+    if ( seen >= rank ) {
+      return min( bucket_upper_bound( i ), max_ );
+    }
+  }
+
+  return max_;
+}
+
+void LatencyHistogram::reset()
+{
+  buckets_.fill( 0 );
+  count_ = sum_ = max_ = 0;
+}
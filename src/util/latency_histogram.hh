@@ -0,0 +1,45 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+/* HDR-style histogram of durations in microseconds: each power-of-two range
+ * is split into SUB_BUCKETS linear buckets, so that a recorded value is
+ * reported within 1/SUB_BUCKETS of itself at a fixed memory footprint */
+class LatencyHistogram
+{
+public:
+  void record( const uint64_t value_us );
+
+  /* the (upper bound of the) value below which 'quantile' of values fall */
+  uint64_t quantile( const double quantile ) const;
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t max() const { return max_; }
+
+  void reset();
+
+private:
+  static constexpr unsigned int SUB_BUCKET_BITS = 4;
+  static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+  /* values are clamped to just under 2^MAX_BITS us (about 12 days) */
+  static constexpr unsigned int MAX_BITS = 40;
+  static constexpr size_t NUM_BUCKETS =
+    SUB_BUCKETS * ( MAX_BITS - SUB_BUCKET_BITS + 1 );
+
+  std::array<uint64_t, NUM_BUCKETS> buckets_ {};
+  uint64_t count_ { 0 };
+  uint64_t sum_ { 0 };
+  uint64_t max_ { 0 };
+
+  static size_t bucket_index( const uint64_t value );
+  static uint64_t bucket_upper_bound( const size_t index );
+};
+
+#endif /* LATENCY_HISTOGRAM_HH */
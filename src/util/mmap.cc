@@ -1,4 +1,5 @@
 #include "mmap.hh"
+#include <iterator>
 #include <exception.hh>
 
 using namespace std;
@@ -18,3 +19,57 @@ shared_ptr<void> mmap_shared(void *addr, size_t length, int prot,
   return { p, deleter };
 }
 
+MmapReclaimer::MmapReclaimer()
+  : thread_(&MmapReclaimer::run, this)
+{}
+
+MmapReclaimer::~MmapReclaimer()
+{
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void MmapReclaimer::retire(vector<shared_ptr<void>> && mappings)
+{
+  if (mappings.empty()) {
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (pending_.empty()) {
+      pending_ = move(mappings);
+    } else {
+      move(mappings.begin(), mappings.end(), back_inserter(pending_));
+    }
+  }
+  mappings.clear();
+
+  cv_.notify_one();
+}
+
+void MmapReclaimer::run()
+{
+  vector<shared_ptr<void>> batch;
+
+  for (;;) {
+    {
+      unique_lock<mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stopping_ or not pending_.empty(); });
+
+      if (pending_.empty()) {
+        return;  /* stopping with nothing left to release */
+      }
+
+      swap(batch, pending_);
+    }
+
+    /* unmap outside the lock, so that retire() never waits for munmap */
+    reclaimed_ += batch.size();
+    batch.clear();
+  }
+}
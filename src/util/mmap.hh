@@ -3,8 +3,47 @@
 
 #include <sys/mman.h>
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 
 std::shared_ptr<void> mmap_shared(void *addr, size_t length, int prot,
                                   int flags, int fd, off_t offset);
 
+/* releases mappings handed over by the event loop on a background thread, so
+ * that munmap (and its TLB shootdowns) does not stall the event loop */
+class MmapReclaimer
+{
+public:
+  MmapReclaimer();
+
+  /* releases the mappings retired so far before returning */
+  ~MmapReclaimer();
+
+  /* drop these references to mappings on the reclaimer thread, in a batch;
+   * a mapping is unmapped once its last reference is dropped */
+  void retire(std::vector<std::shared_ptr<void>> && mappings);
+
+  /* number of references dropped on the reclaimer thread so far */
+  uint64_t reclaimed() const { return reclaimed_; }
+
+  /* forbid copying or assigning */
+  MmapReclaimer(const MmapReclaimer & other) = delete;
+  const MmapReclaimer & operator=(const MmapReclaimer & other) = delete;
+
+private:
+  std::mutex mutex_ {};
+  std::condition_variable cv_ {};
+  std::vector<std::shared_ptr<void>> pending_ {};
+  bool stopping_ {false};
+  std::atomic<uint64_t> reclaimed_ {0};
+
+  /* started last */
+  std::thread thread_;
+
+  void run();
+};
+
 #endif /* MMAP_HH */
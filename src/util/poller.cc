@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <numeric>
+#include <chrono>
 
 #include "poller.hh"
 #include "exception.hh"
@@ -18,7 +19,7 @@ Poller::Action::Action( NBSecureSocket & s_socket,
                         const bool s_fail_poller )
   : fd( s_socket ), direction( s_direction ), callback(), when_interested(),
     fderror_callback( s_fderror_callback ), fail_poller ( s_fail_poller ),
-    active( true )
+    active( true ), category( "other" )
 {
   if ( direction == Out ) { /* write */
     callback =
@@ -116,8 +117,10 @@ Poller::Action::Action( NBSecureSocket & s_socket,
   }
 }
 
-void Poller::add_action( Poller::Action action )
+void Poller::add_action( Poller::Action action, const string & category )
 {
+  action.category = category;
+
   /* the action won't be actually added until the next poll() function call.
      this allows us to call add_action inside the callback functions */
   action_add_queue_.push( action );
@@ -130,6 +133,26 @@ void Poller::remove_fd( const int fd_num )
   fds_to_remove_.emplace( fd_num );
 }
 
+#ifdef POLLER_PROFILING
+static uint64_t elapsed_us( const chrono::steady_clock::time_point & begin,
+                            const chrono::steady_clock::time_point & end )
+{
+  return chrono::duration_cast<chrono::microseconds>( end - begin ).count();
+}
+
+void Poller::reset_profile()
+{
+  profile_.iterations = 0;
+  profile_.poll_time_us.reset();
+
+  /* actions point to the entries, which must stay */
+  for ( auto & entry : profile_.callbacks ) {
+    entry.second.run_time_us.reset();
+    entry.second.wait_time_us.reset();
+  }
+}
+#endif
+
 unsigned int Poller::Action::service_count( void ) const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
@@ -140,6 +163,10 @@ Poller::Result Poller::poll( const int timeout_ms )
   /* first, let's add all the actions that are waiting in the queue */
   while ( not action_add_queue_.empty() ) {
     Action & action = action_add_queue_.front();
+#ifdef POLLER_PROFILING
+    action.profile = profile_.callbacks.emplace( action.category,
+                                                 CallbackProfile() ).first;
+#endif
     pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
     actions_.emplace_back( move( action ) );
     action_add_queue_.pop();
@@ -174,9 +201,22 @@ Poller::Result Poller::poll( const int timeout_ms )
     return Result::Type::Exit;
   }
 
+#ifdef POLLER_PROFILING
+  const auto poll_begin = chrono::steady_clock::now();
+  const int ready = CheckSystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) );
+  const auto poll_end = chrono::steady_clock::now();
+
+  profile_.iterations++;
+  profile_.poll_time_us.record( elapsed_us( poll_begin, poll_end ) );
+
+  if ( ready == 0 ) {
+    return Result::Type::Timeout;
+  }
+#else
   if ( 0 == CheckSystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
     return Result::Type::Timeout;
   }
+#endif
 
   it_action = actions_.begin();
   it_pollfd = pollfds_.begin();
@@ -195,9 +235,19 @@ Poller::Result Poller::poll( const int timeout_ms )
         the event we asked for */
       const auto count_before = it_action->service_count();
 
+#ifdef POLLER_PROFILING
+      const auto callback_begin = chrono::steady_clock::now();
+      it_action->profile->second.wait_time_us.record( elapsed_us( poll_end, callback_begin ) );
+#endif
+
       try {
         auto result = it_action->callback();
 
+#ifdef POLLER_PROFILING
+        it_action->profile->second.run_time_us.record(
+          elapsed_us( callback_begin, chrono::steady_clock::now() ) );
+#endif
+
         switch ( result.result ) {
         case ResultType::Exit:
           return Result( Result::Type::Exit, result.exit_status );
@@ -9,15 +9,38 @@
 #include <list>
 #include <set>
 #include <queue>
+#include <map>
+#include <string>
 #include <poll.h>
 
 #include "file_descriptor.hh"
 
+#ifdef POLLER_PROFILING
+#include "latency_histogram.hh"
+#endif
+
 class NBSecureSocket;
 
 class Poller
 {
 public:
+#ifdef POLLER_PROFILING
+  /* time spent in the callbacks of a category of actions, and how long they
+   * waited to run after poll() returned (behind the other callbacks) */
+  struct CallbackProfile
+  {
+    LatencyHistogram run_time_us {};
+    LatencyHistogram wait_time_us {};
+  };
+
+  struct Profile
+  {
+    uint64_t iterations { 0 };
+    LatencyHistogram poll_time_us {};  /* time blocked in poll() */
+    std::map<std::string, CallbackProfile> callbacks {};  /* key: category */
+  };
+#endif
+
   struct Action
   {
     struct Result
@@ -42,6 +65,14 @@ public:
 
     bool active;
 
+    /* what the callback does, e.g., "websocket" or "inotify"; the profile
+     * of the poller (if enabled) is broken down by category */
+    std::string category;
+
+#ifdef POLLER_PROFILING
+    std::map<std::string, CallbackProfile>::iterator profile {};
+#endif
+
     Action( FileDescriptor & s_fd,
             const PollDirection & s_direction,
             const CallbackType & s_callback,
@@ -51,7 +82,7 @@ public:
       : fd( s_fd ), direction( s_direction ), callback( s_callback ),
         when_interested( s_when_interested ),
         fderror_callback( s_fderror_callback ), fail_poller( s_fail_poller ),
-        active( true ) {}
+        active( true ), category( "other" ) {}
 
     Action( NBSecureSocket & s_socket,
             const PollDirection & s_direction,
@@ -69,6 +100,10 @@ private:
   std::vector<pollfd> pollfds_ {};
   std::set<int> fds_to_remove_ {};
 
+#ifdef POLLER_PROFILING
+  Profile profile_ {};
+#endif
+
   /* remove all actions for file descriptors in `fd_nums` */
   void remove_actions( const std::set<int> & fd_nums );
 
@@ -83,9 +118,17 @@ public:
 
   Poller() {}
 
-  void add_action( Action action );
+  /* 'category' groups the action with others in the profile */
+  void add_action( Action action, const std::string & category = "other" );
   void remove_fd( const int fd_num );
   Result poll( const int timeout_ms );
+
+#ifdef POLLER_PROFILING
+  const Profile & profile() const { return profile_; }
+
+  /* clear the histograms, e.g., after they have been logged */
+  void reset_profile();
+#endif
 };
 
 namespace PollerShortNames {
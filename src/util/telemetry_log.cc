@@ -0,0 +1,613 @@
+#include "telemetry_log.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "exception.hh"
+#include "strict_conversions.hh"
+
+using namespace std;
+
+static const string MAGIC = "PUFFTLOG";
+static const string BLOCK_MAGIC = "BLCK";
+static const uint16_t FORMAT_VERSION = 2;
+
+/* sizes of the fixed parts of the header and of a block header */
+static const size_t HEADER_PREFIX_SIZE = 8 + 2 + 4;
+static const size_t BLOCK_HEADER_SIZE = 4 + 4 + 4 + 4;
+
+namespace {
+
+void put_u8(string & out, const uint8_t value)
+{
+  out.push_back(static_cast<char>(value));
+}
+
+void put_u16(string & out, const uint16_t value)
+{
+  put_u8(out, value & 0xFF);
+  put_u8(out, value >> 8);
+}
+
+void put_u32(string & out, const uint32_t value)
+{
+  for (unsigned int i = 0; i < 4; i++) {
+    put_u8(out, (value >> (8 * i)) & 0xFF);
+  }
+}
+
+/* overwrite a u32 reserved earlier at 'pos' */
+void patch_u32(string & out, const size_t pos, const uint32_t value)
+{
+  for (unsigned int i = 0; i < 4; i++) {
+    out[pos + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+}
+
+void put_double(string & out, const double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  for (unsigned int i = 0; i < 8; i++) {
+    put_u8(out, (bits >> (8 * i)) & 0xFF);
+  }
+}
+
+void put_varint(string & out, uint64_t value)
+{
+  while (value >= 0x80) {
+    put_u8(out, (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  put_u8(out, value);
+}
+
+void put_str(string & out, const string_view str)
+{
+  put_varint(out, str.size());
+  out.append(str);
+}
+
+uint64_t zigzag(const int64_t value)
+{
+  return (static_cast<uint64_t>(value) << 1) ^ (value < 0 ? ~0ULL : 0);
+}
+
+int64_t unzigzag(const uint64_t value)
+{
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+uint32_t fnv1a(const string_view data, uint32_t hash = 2166136261u)
+{
+  for (const char c : data) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+/* covers the fields of the block header that the payload is decoded with */
+uint32_t block_checksum(const uint32_t num_rows, const uint32_t payload_size,
+                        const string_view payload)
+{
+  string fields;
+  put_u32(fields, num_rows);
+  put_u32(fields, payload_size);
+
+  return fnv1a(payload, fnv1a(fields));
+}
+
+/* reads the encoded fields of a header or block in order */
+class Parser
+{
+public:
+  Parser(const string_view data) : data_(data) {}
+
+  bool done() const { return pos_ == data_.size(); }
+
+  uint8_t u8()
+  {
+    need(1);
+    return static_cast<uint8_t>(data_[pos_++]);
+  }
+
+  uint16_t u16()
+  {
+    const uint16_t low = u8();
+    return low | (static_cast<uint16_t>(u8()) << 8);
+  }
+
+  uint32_t u32()
+  {
+    uint32_t value = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+      value |= static_cast<uint32_t>(u8()) << (8 * i);
+    }
+    return value;
+  }
+
+  double float64()
+  {
+    uint64_t bits = 0;
+    for (unsigned int i = 0; i < 8; i++) {
+      bits |= static_cast<uint64_t>(u8()) << (8 * i);
+    }
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  uint64_t varint()
+  {
+    uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+      const uint8_t byte = u8();
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (not (byte & 0x80)) {
+        return value;
+      }
+    }
+    throw runtime_error("TelemetryLogReader: invalid varint");
+  }
+
+  string_view bytes(const size_t length)
+  {
+    need(length);
+    const string_view ret = data_.substr(pos_, length);
+    pos_ += length;
+    return ret;
+  }
+
+  string_view str() { return bytes(varint()); }
+
+  /* check that 'count' values of at least 'min_size' bytes each are left,
+   * before making room for them */
+  size_t count(const uint64_t count, const size_t min_size)
+  {
+    if (count > (data_.size() - pos_) / min_size) {
+      throw runtime_error("TelemetryLogReader: invalid number of values");
+    }
+    return count;
+  }
+
+private:
+  string_view data_;
+  size_t pos_ {0};
+
+  void need(const size_t length) const
+  {
+    if (length > data_.size() - pos_) {
+      throw runtime_error("TelemetryLogReader: truncated data");
+    }
+  }
+};
+
+string encode_header(const TelemetrySchema & schema)
+{
+  string encoded_schema;
+  put_str(encoded_schema, schema.name);
+  put_u32(encoded_schema, schema.version);
+  put_u16(encoded_schema, schema.columns.size());
+
+  for (const auto & column : schema.columns) {
+    put_u8(encoded_schema, static_cast<uint8_t>(column.type));
+    put_u8(encoded_schema, column.precision);
+    put_str(encoded_schema, column.name);
+  }
+
+  string header = MAGIC;
+  put_u16(header, FORMAT_VERSION);
+  put_u32(header, encoded_schema.size());
+  return header + encoded_schema;
+}
+
+}
+
+void append_as_text(string & out, const int64_t value)
+{
+  char buf[24];
+  const auto result = to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, result.ptr);
+}
+
+void append_as_text(string & out, const double value,
+                    const unsigned int precision)
+{
+  char buf[128];
+  const auto result = to_chars(buf, buf + sizeof(buf), value,
+                               chars_format::fixed, precision);
+  if (result.ec == errc()) {
+    out.append(buf, result.ptr);
+  } else {
+    /* too large to be written in the buffer */
+    out += double_to_string(value, precision);
+  }
+}
+
+void append_as_text(string & out, const TelemetryColumn & column,
+                    const TelemetryValue & value)
+{
+  const auto & v = value.get();
+
+  if (holds_alternative<string>(v)) {
+    out += std::get<string>(v);
+  } else if (column.type == TelemetryColumn::Type::Float) {
+    const double d = holds_alternative<double>(v) ? std::get<double>(v)
+                     : static_cast<double>(std::get<int64_t>(v));
+    append_as_text(out, d, column.precision);
+  } else if (holds_alternative<int64_t>(v)) {
+    append_as_text(out, std::get<int64_t>(v));
+  } else {
+    append_as_text(out, std::get<double>(v), column.precision);
+  }
+}
+
+void TelemetryLogWriter::Column::clear()
+{
+  ints.clear();
+  floats.clear();
+  dictionary.clear();
+  lookup.clear();
+  indices.clear();
+}
+
+TelemetryLogWriter::TelemetryLogWriter(const string & path,
+                                       const TelemetrySchema & schema,
+                                       const size_t rows_per_block)
+  : schema_(schema), rows_per_block_(rows_per_block),
+    fd_(CheckSystemCall("open (" + path + ")",
+        open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644))),
+    columns_(schema.columns.size())
+{
+  if (schema_.columns.empty() or rows_per_block_ == 0) {
+    throw runtime_error("TelemetryLogWriter: invalid schema or block size");
+  }
+
+  const string header = encode_header(schema_);
+
+  if (fd_.filesize() == 0) {
+    fd_.write(header);
+    size_ = header.size();
+    return;
+  }
+
+  /* append to an existing log only if it has the same schema */
+  TelemetryLogReader reader(path);
+  if (encode_header(reader.schema()) != header) {
+    throw runtime_error("TelemetryLogWriter: " + path + " has another schema");
+  }
+
+  while (reader.skip_block()) {}
+  size_ = reader.offset();
+
+  if (size_ < fd_.filesize()) {
+    cerr << "TelemetryLogWriter: dropping a truncated block at the end of "
+         << path << endl;
+    CheckSystemCall("ftruncate", ftruncate(fd_.fd_num(), size_));
+  }
+}
+
+TelemetryLogWriter::~TelemetryLogWriter()
+{
+  try {
+    flush();
+  } catch (const exception & e) {
+    print_exception("TelemetryLogWriter", e);
+  }
+}
+
+void TelemetryLogWriter::append(const vector<TelemetryValue> & row)
+{
+  if (row.size() != columns_.size()) {
+    throw runtime_error("TelemetryLogWriter: expected "
+                        + to_string(columns_.size()) + " values in a row");
+  }
+
+  /* check the whole row before buffering any of it */
+  for (size_t i = 0; i < row.size(); i++) {
+    const auto & value = row[i].get();
+
+    bool valid;
+    switch (schema_.columns[i].type) {
+    case TelemetryColumn::Type::Int:
+      valid = holds_alternative<int64_t>(value);
+      break;
+    case TelemetryColumn::Type::Float:
+      valid = not holds_alternative<string>(value);
+      break;
+    default:
+      valid = holds_alternative<string>(value);
+    }
+
+    if (not valid) {
+      throw runtime_error("TelemetryLogWriter: invalid value for column "
+                          + schema_.columns[i].name);
+    }
+  }
+
+  for (size_t i = 0; i < row.size(); i++) {
+    const auto & value = row[i].get();
+    Column & column = columns_[i];
+
+    switch (schema_.columns[i].type) {
+    case TelemetryColumn::Type::Int:
+      column.ints.emplace_back(std::get<int64_t>(value));
+      break;
+    case TelemetryColumn::Type::Float:
+      column.floats.emplace_back(holds_alternative<double>(value)
+          ? std::get<double>(value)
+          : static_cast<double>(std::get<int64_t>(value)));
+      break;
+    default:
+      const string & str = std::get<string>(value);
+      auto it = column.lookup.find(str);
+      if (it == column.lookup.end()) {
+        it = column.lookup.emplace(str, column.dictionary.size()).first;
+        column.dictionary.emplace_back(str);
+      }
+      column.indices.emplace_back(it->second);
+    }
+  }
+
+  if (++num_rows_ >= rows_per_block_) {
+    flush();
+  }
+}
+
+void TelemetryLogWriter::flush()
+{
+  if (num_rows_ == 0) {
+    return;
+  }
+
+  block_.clear();
+  block_ += BLOCK_MAGIC;
+  put_u32(block_, num_rows_);
+  put_u32(block_, 0);  /* payload size */
+  put_u32(block_, 0);  /* checksum */
+
+  for (size_t i = 0; i < columns_.size(); i++) {
+    const Column & column = columns_[i];
+
+    const size_t column_start = block_.size();
+    put_u32(block_, 0);  /* column size */
+
+    switch (schema_.columns[i].type) {
+    case TelemetryColumn::Type::Int: {
+      int64_t prev = 0;
+      for (const int64_t value : column.ints) {
+        put_varint(block_, zigzag(static_cast<int64_t>(
+            static_cast<uint64_t>(value) - static_cast<uint64_t>(prev))));
+        prev = value;
+      }
+      break;
+    }
+    case TelemetryColumn::Type::Float:
+      for (const double value : column.floats) {
+        put_double(block_, value);
+      }
+      break;
+    default:
+      put_varint(block_, column.dictionary.size());
+      for (const auto & str : column.dictionary) {
+        put_str(block_, str);
+      }
+      for (const uint32_t index : column.indices) {
+        put_varint(block_, index);
+      }
+    }
+
+    patch_u32(block_, column_start, block_.size() - column_start - 4);
+  }
+
+  const string_view payload = string_view(block_).substr(BLOCK_HEADER_SIZE);
+  patch_u32(block_, 8, payload.size());
+  patch_u32(block_, 12, block_checksum(num_rows_, payload.size(), payload));
+
+  /* a single write, so that a reader never sees a partial block */
+  fd_.write(block_);
+  size_ += block_.size();
+
+  for (auto & column : columns_) {
+    column.clear();
+  }
+  num_rows_ = 0;
+}
+
+TelemetryLogReader::TelemetryLogReader(const string & path)
+  : fd_(CheckSystemCall("open (" + path + ")",
+        open(path.c_str(), O_RDONLY)))
+{
+  const string prefix = fd_.read_exactly(HEADER_PREFIX_SIZE, true);
+  if (prefix.size() < HEADER_PREFIX_SIZE
+      or prefix.compare(0, MAGIC.size(), MAGIC) != 0) {
+    throw runtime_error("TelemetryLogReader: " + path
+                        + " is not a telemetry log");
+  }
+
+  Parser prefix_parser(string_view(prefix).substr(MAGIC.size()));
+  const uint16_t format_version = prefix_parser.u16();
+  const uint32_t schema_size = prefix_parser.u32();
+
+  if (format_version != FORMAT_VERSION) {
+    throw runtime_error("TelemetryLogReader: unsupported format version "
+                        + to_string(format_version));
+  }
+
+  const string encoded_schema = fd_.read_exactly(schema_size);
+  Parser parser(encoded_schema);
+
+  schema_.name = parser.str();
+  schema_.version = parser.u32();
+
+  const uint16_t num_columns = parser.u16();
+  for (unsigned int i = 0; i < num_columns; i++) {
+    TelemetryColumn column;
+
+    const uint8_t type = parser.u8();
+    if (type > static_cast<uint8_t>(TelemetryColumn::Type::String)) {
+      throw runtime_error("TelemetryLogReader: invalid column type");
+    }
+    column.type = static_cast<TelemetryColumn::Type>(type);
+    column.precision = parser.u8();
+    column.name = parser.str();
+
+    schema_.columns.emplace_back(move(column));
+  }
+
+  columns_.resize(schema_.columns.size());
+  offset_ = HEADER_PREFIX_SIZE + schema_size;
+}
+
+bool TelemetryLogReader::read_block(uint32_t & num_rows)
+{
+  const string header = fd_.read_exactly(BLOCK_HEADER_SIZE, true);
+  if (header.size() < BLOCK_HEADER_SIZE) {
+    /* the end of the log, or a truncated block */
+    return false;
+  }
+
+  if (header.compare(0, BLOCK_MAGIC.size(), BLOCK_MAGIC) != 0) {
+    throw runtime_error("TelemetryLogReader: invalid block at offset "
+                        + to_string(offset_));
+  }
+
+  Parser parser(string_view(header).substr(BLOCK_MAGIC.size()));
+  num_rows = parser.u32();
+  const uint32_t payload_size = parser.u32();
+  const uint32_t checksum = parser.u32();
+
+  /* only complete blocks count */
+  if (offset_ + BLOCK_HEADER_SIZE + payload_size > fd_.filesize()) {
+    return false;
+  }
+
+  payload_ = fd_.read_exactly(payload_size);
+
+  if (block_checksum(num_rows, payload_size, payload_) != checksum) {
+    throw runtime_error("TelemetryLogReader: corrupted block at offset "
+                        + to_string(offset_));
+  }
+
+  return true;
+}
+
+bool TelemetryLogReader::skip_block()
+{
+  uint32_t num_rows;
+  if (not read_block(num_rows)) {
+    return false;
+  }
+
+  offset_ += BLOCK_HEADER_SIZE + payload_.size();
+  num_rows_ = 0;
+
+  return true;
+}
+
+bool TelemetryLogReader::next_block()
+{
+  uint32_t num_rows;
+  if (not read_block(num_rows)) {
+    return false;
+  }
+
+  Parser parser(payload_);
+
+  for (size_t i = 0; i < columns_.size(); i++) {
+    Column & column = columns_[i];
+    Parser column_parser(parser.bytes(parser.u32()));
+
+    switch (schema_.columns[i].type) {
+    case TelemetryColumn::Type::Int: {
+      column.ints.resize(column_parser.count(num_rows, 1));
+      uint64_t prev = 0;
+      for (auto & value : column.ints) {
+        prev += static_cast<uint64_t>(unzigzag(column_parser.varint()));
+        value = static_cast<int64_t>(prev);
+      }
+      break;
+    }
+    case TelemetryColumn::Type::Float:
+      column.floats.resize(column_parser.count(num_rows, 8));
+      for (auto & value : column.floats) {
+        value = column_parser.float64();
+      }
+      break;
+    default:
+      column.dictionary.resize(column_parser.count(column_parser.varint(), 1));
+      for (auto & str : column.dictionary) {
+        str = column_parser.str();
+      }
+
+      column.strings.resize(column_parser.count(num_rows, 1));
+      for (auto & str : column.strings) {
+        const uint64_t index = column_parser.varint();
+        if (index >= column.dictionary.size()) {
+          throw runtime_error("TelemetryLogReader: invalid string index");
+        }
+        str = column.dictionary[index];
+      }
+    }
+
+    if (not column_parser.done()) {
+      throw runtime_error("TelemetryLogReader: invalid column size");
+    }
+  }
+
+  offset_ += BLOCK_HEADER_SIZE + payload_.size();
+  num_rows_ = num_rows;
+
+  return true;
+}
+
+const TelemetryLogReader::Column &
+TelemetryLogReader::column(const size_t index,
+                           const TelemetryColumn::Type type) const
+{
+  if (index >= columns_.size() or schema_.columns[index].type != type) {
+    throw runtime_error("TelemetryLogReader: no such column");
+  }
+
+  return columns_[index];
+}
+
+const vector<int64_t> & TelemetryLogReader::ints(const size_t index) const
+{
+  return column(index, TelemetryColumn::Type::Int).ints;
+}
+
+const vector<double> & TelemetryLogReader::floats(const size_t index) const
+{
+  return column(index, TelemetryColumn::Type::Float).floats;
+}
+
+const vector<string_view> &
+TelemetryLogReader::strings(const size_t index) const
+{
+  return column(index, TelemetryColumn::Type::String).strings;
+}
+
+void TelemetryLogReader::append_as_text(string & out, const size_t row,
+                                        const size_t index) const
+{
+  const TelemetryColumn & schema_column = schema_.columns.at(index);
+  const Column & column = columns_[index];
+
+  switch (schema_column.type) {
+  case TelemetryColumn::Type::Int:
+    ::append_as_text(out, column.ints.at(row));
+    break;
+  case TelemetryColumn::Type::Float:
+    ::append_as_text(out, column.floats.at(row), schema_column.precision);
+    break;
+  default:
+    out += column.strings.at(row);
+  }
+}
@@ -0,0 +1,195 @@
+#ifndef TELEMETRY_LOG_HH
+#define TELEMETRY_LOG_HH
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+#include <unordered_map>
+#include <type_traits>
+
+#include "file_descriptor.hh"
+
+/* A compact, append-only binary log of rows sharing a schema, written in
+ * blocks of rows stored column by column:
+ *
+ *   log     := header block*
+ *   header  := "PUFFTLOG" format_version:u16 schema_size:u32 schema
+ *   schema  := name:str version:u32 num_columns:u16
+ *              (type:u8 precision:u8 name:str)*
+ *   block   := "BLCK" num_rows:u32 payload_size:u32 checksum:u32 payload
+ *   payload := (column_size:u32 column)*  (every column, in order)
+ *
+ * Fixed-size integers are little-endian, str is a varint length followed by
+ * the bytes, and the checksum is the FNV-1a hash of num_rows and payload_size
+ * as encoded, followed by the payload. Columns are encoded by type:
+ *
+ *   Int:    zigzag varint of the difference from the previous row (or 0)
+ *   Float:  IEEE 754 doubles, 8 bytes each
+ *   String: varint number of distinct strings, the strs, then the varint
+ *           index of each row's string among them
+ *
+ * A block is appended with a single write, so only a log whose writer died
+ * can end with a truncated block, which readers ignore; any other invalid
+ * block is an error, whether it is decoded or skipped. */
+
+struct TelemetryColumn
+{
+  enum class Type : uint8_t {Int = 0, Float = 1, String = 2};
+
+  std::string name {};
+  Type type {Type::Int};
+
+  /* digits after the decimal point when a Float is written as text */
+  uint8_t precision {0};
+};
+
+struct TelemetrySchema
+{
+  std::string name {};
+
+  /* to be incremented whenever the columns change */
+  uint32_t version {0};
+
+  std::vector<TelemetryColumn> columns {};
+};
+
+/* a value in a row, of any integral type, a double or a string */
+class TelemetryValue
+{
+public:
+  template<typename T,
+           typename = std::enable_if_t<std::is_integral_v<T>>>
+  TelemetryValue(const T value) : value_(static_cast<int64_t>(value)) {}
+
+  TelemetryValue(const double value) : value_(value) {}
+  TelemetryValue(const std::string & value) : value_(value) {}
+  TelemetryValue(std::string && value) : value_(std::move(value)) {}
+  TelemetryValue(const char * value) : value_(std::string(value)) {}
+
+  const std::variant<int64_t, double, std::string> & get() const
+  { return value_; }
+
+private:
+  std::variant<int64_t, double, std::string> value_;
+};
+
+/* append 'value' as the text logs write it */
+void append_as_text(std::string & out, const int64_t value);
+void append_as_text(std::string & out, const double value,
+                    const unsigned int precision);
+void append_as_text(std::string & out, const TelemetryColumn & column,
+                    const TelemetryValue & value);
+
+class TelemetryLogWriter
+{
+public:
+  static constexpr size_t DEFAULT_ROWS_PER_BLOCK = 4096;
+
+  /* append to the log at 'path', creating it if necessary; throws if the log
+   * exists with another schema, and drops a truncated block at its end */
+  TelemetryLogWriter(const std::string & path, const TelemetrySchema & schema,
+                     const size_t rows_per_block = DEFAULT_ROWS_PER_BLOCK);
+
+  /* flushes the buffered rows, suppressing exceptions */
+  ~TelemetryLogWriter();
+
+  /* buffer a row of values in column order, and write a block once
+   * rows_per_block rows are buffered; an Int may be given for a Float */
+  void append(const std::vector<TelemetryValue> & row);
+
+  /* write the buffered rows (if any) as a block */
+  void flush();
+
+  /* size of the log on disk, excluding the buffered rows */
+  uint64_t size() const { return size_; }
+
+  size_t buffered_rows() const { return num_rows_; }
+
+  /* forbid copying or assigning */
+  TelemetryLogWriter(const TelemetryLogWriter & other) = delete;
+  const TelemetryLogWriter & operator=(const TelemetryLogWriter & other) = delete;
+
+private:
+  struct Column {
+    std::vector<int64_t> ints {};
+    std::vector<double> floats {};
+
+    /* distinct strings of the block and the index of each row's string */
+    std::vector<std::string> dictionary {};
+    std::unordered_map<std::string, uint32_t> lookup {};
+    std::vector<uint32_t> indices {};
+
+    void clear();
+  };
+
+  TelemetrySchema schema_;
+  size_t rows_per_block_;
+
+  FileDescriptor fd_;
+  uint64_t size_ {0};
+
+  std::vector<Column> columns_ {};
+  size_t num_rows_ {0};
+
+  /* reused to encode each block */
+  std::string block_ {};
+};
+
+class TelemetryLogReader
+{
+public:
+  /* open the log at 'path' and read its header */
+  TelemetryLogReader(const std::string & path);
+
+  const TelemetrySchema & schema() const { return schema_; }
+
+  /* read and decode the next block; false at the end of the log */
+  bool next_block();
+
+  /* move past the next block after checking it, without decoding it;
+   * false at the end */
+  bool skip_block();
+
+  /* offset just past the last complete block read or skipped */
+  uint64_t offset() const { return offset_; }
+
+  /* the rows of the current block, by column */
+  size_t num_rows() const { return num_rows_; }
+  const std::vector<int64_t> & ints(const size_t column) const;
+  const std::vector<double> & floats(const size_t column) const;
+
+  /* views into the current block, valid until the next one is read */
+  const std::vector<std::string_view> & strings(const size_t column) const;
+
+  /* append a value of the current block as the text logs write it */
+  void append_as_text(std::string & out, const size_t row,
+                      const size_t column) const;
+
+private:
+  struct Column {
+    std::vector<int64_t> ints {};
+    std::vector<double> floats {};
+    std::vector<std::string_view> dictionary {};
+    std::vector<std::string_view> strings {};
+  };
+
+  FileDescriptor fd_;
+  TelemetrySchema schema_ {};
+  uint64_t offset_ {0};
+
+  /* current block */
+  std::string payload_ {};
+  std::vector<Column> columns_ {};
+  size_t num_rows_ {0};
+
+  /* read the next complete block into payload_ and check it: false at the
+   * end of the log */
+  bool read_block(uint32_t & num_rows);
+
+  const Column & column(const size_t index,
+                        const TelemetryColumn::Type type) const;
+};
+
+#endif /* TELEMETRY_LOG_HH */
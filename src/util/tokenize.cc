@@ -32,3 +32,19 @@ vector< string > split( const string & str, const string & separator )
 
   return ret;
 }
+
+void split_view( const string_view str, const char separator,
+                 vector< string_view > & tokens )
+{
+  tokens.clear();
+
+  size_t start = 0;
+  size_t next_token;
+  while ( (next_token = str.find( separator, start )) != string_view::npos ) {
+    tokens.push_back( str.substr( start, next_token - start ) );
+    start = next_token + 1;
+  }
+
+  /* last token */
+  tokens.push_back( str.substr( start ) );
+}
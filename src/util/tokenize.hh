@@ -4,9 +4,15 @@
 #define TOKENIZE_HH
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 
 std::vector< std::string > split( const std::string & str, const std::string & separator );
 
+/* same as split, into views of 'str' stored in 'tokens' (which is cleared
+ * first, so that it can be reused without allocating) */
+void split_view( const std::string_view str, const char separator,
+                 std::vector< std::string_view > & tokens );
+
 #endif /* TOKENIZE_HH */
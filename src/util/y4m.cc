@@ -13,7 +13,8 @@ using namespace std;
 
 Y4MParser::Y4MParser(const string & y4m_path)
   : width_(-1), height_(-1), frame_rate_numerator_(-1),
-    frame_rate_denominator_(-1), interlaced_(false)
+    frame_rate_denominator_(-1), interlaced_(false),
+    top_field_first_(true)
 {
   ifstream y4m_file(y4m_path);
   string line;
@@ -48,6 +49,7 @@ Y4MParser::Y4MParser(const string & y4m_path)
     case 'I':
       if (p.at(1) != 'p') {
         interlaced_ = true;
+        top_field_first_ = (p.at(1) != 'b');
       }
       break;
     default:
@@ -26,10 +26,14 @@ public:
 
   bool is_interlaced() { return interlaced_; }
 
+  /* meaningful only if interlaced; mixed ("Im") is treated as top first */
+  bool is_top_field_first() { return top_field_first_; }
+
 private:
   int width_, height_;
   int frame_rate_numerator_, frame_rate_denominator_;
   bool interlaced_;
+  bool top_field_first_;
 };
 
 #endif /* Y4M_HH */
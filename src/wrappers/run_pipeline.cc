@@ -54,6 +54,7 @@ void run_video_canonicalizer(ProcessManager & proc_manager,
 void run_video_encoder(ProcessManager & proc_manager,
                        const fs::path & output_path,
                        vector<tuple<string, string>> & vwork,
+                       vector<tuple<string, string>> & vready,
                        const VideoFormat & vf)
 {
   /* prepare directories */
@@ -61,51 +62,29 @@ void run_video_encoder(ProcessManager & proc_manager,
   string src_dir = output_path / "working/video-canonical";
   string dst_dir = output_path / "working" / base;
   string tmp_dir = output_path / "tmp" / base;
+  string ready_dir = output_path / "ready" / vf.to_string();
+  string ready_tmp_dir = output_path / "tmp" / vf.to_string();
 
-  for (const auto & dir : {src_dir, dst_dir, tmp_dir}) {
+  for (const auto & dir : {src_dir, dst_dir, tmp_dir,
+                           ready_dir, ready_tmp_dir}) {
     fs::create_directories(dir);
   }
 
   vwork.emplace_back(dst_dir, ".mp4");
+  vready.emplace_back(ready_dir, ".m4s");
 
-  /* notifier runs video_encoder */
+  /* notifier runs video_encoder, which also writes the fragmented .m4s
+   * (and init.mp4) into ready_dir directly */
   string video_encoder = src_path / "wrappers/video_encoder";
 
   vector<string> args {
     notifier, src_dir, ".y4m", "--check", dst_dir, ".mp4", "--tmp", tmp_dir,
-    "--exec", video_encoder, "-s", vf.resolution(), "--crf", to_string(vf.crf)
+    "--exec", video_encoder, "-s", vf.resolution(), "--crf", to_string(vf.crf),
+    "--fragment", ready_dir, "--fragment-tmp", ready_tmp_dir
   };
   proc_manager.run_as_child(notifier, args);
 }
 
-void run_video_fragmenter(ProcessManager & proc_manager,
-                          const fs::path & output_path,
-                          vector<tuple<string, string>> & vready,
-                          const VideoFormat & vf)
-{
-  /* prepare directories */
-  string working_base = vf.to_string() + "-" + "mp4";
-  string ready_base = vf.to_string();
-  string src_dir = output_path / "working" / working_base;
-  string dst_dir = output_path / "ready" / ready_base;
-  string tmp_dir = output_path / "tmp" / ready_base;
-
-  for (const auto & dir : {src_dir, dst_dir, tmp_dir}) {
-    fs::create_directories(dir);
-  }
-
-  vready.emplace_back(dst_dir, ".m4s");
-
-  /* notifier runs video_fragmenter */
-  string video_fragmenter = src_path / "wrappers/video_fragmenter";
-  string dst_init_path = fs::path(dst_dir) / "init.mp4";
-
-  vector<string> args {
-    notifier, src_dir, ".mp4", "--check", dst_dir, ".m4s", "--tmp", tmp_dir,
-    "--exec", video_fragmenter, "-i", dst_init_path };
-  proc_manager.run_as_child(notifier, args);
-}
-
 void run_ssim_calculator(ProcessManager & proc_manager,
                          const fs::path & output_path,
                          vector<tuple<string, string>> & vready,
@@ -137,27 +116,48 @@ void run_ssim_calculator(ProcessManager & proc_manager,
 void run_audio_encoder(ProcessManager & proc_manager,
                        const fs::path & output_path,
                        vector<tuple<string, string>> & awork,
-                       const AudioFormat & af)
+                       const vector<AudioFormat> & aformats)
 {
-  /* prepare directories */
-  string base = af.to_string() + "-" + "webm";
-  string src_dir = output_path / "working/audio-raw";
-  string dst_dir = output_path / "working" / base;
-  string tmp_dir = output_path / "tmp" / base;
-
-  for (const auto & dir : {src_dir, dst_dir, tmp_dir}) {
-    fs::create_directories(dir);
+  if (aformats.empty()) {
+    return;
   }
 
+  string src_dir = output_path / "working/audio-raw";
+  fs::create_directories(src_dir);
   awork.emplace_back(src_dir, ".wav");
-  awork.emplace_back(dst_dir, ".webm");
 
-  /* notifier runs audio_encoder */
+  /* prepare directories for each bitrate */
+  vector<tuple<string, string>> dst_tmp_dirs;
+  for (const auto & af : aformats) {
+    string base = af.to_string() + "-" + "webm";
+    string dst_dir = output_path / "working" / base;
+    string tmp_dir = output_path / "tmp" / base;
+
+    for (const auto & dir : {dst_dir, tmp_dir}) {
+      fs::create_directories(dir);
+    }
+
+    awork.emplace_back(dst_dir, ".webm");
+    dst_tmp_dirs.emplace_back(dst_dir, tmp_dir);
+  }
+
+  /* a single notifier runs audio_encoder once per .wav for all bitrates:
+   * the first bitrate is checked by notifier and the others are moved
+   * into their directories by audio_encoder itself */
   string audio_encoder = src_path / "opus-encoder/opus-encoder";
+  const auto & [first_dst_dir, first_tmp_dir] = dst_tmp_dirs.front();
 
   vector<string> args {
-    notifier, src_dir, ".wav", "--check", dst_dir, ".webm", "--tmp", tmp_dir,
-    "--exec", audio_encoder, "-b", af.to_string() };
+    notifier, src_dir, ".wav", "--check", first_dst_dir, ".webm",
+    "--tmp", first_tmp_dir, "--exec", audio_encoder,
+    "-b", aformats.front().to_string() };
+
+  for (size_t i = 1; i < aformats.size(); i++) {
+    const auto & [dst_dir, tmp_dir] = dst_tmp_dirs[i];
+    args.insert(args.end(),
+                {"--extra", aformats[i].to_string(), dst_dir, tmp_dir});
+  }
+
   proc_manager.run_as_child(notifier, args);
 }
 
@@ -193,69 +193,85 @@ void run_file_sender(ProcessManager & proc_manager,
                      const vector<tuple<string, string>> & ready,
                      const YAML::Node & config)
 {
-  string host = config["host"].as<string>();
-  uint16_t port = config["port"].as<uint16_t>();
-  fs::path dst_media_dir = config["media_dir"].as<string>();
   string file_sender = src_path / "forwarder/file_sender";
+  vector<string> args { file_sender };
+
+  /* replicate to a single media server or to a list of them */
+  vector<YAML::Node> servers;
+  if (config.IsSequence()) {
+    for (const auto & server : config) {
+      servers.emplace_back(server);
+    }
+  } else {
+    servers.emplace_back(config);
+  }
 
-  for (const auto & item : ready) {
-    const auto & dir = std::get<0>(item);
+  for (const auto & server : servers) {
+    string host = server["host"].as<string>();
+    uint16_t port = server["port"].as<uint16_t>();
+    string dst_media_dir = server["media_dir"].as<string>();
 
-    /* remove the prefix of media_dir from dir and append to dst_media_dir */
-    string remaining = dir.substr(media_dir.string().size());
-    string dst_dir = dst_media_dir / remaining;
+    args.emplace_back("--destination");
+    args.emplace_back(host + ":" + to_string(port) + ":" + dst_media_dir);
+  }
 
-    /* file sender is interested in any move-in files
-     * e.g., init.mp4 and .m4s in a vready dir */
-    vector<string> notifier_args { notifier, dir, ".", "--exec",
-      file_sender, host, to_string(port), dst_dir };
-    proc_manager.run_as_child(notifier, notifier_args);
+  /* file sender is interested in any move-in files
+   * e.g., init.mp4 and .m4s in a vready dir */
+  args.emplace_back(media_dir);
+  for (const auto & item : ready) {
+    args.emplace_back(std::get<0>(item));
   }
+
+  proc_manager.run_as_child(file_sender, args);
 }
 
-void run_depcleaner(ProcessManager & proc_manager,
-                    const vector<tuple<string, string>> & work,
-                    const vector<tuple<string, string>> & ready)
+void add_dependency_retention(vector<string> & retention_args,
+                              const vector<tuple<string, string>> & work,
+                              const vector<tuple<string, string>> & ready,
+                              const unsigned int clean_window_ts)
 {
-  string depcleaner = src_path / "cleaner/depcleaner";
-  vector<string> args = {depcleaner};
-
-  args.emplace_back("--clean");
+  /* clean up the files in work once they have appeared in every dir of ready */
+  retention_args.emplace_back("--clean");
   for (const auto & item : work) {
     const auto & [dir, ext] = item;
-    args.emplace_back(dir);
-    args.emplace_back(ext);
+    retention_args.emplace_back(dir);
+    retention_args.emplace_back(ext);
   }
 
-  args.emplace_back("--depend");
+  retention_args.emplace_back("--depend");
   for (const auto & item : ready) {
     const auto & [dir, ext] = item;
-    args.emplace_back(dir);
-    args.emplace_back(ext);
+    retention_args.emplace_back(dir);
+    retention_args.emplace_back(ext);
   }
 
-  /* run notifier to start depcleaner for each directory in ready/ */
+  /* give up on the files whose dependents are older than ready/ keeps */
+  retention_args.emplace_back("--expire");
+  retention_args.emplace_back(to_string(clean_window_ts));
+}
+
+void add_window_retention(vector<string> & retention_args,
+                          const vector<tuple<string, string>> & ready,
+                          const unsigned int clean_window_ts)
+{
+  /* keep only the last clean_window_ts of each directory in ready/ */
   for (const auto & item : ready) {
     const auto & [dir, ext] = item;
-    vector<string> notifier_args { notifier, dir, ext, "--exec" };
-    notifier_args.insert(notifier_args.end(), args.begin(), args.end());
-    proc_manager.run_as_child(notifier, notifier_args);
+    retention_args.emplace_back("--window");
+    retention_args.emplace_back(dir);
+    retention_args.emplace_back(ext);
+    retention_args.emplace_back(to_string(clean_window_ts));
   }
 }
 
-void run_windowcleaner(ProcessManager & proc_manager,
-                       const vector<tuple<string, string>> & ready,
-                       const unsigned int clean_window_ts)
+void run_retention_manager(ProcessManager & proc_manager,
+                           const vector<string> & retention_args)
 {
-  string windowcleaner = src_path / "cleaner/windowcleaner";
+  string retention_manager = src_path / "cleaner/retention_manager";
+  vector<string> args { retention_manager };
+  args.insert(args.end(), retention_args.begin(), retention_args.end());
 
-  /* run notifier to start windowcleaner for each directory in ready/ */
-  for (const auto & item : ready) {
-    const auto & [dir, ext] = item;
-    vector<string> notifier_args { notifier, dir, ext, "--exec", windowcleaner,
-                                   ext, to_string(clean_window_ts) };
-    proc_manager.run_as_child(notifier, notifier_args);
-  }
+  proc_manager.run_as_child(retention_manager, args);
 }
 
 void run_decoder(ProcessManager & proc_manager,
@@ -282,7 +298,9 @@ void run_decoder(ProcessManager & proc_manager,
 
 void run_pipeline(ProcessManager & proc_manager,
                   const string & channel_name,
-                  const YAML::Node & config)
+                  const YAML::Node & config,
+                  vector<tuple<string, string>> & all_ready,
+                  vector<string> & retention_args)
 {
   const auto & channel_config = config["channel_configs"][channel_name];
   vector<VideoFormat> vformats = channel_video_formats(channel_config);
@@ -307,36 +325,35 @@ void run_pipeline(ProcessManager & proc_manager,
   run_video_canonicalizer(proc_manager, output_path, vwork);
 
   for (const auto & vf : vformats) {
-    /* run video encoder and video fragmenter */
-    run_video_encoder(proc_manager, output_path, vwork, vf);
-    run_video_fragmenter(proc_manager, output_path, vready, vf);
+    /* run video encoder (which also fragments the encoded video) */
+    run_video_encoder(proc_manager, output_path, vwork, vready, vf);
 
     /* run ssim_calculator */
     run_ssim_calculator(proc_manager, output_path, vready, vf);
   }
 
+  /* run audio encoder once for all bitrates */
+  run_audio_encoder(proc_manager, output_path, awork, aformats);
+
   for (const auto & af : aformats) {
-    /* run audio encoder and audio fragmenter */
-    run_audio_encoder(proc_manager, output_path, awork, af);
+    /* run audio fragmenter */
     run_audio_fragmenter(proc_manager, output_path, aready, af);
   }
 
-  if (config["remote_media_server"]) {
-    /* run file_sender to transfer files in ready/ */
-    run_file_sender(proc_manager, vready, config["remote_media_server"]);
-    run_file_sender(proc_manager, aready, config["remote_media_server"]);
-  }
+  /* files in ready/ are transferred by a file_sender shared by channels */
+  all_ready.insert(all_ready.end(), vready.begin(), vready.end());
+  all_ready.insert(all_ready.end(), aready.begin(), aready.end());
 
   /* vwork, awork, vready, aready should already be filled in */
 
-  /* run depcleaner to clean up files in working/ */
-  run_depcleaner(proc_manager, vwork, vready);
-  run_depcleaner(proc_manager, awork, aready);
-
-  /* run windowcleaner to clean up files in ready/ */
+  /* files in working/ and ready/ are cleaned up by a retention_manager
+   * shared by channels */
   unsigned int clean_window_ts = clean_window_s * global_timescale;
-  run_windowcleaner(proc_manager, vready, clean_window_ts);
-  run_windowcleaner(proc_manager, aready, clean_window_ts);
+  add_dependency_retention(retention_args, vwork, vready, clean_window_ts);
+  add_dependency_retention(retention_args, awork, aready, clean_window_ts);
+
+  add_window_retention(retention_args, vready, clean_window_ts);
+  add_window_retention(retention_args, aready, clean_window_ts);
 
   /* run decoder */
   run_decoder(proc_manager, output_path, channel_config);
@@ -365,10 +382,26 @@ int main(int argc, char * argv[])
 
   ProcessManager proc_manager;
 
+  /* ready/ directories of all the channels */
+  vector<tuple<string, string>> ready;
+
+  /* what to clean up in working/ and ready/ of all the channels */
+  vector<string> retention_args;
+
   set<string> channel_set = load_channels(config);
   for (const auto & channel_name : channel_set) {
     /* run the encoding pipeline for channel_name */
-    run_pipeline(proc_manager, channel_name, config);
+    run_pipeline(proc_manager, channel_name, config, ready, retention_args);
+  }
+
+  /* run a single retention_manager to clean up files in working/ and ready/,
+   * instead of a cleaner process per file */
+  run_retention_manager(proc_manager, retention_args);
+
+  if (config["remote_media_server"]) {
+    /* run a single file_sender to replicate files in ready/, so that all
+     * the channels share one connection to each remote media server */
+    run_file_sender(proc_manager, ready, config["remote_media_server"]);
   }
 
   /* if logging is enabled */
@@ -1,9 +1,13 @@
+#include <getopt.h>
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 
-#include "child_process.hh"
+#include "deinterlacer.hh"
 #include "filesystem.hh"
+#include "strict_conversions.hh"
+#include "tokenize.hh"
 #include "y4m.hh"
 
 using namespace std;
@@ -11,13 +15,122 @@ using namespace std;
 void print_usage(const string & program)
 {
   cerr <<
-  "Usage: " << program << " <input_path> <output_path>\n"
+  "Usage: " << program << " <input_path> <output_path> [--threads N]\n"
   "Canonicalize the video <input_path> and output to <output_path>\n\n"
   "<input_path>     path of the input raw video\n"
-  "<output_path>    path to output the canonical video"
+  "<output_path>    path to output the canonical video\n\n"
+  "Options:\n"
+  "--threads N      number of threads used to deinterlace (default: 1)"
   << endl;
 }
 
+/* header of the deinterlaced output: progressive at twice the frame rate */
+string progressive_header(const string & interlaced_header)
+{
+  string header;
+
+  for (const string & param : split(interlaced_header, " ")) {
+    string new_param = param;
+
+    if (param.empty()) {
+      continue;
+    }
+
+    if (param.at(0) == 'F') {
+      const size_t pos = param.find(':');
+      if (pos == string::npos) {
+        throw runtime_error("invalid frame rate in Y4M header: " + param);
+      }
+
+      new_param = "F" + to_string(2 * stoll(param.substr(1, pos - 1)))
+                  + param.substr(pos);
+    } else if (param.at(0) == 'I') {
+      new_param = "Ip";
+    } else if (param.at(0) == 'C' and param.compare(0, 4, "C420") != 0) {
+      throw runtime_error("unsupported Y4M colorspace: " + param);
+    }
+
+    header += (header.empty() ? "" : " ") + new_param;
+  }
+
+  return header + "\n";
+}
+
+/* read the next frame into `frame`; return false at the end of the input */
+bool read_frame(ifstream & input, vector<uint8_t> & frame)
+{
+  string frame_header;
+  if (not getline(input, frame_header)) {
+    return false;
+  }
+
+  if (frame_header.compare(0, 5, "FRAME") != 0) {
+    throw runtime_error("invalid Y4M frame header");
+  }
+
+  input.read(reinterpret_cast<char *>(frame.data()), frame.size());
+  if (static_cast<size_t>(input.gcount()) != frame.size()) {
+    throw runtime_error("truncated Y4M frame");
+  }
+
+  return true;
+}
+
+void write_frame(ofstream & output, const vector<uint8_t> & frame)
+{
+  output << "FRAME\n";
+  output.write(reinterpret_cast<const char *>(frame.data()), frame.size());
+}
+
+/* field-rate deinterlacing in process, modeled on ffmpeg's bwdif (the
+ * lines at the top and bottom edges are filtered slightly differently) */
+void deinterlace(const string & input_path, const string & output_path,
+                 Y4MParser & y4m_parser, const unsigned int num_threads)
+{
+  ifstream input(input_path, ios::binary);
+  string header;
+  getline(input, header);
+
+  ofstream output(output_path, ios::binary | ios::trunc);
+  output << progressive_header(header);
+
+  const Deinterlacer deinterlacer(y4m_parser.get_frame_width(),
+                                  y4m_parser.get_frame_height(),
+                                  y4m_parser.is_top_field_first(),
+                                  num_threads);
+
+  /* sliding window of previous, current and next frames */
+  vector<vector<uint8_t>> frames(3, vector<uint8_t>(deinterlacer.frame_size()));
+  vector<uint8_t> first_field(deinterlacer.frame_size());
+  vector<uint8_t> second_field(deinterlacer.frame_size());
+
+  bool has_prev = false;
+  bool has_cur = read_frame(input, frames[1]);
+
+  while (has_cur) {
+    const bool has_next = read_frame(input, frames[2]);
+
+    deinterlacer.process(has_prev ? frames[0].data() : nullptr,
+                         frames[1].data(),
+                         has_next ? frames[2].data() : nullptr,
+                         first_field.data(), second_field.data());
+
+    write_frame(output, first_field);
+    write_frame(output, second_field);
+
+    /* advance the window without copying */
+    swap(frames[0], frames[1]);
+    swap(frames[1], frames[2]);
+    has_prev = true;
+    has_cur = has_next;
+  }
+
+  output.close();
+  if (not output) {
+    throw runtime_error("failed to write " + output_path);
+  }
+}
+
 int main(int argc, char * argv[])
 {
   /* parse arguments */
@@ -25,13 +138,36 @@ int main(int argc, char * argv[])
     abort();
   }
 
-  if (argc != 3) {
+  unsigned int num_threads = 1;
+
+  const option cmd_line_opts[] = {
+    {"threads", required_argument, nullptr, 't'},
+    { nullptr,  0,                 nullptr,  0 }
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "t:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+    case 't':
+      num_threads = narrow_cast<unsigned int>(strict_atoui(optarg));
+      break;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 2) {
     print_usage(argv[0]);
     return EXIT_FAILURE;
   }
 
-  string input_path = argv[1];
-  string output_path= argv[2];
+  string input_path = argv[optind];
+  string output_path = argv[optind + 1];
 
   /* parse header of the input Y4M */
   Y4MParser y4m_parser(input_path);
@@ -42,15 +178,10 @@ int main(int argc, char * argv[])
     return EXIT_SUCCESS;
   } else {
     /* canonicalize video */
-    vector<string> args {
-      "ffmpeg", "-nostdin", "-hide_banner", "-loglevel", "panic", "-y",
-      "-i", input_path, "-vf", "bwdif", "-threads", "1", output_path };
-
-    ProcessManager proc_manager;
-    int ret_code = proc_manager.run("ffmpeg", args);
+    deinterlace(input_path, output_path, y4m_parser, num_threads);
 
     /* remove the input raw video */
     fs::remove(input_path);
-    return ret_code;
+    return EXIT_SUCCESS;
   }
 }
@@ -5,6 +5,7 @@
 
 #include "child_process.hh"
 #include "filesystem.hh"
+#include "mp4_fragmenter.hh"
 
 using namespace std;
 
@@ -18,7 +19,12 @@ void print_usage(const string & program)
   "<output_path>    path to output the encoded video\n\n"
   "Options:\n"
   "-s <resolution>    resolution (e.g., 1280x720)\n"
-  "--crf <CRF>        constant rate factor"
+  "--crf <CRF>        constant rate factor\n"
+  "--fragment <dir>   also fragment the encoded video into <dir> as\n"
+  "                   <num>.m4s (and init.mp4 if not exists), without\n"
+  "                   a separate video_fragmenter pass\n"
+  "--fragment-tmp <dir>\n"
+  "                   temporary directory used with --fragment"
   << endl;
 }
 
@@ -31,15 +37,18 @@ int main(int argc, char * argv[])
 
   string resolution;
   string crf;
+  string fragment_dir, fragment_tmp_dir;
 
   const option cmd_line_opts[] = {
-    {"res",    required_argument, nullptr, 's'},
-    {"crf",    required_argument, nullptr, 'c'},
-    { nullptr, 0,                 nullptr,  0 }
+    {"res",          required_argument, nullptr, 's'},
+    {"crf",          required_argument, nullptr, 'c'},
+    {"fragment",     required_argument, nullptr, 'f'},
+    {"fragment-tmp", required_argument, nullptr, 't'},
+    { nullptr,       0,                 nullptr,  0 }
   };
 
   while (true) {
-    const int opt = getopt_long(argc, argv, "s:c:", cmd_line_opts, nullptr);
+    const int opt = getopt_long(argc, argv, "s:c:f:t:", cmd_line_opts, nullptr);
     if (opt == -1) {
       break;
     }
@@ -51,6 +60,12 @@ int main(int argc, char * argv[])
     case 'c':
       crf = optarg;
       break;
+    case 'f':
+      fragment_dir = optarg;
+      break;
+    case 't':
+      fragment_tmp_dir = optarg;
+      break;
     default:
       print_usage(argv[0]);
       return EXIT_FAILURE;
@@ -78,5 +93,35 @@ int main(int argc, char * argv[])
     "-preset", "veryfast", "-threads", "1", output_path };
 
   ProcessManager proc_manager;
-  return proc_manager.run("ffmpeg", args);
+  int ret_code = proc_manager.run("ffmpeg", args);
+
+  if (ret_code != EXIT_SUCCESS or fragment_dir.empty()) {
+    return ret_code;
+  }
+
+  /* fragment the freshly encoded MP4 in process: build the media segment
+   * (and init segment if needed) in memory and move them into fragment_dir */
+  if (fragment_tmp_dir.empty()) {
+    fragment_tmp_dir = fs::path(output_path).parent_path();
+  }
+
+  string prefix = fs::path(output_path).stem();
+  string init_path = fs::path(fragment_dir) / "init.mp4";
+  string media_path = fs::path(fragment_dir) / (prefix + ".m4s");
+  string tmp_init_path = fs::path(fragment_tmp_dir) / (prefix + "-init.mp4");
+  string tmp_media_path = fs::path(fragment_tmp_dir) / (prefix + ".m4s");
+
+  bool output_tmp_init = not fs::exists(init_path);
+
+  MP4::fragment_mp4(output_path, tmp_media_path,
+                    output_tmp_init ? tmp_init_path : "");
+
+  /* init segment must be in place before the first media segment */
+  if (output_tmp_init) {
+    fs::rename(tmp_init_path, init_path);
+  }
+
+  fs::rename(tmp_media_path, media_path);
+
+  return EXIT_SUCCESS;
 }
@@ -3,9 +3,8 @@
 #include <string>
 #include <vector>
 
-#include "child_process.hh"
 #include "filesystem.hh"
-#include "path.hh"  /* readlink */
+#include "mp4_fragmenter.hh"
 
 using namespace std;
 
@@ -62,28 +61,17 @@ int main(int argc, char * argv[])
   string tmp_init_name = fs::path(output_path).stem().string() + "-init.mp4";
   string tmp_init_path = fs::path(output_path).parent_path() / tmp_init_name;
 
-  /* path of the mp4_fragment program */
-  auto exe_dir = fs::path(roost::readlink("/proc/self/exe")).parent_path();
-  string mp4_fragment = fs::canonical(exe_dir / "../mp4/mp4_fragment");
-
-  /* fragment video */
-  vector<string> args = { mp4_fragment, input_path, "-m", output_path };
-
   /* output a temp init segment if the dest init segment does not exist */
-  bool output_tmp_init = false;
-  if (not fs::exists(init_path)) {
-    args.emplace_back("-i");
-    args.emplace_back(tmp_init_path);
-    output_tmp_init = true;
-  }
+  bool output_tmp_init = not fs::exists(init_path);
 
-  ProcessManager proc_manager;
-  int ret_code = proc_manager.run(mp4_fragment, args);
+  /* fragment video in process */
+  MP4::fragment_mp4(input_path, output_path,
+                    output_tmp_init ? tmp_init_path : "");
 
   /* move the init segment from temporary path to target path */
   if (output_tmp_init) {
     fs::rename(tmp_init_path, init_path);
   }
 
-  return ret_code;
+  return EXIT_SUCCESS;
 }